@@ -25,6 +25,7 @@
 // gbms
 #include "../src/gbm/gbm.cc"
 #include "../src/gbm/gbtree.cc"
+#include "../src/gbm/gbtree_model.cc"
 #include "../src/gbm/gblinear.cc"
 
 // data
@@ -36,6 +37,12 @@
 // prediction
 #include "../src/predictor/predictor.cc"
 #include "../src/predictor/cpu_predictor.cc"
+#include "../src/predictor/compiled_forest.cc"
+#include "../src/predictor/traversal_kernel.cc"
+#include "../src/predictor/quickscorer_predictor.cc"
+#include "../src/predictor/binned_forest.cc"
+#include "../src/predictor/compressed_forest.cc"
+#include "../src/predictor/shap_summary.cc"
 
 #if DMLC_ENABLE_STD_THREAD
 #include "../src/data/sparse_page_source.cc"
@@ -35,6 +35,10 @@ typedef void *BoosterHandle;  // NOLINT(*)
 typedef void *DataIterHandle;  // NOLINT(*)
 /*! \brief handle to a internal data holder. */
 typedef void *DataHolderHandle;  // NOLINT(*)
+/*! \brief handle to a forest predicting on quantile bins */
+typedef void *BinnedForestHandle;  // NOLINT(*)
+/*! \brief handle to a forest compressed for inference */
+typedef void *CompressedForestHandle;  // NOLINT(*)
 
 /*! \brief Mini batch used in XGBoost Data Iteration */
 typedef struct {  // NOLINT(*)
@@ -82,6 +86,17 @@ XGB_EXTERN_C typedef int XGBCallbackDataIterNext(  // NOLINT(*)
     DataIterHandle data_handle, XGBCallbackSetData *set_function,
     DataHolderHandle set_function_handle);
 
+/*!
+ * \brief Callback receiving the dump of one booster of a model.
+ * \param handle The handle given along with the callback.
+ * \param index Index of the booster, boosters are passed in order.
+ * \param dump The dump of the booster, only valid during the call.
+ * \param len Length of the dump.
+ * \return 0 to continue, any other value stops the dump with an error.
+ */
+XGB_EXTERN_C typedef int XGBCallbackDumpModel(  // NOLINT(*)
+    void *handle, bst_ulong index, const char *dump, bst_ulong len);
+
 /*!
  * \brief get string message of the last error
  *
@@ -414,6 +429,167 @@ XGB_DLL int XGBoosterPredict(BoosterHandle handle,
                              unsigned ntree_limit,
                              bst_ulong *out_len,
                              const float **out_result);
+/*!
+ * \brief predict margins together with the leaf index reached in each tree, and
+ *  optionally approximate feature contributions, from one traversal of each tree
+ * \param handle handle
+ * \param dmat data matrix
+ * \param option_mask bit-mask of options taken in prediction, possible values
+ *          0:normal prediction
+ *          1:output margin instead of transformed value
+ *          8:also output approximate feature contributions
+ * \param leaf_format encoding of the leaf indices, nrow * ntree values
+ *          0:no leaf output
+ *          1:int32 leaf index as returned by XGBoosterPredict
+ *          2:uint16 leaf index, for trees of fewer than 65536 nodes
+ *          3:unsigned one-hot column of the leaf, leaves of each tree numbered after
+ *            those of the trees before it; row i of the CSR one-hot matrix holds
+ *            ntree ones in entries [i * ntree, (i + 1) * ntree)
+ * \param ntree_limit limit number of trees used for prediction, 0 for all trees
+ * \param out_len used to store length of the predictions
+ * \param out_result used to set a pointer to the predictions
+ * \param out_leaf_len used to store the number of leaf values
+ * \param out_leaf used to set a pointer to the leaf values, typed as leaf_format
+ * \param out_num_leaf_col used to store the number of one-hot columns
+ * \param out_contribs used to set a pointer to the contributions laid out as by
+ *    XGBoosterPredict, NULL when they are not requested
+ * \return 0 when success, -1 when failure happens
+ */
+XGB_DLL int XGBoosterPredictCombined(BoosterHandle handle,
+                                     DMatrixHandle dmat,
+                                     int option_mask,
+                                     int leaf_format,
+                                     unsigned ntree_limit,
+                                     bst_ulong *out_len,
+                                     const float **out_result,
+                                     bst_ulong *out_leaf_len,
+                                     const void **out_leaf,
+                                     bst_ulong *out_num_leaf_col,
+                                     const float **out_contribs);
+/*!
+ * \brief predict feature contributions based on dmat in compressed sparse row
+ *  format, with a row for each data row and output group in the order of
+ *  XGBoosterPredict.  Only non-zero contributions are stored and the bias is
+ *  returned separately, so memory scales with the features on the tree paths.
+ * \param handle handle
+ * \param dmat data matrix
+ * \param option_mask bit-mask of options taken in prediction, possible values
+ *          0:exact SHAP values
+ *          8:use the approximate algorithm
+ * \param ntree_limit limit number of trees used for prediction, 0 for all trees
+ * \param out_nrow used to store the number of rows, nrow * num_output_group
+ * \param out_indptr used to set a pointer to the out_nrow + 1 row offsets
+ * \param out_indices used to set a pointer to the feature of each value
+ * \param out_values used to set a pointer to the non-zero contributions
+ * \param out_bias used to set a pointer to the out_nrow bias values
+ * \return 0 when success, -1 when failure happens
+ */
+XGB_DLL int XGBoosterPredictContribSparse(BoosterHandle handle,
+                                          DMatrixHandle dmat,
+                                          int option_mask,
+                                          unsigned ntree_limit,
+                                          bst_ulong *out_nrow,
+                                          const size_t **out_indptr,
+                                          const unsigned **out_indices,
+                                          const float **out_values,
+                                          const float **out_bias);
+/*!
+ * \brief make prediction for a single row without creating a DMatrix
+ *
+ *  Buffers are kept per thread, so repeated calls don't allocate once they
+ *  have seen a row of the same size.
+ * \param handle handle
+ * \param values feature values of the row
+ * \param indices feature index of each value, NULL if values is a dense row
+ * \param nnz number of values
+ * \param missing value treated as missing, NAN is always treated as missing
+ * \param option_mask bit-mask of options taken in prediction, possible values
+ *          0:normal prediction
+ *          1:output margin instead of transformed value
+ * \param ntree_limit limit number of trees used for prediction, this is only valid for
+ *    boosted trees, when the parameter is set to 0, we will use all the trees
+ * \param out_len used to store length of returning result
+ * \param out_result caller allocated buffer holding at least num_output_group values
+ * \return 0 when success, -1 when failure happens
+ */
+XGB_DLL int XGBoosterPredictRow(BoosterHandle handle,
+                                const float *values,
+                                const unsigned *indices,
+                                bst_ulong nnz,
+                                float missing,
+                                int option_mask,
+                                unsigned ntree_limit,
+                                bst_ulong *out_len,
+                                float *out_result);
+/*!
+ * \brief make staged prediction based on dmat: the result of every boosting
+ *  round, computed in one pass over the data
+ * \param handle handle
+ * \param dmat data matrix
+ * \param option_mask bit-mask of options taken in prediction, possible values
+ *          0:normal prediction
+ *          1:output margin instead of transformed value
+ * \param ntree_limit number of stages, stage i uses the trees of the first i + 1
+ *    boosting rounds; 0 for one stage per boosting round of the model
+ * \param out_nstage used to store the number of stages
+ * \param out_len used to store length of returning result
+ * \param out_result used to set a pointer to array, stages one after another, each
+ *    laid out like the result of XGBoosterPredict
+ * \return 0 when success, -1 when failure happens
+ */
+XGB_DLL int XGBoosterPredictStaged(BoosterHandle handle,
+                                   DMatrixHandle dmat,
+                                   int option_mask,
+                                   unsigned ntree_limit,
+                                   bst_ulong *out_nstage,
+                                   bst_ulong *out_len,
+                                   const float **out_result);
+/*!
+ * \brief predict margins of a binary classifier with early exit: each row stops
+ *  evaluating trees once the remaining ones can't move its margin across
+ *  margin_threshold, so only the side of the threshold is exact for such rows.
+ * \param handle handle
+ * \param dmat data matrix
+ * \param margin_threshold decision threshold on the margin, e.g. the logit of a
+ *    probability threshold for binary:logistic
+ * \param ntree_limit limit number of trees used for prediction, 0 for all trees
+ * \param out_len used to store number of rows
+ * \param out_result used to set a pointer to the (partial) margins
+ * \param out_ntrees used to set a pointer to the number of trees used for each row
+ * \return 0 when success, -1 when failure happens
+ */
+XGB_DLL int XGBoosterPredictCascade(BoosterHandle handle,
+                                    DMatrixHandle dmat,
+                                    float margin_threshold,
+                                    unsigned ntree_limit,
+                                    bst_ulong *out_len,
+                                    const float **out_result,
+                                    const unsigned **out_ntrees);
+/*!
+ * \brief predict the top_k SHAP interaction values of largest magnitude for each
+ *  row and output group, without materializing the full interaction matrices
+ * \param handle handle
+ * \param dmat data matrix
+ * \param top_k number of interactions kept, clamped to the number of feature pairs
+ * \param option_mask bit-mask of options taken in prediction, possible values
+ *          0:exact SHAP values
+ *          8:use the approximate algorithm
+ * \param ntree_limit limit number of trees used for prediction, 0 for all trees
+ * \param out_len used to store length of returning result, nrow * num_output_group * k
+ * \param out_values used to set a pointer to the interaction values, largest
+ *    magnitude first
+ * \param out_index used to set a pointer to the position i * (nfeats + 1) + j,
+ *    i < j, of each value in the interaction matrix returned by XGBoosterPredict
+ * \return 0 when success, -1 when failure happens
+ */
+XGB_DLL int XGBoosterPredictInteractionTopK(BoosterHandle handle,
+                                            DMatrixHandle dmat,
+                                            unsigned top_k,
+                                            int option_mask,
+                                            unsigned ntree_limit,
+                                            bst_ulong *out_len,
+                                            const float **out_values,
+                                            const unsigned **out_index);
 
 /*!
  * \brief load model from existing file
@@ -431,6 +607,26 @@ XGB_DLL int XGBoosterLoadModel(BoosterHandle handle,
  */
 XGB_DLL int XGBoosterSaveModel(BoosterHandle handle,
                                const char *fname);
+/*!
+ * \brief load model from a file written by XGBoosterSaveModelMmap.  The file
+ *  is mapped read-only and the trees are used in place, so processes loading
+ *  the same file share one copy through the page cache.  The booster can
+ *  predict margins and leaf indices with cpu_predictor afterwards, but can't
+ *  be trained, dumped or saved with XGBoosterSaveModel.
+ * \param handle handle
+ * \param fname file name
+ * \return 0 when success, -1 when failure happens
+ */
+XGB_DLL int XGBoosterLoadModelMmap(BoosterHandle handle,
+                                   const char *fname);
+/*!
+ * \brief save model into a file that XGBoosterLoadModelMmap can map
+ * \param handle handle
+ * \param fname file name
+ * \return 0 when success, -1 when failure happens
+ */
+XGB_DLL int XGBoosterSaveModelMmap(BoosterHandle handle,
+                                   const char *fname);
 /*!
  * \brief load model from in memory buffer
  * \param handle handle
@@ -524,6 +720,154 @@ XGB_DLL int XGBoosterDumpModelExWithFeatures(BoosterHandle handle,
                                              bst_ulong *out_len,
                                              const char ***out_models);
 
+/*!
+ * \brief dump model to a file without holding the whole dump in memory,
+ *  in the layout of the command line dump: a `booster[i]:` line ahead of
+ *  each text dump, or a json array of the json dumps
+ * \param handle handle
+ * \param fmap  name to fmap can be empty string
+ * \param with_stats whether to dump with statistics
+ * \param format the format to dump the model in
+ * \param fname name of the output file
+ * \return 0 when success, -1 when failure happens
+ */
+XGB_DLL int XGBoosterDumpModelToFile(BoosterHandle handle,
+                                     const char *fmap,
+                                     int with_stats,
+                                     const char *format,
+                                     const char *fname);
+
+/*!
+ * \brief dump model one booster at a time, boosters are dumped in parallel
+ *  and handed to the callback in order, so only a few are held in memory
+ * \param handle handle
+ * \param fmap  name to fmap can be empty string
+ * \param with_stats whether to dump with statistics
+ * \param format the format to dump the model in
+ * \param callback called with the dump of each booster
+ * \param callback_handle handle passed to the callback
+ * \return 0 when success, -1 when failure happens
+ */
+XGB_DLL int XGBoosterDumpModelCallback(BoosterHandle handle,
+                                       const char *fmap,
+                                       int with_stats,
+                                       const char *format,
+                                       XGBCallbackDumpModel *callback,
+                                       void *callback_handle);
+
+/*!
+ * \brief generate C source code of the model for ahead of time compilation.
+ *  The source exports `void predict(const float* row, float* out)` computing
+ *  the margins of a dense row, with NaN marking missing features.
+ * \param handle handle
+ * \param ntree_limit limit number of trees used, 0 means use all trees
+ * \param out_len length of the source
+ * \param out_source pointer to hold the source
+ * \return 0 when success, -1 when failure happens
+ */
+XGB_DLL int XGBoosterGenerateSource(BoosterHandle handle,
+                                    unsigned ntree_limit,
+                                    bst_ulong *out_len,
+                                    const char **out_source);
+/*!
+ * \brief save the trees with their split conditions remapped to quantile bins,
+ *  for XGBinnedForestLoad.  The cuts are built from dtrain with max_bin bins
+ *  per feature, as tree_method=hist does, and every split condition must be
+ *  one of them, which holds for models trained that way on dtrain.
+ * \param handle handle
+ * \param dtrain the matrix the model was trained on
+ * \param max_bin max_bin the model was trained with
+ * \param fname file name
+ * \return 0 when success, -1 when failure happens
+ */
+XGB_DLL int XGBoosterSaveBinnedForest(BoosterHandle handle,
+                                      DMatrixHandle dtrain,
+                                      int max_bin,
+                                      const char *fname);
+/*!
+ * \brief load a forest written by XGBoosterSaveBinnedForest, it predicts
+ *  margins without the booster
+ * \param fname file name
+ * \param out handle to the loaded forest
+ * \return 0 when success, -1 when failure happens
+ */
+XGB_DLL int XGBinnedForestLoad(const char *fname,
+                               BinnedForestHandle *out);
+/*!
+ * \brief predict margins of a matrix with a binned forest, the rows are
+ *  binned with the saved cuts on the fly
+ * \param handle handle
+ * \param dmat data matrix
+ * \param ntree_limit limit number of trees used, 0 means use all trees
+ * \param out_len used to store length of returning result
+ * \param out_result used to set a pointer to array of num_row * num_group margins
+ * \return 0 when success, -1 when failure happens
+ */
+XGB_DLL int XGBinnedForestPredict(BinnedForestHandle handle,
+                                  DMatrixHandle dmat,
+                                  unsigned ntree_limit,
+                                  bst_ulong *out_len,
+                                  const float **out_result);
+/*!
+ * \brief free a binned forest
+ * \param handle handle to be freed
+ * \return 0 when success, -1 when failure happens
+ */
+XGB_DLL int XGBinnedForestFree(BinnedForestHandle handle);
+/*!
+ * \brief save the trees compressed for inference, for XGCompressedForestLoad.
+ *  Thresholds are shared per feature and kept exact, leaf values are stored
+ *  per tree in the narrowest format within max_leaf_error.  The margins of the
+ *  compressed forest are compared with those of the booster on dvalid.
+ * \param handle handle
+ * \param leaf_format narrowest format tried for the leaves of each tree:
+ *    0 for 8 bit codes, 1 for half precision floats, 2 for floats
+ * \param max_leaf_error largest error allowed for a single leaf value
+ * \param dvalid validation rows
+ * \param fname file name
+ * \param out_bytes bytes used by the compressed forest
+ * \param out_max_error largest absolute error of a margin on dvalid
+ * \param out_mean_error mean absolute error of the margins on dvalid
+ * \return 0 when success, -1 when failure happens
+ */
+XGB_DLL int XGBoosterSaveCompressedForest(BoosterHandle handle,
+                                          int leaf_format,
+                                          float max_leaf_error,
+                                          DMatrixHandle dvalid,
+                                          const char *fname,
+                                          bst_ulong *out_bytes,
+                                          double *out_max_error,
+                                          double *out_mean_error);
+/*!
+ * \brief load a forest written by XGBoosterSaveCompressedForest, it predicts
+ *  margins without the booster
+ * \param fname file name
+ * \param out handle to the loaded forest
+ * \return 0 when success, -1 when failure happens
+ */
+XGB_DLL int XGCompressedForestLoad(const char *fname,
+                                   CompressedForestHandle *out);
+/*!
+ * \brief predict margins of a matrix with a compressed forest
+ * \param handle handle
+ * \param dmat data matrix
+ * \param ntree_limit limit number of trees used, 0 means use all trees
+ * \param out_len used to store length of returning result
+ * \param out_result used to set a pointer to array of num_row * num_group margins
+ * \return 0 when success, -1 when failure happens
+ */
+XGB_DLL int XGCompressedForestPredict(CompressedForestHandle handle,
+                                      DMatrixHandle dmat,
+                                      unsigned ntree_limit,
+                                      bst_ulong *out_len,
+                                      const float **out_result);
+/*!
+ * \brief free a compressed forest
+ * \param handle handle to be freed
+ * \return 0 when success, -1 when failure happens
+ */
+XGB_DLL int XGCompressedForestFree(CompressedForestHandle handle);
+
 /*!
  * \brief Get string attribute from Booster.
  * \param handle handle
@@ -24,6 +24,10 @@
 #include "../../src/common/host_device_vector.h"
 
 namespace xgboost {
+struct CombinedPrediction;
+namespace predictor {
+struct CompressionReport;
+}  // namespace predictor
 /*!
  * \brief interface of gradient boosting model.
  */
@@ -59,6 +63,22 @@ class GradientBooster {
    * \param fo output stream
    */
   virtual void Save(dmlc::Stream* fo) const = 0;
+  /*!
+   * \brief append the model to a read-only image that LoadImage can use in place.
+   * \param image output image, its current end must be aligned to 64 bytes.
+   */
+  virtual void SaveImage(std::string* image) const {
+    LOG(FATAL) << "Saving a model image is not supported by this booster.";
+  }
+  /*!
+   * \brief use a model image written by SaveImage without copying it.  The
+   *  booster can only predict afterwards.
+   * \param data start of the image, aligned to 64 bytes, must outlive the booster.
+   * \param size size of the image in bytes.
+   */
+  virtual void LoadImage(const char* data, size_t size) {
+    LOG(FATAL) << "Loading a model image is not supported by this booster.";
+  }
   /*!
    * \brief whether the model allow lazy checkpoint
    * return true if model is only updated in DoBoost
@@ -115,6 +135,48 @@ class GradientBooster {
   virtual void PredictLeaf(DMatrix* dmat,
                            std::vector<bst_float>* out_preds,
                            unsigned ntree_limit = 0) = 0;
+  /*!
+   * \brief predict margins, leaf indices and approximate contributions with a single
+   *  traversal of each tree, only valid for gbtree.
+   * \param dmat feature matrix
+   * \param out the requested outputs, outputs left null are not computed
+   * \param ntree_limit limit the number of trees used in prediction, when it equals 0, this means
+   *    we do not limit number of trees
+   */
+  virtual void PredictCombined(DMatrix* dmat, CombinedPrediction* out,
+                               unsigned ntree_limit = 0) {
+    LOG(FATAL) << "Combined prediction is not supported by this booster.";
+  }
+  /*!
+   * \brief predict margins after each boosting round in one pass over the data,
+   *  stage s matches PredictBatch with ntree_limit s + 1.
+   * \param dmat feature matrix
+   * \param out_preds output margins of all stages, one stage after another
+   * \param ntree_limit number of stages, 0 for one per boosting round
+   * \return number of stages
+   */
+  virtual unsigned PredictStaged(DMatrix* dmat,
+                                 HostDeviceVector<bst_float>* out_preds,
+                                 unsigned ntree_limit = 0) {
+    LOG(FATAL) << "Staged prediction is not supported by this booster.";
+    return 0;
+  }
+  /*!
+   * \brief predict margins, stopping for each row once the remaining trees can't
+   *  move it across a decision threshold. Only valid for single output gbtree.
+   * \param dmat feature matrix
+   * \param margin_threshold decision threshold on the margin
+   * \param out_preds output margins, partial for rows that stopped early
+   * \param out_ntrees number of trees evaluated for each row
+   * \param ntree_limit limit the number of trees used in prediction, when it equals 0, this means
+   *    we do not limit number of trees
+   */
+  virtual void PredictCascade(DMatrix* dmat, bst_float margin_threshold,
+                              HostDeviceVector<bst_float>* out_preds,
+                              std::vector<unsigned>* out_ntrees,
+                              unsigned ntree_limit = 0) {
+    LOG(FATAL) << "Cascaded prediction is not supported by this booster.";
+  }
 
   /*!
    * \brief feature contributions to individual predictions; the output will be a vector
@@ -132,9 +194,48 @@ class GradientBooster {
                            unsigned ntree_limit = 0, bool approximate = false,
                            int condition = 0, unsigned condition_feature = 0) = 0;
 
+  /*!
+   * \brief feature contributions in compressed sparse row format, a row for each
+   *  sample and output group; only non-zero contributions are stored.
+   * \param dmat feature matrix
+   * \param out_indptr row offsets, nsample * num_output_group + 1
+   * \param out_index feature of each value, increasing within a row
+   * \param out_values non-zero contributions
+   * \param out_bias bias of each row, nsample * num_output_group
+   * \param ntree_limit limit the number of trees used in prediction, when it equals 0, this means
+   *    we do not limit number of trees
+   * \param approximate use a faster (inconsistent) approximation of SHAP values
+   */
+  virtual void PredictContributionSparse(DMatrix* dmat,
+                                         std::vector<size_t>* out_indptr,
+                                         std::vector<unsigned>* out_index,
+                                         std::vector<bst_float>* out_values,
+                                         std::vector<bst_float>* out_bias,
+                                         unsigned ntree_limit, bool approximate) {
+    LOG(FATAL) << "Sparse contributions are not supported by this booster.";
+  }
+
   virtual void PredictInteractionContributions(DMatrix* dmat,
                            std::vector<bst_float>* out_contribs,
                            unsigned ntree_limit, bool approximate) = 0;
+  /*!
+   * \brief the top_k SHAP interaction values of largest magnitude of each row and
+   *  output group, over pairs of distinct features.
+   * \param dmat feature matrix
+   * \param top_k number of interactions kept, at most the number of feature pairs
+   * \param out_values output interaction values, nsample * num_output_group * k
+   * \param out_index position i * (nfeats + 1) + j, i < j, of each value in the
+   *    interaction matrix of PredictInteractionContributions
+   * \param ntree_limit limit the number of trees used in prediction, when it equals 0, this means
+   *    we do not limit number of trees
+   * \param approximate use a faster (inconsistent) approximation of SHAP values
+   */
+  virtual void PredictInteractionTopK(DMatrix* dmat, unsigned top_k,
+                                      std::vector<bst_float>* out_values,
+                                      std::vector<unsigned>* out_index,
+                                      unsigned ntree_limit, bool approximate) {
+    LOG(FATAL) << "Top-k interactions are not supported by this booster.";
+  }
 
   /*!
    * \brief dump the model in the requested format
@@ -146,6 +247,54 @@ class GradientBooster {
   virtual std::vector<std::string> DumpModel(const FeatureMap& fmap,
                                              bool with_stats,
                                              std::string format) const = 0;
+  /*!
+   * \brief dump the model in the requested format one booster at a time
+   * \param fmap feature map that may help give interpretations of feature
+   * \param with_stats extra statistics while dumping model
+   * \param format the format to dump the model in
+   * \param fn called with the index and the dump of each booster, in order
+   */
+  virtual void DumpModel(const FeatureMap& fmap,
+                         bool with_stats,
+                         std::string format,
+                         const std::function<void(size_t, const std::string&)>& fn) const {
+    std::vector<std::string> dump = this->DumpModel(fmap, with_stats, format);
+    for (size_t i = 0; i < dump.size(); ++i) {
+      fn(i, dump[i]);
+    }
+  }
+  /*!
+   * \brief generate C source of a function predicting the margin of one row.
+   * \param ntree_limit limit number of trees used, 0 means use all trees.
+   * \return source of a translation unit exporting `predict`.
+   */
+  virtual std::string GenerateSource(unsigned ntree_limit) const {
+    LOG(FATAL) << "Source generation is not supported by this booster.";
+    return "";
+  }
+  /*!
+   * \brief write the trees with their split conditions remapped to the quantile
+   *  bins of a matrix, to be read back for prediction without the model.
+   * \param dmat matrix the cuts are built from, the training data of a hist model.
+   * \param max_bin maximum number of bins per feature the model was trained with.
+   * \param fo output stream.
+   */
+  virtual void SaveBinnedForest(DMatrix* dmat, int max_bin, dmlc::Stream* fo) const {
+    LOG(FATAL) << "Binned forests are not supported by this booster.";
+  }
+  /*!
+   * \brief write the trees compressed for inference, with quantized leaf values.
+   * \param leaf_format narrowest predictor::LeafFormat tried for the leaves of each tree.
+   * \param max_leaf_error largest error allowed for a single leaf value.
+   * \param dvalid validation rows the compressed margins are compared on.
+   * \param fo output stream.
+   * \param out_report size and error of the compressed forest.
+   */
+  virtual void SaveCompressedForest(int leaf_format, bst_float max_leaf_error,
+                                    DMatrix* dvalid, dmlc::Stream* fo,
+                                    predictor::CompressionReport* out_report) const {
+    LOG(FATAL) << "Compressed forests are not supported by this booster.";
+  }
   /*!
    * \brief Whether the current booster use GPU.
    */
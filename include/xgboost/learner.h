@@ -17,6 +17,7 @@
 #include <xgboost/feature_map.h>
 #include <xgboost/generic_parameters.h>
 
+#include <functional>
 #include <utility>
 #include <map>
 #include <memory>
@@ -74,6 +75,19 @@ class Learner : public rabit::Serializable {
    * \param fo output stream
    */
   void Save(dmlc::Stream* fo) const override = 0;
+  /*!
+   * \brief save model in the versioned format LoadMmap maps into memory.
+   * \param fo output stream
+   */
+  virtual void SaveMmap(dmlc::Stream* fo) const = 0;
+  /*!
+   * \brief load a model saved by SaveMmap by mapping the file read-only.  The
+   *  trees are used in place from the mapping, so processes loading the same
+   *  file share its pages.  Such a model can predict margins and leaf indices
+   *  with cpu_predictor, but not be trained, saved in binary format or dumped.
+   * \param fname file name
+   */
+  virtual void LoadMmap(const std::string& fname) = 0;
   /*!
    * \brief update the model for one iteration
    *  With the specified objective function.
@@ -164,6 +178,123 @@ class Learner : public rabit::Serializable {
   std::vector<std::string> DumpModel(const FeatureMap& fmap,
                                      bool with_stats,
                                      std::string format) const;
+  /*!
+   * \brief dump the model to a stream without holding the whole dump in
+   *  memory. Text dumps are headed by `booster[i]:` per booster, json dumps
+   *  are a json array of the boosters.
+   * \param fmap feature map that may help give interpretations of feature
+   * \param with_stats extra statistics while dumping model
+   * \param format the format to dump the model in
+   * \param fo output stream
+   */
+  void DumpModel(const FeatureMap& fmap,
+                 bool with_stats,
+                 std::string format,
+                 dmlc::Stream* fo) const;
+  /*!
+   * \brief dump the model one booster at a time.
+   * \param fmap feature map that may help give interpretations of feature
+   * \param with_stats extra statistics while dumping model
+   * \param format the format to dump the model in
+   * \param fn called with the index and the dump of each booster, in order
+   */
+  void DumpModel(const FeatureMap& fmap,
+                 bool with_stats,
+                 std::string format,
+                 const std::function<void(size_t, const std::string&)>& fn) const;
+  /*!
+   * \brief generate C source predicting the margin of one row with the model,
+   *  to be compiled ahead of time into a native library.
+   * \param ntree_limit limit number of trees used, 0 means use all trees.
+   * \return source of a translation unit exporting `predict`.
+   */
+  std::string GenerateSource(unsigned ntree_limit = 0) const;
+  /*!
+   * \brief write the trees with their split conditions remapped to the quantile
+   *  bins of a matrix, see XGBoosterSaveBinnedForest.
+   * \param dmat matrix the cuts are built from, the training data of a hist model.
+   * \param max_bin maximum number of bins per feature the model was trained with.
+   * \param fo output stream.
+   */
+  void SaveBinnedForest(DMatrix* dmat, int max_bin, dmlc::Stream* fo) const;
+  /*!
+   * \brief write the trees compressed for inference, see XGBoosterSaveCompressedForest.
+   * \param leaf_format narrowest predictor::LeafFormat tried for the leaves of each tree.
+   * \param max_leaf_error largest error allowed for a single leaf value.
+   * \param dvalid validation rows the compressed margins are compared on.
+   * \param fo output stream.
+   * \param out_report size and error of the compressed forest.
+   */
+  void SaveCompressedForest(int leaf_format, bst_float max_leaf_error, DMatrix* dvalid,
+                            dmlc::Stream* fo, predictor::CompressionReport* out_report) const;
+  /*!
+   * \brief predict margins, leaf indices and approximate contributions with a single
+   *  traversal of each tree, instead of one prediction call for each of them.
+   * \param data input data
+   * \param output_margin whether to only predict margin value instead of transformed prediction
+   * \param out the requested outputs, outputs left null are not computed
+   * \param ntree_limit limit number of trees used, 0 means use all trees.
+   */
+  void PredictCombined(DMatrix* data, bool output_margin, CombinedPrediction* out,
+                       unsigned ntree_limit = 0) const;
+  /*!
+   * \brief predict after each boosting round in one pass over the data.
+   * \param data input data
+   * \param output_margin whether to only predict margin value instead of transformed prediction
+   * \param out_preds output of all stages one after another, each laid out like Predict
+   * \param ntree_limit number of stages, 0 for one per boosting round
+   * \return number of stages
+   */
+  unsigned PredictStaged(DMatrix* data, bool output_margin,
+                         HostDeviceVector<bst_float>* out_preds,
+                         unsigned ntree_limit = 0) const;
+  /*!
+   * \brief predict margins of a binary classifier, stopping for each row once
+   *  the remaining trees can't move its margin across the decision threshold.
+   * \param data input data
+   * \param margin_threshold decision threshold on the margin
+   * \param out_preds output margins, partial for rows that stopped early
+   * \param out_ntrees number of trees evaluated for each row
+   * \param ntree_limit limit number of trees used, 0 means use all trees.
+   */
+  void PredictCascade(DMatrix* data, bst_float margin_threshold,
+                      HostDeviceVector<bst_float>* out_preds,
+                      std::vector<unsigned>* out_ntrees,
+                      unsigned ntree_limit = 0) const;
+  /*!
+   * \brief feature contributions in compressed sparse row format, a row for each
+   *  sample and output group; only non-zero contributions are stored so memory
+   *  scales with the features on the tree paths instead of all features.
+   * \param data input data
+   * \param out_indptr row offsets, nsample * num_output_group + 1
+   * \param out_index feature of each value, increasing within a row
+   * \param out_values non-zero contributions
+   * \param out_bias bias of each row, nsample * num_output_group
+   * \param ntree_limit limit number of trees used, 0 means use all trees.
+   * \param approximate use a faster (inconsistent) approximation of SHAP values
+   */
+  void PredictContributionSparse(DMatrix* data, std::vector<size_t>* out_indptr,
+                                 std::vector<unsigned>* out_index,
+                                 std::vector<bst_float>* out_values,
+                                 std::vector<bst_float>* out_bias,
+                                 unsigned ntree_limit = 0,
+                                 bool approximate = false) const;
+  /*!
+   * \brief the top_k SHAP interaction values of largest magnitude of each row and
+   *  output group, without materializing the full interaction matrices.
+   * \param data input data
+   * \param top_k number of interactions kept, at most the number of feature pairs
+   * \param out_values output interaction values, nsample * num_output_group * k
+   * \param out_index position i * (nfeats + 1) + j, i < j, of each value in the
+   *    interaction matrix of a row
+   * \param ntree_limit limit number of trees used, 0 means use all trees.
+   * \param approximate use a faster (inconsistent) approximation of SHAP values
+   */
+  void PredictInteractionTopK(DMatrix* data, unsigned top_k,
+                              std::vector<bst_float>* out_values,
+                              std::vector<unsigned>* out_index,
+                              unsigned ntree_limit = 0,
+                              bool approximate = false) const;
   /*!
    * \brief online prediction function, predict score for one instance at a time
    *  NOTE: use the batch prediction interface if possible, batch prediction is usually
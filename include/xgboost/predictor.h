@@ -26,6 +26,31 @@ class TreeUpdater;
 
 namespace xgboost {
 
+/**
+ * \struct  CombinedPrediction
+ *
+ * \brief Outputs of Predictor::PredictCombined, all computed from a single
+ * traversal of each tree.  Outputs left null are not computed.
+ */
+struct CombinedPrediction {
+  /*! \brief margins, laid out as the output of PredictBatch */
+  HostDeviceVector<bst_float>* margin{nullptr};
+  /*! \brief leaf index reached in each tree, nsample * ntree as PredictLeaf */
+  std::vector<int32_t>* leaf_int32{nullptr};
+  /*! \brief leaf indices in 16 bits, every tree must have fewer than 65536 nodes */
+  std::vector<uint16_t>* leaf_uint16{nullptr};
+  /*!
+   * \brief one-hot encoding of the leaves, i.e. a CSR matrix with ntree ones
+   * per row: the column of the leaf reached in each tree, nsample * ntree.
+   * Leaves of a tree take the columns following those of the trees before it.
+   */
+  std::vector<unsigned>* leaf_onehot{nullptr};
+  /*! \brief set to the number of one-hot columns, the leaves of all trees used */
+  size_t num_leaf_columns{0};
+  /*! \brief approximate feature contributions, laid out as PredictContribution */
+  std::vector<bst_float>* approx_contribs{nullptr};
+};
+
 /**
  * \class Predictor
  *
@@ -135,6 +160,68 @@ class Predictor {
                            const gbm::GBTreeModel& model,
                            unsigned ntree_limit = 0) = 0;
 
+  /**
+   * \brief Predict any of margins, leaf indices in several encodings and
+   * approximate feature contributions with a single traversal of each tree.
+   *
+   * \param [in,out]  dmat         The input feature matrix.
+   * \param [in,out]  out          The requested outputs.
+   * \param           model        Model to make predictions from.
+   * \param           ntree_limit  (Optional) The ntree limit.
+   */
+
+  virtual void PredictCombined(DMatrix* dmat, CombinedPrediction* out,
+                               const gbm::GBTreeModel& model,
+                               unsigned ntree_limit = 0) {
+    LOG(FATAL) << "Combined prediction is not supported by this predictor.";
+  }
+
+  /**
+   * \brief Predict margins after each boosting round in one pass over the
+   * data.  Stage s holds the margins PredictBatch gives with ntree_limit
+   * s + 1, laid out like its output; stages are stored one after another.
+   *
+   * \param [in,out]  dmat        The input feature matrix.
+   * \param [in,out]  out_preds   The output margins of all stages.
+   * \param           model       Model to make predictions from.
+   * \param           ntree_limit (Optional) Number of stages, 0 for one per
+   * boosting round of the model.
+   * \return number of stages.
+   */
+
+  virtual unsigned PredictStaged(DMatrix* dmat,
+                                 HostDeviceVector<bst_float>* out_preds,
+                                 const gbm::GBTreeModel& model,
+                                 unsigned ntree_limit = 0) {
+    LOG(FATAL) << "Staged prediction is not supported by this predictor.";
+    return 0;
+  }
+
+  /**
+   * \brief Predict margins of a single output model, stopping for each row
+   * once the remaining trees can no longer move its margin across
+   * `margin_threshold`.
+   *
+   * Rows evaluating every tree get the exact margin of PredictBatch, other rows
+   * get the partial margin, which lies on the same side of the threshold as
+   * the exact one.
+   *
+   * \param [in,out]  dmat              The input feature matrix.
+   * \param           margin_threshold  Decision threshold on the margin.
+   * \param [in,out]  out_preds         The output (partial) margins.
+   * \param [in,out]  out_ntrees        Number of trees evaluated for each row.
+   * \param           model             Model to make predictions from.
+   * \param           ntree_limit       (Optional) The ntree limit.
+   */
+
+  virtual void PredictCascade(DMatrix* dmat, bst_float margin_threshold,
+                              HostDeviceVector<bst_float>* out_preds,
+                              std::vector<unsigned>* out_ntrees,
+                              const gbm::GBTreeModel& model,
+                              unsigned ntree_limit = 0) {
+    LOG(FATAL) << "Cascaded prediction is not supported by this predictor.";
+  }
+
   /**
    * \fn  virtual void Predictor::PredictContribution( DMatrix* dmat,
    * std::vector<bst_float>* out_contribs, const gbm::GBTreeModel& model,
@@ -161,12 +248,63 @@ class Predictor {
                                    int condition = 0,
                                    unsigned condition_feature = 0) = 0;
 
+  /**
+   * \brief Feature contributions in compressed sparse row format, one row for
+   * each sample and output group in the order of PredictContribution.  Only
+   * non-zero contributions are stored, the bias is returned separately.
+   *
+   * \param [in,out]  dmat         The input feature matrix.
+   * \param [in,out]  out_indptr   Row offsets, nsample * num_output_group + 1.
+   * \param [in,out]  out_index    Feature of each value, increasing in a row.
+   * \param [in,out]  out_values   The non-zero contributions.
+   * \param [in,out]  out_bias     Bias of each row, nsample * num_output_group.
+   * \param           model        Model to make predictions from.
+   * \param           ntree_limit  (Optional) The ntree limit.
+   * \param           approximate  Use fast approximate algorithm.
+   */
+
+  virtual void PredictContributionSparse(DMatrix* dmat,
+                                         std::vector<size_t>* out_indptr,
+                                         std::vector<unsigned>* out_index,
+                                         std::vector<bst_float>* out_values,
+                                         std::vector<bst_float>* out_bias,
+                                         const gbm::GBTreeModel& model,
+                                         unsigned ntree_limit = 0,
+                                         bool approximate = false) {
+    LOG(FATAL) << "Sparse contributions are not supported by this predictor.";
+  }
+
   virtual void PredictInteractionContributions(DMatrix* dmat,
                                    std::vector<bst_float>* out_contribs,
                                    const gbm::GBTreeModel& model,
                                    unsigned ntree_limit = 0,
                                    bool approximate = false) = 0;
 
+  /**
+   * \brief The k SHAP interaction values of largest magnitude of each row and
+   * output group, taken over pairs of distinct features.
+   *
+   * \param [in,out]  dmat         The input feature matrix.
+   * \param           top_k        Number of interactions kept, at most the
+   * number of feature pairs.
+   * \param [in,out]  out_values   The interaction values, nsample *
+   * num_output_group * k in that order, largest magnitude first.
+   * \param [in,out]  out_index    Position i * (nfeats + 1) + j with i < j of
+   * each value in the interaction matrix of PredictInteractionContributions.
+   * \param           model        Model to make predictions from.
+   * \param           ntree_limit  (Optional) The ntree limit.
+   * \param           approximate  Use fast approximate algorithm.
+   */
+
+  virtual void PredictInteractionTopK(DMatrix* dmat, unsigned top_k,
+                                      std::vector<bst_float>* out_values,
+                                      std::vector<unsigned>* out_index,
+                                      const gbm::GBTreeModel& model,
+                                      unsigned ntree_limit = 0,
+                                      bool approximate = false) {
+    LOG(FATAL) << "Top-k interactions are not supported by this predictor.";
+  }
+
   /**
    * \fn  static Predictor* Predictor::Create(std::string name);
    *
@@ -193,6 +331,38 @@ class Predictor {
    */
 
   std::unordered_map<DMatrix*, PredictionCacheEntry> cache_;
+
+  /**
+   * \brief Copy the cached predictions of dmat into out_preds if the cache
+   * holds predictions of all the trees used.
+   *
+   * \return whether out_preds was filled from the cache.
+   */
+  bool PredictFromCache(DMatrix* dmat, HostDeviceVector<bst_float>* out_preds,
+                        const gbm::GBTreeModel& model, unsigned ntree_limit) const;
+
+  /**
+   * \brief Resize out_preds to hold the predictions of a matrix and fill it
+   * with its base margin, or with the base score of the model when the
+   * matrix doesn't have a base margin of the right size.
+   */
+  void InitOutPredictions(const MetaInfo& info,
+                          HostDeviceVector<bst_float>* out_preds,
+                          const gbm::GBTreeModel& model) const;
+
+  /**
+   * \brief Bring the predictions of every cached matrix up to date with the
+   * newly added trees, letting the last updater update them in place when it
+   * can.
+   *
+   * \param pred_loop adds the leaf values of trees [tree_begin, tree_end) of
+   * the model to the predictions of a matrix.
+   */
+  void UpdateCachedPredictions(
+      const gbm::GBTreeModel& model,
+      std::vector<std::unique_ptr<TreeUpdater>>* updaters, int num_new_trees,
+      const std::function<void(DMatrix*, std::vector<bst_float>*, unsigned,
+                               unsigned)>& pred_loop);
 };
 
 /*!
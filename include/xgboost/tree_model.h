@@ -23,6 +23,7 @@
 namespace xgboost {
 
 struct PathElement;  // forward declaration
+struct ConditionedPath;  // forward declaration
 
 /*! \brief meta parameters of the tree */
 struct TreeParam : public dmlc::Parameter<TreeParam> {
@@ -466,6 +467,17 @@ class RegTree {
   void CalculateContributions(const RegTree::FVec& feat, unsigned root_id,
                               bst_float* out_contribs, int condition = 0,
                               unsigned condition_feature = 0) const;
+  /*!
+   * \brief add the SHAP interaction values (https://arxiv.org/abs/1802.03888) of the tree
+   *  to a row's (nfeats + 1) x (nfeats + 1) interaction matrix. The contributions
+   *  conditioned on and off every split feature are found in a single traversal.
+   * \param feat dense feature vector, if the feature is missing the field is set to NaN
+   * \param root_id starting root index of the instance
+   * \param out_interactions row major interaction matrix, the main effects are not added
+   *    to its diagonal
+   */
+  void CalculateInteractionContributions(const RegTree::FVec& feat, unsigned root_id,
+                                         bst_float* out_interactions) const;
   /*!
    * \brief Recursive function that computes the feature attributions for a single tree.
    * \param feat dense feature vector, if the feature is missing the field is set to NaN
@@ -485,15 +497,36 @@ class RegTree {
                 bst_float parent_zero_fraction, bst_float parent_one_fraction,
                 int parent_feature_index, int condition,
                 unsigned condition_feature, bst_float condition_fraction) const;
+  /*!
+   * \brief Recursive function that computes the interaction values for a single tree.
+   *  Next to the unconditioned path it keeps one path per split feature seen above the
+   *  node, conditioned on that feature. A conditioned path never holds its feature, so
+   *  the on and off conditions share it and differ only in their weights.
+   * \param feat dense feature vector, if the feature is missing the field is set to NaN
+   * \param out_interactions row major interaction matrix
+   * \param node_index the index of the current node in the tree
+   * \param parent_paths the paths of the parent node, the unconditioned one first
+   * \param num_paths number of paths of the parent node
+   * \param parent_zero_fraction what fraction of the parent path weight is coming as 0 (integrated)
+   * \param parent_one_fraction what fraction of the parent path weight is coming as 1 (fixed)
+   * \param parent_feature_index what feature the parent node used to split
+   * \param path_stride distance between the path buffers of two successive paths
+   */
+  void TreeShapInteractions(const RegTree::FVec& feat, bst_float* out_interactions,
+                            unsigned node_index, ConditionedPath* parent_paths,
+                            unsigned num_paths, bst_float parent_zero_fraction,
+                            bst_float parent_one_fraction, int parent_feature_index,
+                            size_t path_stride) const;
 
   /*!
    * \brief calculate the approximate feature contributions for the given root
    * \param feat dense feature vector, if the feature is missing the field is set to NaN
    * \param root_id starting root index of the instance
    * \param out_contribs output vector to hold the contributions
+   * \return id of the leaf reached by the instance
    */
-  void CalculateContributionsApprox(const RegTree::FVec& feat, unsigned root_id,
-                                    bst_float* out_contribs) const;
+  int CalculateContributionsApprox(const RegTree::FVec& feat, unsigned root_id,
+                                   bst_float* out_contribs) const;
   /*!
    * \brief get next position of the tree given current pid
    * \param pid Current node id.
@@ -511,10 +544,28 @@ class RegTree {
   std::string DumpModel(const FeatureMap& fmap,
                         bool with_stats,
                         std::string format) const;
+  /*!
+   * \brief append the dump of the model in the requested format to a string
+   * \param fmap feature map that may help give interpretations of feature
+   * \param with_stats whether dump out statistics as well
+   * \param format the format to dump the model in
+   * \param out the string the dump is appended to
+   */
+  void DumpModel(const FeatureMap& fmap,
+                 bool with_stats,
+                 const std::string& format,
+                 std::string* out) const;
   /*!
    * \brief calculate the mean value for each node, required for feature contributions
    */
   void FillNodeMeanValues();
+  /*!
+   * \brief drop the node mean values, they are recomputed by the next
+   *  FillNodeMeanValues after the tree has been changed in place.
+   */
+  void ClearNodeMeanValues() {
+    node_mean_values_.clear();
+  }
 
  private:
   // vector of nodes
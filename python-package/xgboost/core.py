@@ -1377,10 +1377,13 @@ class Booster(object):
         """
         Dump model into a text or JSON file.
 
+        Trees are written to the file as they are dumped, so the whole dump is
+        never held in memory unless the feature names of the booster are used.
+
         Parameters
         ----------
-        fout : string
-            Output file name.
+        fout : string or file object
+            Output file name, or an open text file.
         fmap : string, optional
             Name of the file containing feature map names.
         with_stats : bool, optional
@@ -1393,20 +1396,54 @@ class Booster(object):
             need_close = True
         else:
             need_close = False
-        ret = self.get_dump(fmap, with_stats, dump_format)
         if dump_format == 'json':
             fout.write('[\n')
-            for i, _ in enumerate(ret):
-                fout.write(ret[i])
-                if i < len(ret) - 1:
+
+        def write_tree(index, dump):
+            """Write the dump of one tree in the layout of the format."""
+            if dump_format == 'json':
+                if index != 0:
                     fout.write(",\n")
-            fout.write('\n]')
-        else:
-            for i, _ in enumerate(ret):
-                fout.write('booster[{}]:\n'.format(i))
-                fout.write(ret[i])
-        if need_close:
-            fout.close()
+            else:
+                fout.write('booster[{}]:\n'.format(index))
+            fout.write(dump)
+
+        try:
+            if self.feature_names is not None and fmap == '':
+                # feature names can only be passed to the list dump
+                for i, dump in enumerate(self.get_dump(fmap, with_stats, dump_format)):
+                    write_tree(i, dump)
+            else:
+                if fmap != '' and not os.path.exists(fmap):
+                    raise ValueError("No such file: {0}".format(fmap))
+                errors = []
+
+                def dump_callback(_, index, dump, length):
+                    """Receive the dump of one tree from the native library."""
+                    try:
+                        write_tree(index, py_str(ctypes.string_at(dump, length)))
+                    except Exception as e:  # pylint: disable=broad-except
+                        errors.append(e)
+                        return -1
+                    return 0
+
+                callback_type = ctypes.CFUNCTYPE(ctypes.c_int, ctypes.c_void_p,
+                                                 c_bst_ulong, ctypes.c_void_p,
+                                                 c_bst_ulong)
+                ret = _LIB.XGBoosterDumpModelCallback(self.handle,
+                                                      c_str(fmap),
+                                                      ctypes.c_int(with_stats),
+                                                      c_str(dump_format),
+                                                      callback_type(dump_callback),
+                                                      None)
+                if errors:
+                    raise errors[0]
+                _check_call(ret)
+            if dump_format == 'json':
+                fout.write('\n]')
+        finally:
+            if need_close:
+                fout.close()
 
     def get_dump(self, fmap='', with_stats=False, dump_format="text"):
         """
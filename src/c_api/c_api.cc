@@ -4,6 +4,7 @@
 #include <xgboost/learner.h>
 #include <xgboost/c_api.h>
 #include <xgboost/logging.h>
+#include <xgboost/predictor.h>
 
 #include <dmlc/thread_local.h>
 #include <rabit/rabit.h>
@@ -12,15 +13,19 @@
 #include <cstdio>
 #include <cstring>
 #include <algorithm>
+#include <atomic>
 #include <vector>
 #include <string>
 #include <memory>
+#include <mutex>
 
 #include "./c_api_error.h"
 #include "../data/simple_csr_source.h"
 #include "../common/math.h"
 #include "../common/io.h"
 #include "../common/group_data.h"
+#include "../predictor/binned_forest.h"
+#include "../predictor/compressed_forest.h"
 
 
 namespace xgboost {
@@ -55,6 +60,9 @@ class Booster {
   }
 
   inline void LazyInit() {
+    // the flags are only set once, so concurrent predictions skip the lock
+    if (configured_ && initialized_) return;
+    std::lock_guard<std::mutex> guard(init_mutex_);
     if (!configured_) {
       LoadSavedParamFromAttr();
       learner_->Configure(cfg_);
@@ -90,12 +98,18 @@ class Booster {
     initialized_ = true;
   }
 
+  inline void LoadModelMmap(const std::string& fname) {
+    learner_->LoadMmap(fname);
+    initialized_ = true;
+  }
+
   bool IsInitialized() const { return initialized_; }
   void Intialize() { initialized_ = true; }
 
  private:
-  bool configured_;
-  bool initialized_;
+  std::atomic<bool> configured_;
+  std::atomic<bool> initialized_;
+  std::mutex init_mutex_;
   std::unique_ptr<Learner> learner_;
   std::vector<std::pair<std::string, std::string> > cfg_;
 };
@@ -222,8 +236,22 @@ struct XGBAPIThreadLocalEntry {
   std::vector<const char *> ret_vec_charp;
   /*! \brief returning float vector. */
   std::vector<bst_float> ret_vec_float;
+  /*! \brief returning unsigned vector. */
+  std::vector<unsigned> ret_vec_uint;
+  /*! \brief returning row offsets of a sparse result. */
+  std::vector<size_t> ret_vec_indptr;
+  /*! \brief returning second float vector. */
+  std::vector<bst_float> ret_vec_float_aux;
+  /*! \brief returning int32 vector. */
+  std::vector<int32_t> ret_vec_int32;
+  /*! \brief returning uint16 vector. */
+  std::vector<uint16_t> ret_vec_uint16;
   /*! \brief temp variable of gradient pairs. */
   std::vector<GradientPair> tmp_gpair;
+  /*! \brief temp variable of single row prediction. */
+  std::vector<Entry> tmp_row;
+  /*! \brief temp variable of single row prediction result. */
+  HostDeviceVector<bst_float> tmp_row_preds;
 };
 
 // define the threadlocal store.
@@ -969,6 +997,194 @@ XGB_DLL int XGBoosterPredict(BoosterHandle handle,
   API_END();
 }
 
+XGB_DLL int XGBoosterPredictCombined(BoosterHandle handle,
+                                     DMatrixHandle dmat,
+                                     int option_mask,
+                                     int leaf_format,
+                                     unsigned ntree_limit,
+                                     xgboost::bst_ulong *out_len,
+                                     const bst_float **out_result,
+                                     xgboost::bst_ulong *out_leaf_len,
+                                     const void **out_leaf,
+                                     xgboost::bst_ulong *out_num_leaf_col,
+                                     const bst_float **out_contribs) {
+  XGBAPIThreadLocalEntry *entry = XGBAPIThreadLocalStore::Get();
+  API_BEGIN();
+  CHECK_HANDLE();
+  CHECK_EQ(option_mask & ~(1 | 8), 0)
+      << "Only margin output and approximate contributions are supported "
+      << "by combined prediction.";
+  CHECK(leaf_format >= 0 && leaf_format <= 3) << "Unknown leaf format " << leaf_format;
+  auto *bst = static_cast<Booster*>(handle);
+  bst->LazyInit();
+  HostDeviceVector<bst_float> tmp_preds;
+  CombinedPrediction out;
+  out.margin = &tmp_preds;
+  out.leaf_int32 = leaf_format == 1 ? &entry->ret_vec_int32 : nullptr;
+  out.leaf_uint16 = leaf_format == 2 ? &entry->ret_vec_uint16 : nullptr;
+  out.leaf_onehot = leaf_format == 3 ? &entry->ret_vec_uint : nullptr;
+  out.approx_contribs = (option_mask & 8) != 0 ? &entry->ret_vec_float_aux : nullptr;
+  bst->learner()->PredictCombined(
+      static_cast<std::shared_ptr<DMatrix>*>(dmat)->get(),
+      (option_mask & 1) != 0, &out, ntree_limit);
+  entry->ret_vec_float = tmp_preds.HostVector();
+  *out_result = dmlc::BeginPtr(entry->ret_vec_float);
+  *out_len = static_cast<xgboost::bst_ulong>(entry->ret_vec_float.size());
+  *out_leaf_len = 0;
+  *out_leaf = nullptr;
+  if (leaf_format == 1) {
+    *out_leaf = dmlc::BeginPtr(entry->ret_vec_int32);
+    *out_leaf_len = static_cast<xgboost::bst_ulong>(entry->ret_vec_int32.size());
+  } else if (leaf_format == 2) {
+    *out_leaf = dmlc::BeginPtr(entry->ret_vec_uint16);
+    *out_leaf_len = static_cast<xgboost::bst_ulong>(entry->ret_vec_uint16.size());
+  } else if (leaf_format == 3) {
+    *out_leaf = dmlc::BeginPtr(entry->ret_vec_uint);
+    *out_leaf_len = static_cast<xgboost::bst_ulong>(entry->ret_vec_uint.size());
+  }
+  *out_num_leaf_col = static_cast<xgboost::bst_ulong>(out.num_leaf_columns);
+  *out_contribs = (option_mask & 8) != 0 ? dmlc::BeginPtr(entry->ret_vec_float_aux)
+                                         : nullptr;
+  API_END();
+}
+
+XGB_DLL int XGBoosterPredictContribSparse(BoosterHandle handle,
+                                          DMatrixHandle dmat,
+                                          int option_mask,
+                                          unsigned ntree_limit,
+                                          xgboost::bst_ulong *out_nrow,
+                                          const size_t **out_indptr,
+                                          const unsigned **out_indices,
+                                          const bst_float **out_values,
+                                          const bst_float **out_bias) {
+  XGBAPIThreadLocalEntry *entry = XGBAPIThreadLocalStore::Get();
+  API_BEGIN();
+  CHECK_HANDLE();
+  CHECK_EQ(option_mask & ~8, 0)
+      << "Only the approximate algorithm is supported as option of sparse contributions.";
+  auto *bst = static_cast<Booster*>(handle);
+  bst->LazyInit();
+  bst->learner()->PredictContributionSparse(
+      static_cast<std::shared_ptr<DMatrix>*>(dmat)->get(), &entry->ret_vec_indptr,
+      &entry->ret_vec_uint, &entry->ret_vec_float, &entry->ret_vec_float_aux,
+      ntree_limit, (option_mask & 8) != 0);
+  *out_indptr = dmlc::BeginPtr(entry->ret_vec_indptr);
+  *out_indices = dmlc::BeginPtr(entry->ret_vec_uint);
+  *out_values = dmlc::BeginPtr(entry->ret_vec_float);
+  *out_bias = dmlc::BeginPtr(entry->ret_vec_float_aux);
+  *out_nrow = static_cast<xgboost::bst_ulong>(entry->ret_vec_float_aux.size());
+  API_END();
+}
+
+XGB_DLL int XGBoosterPredictStaged(BoosterHandle handle,
+                                   DMatrixHandle dmat,
+                                   int option_mask,
+                                   unsigned ntree_limit,
+                                   xgboost::bst_ulong *out_nstage,
+                                   xgboost::bst_ulong *out_len,
+                                   const bst_float **out_result) {
+  std::vector<bst_float>&preds =
+    XGBAPIThreadLocalStore::Get()->ret_vec_float;
+  API_BEGIN();
+  CHECK_HANDLE();
+  CHECK_EQ(option_mask & ~1, 0)
+      << "Staged prediction only takes the output margin option (1), "
+      << "leaf index and contribution options are not supported.";
+  auto *bst = static_cast<Booster*>(handle);
+  bst->LazyInit();
+  HostDeviceVector<bst_float> tmp_preds;
+  *out_nstage = bst->learner()->PredictStaged(
+      static_cast<std::shared_ptr<DMatrix>*>(dmat)->get(),
+      (option_mask & 1) != 0, &tmp_preds, ntree_limit);
+  preds = tmp_preds.HostVector();
+  *out_result = dmlc::BeginPtr(preds);
+  *out_len = static_cast<xgboost::bst_ulong>(preds.size());
+  API_END();
+}
+
+XGB_DLL int XGBoosterPredictCascade(BoosterHandle handle,
+                                    DMatrixHandle dmat,
+                                    bst_float margin_threshold,
+                                    unsigned ntree_limit,
+                                    xgboost::bst_ulong *out_len,
+                                    const bst_float **out_result,
+                                    const unsigned **out_ntrees) {
+  XGBAPIThreadLocalEntry *entry = XGBAPIThreadLocalStore::Get();
+  API_BEGIN();
+  CHECK_HANDLE();
+  auto *bst = static_cast<Booster*>(handle);
+  bst->LazyInit();
+  HostDeviceVector<bst_float> tmp_preds;
+  bst->learner()->PredictCascade(
+      static_cast<std::shared_ptr<DMatrix>*>(dmat)->get(), margin_threshold,
+      &tmp_preds, &entry->ret_vec_uint, ntree_limit);
+  entry->ret_vec_float = tmp_preds.HostVector();
+  *out_result = dmlc::BeginPtr(entry->ret_vec_float);
+  *out_ntrees = dmlc::BeginPtr(entry->ret_vec_uint);
+  *out_len = static_cast<xgboost::bst_ulong>(entry->ret_vec_float.size());
+  API_END();
+}
+
+XGB_DLL int XGBoosterPredictInteractionTopK(BoosterHandle handle,
+                                            DMatrixHandle dmat,
+                                            unsigned top_k,
+                                            int option_mask,
+                                            unsigned ntree_limit,
+                                            xgboost::bst_ulong *out_len,
+                                            const bst_float **out_values,
+                                            const unsigned **out_index) {
+  XGBAPIThreadLocalEntry *entry = XGBAPIThreadLocalStore::Get();
+  API_BEGIN();
+  CHECK_HANDLE();
+  CHECK_EQ(option_mask & ~8, 0)
+      << "Only the approximate algorithm is supported as option of top-k interactions.";
+  auto *bst = static_cast<Booster*>(handle);
+  bst->LazyInit();
+  bst->learner()->PredictInteractionTopK(
+      static_cast<std::shared_ptr<DMatrix>*>(dmat)->get(), top_k,
+      &entry->ret_vec_float, &entry->ret_vec_uint, ntree_limit,
+      (option_mask & 8) != 0);
+  *out_values = dmlc::BeginPtr(entry->ret_vec_float);
+  *out_index = dmlc::BeginPtr(entry->ret_vec_uint);
+  *out_len = static_cast<xgboost::bst_ulong>(entry->ret_vec_float.size());
+  API_END();
+}
+
+XGB_DLL int XGBoosterPredictRow(BoosterHandle handle,
+                                const bst_float *values,
+                                const unsigned *indices,
+                                xgboost::bst_ulong nnz,
+                                bst_float missing,
+                                int option_mask,
+                                unsigned ntree_limit,
+                                xgboost::bst_ulong *out_len,
+                                bst_float *out_result) {
+  XGBAPIThreadLocalEntry *entry = XGBAPIThreadLocalStore::Get();
+  API_BEGIN();
+  CHECK_HANDLE();
+  CHECK_EQ(option_mask & ~1, 0)
+      << "Only margin output is supported by single row prediction.";
+  auto *bst = static_cast<Booster*>(handle);
+  bst->LazyInit();
+  bool nan_missing = common::CheckNAN(missing);
+  std::vector<Entry> &row = entry->tmp_row;
+  row.clear();
+  for (xgboost::bst_ulong i = 0; i < nnz; ++i) {
+    if (common::CheckNAN(values[i]) || (!nan_missing && values[i] == missing)) {
+      continue;
+    }
+    row.emplace_back(indices == nullptr ? static_cast<bst_uint>(i) : indices[i],
+                     values[i]);
+  }
+  bst->learner()->Predict(SparsePage::Inst(dmlc::BeginPtr(row), row.size()),
+                          (option_mask & 1) != 0, &entry->tmp_row_preds,
+                          ntree_limit);
+  const std::vector<bst_float> &preds = entry->tmp_row_preds.ConstHostVector();
+  std::copy(preds.begin(), preds.end(), out_result);
+  *out_len = static_cast<xgboost::bst_ulong>(preds.size());
+  API_END();
+}
+
 XGB_DLL int XGBoosterLoadModel(BoosterHandle handle, const char* fname) {
   API_BEGIN();
   CHECK_HANDLE();
@@ -987,6 +1203,23 @@ XGB_DLL int XGBoosterSaveModel(BoosterHandle handle, const char* fname) {
   API_END();
 }
 
+XGB_DLL int XGBoosterLoadModelMmap(BoosterHandle handle, const char* fname) {
+  API_BEGIN();
+  CHECK_HANDLE();
+  static_cast<Booster*>(handle)->LoadModelMmap(fname);
+  API_END();
+}
+
+XGB_DLL int XGBoosterSaveModelMmap(BoosterHandle handle, const char* fname) {
+  API_BEGIN();
+  CHECK_HANDLE();
+  std::unique_ptr<dmlc::Stream> fo(dmlc::Stream::Create(fname, "w"));
+  auto *bst = static_cast<Booster*>(handle);
+  bst->LazyInit();
+  bst->learner()->SaveMmap(fo.get());
+  API_END();
+}
+
 XGB_DLL int XGBoosterLoadModelFromBuffer(BoosterHandle handle,
                                  const void* buf,
                                  xgboost::bst_ulong len) {
@@ -1014,6 +1247,15 @@ XGB_DLL int XGBoosterGetModelRaw(BoosterHandle handle,
   API_END();
 }
 
+inline void LoadFeatureMap(const char* fname, FeatureMap* fmap) {
+  if (strlen(fname) != 0) {
+    std::unique_ptr<dmlc::Stream> fs(
+        dmlc::Stream::Create(fname, "r"));
+    dmlc::istream is(fs.get());
+    fmap->LoadText(is);
+  }
+}
+
 inline void XGBoostDumpModelImpl(
     BoosterHandle handle,
     const FeatureMap& fmap,
@@ -1049,16 +1291,165 @@ XGB_DLL int XGBoosterDumpModelEx(BoosterHandle handle,
   API_BEGIN();
   CHECK_HANDLE();
   FeatureMap featmap;
-  if (strlen(fmap) != 0) {
-    std::unique_ptr<dmlc::Stream> fs(
-        dmlc::Stream::Create(fmap, "r"));
-    dmlc::istream is(fs.get());
-    featmap.LoadText(is);
-  }
+  LoadFeatureMap(fmap, &featmap);
   XGBoostDumpModelImpl(handle, featmap, with_stats, format, len, out_models);
   API_END();
 }
 
+XGB_DLL int XGBoosterDumpModelToFile(BoosterHandle handle,
+                                     const char* fmap,
+                                     int with_stats,
+                                     const char* format,
+                                     const char* fname) {
+  API_BEGIN();
+  CHECK_HANDLE();
+  FeatureMap featmap;
+  LoadFeatureMap(fmap, &featmap);
+  auto *bst = static_cast<Booster*>(handle);
+  bst->LazyInit();
+  std::unique_ptr<dmlc::Stream> fo(dmlc::Stream::Create(fname, "w"));
+  bst->learner()->DumpModel(featmap, with_stats != 0, format, fo.get());
+  API_END();
+}
+
+XGB_DLL int XGBoosterDumpModelCallback(BoosterHandle handle,
+                                       const char* fmap,
+                                       int with_stats,
+                                       const char* format,
+                                       XGBCallbackDumpModel* callback,
+                                       void* callback_handle) {
+  API_BEGIN();
+  CHECK_HANDLE();
+  FeatureMap featmap;
+  LoadFeatureMap(fmap, &featmap);
+  auto *bst = static_cast<Booster*>(handle);
+  bst->LazyInit();
+  bst->learner()->DumpModel(
+      featmap, with_stats != 0, format,
+      [&](size_t i, const std::string& dump) {
+        CHECK_EQ(callback(callback_handle, static_cast<xgboost::bst_ulong>(i),
+                          dump.c_str(), static_cast<xgboost::bst_ulong>(dump.length())), 0)
+            << "Dump callback failed at booster " << i;
+      });
+  API_END();
+}
+
+XGB_DLL int XGBoosterGenerateSource(BoosterHandle handle,
+                                    unsigned ntree_limit,
+                                    xgboost::bst_ulong* out_len,
+                                    const char** out_source) {
+  std::string& source = XGBAPIThreadLocalStore::Get()->ret_str;
+  API_BEGIN();
+  CHECK_HANDLE();
+  auto *bst = static_cast<Booster*>(handle);
+  bst->LazyInit();
+  source = bst->learner()->GenerateSource(ntree_limit);
+  *out_source = source.c_str();
+  *out_len = static_cast<xgboost::bst_ulong>(source.length());
+  API_END();
+}
+
+XGB_DLL int XGBoosterSaveBinnedForest(BoosterHandle handle,
+                                      DMatrixHandle dtrain,
+                                      int max_bin,
+                                      const char* fname) {
+  API_BEGIN();
+  CHECK_HANDLE();
+  CHECK_GT(max_bin, 1) << "max_bin must be larger than 1";
+  auto *bst = static_cast<Booster*>(handle);
+  bst->LazyInit();
+  std::unique_ptr<dmlc::Stream> fo(dmlc::Stream::Create(fname, "w"));
+  bst->learner()->SaveBinnedForest(
+      static_cast<std::shared_ptr<DMatrix>*>(dtrain)->get(), max_bin, fo.get());
+  API_END();
+}
+
+XGB_DLL int XGBinnedForestLoad(const char* fname, BinnedForestHandle* out) {
+  API_BEGIN();
+  std::unique_ptr<dmlc::Stream> fi(dmlc::Stream::Create(fname, "r"));
+  std::unique_ptr<predictor::BinnedForest> forest(new predictor::BinnedForest());
+  forest->Load(fi.get());
+  *out = forest.release();
+  API_END();
+}
+
+XGB_DLL int XGBinnedForestPredict(BinnedForestHandle handle,
+                                  DMatrixHandle dmat,
+                                  unsigned ntree_limit,
+                                  xgboost::bst_ulong *out_len,
+                                  const bst_float **out_result) {
+  std::vector<bst_float>& preds = XGBAPIThreadLocalStore::Get()->ret_vec_float;
+  API_BEGIN();
+  CHECK_HANDLE();
+  static_cast<predictor::BinnedForest*>(handle)->PredictBatch(
+      static_cast<std::shared_ptr<DMatrix>*>(dmat)->get(), &preds, ntree_limit);
+  *out_result = dmlc::BeginPtr(preds);
+  *out_len = static_cast<xgboost::bst_ulong>(preds.size());
+  API_END();
+}
+
+XGB_DLL int XGBinnedForestFree(BinnedForestHandle handle) {
+  API_BEGIN();
+  CHECK_HANDLE();
+  delete static_cast<predictor::BinnedForest*>(handle);
+  API_END();
+}
+
+XGB_DLL int XGBoosterSaveCompressedForest(BoosterHandle handle,
+                                          int leaf_format,
+                                          float max_leaf_error,
+                                          DMatrixHandle dvalid,
+                                          const char* fname,
+                                          xgboost::bst_ulong* out_bytes,
+                                          double* out_max_error,
+                                          double* out_mean_error) {
+  API_BEGIN();
+  CHECK_HANDLE();
+  CHECK(dvalid != nullptr) << "Compression needs validation rows to report its error";
+  auto *bst = static_cast<Booster*>(handle);
+  bst->LazyInit();
+  std::unique_ptr<dmlc::Stream> fo(dmlc::Stream::Create(fname, "w"));
+  predictor::CompressionReport report;
+  bst->learner()->SaveCompressedForest(
+      leaf_format, max_leaf_error, static_cast<std::shared_ptr<DMatrix>*>(dvalid)->get(),
+      fo.get(), &report);
+  *out_bytes = static_cast<xgboost::bst_ulong>(report.bytes);
+  *out_max_error = report.max_error;
+  *out_mean_error = report.mean_error;
+  API_END();
+}
+
+XGB_DLL int XGCompressedForestLoad(const char* fname, CompressedForestHandle* out) {
+  API_BEGIN();
+  std::unique_ptr<dmlc::Stream> fi(dmlc::Stream::Create(fname, "r"));
+  std::unique_ptr<predictor::CompressedForest> forest(new predictor::CompressedForest());
+  forest->Load(fi.get());
+  *out = forest.release();
+  API_END();
+}
+
+XGB_DLL int XGCompressedForestPredict(CompressedForestHandle handle,
+                                      DMatrixHandle dmat,
+                                      unsigned ntree_limit,
+                                      xgboost::bst_ulong *out_len,
+                                      const bst_float **out_result) {
+  std::vector<bst_float>& preds = XGBAPIThreadLocalStore::Get()->ret_vec_float;
+  API_BEGIN();
+  CHECK_HANDLE();
+  static_cast<predictor::CompressedForest*>(handle)->PredictBatch(
+      static_cast<std::shared_ptr<DMatrix>*>(dmat)->get(), &preds, ntree_limit);
+  *out_result = dmlc::BeginPtr(preds);
+  *out_len = static_cast<xgboost::bst_ulong>(preds.size());
+  API_END();
+}
+
+XGB_DLL int XGCompressedForestFree(CompressedForestHandle handle) {
+  API_BEGIN();
+  CHECK_HANDLE();
+  delete static_cast<predictor::CompressedForest*>(handle);
+  API_END();
+}
+
 XGB_DLL int XGBoosterDumpModelWithFeatures(BoosterHandle handle,
                                    int fnum,
                                    const char** fname,
@@ -17,6 +17,7 @@
 #include <ctime>
 #include <string>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <vector>
 #include "./common/common.h"
@@ -28,7 +29,8 @@ namespace xgboost {
 enum CLITask {
   kTrain = 0,
   kDumpModel = 1,
-  kPredict = 2
+  kPredict = 2,
+  kCompileModel = 3
 };
 
 struct CLIParam : public dmlc::Parameter<CLIParam> {
@@ -66,6 +68,12 @@ struct CLIParam : public dmlc::Parameter<CLIParam> {
   std::string name_fmap;
   /*! \brief name of dump file */
   std::string name_dump;
+  /*! \brief name of generated source file */
+  std::string name_source;
+  /*! \brief name of compiled library, if any */
+  std::string name_lib;
+  /*! \brief command used to compile the generated source into a library */
+  std::string compile_cmd;
   /*! \brief the paths of validation data sets */
   std::vector<std::string> eval_data_paths;
   /*! \brief the names of the evaluation data used in output log */
@@ -80,6 +88,7 @@ struct CLIParam : public dmlc::Parameter<CLIParam> {
         .add_enum("train", kTrain)
         .add_enum("dump", kDumpModel)
         .add_enum("pred", kPredict)
+        .add_enum("compile", kCompileModel)
         .describe("Task to be performed by the CLI program.");
     DMLC_DECLARE_FIELD(eval_train).set_default(false)
         .describe("Whether evaluate on training data during training.");
@@ -116,6 +125,13 @@ struct CLIParam : public dmlc::Parameter<CLIParam> {
         .describe("Name of the feature map file.");
     DMLC_DECLARE_FIELD(name_dump).set_default("dump.txt")
         .describe("Name of the output dump text file.");
+    DMLC_DECLARE_FIELD(name_source).set_default("model.c")
+        .describe("Name of the C source file generated from the model.");
+    DMLC_DECLARE_FIELD(name_lib).set_default("NULL")
+        .describe("Name of the shared library compiled from the generated source, "
+                  "no library is built if not specified.");
+    DMLC_DECLARE_FIELD(compile_cmd).set_default("cc -O2 -fPIC -shared")
+        .describe("Compiler command used to build the shared library.");
     // alias
     DMLC_DECLARE_ALIAS(train_path, data);
     DMLC_DECLARE_ALIAS(test_path, test:data);
@@ -278,26 +294,33 @@ void CLIDumpModel(const CLIParam& param) {
   learner->Configure(param.cfg);
   learner->Load(fi.get());
   // dump data
-  std::vector<std::string> dump = learner->DumpModel(
-      fmap, param.dump_stats, param.dump_format);
   std::unique_ptr<dmlc::Stream> fo(
       dmlc::Stream::Create(param.name_dump.c_str(), "w"));
-  dmlc::ostream os(fo.get());
-  if (param.dump_format == "json") {
-    os << "[" << std::endl;
-    for (size_t i = 0; i < dump.size(); ++i) {
-      if (i != 0) os << "," << std::endl;
-      os << dump[i];  // Dump the previously generated JSON here
-    }
-    os << std::endl << "]" << std::endl;
-  } else {
-    for (size_t i = 0; i < dump.size(); ++i) {
-      os << "booster[" << i << "]:\n";
-      os << dump[i];
-    }
+  learner->DumpModel(fmap, param.dump_stats, param.dump_format, fo.get());
+}
+
+void CLICompileModel(const CLIParam& param) {
+  CHECK_NE(param.model_in, "NULL")
+      << "Must specify model_in for compile";
+  std::unique_ptr<Learner> learner(Learner::Create({}));
+  std::unique_ptr<dmlc::Stream> fi(
+      dmlc::Stream::Create(param.model_in.c_str(), "r"));
+  learner->Configure(param.cfg);
+  learner->Load(fi.get());
+  std::string source = learner->GenerateSource(param.ntree_limit);
+  {
+    std::unique_ptr<dmlc::Stream> fo(
+        dmlc::Stream::Create(param.name_source.c_str(), "w"));
+    fo->Write(source.c_str(), source.length());
+  }
+  LOG(CONSOLE) << "model source written to " << param.name_source;
+  if (param.name_lib != "NULL") {
+    std::string cmd = param.compile_cmd + " -o \"" + param.name_lib + "\" \"" +
+                      param.name_source + "\"";
+    LOG(CONSOLE) << cmd;
+    CHECK_EQ(std::system(cmd.c_str()), 0)
+        << "Failed to compile " << param.name_source;
   }
-  // force flush before fo destruct.
-  os.set_stream(nullptr);
 }
 
 void CLIPredict(const CLIParam& param) {
@@ -358,6 +381,7 @@ int CLIRunTask(int argc, char *argv[]) {
     case kTrain: CLITrain(param); break;
     case kDumpModel: CLIDumpModel(param); break;
     case kPredict: CLIPredict(param); break;
+    case kCompileModel: CLICompileModel(param); break;
   }
   rabit::Finalize();
   return 0;
@@ -8,6 +8,7 @@
 #ifndef XGBOOST_COMMON_COLUMN_MATRIX_H_
 #define XGBOOST_COMMON_COLUMN_MATRIX_H_
 
+#include <algorithm>
 #include <limits>
 #include <vector>
 #include "hist_util.h"
@@ -24,10 +25,12 @@ enum ColumnType {
 };
 
 /*! \brief a column storage, to be used with ApplySplit. Note that each
-    bin id is stored as index[i] + index_base. */
+    bin id is stored as index[i] + index_base. The largest value of
+    BinIdxType marks a missing value in a dense column. */
+template <typename BinIdxType>
 class Column {
  public:
-  Column(ColumnType type, const uint32_t* index, uint32_t index_base,
+  Column(ColumnType type, const BinIdxType* index, uint32_t index_base,
          const size_t* row_ind, size_t len)
       : type_(type),
         index_(index),
@@ -36,7 +39,7 @@ class Column {
         len_(len) {}
   size_t Size() const { return len_; }
   uint32_t GetGlobalBinIdx(size_t idx) const { return index_base_ + index_[idx]; }
-  uint32_t GetFeatureBinIdx(size_t idx) const { return index_[idx]; }
+  BinIdxType GetFeatureBinIdx(size_t idx) const { return index_[idx]; }
   // column.GetFeatureBinIdx(idx) + column.GetBaseIdx(idx) ==
   // column.GetGlobalBinIdx(idx)
   uint32_t GetBaseIdx() const { return index_base_; }
@@ -47,20 +50,27 @@ class Column {
     return type_ == ColumnType::kDenseColumn ? idx : row_ind_[idx];  // NOLINT
   }
   bool IsMissing(size_t idx) const {
-    return index_[idx] == std::numeric_limits<uint32_t>::max();
+    return index_[idx] == kMissingBin;
   }
   const size_t* GetRowData() const { return row_ind_; }
 
+  /*! \brief stored bin of a missing value */
+  static constexpr BinIdxType kMissingBin = std::numeric_limits<BinIdxType>::max();
+
  private:
   ColumnType type_;
-  const uint32_t* index_;
+  const BinIdxType* index_;
   uint32_t index_base_;
   const size_t* row_ind_;
   const size_t len_;
 };
 
+template <typename BinIdxType>
+constexpr BinIdxType Column<BinIdxType>::kMissingBin;
+
 /*! \brief a collection of columns, with support for construction from
-    GHistIndexMatrix. */
+    GHistIndexMatrix. Bins are stored local to the feature in the narrowest
+    unsigned type leaving its largest value free to mark missing values. */
 class ColumnMatrix {
  public:
   // get number of features
@@ -68,6 +78,11 @@ class ColumnMatrix {
     return static_cast<bst_uint>(type_.size());
   }
 
+  // width of the stored bins, selects the BinIdxType of GetColumn
+  inline BinTypeSize GetBinTypeSize() const {
+    return bins_type_size_;
+  }
+
   // construct column matrix from GHistIndexMatrix
   inline void Init(const GHistIndexMatrix& gmat,
                    double  sparse_threshold) {
@@ -80,9 +95,14 @@ class ColumnMatrix {
     std::fill(feature_counts_.begin(), feature_counts_.end(), 0);
 
     uint32_t max_val = std::numeric_limits<uint32_t>::max();
+    uint32_t max_feature_bins = 0;
     for (bst_uint fid = 0; fid < nfeature; ++fid) {
-      CHECK_LE(gmat.cut.row_ptr[fid + 1] - gmat.cut.row_ptr[fid], max_val);
+      const uint32_t nbins = gmat.cut.row_ptr[fid + 1] - gmat.cut.row_ptr[fid];
+      CHECK_LT(nbins, max_val);
+      max_feature_bins = std::max(max_feature_bins, nbins);
     }
+    // local bins are below max_feature_bins, which is then free for missing
+    bins_type_size_ = NarrowestBinType(max_feature_bins);
 
     gmat.GetFeatureCounts(&feature_counts_[0]);
     // classify features
@@ -114,7 +134,7 @@ class ColumnMatrix {
       boundary_[fid].row_ind_end = accum_row_ind_;
     }
 
-    index_.resize(boundary_[nfeature - 1].index_end);
+    index_.resize(boundary_[nfeature - 1].index_end * bins_type_size_);
     row_ind_.resize(boundary_[nfeature - 1].row_ind_end);
 
     // store least bin id for each feature
@@ -123,15 +143,49 @@ class ColumnMatrix {
       index_base_[fid] = gmat.cut.row_ptr[fid];
     }
 
+    switch (bins_type_size_) {
+      case kUint8BinsTypeSize:
+        this->SetIndex<uint8_t>(gmat);
+        break;
+      case kUint16BinsTypeSize:
+        this->SetIndex<uint16_t>(gmat);
+        break;
+      default:
+        this->SetIndex<uint32_t>(gmat);
+    }
+  }
+
+  /* Fetch an individual column. BinIdxType must match GetBinTypeSize() */
+  template <typename BinIdxType>
+  inline Column<BinIdxType> GetColumn(unsigned fid) const {
+    CHECK_EQ(sizeof(BinIdxType), static_cast<size_t>(bins_type_size_));
+    const auto* index = reinterpret_cast<const BinIdxType*>(index_.data());
+    Column<BinIdxType> c(type_[fid], index + boundary_[fid].index_begin, index_base_[fid],
+                         (type_[fid] == ColumnType::kSparseColumn ?
+                          &row_ind_[boundary_[fid].row_ind_begin] : nullptr),
+                         boundary_[fid].index_end - boundary_[fid].index_begin);
+    return c;
+  }
+
+  /*! \brief bytes used by the stored bins */
+  size_t IndexBytes() const { return index_.size(); }
+
+ private:
+  template <typename BinIdxType>
+  inline void SetIndex(const GHistIndexMatrix& gmat) {
+    const int32_t nfeature = static_cast<int32_t>(gmat.cut.row_ptr.size() - 1);
+    const size_t nrow = gmat.row_ptr.size() - 1;
+    auto* index = reinterpret_cast<BinIdxType*>(index_.data());
+
     // pre-fill index_ for dense columns
 
     #pragma omp parallel for
     for (int32_t fid = 0; fid < nfeature; ++fid) {
       if (type_[fid] == kDenseColumn) {
         const size_t ibegin = boundary_[fid].index_begin;
-        uint32_t* begin = &index_[ibegin];
-        uint32_t* end = begin + nrow;
-        std::fill(begin, end, std::numeric_limits<uint32_t>::max());
+        BinIdxType* begin = index + ibegin;
+        BinIdxType* end = begin + nrow;
+        std::fill(begin, end, Column<BinIdxType>::kMissingBin);
         // max() indicates missing values
       }
     }
@@ -150,12 +204,12 @@ class ColumnMatrix {
         while (bin_id >= gmat.cut.row_ptr[fid + 1]) {
           ++fid;
         }
+        BinIdxType* begin = index + boundary_[fid].index_begin;
+        const auto bin = static_cast<BinIdxType>(bin_id - index_base_[fid]);
         if (type_[fid] == kDenseColumn) {
-          uint32_t* begin = &index_[boundary_[fid].index_begin];
-          begin[rid] = bin_id - index_base_[fid];
+          begin[rid] = bin;
         } else {
-          uint32_t* begin = &index_[boundary_[fid].index_begin];
-          begin[num_nonzeros[fid]] = bin_id - index_base_[fid];
+          begin[num_nonzeros[fid]] = bin;
           row_ind_[boundary_[fid].row_ind_begin + num_nonzeros[fid]] = rid;
           ++num_nonzeros[fid];
         }
@@ -163,21 +217,10 @@ class ColumnMatrix {
     }
   }
 
-  /* Fetch an individual column. This code should be used with XGBOOST_TYPE_SWITCH
-     to determine type of bin id's */
-  inline Column GetColumn(unsigned fid) const {
-    Column c(type_[fid], &index_[boundary_[fid].index_begin], index_base_[fid],
-             (type_[fid] == ColumnType::kSparseColumn ?
-              &row_ind_[boundary_[fid].row_ind_begin] : nullptr),
-             boundary_[fid].index_end - boundary_[fid].index_begin);
-    return c;
-  }
-
- private:
   struct ColumnBoundary {
     // indicate where each column's index and row_ind is stored.
     // index_begin and index_end are logical offsets, so they should be converted to
-    // actual offsets by scaling with packing_factor_
+    // actual offsets by scaling with bins_type_size_
     size_t index_begin;
     size_t index_end;
     size_t row_ind_begin;
@@ -186,9 +229,11 @@ class ColumnMatrix {
 
   std::vector<size_t> feature_counts_;
   std::vector<ColumnType> type_;
-  SimpleArray<uint32_t> index_;  // index_: may store smaller integers; needs padding
+  // bins of all columns, stored as BinIdxType of width bins_type_size_
+  SimpleArray<uint8_t> index_;
   SimpleArray<size_t> row_ind_;
   std::vector<ColumnBoundary> boundary_;
+  BinTypeSize bins_type_size_{kUint32BinsTypeSize};
 
   // index_base_[fid]: least bin id for feature fid
   std::vector<uint32_t> index_base_;
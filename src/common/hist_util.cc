@@ -185,8 +185,27 @@ void GHistIndexMatrix::Init(DMatrix* p_fmat, int max_num_bins) {
 
 
   size_t new_size = 1;
+  size_t nnz = 0;
   for (const auto &batch : p_fmat->GetRowBatches()) {
     new_size += batch.Size();
+    nnz += batch.data.Size();
+  }
+
+  // A dense matrix stores bins local to their feature, the width then only
+  // depends on the number of bins per feature.  Otherwise global bins are
+  // stored and the width depends on the total number of bins.  A matrix with
+  // as many entries as a dense one may still repeat a feature in a row, its
+  // bins then don't line up with the features and are stored globally too.
+  const size_t nfeature = cut.row_ptr.size() - 1;
+  if (nfeature != 0 && nnz == (new_size - 1) * nfeature) {
+    uint32_t max_feature_bins = 0;
+    for (size_t fid = 0; fid < nfeature; ++fid) {
+      max_feature_bins = std::max(max_feature_bins, cut.row_ptr[fid + 1] - cut.row_ptr[fid]);
+    }
+    index.Init(NarrowestBinType(max_feature_bins - 1),
+               std::vector<uint32_t>(cut.row_ptr.begin(), cut.row_ptr.end() - 1));
+  } else {
+    index.Init(NarrowestBinType(nbins - 1), {});
   }
 
   row_ptr.resize(new_size);
@@ -238,25 +257,54 @@ void GHistIndexMatrix::Init(DMatrix* p_fmat, int max_num_bins) {
       }
     }
 
-    index.resize(row_ptr[rbegin + batch.Size()]);
+    index.Resize(row_ptr[rbegin + batch.Size()]);
 
     CHECK_GT(cut.cut.size(), 0U);
 
-    #pragma omp parallel for num_threads(batch_threads) schedule(static)
-    for (omp_ulong i = 0; i < batch.Size(); ++i) { // NOLINT(*)
-      const int tid = omp_get_thread_num();
-      size_t ibegin = row_ptr[rbegin + i];
-      size_t iend = row_ptr[rbegin + i + 1];
+    // sorted global bins of row i of the batch
+    auto row_bins = [&](size_t i, std::vector<uint32_t>* bins) {
       SparsePage::Inst inst = batch[i];
-
-      CHECK_EQ(ibegin + inst.size(), iend);
+      CHECK_EQ(row_ptr[rbegin + i] + inst.size(), row_ptr[rbegin + i + 1]);
+      bins->resize(inst.size());
       for (bst_uint j = 0; j < inst.size(); ++j) {
-        uint32_t idx = cut.GetBinIdx(inst[j]);
-
-        index[ibegin + j] = idx;
-        ++hit_count_tloc_[tid * nbins + idx];
+        (*bins)[j] = cut.GetBinIdx(inst[j]);
+      }
+      std::sort(bins->begin(), bins->end());
+    };
+    const bool local_bins = index.IsDense();
+    int bins_fit = 1;
+    #pragma omp parallel num_threads(batch_threads)
+    {
+      std::vector<uint32_t> bins;
+      #pragma omp for schedule(static) reduction(&:bins_fit)
+      for (omp_ulong i = 0; i < batch.Size(); ++i) { // NOLINT(*)
+        const int tid = omp_get_thread_num();
+        size_t ibegin = row_ptr[rbegin + i];
+        row_bins(i, &bins);
+        for (bst_uint j = 0; j < bins.size(); ++j) {
+          ++hit_count_tloc_[tid * nbins + bins[j]];
+          if (local_bins) {
+            const size_t fid = (ibegin + j) % nfeature;
+            bins_fit &= cut.row_ptr[fid] <= bins[j] && bins[j] < cut.row_ptr[fid + 1];
+          }
+          index.Set(ibegin + j, bins[j]);
+        }
+      }
+    }
+    if (!bins_fit) {
+      // earlier batches are kept, this one is stored again with global bins
+      index.ToGlobal(NarrowestBinType(nbins - 1), row_ptr[rbegin]);
+      #pragma omp parallel num_threads(batch_threads)
+      {
+        std::vector<uint32_t> bins;
+        #pragma omp for schedule(static)
+        for (omp_ulong i = 0; i < batch.Size(); ++i) { // NOLINT(*)
+          row_bins(i, &bins);
+          for (bst_uint j = 0; j < bins.size(); ++j) {
+            index.Set(row_ptr[rbegin + i] + j, bins[j]);
+          }
+        }
       }
-      std::sort(index.begin() + ibegin, index.begin() + iend);
     }
 
     #pragma omp parallel for num_threads(nthread) schedule(static)
@@ -271,13 +319,14 @@ void GHistIndexMatrix::Init(DMatrix* p_fmat, int max_num_bins) {
   }
 }
 
+template <typename BinIdxType>
 static size_t GetConflictCount(const std::vector<bool>& mark,
-                               const Column& column,
+                               const Column<BinIdxType>& column,
                                size_t max_cnt) {
   size_t ret = 0;
   if (column.GetType() == xgboost::common::kDenseColumn) {
     for (size_t i = 0; i < column.Size(); ++i) {
-      if (column.GetFeatureBinIdx(i) != std::numeric_limits<uint32_t>::max() && mark[i]) {
+      if (!column.IsMissing(i) && mark[i]) {
         ++ret;
         if (ret > max_cnt) {
           return max_cnt + 1;
@@ -297,12 +346,13 @@ static size_t GetConflictCount(const std::vector<bool>& mark,
   return ret;
 }
 
+template <typename BinIdxType>
 inline void
-MarkUsed(std::vector<bool>* p_mark, const Column& column) {
+MarkUsed(std::vector<bool>* p_mark, const Column<BinIdxType>& column) {
   std::vector<bool>& mark = *p_mark;
   if (column.GetType() == xgboost::common::kDenseColumn) {
     for (size_t i = 0; i < column.Size(); ++i) {
-      if (column.GetFeatureBinIdx(i) != std::numeric_limits<uint32_t>::max()) {
+      if (!column.IsMissing(i)) {
         mark[i] = true;
       }
     }
@@ -313,6 +363,7 @@ MarkUsed(std::vector<bool>* p_mark, const Column& column) {
   }
 }
 
+template <typename BinIdxType>
 inline std::vector<std::vector<unsigned>>
 FindGroups(const std::vector<unsigned>& feature_list,
            const std::vector<size_t>& feature_nnz,
@@ -332,7 +383,7 @@ FindGroups(const std::vector<unsigned>& feature_list,
     = static_cast<size_t>(param.max_conflict_rate * nrow);
 
   for (auto fid : feature_list) {
-    const Column& column = colmat.GetColumn(fid);
+    const Column<BinIdxType> column = colmat.GetColumn<BinIdxType>(fid);
 
     const size_t cur_fid_nnz = feature_nnz[fid];
     bool need_new_group = true;
@@ -377,6 +428,22 @@ FindGroups(const std::vector<unsigned>& feature_list,
   return groups;
 }
 
+inline std::vector<std::vector<unsigned>>
+FindGroups(const std::vector<unsigned>& feature_list,
+           const std::vector<size_t>& feature_nnz,
+           const ColumnMatrix& colmat,
+           size_t nrow,
+           const tree::TrainParam& param) {
+  switch (colmat.GetBinTypeSize()) {
+    case kUint8BinsTypeSize:
+      return FindGroups<uint8_t>(feature_list, feature_nnz, colmat, nrow, param);
+    case kUint16BinsTypeSize:
+      return FindGroups<uint16_t>(feature_list, feature_nnz, colmat, nrow, param);
+    default:
+      return FindGroups<uint32_t>(feature_list, feature_nnz, colmat, nrow, param);
+  }
+}
+
 inline std::vector<std::vector<unsigned>>
 FastFeatureGrouping(const GHistIndexMatrix& gmat,
                     const ColumnMatrix& colmat,
@@ -496,21 +563,108 @@ void GHistIndexBlockMatrix::Init(const GHistIndexMatrix& gmat,
   }
 }
 
-void GHistBuilder::BuildHist(const std::vector<GradientPair>& gpair,
-                             const RowSetCollection::Elem row_indices,
-                             const GHistIndexMatrix& gmat,
-                             GHistRow hist) {
+// Accumulate rows [istart, iend) of rid into hist, locating each row by row_ptr.
+template <typename GradientSumT, typename BinIdxType>
+void BuildHistSparseRows(const size_t* rid, size_t istart, size_t iend,
+                         size_t prefetch_end, size_t prefetch_offset,
+                         const size_t* row_ptr, const BinIdxType* index,
+                         const float* pgh, GradientSumT* hist) {
+  for (size_t i = istart; i < iend; ++i) {
+    const size_t icol_start = row_ptr[rid[i]];
+    const size_t icol_end = row_ptr[rid[i]+1];
+
+    if (i < prefetch_end) {
+      PREFETCH_READ_T0(row_ptr + rid[i + prefetch_offset]);
+      PREFETCH_READ_T0(pgh + 2*rid[i + prefetch_offset]);
+    }
+
+    const BinIdxType* row_index = index + icol_start;
+    const size_t idx_gh = 2*rid[i];
+    for (size_t j = 0; j < icol_end - icol_start; ++j) {
+      const uint32_t idx_bin = 2*static_cast<uint32_t>(row_index[j]);
+
+      hist[idx_bin] += pgh[idx_gh];
+      hist[idx_bin+1] += pgh[idx_gh+1];
+    }
+  }
+}
+
+// Same for a dense matrix: row r starts at r * nfeature and holds the bin of
+// feature j local to the feature at position j, so neither row_ptr nor the row
+// length are read and the feature loop has the same trip count for every row.
+template <typename GradientSumT, typename BinIdxType>
+void BuildHistDenseRows(const size_t* rid, size_t istart, size_t iend,
+                        size_t prefetch_end, size_t prefetch_offset,
+                        size_t nfeature, const BinIdxType* index,
+                        const uint32_t* offsets, const float* pgh, GradientSumT* hist) {
+  for (size_t i = istart; i < iend; ++i) {
+    if (i < prefetch_end) {
+      PREFETCH_READ_T0(index + rid[i + prefetch_offset] * nfeature);
+      PREFETCH_READ_T0(pgh + 2*rid[i + prefetch_offset]);
+    }
+
+    const BinIdxType* row_index = index + rid[i] * nfeature;
+    const GradientSumT grad = pgh[2*rid[i]];
+    const GradientSumT hess = pgh[2*rid[i]+1];
+    for (size_t j = 0; j < nfeature; ++j) {
+      const uint32_t idx_bin = 2*(static_cast<uint32_t>(row_index[j]) + offsets[j]);
+
+      hist[idx_bin] += grad;
+      hist[idx_bin+1] += hess;
+    }
+  }
+}
+
+template <typename GradientSumT, typename BinIdxType>
+void BuildHistRows(const size_t* rid, size_t istart, size_t iend,
+                   size_t prefetch_end, size_t prefetch_offset,
+                   const size_t* row_ptr, const BinIndex& index,
+                   const float* pgh, GradientSumT* hist) {
+  if (index.IsDense()) {
+    BuildHistDenseRows<GradientSumT, BinIdxType>(rid, istart, iend, prefetch_end, prefetch_offset,
+                                   index.NumFeatures(), index.Data<BinIdxType>(),
+                                   index.Offsets(), pgh, hist);
+  } else {
+    BuildHistSparseRows<GradientSumT, BinIdxType>(rid, istart, iend, prefetch_end, prefetch_offset,
+                                    row_ptr, index.Data<BinIdxType>(), pgh, hist);
+  }
+}
+
+// Accumulate rows [istart, iend) of rid into hist with the kernel of the bin type.
+template <typename GradientSumT>
+void BuildHistBlock(const size_t* rid, size_t istart, size_t iend,
+                    size_t prefetch_end, size_t prefetch_offset,
+                    const GHistIndexMatrix& gmat, const float* pgh, GradientSumT* hist) {
+  const size_t* row_ptr = gmat.row_ptr.data();
+  switch (gmat.index.GetBinTypeSize()) {
+    case kUint8BinsTypeSize:
+      BuildHistRows<GradientSumT, uint8_t>(rid, istart, iend, prefetch_end, prefetch_offset,
+                                           row_ptr, gmat.index, pgh, hist);
+      break;
+    case kUint16BinsTypeSize:
+      BuildHistRows<GradientSumT, uint16_t>(rid, istart, iend, prefetch_end, prefetch_offset,
+                                            row_ptr, gmat.index, pgh, hist);
+      break;
+    default:
+      BuildHistRows<GradientSumT, uint32_t>(rid, istart, iend, prefetch_end, prefetch_offset,
+                                            row_ptr, gmat.index, pgh, hist);
+  }
+}
+
+template <typename GradientSumT>
+void GHistBuilder<GradientSumT>::BuildHist(const std::vector<GradientPair>& gpair,
+                                           const RowSetCollection::Elem row_indices,
+                                           const GHistIndexMatrix& gmat,
+                                           GHistRow<GradientSumT> hist) {
   const size_t nthread = static_cast<size_t>(this->nthread_);
   data_.resize(nbins_ * nthread_);
 
   const size_t* rid =  row_indices.begin;
   const size_t nrows = row_indices.Size();
-  const uint32_t* index = gmat.index.data();
-  const size_t* row_ptr =  gmat.row_ptr.data();
   const float* pgh = reinterpret_cast<const float*>(gpair.data());
 
-  double* hist_data = reinterpret_cast<double*>(hist.data());
-  double* data = reinterpret_cast<double*>(data_.data());
+  GradientSumT* hist_data = reinterpret_cast<GradientSumT*>(hist.data());
+  GradientSumT* data = reinterpret_cast<GradientSumT*>(data_.data());
 
   const size_t block_size = 512;
   size_t n_blocks = nrows/block_size;
@@ -527,33 +681,19 @@ void GHistBuilder::BuildHist(const std::vector<GradientPair>& gpair,
 #pragma omp parallel for num_threads(nthread_to_process) schedule(guided)
   for (bst_omp_uint iblock = 0; iblock < n_blocks; iblock++) {
     dmlc::omp_uint tid = omp_get_thread_num();
-    double* data_local_hist = ((nthread_to_process == 1) ? hist_data :
-                               reinterpret_cast<double*>(data_.data() + tid * nbins_));
+    GradientSumT* data_local_hist = ((nthread_to_process == 1) ? hist_data :
+                                     reinterpret_cast<GradientSumT*>(data_.data() + tid * nbins_));
 
     if (!thread_init_[tid]) {
-      memset(data_local_hist, '\0', 2*nbins_*sizeof(double));
+      memset(data_local_hist, '\0', 2*nbins_*sizeof(GradientSumT));
       thread_init_[tid] = true;
     }
 
     const size_t istart = iblock*block_size;
     const size_t iend = (((iblock+1)*block_size > nrows) ? nrows : istart + block_size);
-    for (size_t i = istart; i < iend; ++i) {
-      const size_t icol_start = row_ptr[rid[i]];
-      const size_t icol_end = row_ptr[rid[i]+1];
-
-      if (i < nrows - no_prefetch_size) {
-        PREFETCH_READ_T0(row_ptr + rid[i + prefetch_offset]);
-        PREFETCH_READ_T0(pgh + 2*rid[i + prefetch_offset]);
-      }
-
-      for (size_t j = icol_start; j < icol_end; ++j) {
-        const uint32_t idx_bin = 2*index[j];
-        const size_t idx_gh = 2*rid[i];
-
-        data_local_hist[idx_bin] += pgh[idx_gh];
-        data_local_hist[idx_bin+1] += pgh[idx_gh+1];
-      }
-    }
+    const size_t prefetch_end = nrows - no_prefetch_size;
+    BuildHistBlock(rid, istart, iend, prefetch_end, prefetch_offset, gmat, pgh,
+                   data_local_hist);
   }
 
   if (nthread_to_process > 1) {
@@ -575,7 +715,7 @@ void GHistBuilder::BuildHist(const std::vector<GradientPair>& gpair,
       const size_t iend = (((iblock + 1) * block_size > size) ? size : istart + block_size);
 
       const size_t bin = 2 * thread_init_[0] * nbins_;
-      memcpy(hist_data + istart, (data + bin + istart), sizeof(double) * (iend - istart));
+      memcpy(hist_data + istart, (data + bin + istart), sizeof(GradientSumT) * (iend - istart));
 
       for (size_t i_bin_part = 1; i_bin_part < n_worked_bins; ++i_bin_part) {
         const size_t bin = 2 * thread_init_[i_bin_part] * nbins_;
@@ -587,10 +727,114 @@ void GHistBuilder::BuildHist(const std::vector<GradientPair>& gpair,
   }
 }
 
-void GHistBuilder::BuildBlockHist(const std::vector<GradientPair>& gpair,
-                                  const RowSetCollection::Elem row_indices,
-                                  const GHistIndexBlockMatrix& gmatb,
-                                  GHistRow hist) {
+template <typename GradientSumT>
+void GHistBuilder<GradientSumT>::BuildHists(const std::vector<GradientPair>& gpair,
+                                            const std::vector<RowSetCollection::Elem>& row_indices,
+                                            const GHistIndexMatrix& gmat,
+                                            const std::vector<GHistRow<GradientSumT>>& hists) {
+  CHECK_EQ(row_indices.size(), hists.size());
+  const size_t nnodes = hists.size();
+  const float* pgh = reinterpret_cast<const float*>(gpair.data());
+
+  // work items are blocks of rows of a node, ordered by node
+  const size_t block_size = 512;
+  std::vector<size_t> item_ptr(nnodes + 1, 0);
+  for (size_t k = 0; k < nnodes; ++k) {
+    const size_t nrows = row_indices[k].Size();
+    item_ptr[k + 1] = item_ptr[k] + (nrows + block_size - 1) / block_size;
+    if (nrows == 0) {
+      std::fill(hists[k].begin(), hists[k].end(), GHistEntry<GradientSumT>());
+    }
+  }
+  const size_t n_items = item_ptr.back();
+  if (n_items == 0) {
+    return;
+  }
+
+  // Thread t takes the contiguous items [t * n_items / n, (t + 1) * n_items / n),
+  // so it is the first to touch each node of its range except maybe the first
+  // one.  It writes directly into the histograms of the nodes it touches first
+  // and into its buffer in data_ for a first node shared with earlier threads.
+  const size_t nthread_to_process = std::min(static_cast<size_t>(nthread_), n_items);
+  data_.resize(nbins_ * nthread_);
+  std::vector<size_t> first_node(nthread_to_process);
+  std::vector<int> buffered(nthread_to_process);
+  for (size_t tid = 0; tid < nthread_to_process; ++tid) {
+    const size_t ibegin = tid * n_items / nthread_to_process;
+    first_node[tid] = std::upper_bound(item_ptr.begin(), item_ptr.end(), ibegin)
+                      - item_ptr.begin() - 1;
+    buffered[tid] = ibegin != item_ptr[first_node[tid]];
+  }
+
+  const size_t cache_line_size = 64;
+  const size_t prefetch_offset = 10;
+  const size_t no_prefetch_size = prefetch_offset + cache_line_size / sizeof(size_t);
+
+#pragma omp parallel num_threads(nthread_to_process)
+  {
+    const size_t tid = omp_get_thread_num();
+    const size_t ibegin = tid * n_items / nthread_to_process;
+    const size_t iend = (tid + 1) * n_items / nthread_to_process;
+    size_t node = first_node[tid];
+    for (size_t item = ibegin; item < iend; ++item) {
+      while (item >= item_ptr[node + 1]) {
+        ++node;
+      }
+      GradientSumT* out;
+      if (node == first_node[tid] && buffered[tid]) {
+        out = reinterpret_cast<GradientSumT*>(data_.data() + tid * nbins_);
+      } else {
+        out = reinterpret_cast<GradientSumT*>(hists[node].data());
+      }
+      if (item == ibegin || item == item_ptr[node]) {
+        memset(out, '\0', 2 * nbins_ * sizeof(GradientSumT));
+      }
+
+      const RowSetCollection::Elem& rows = row_indices[node];
+      const size_t nrows = rows.Size();
+      const size_t istart = (item - item_ptr[node]) * block_size;
+      const size_t irow_end = std::min(istart + block_size, nrows);
+      const size_t prefetch_end = nrows - std::min(no_prefetch_size, nrows);
+      BuildHistBlock(rows.begin, istart, irow_end, prefetch_end, prefetch_offset, gmat, pgh,
+                     out);
+    }
+  }
+
+  // single reduction of the buffers into the histograms they belong to
+  std::vector<size_t> buffer_threads;
+  for (size_t tid = 0; tid < nthread_to_process; ++tid) {
+    if (buffered[tid]) {
+      buffer_threads.push_back(tid);
+    }
+  }
+  if (buffer_threads.empty()) {
+    return;
+  }
+  const size_t size = 2 * nbins_;
+  const size_t reduce_block_size = 1024;
+  const size_t n_blocks = (size + reduce_block_size - 1) / reduce_block_size;
+  const GradientSumT* data = reinterpret_cast<const GradientSumT*>(data_.data());
+
+#pragma omp parallel for num_threads(std::min(static_cast<size_t>(nthread_), n_blocks)) \
+    schedule(static)
+  for (bst_omp_uint iblock = 0; iblock < n_blocks; iblock++) {
+    const size_t istart = iblock * reduce_block_size;
+    const size_t iend = std::min(istart + reduce_block_size, size);
+    for (size_t tid : buffer_threads) {
+      GradientSumT* hist_data = reinterpret_cast<GradientSumT*>(hists[first_node[tid]].data());
+      const GradientSumT* buffer = data + 2 * tid * nbins_;
+      for (size_t i = istart; i < iend; ++i) {
+        hist_data[i] += buffer[i];
+      }
+    }
+  }
+}
+
+template <typename GradientSumT>
+void GHistBuilder<GradientSumT>::BuildBlockHist(const std::vector<GradientPair>& gpair,
+                                                const RowSetCollection::Elem row_indices,
+                                                const GHistIndexBlockMatrix& gmatb,
+                                                GHistRow<GradientSumT> hist) {
   constexpr int kUnroll = 8;  // loop unrolling factor
   const size_t nblock = gmatb.GetNumBlock();
   const size_t nrows = row_indices.end - row_indices.begin;
@@ -599,7 +843,7 @@ void GHistBuilder::BuildBlockHist(const std::vector<GradientPair>& gpair,
 #if defined(_OPENMP)
   const auto nthread = static_cast<bst_omp_uint>(this->nthread_);  // NOLINT
 #endif  // defined(_OPENMP)
-  tree::GradStats* p_hist = hist.data();
+  GHistEntry<GradientSumT>* p_hist = hist.data();
 
 #pragma omp parallel for num_threads(nthread) schedule(guided)
   for (bst_omp_uint bid = 0; bid < nblock; ++bid) {
@@ -637,7 +881,10 @@ void GHistBuilder::BuildBlockHist(const std::vector<GradientPair>& gpair,
   }
 }
 
-void GHistBuilder::SubtractionTrick(GHistRow self, GHistRow sibling, GHistRow parent) {
+template <typename GradientSumT>
+void GHistBuilder<GradientSumT>::SubtractionTrick(GHistRow<GradientSumT> self,
+                                                  GHistRow<GradientSumT> sibling,
+                                                  GHistRow<GradientSumT> parent) {
   const uint32_t nbins = static_cast<bst_omp_uint>(nbins_);
   constexpr int kUnroll = 8;  // loop unrolling factor
   const uint32_t rest = nbins % kUnroll;
@@ -645,15 +892,15 @@ void GHistBuilder::SubtractionTrick(GHistRow self, GHistRow sibling, GHistRow pa
 #if defined(_OPENMP)
   const auto nthread = static_cast<bst_omp_uint>(this->nthread_);  // NOLINT
 #endif  // defined(_OPENMP)
-  tree::GradStats* p_self = self.data();
-  tree::GradStats* p_sibling = sibling.data();
-  tree::GradStats* p_parent = parent.data();
+  GHistEntry<GradientSumT>* p_self = self.data();
+  GHistEntry<GradientSumT>* p_sibling = sibling.data();
+  GHistEntry<GradientSumT>* p_parent = parent.data();
 
 #pragma omp parallel for num_threads(nthread) schedule(static)
   for (bst_omp_uint bin_id = 0;
        bin_id < static_cast<bst_omp_uint>(nbins - rest); bin_id += kUnroll) {
-    tree::GradStats pb[kUnroll];
-    tree::GradStats sb[kUnroll];
+    GHistEntry<GradientSumT> pb[kUnroll];
+    GHistEntry<GradientSumT> sb[kUnroll];
     for (int k = 0; k < kUnroll; ++k) {
       pb[k] = p_parent[bin_id + k];
     }
@@ -669,5 +916,8 @@ void GHistBuilder::SubtractionTrick(GHistRow self, GHistRow sibling, GHistRow pa
   }
 }
 
+template class GHistBuilder<float>;
+template class GHistBuilder<double>;
+
 }  // namespace common
 }  // namespace xgboost
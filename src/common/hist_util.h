@@ -9,7 +9,10 @@
 
 #include <xgboost/data.h>
 #include <xgboost/generic_parameters.h>
+#include <algorithm>
 #include <limits>
+#include <numeric>
+#include <utility>
 #include <vector>
 #include "row_set.h"
 #include "../tree/param.h"
@@ -33,7 +36,7 @@ struct SimpleArray {
 
   void resize(size_t n) {
     T* ptr = static_cast<T*>(malloc(n*sizeof(T)));
-    memcpy(ptr, ptr_, n_ * sizeof(T));
+    memcpy(ptr, ptr_, std::min(n, n_) * sizeof(T));
     free(ptr_);
     ptr_ = ptr;
     n_ = n;
@@ -121,11 +124,108 @@ size_t DeviceSketch
   (const tree::TrainParam& param, const LearnerTrainParam &learner_param, int gpu_batch_nrows,
    DMatrix* dmat, HistCutMatrix* hmat);
 
+/*! \brief size in bytes of the unsigned integers a bin index is stored in */
+enum BinTypeSize {
+  kUint8BinsTypeSize = 1,
+  kUint16BinsTypeSize = 2,
+  kUint32BinsTypeSize = 4
+};
+
+/*! \brief narrowest bin type holding values up to max_value */
+inline BinTypeSize NarrowestBinType(uint32_t max_value) {
+  if (max_value <= std::numeric_limits<uint8_t>::max()) {
+    return kUint8BinsTypeSize;
+  } else if (max_value <= std::numeric_limits<uint16_t>::max()) {
+    return kUint16BinsTypeSize;
+  }
+  return kUint32BinsTypeSize;
+}
+
 /*!
- * \brief A single row in global histogram index.
- *  Directly represent the global index in the histogram entry.
+ * \brief bin ids of a quantized matrix stored in the narrowest unsigned
+ *  integer type holding them.
+ *
+ *  Without offsets every entry is a global bin id.  With offsets, used when
+ *  each row holds every feature once, entry i stores the bin local to
+ *  feature i % offsets.size() and the global bin id adds the first bin of the
+ *  feature, so 256 bins per feature fit in a byte.
  */
-using GHistIndexRow = Span<uint32_t const>;
+class BinIndex {
+ public:
+  /*! \brief reset to empty storage of the given width */
+  void Init(BinTypeSize type, std::vector<uint32_t> offsets) {
+    type_ = type;
+    offsets_ = std::move(offsets);
+    data_.clear();
+  }
+  /*! \brief resize to n entries, keeping the existing ones */
+  void Resize(size_t n) { data_.resize(n * type_); }
+  size_t Size() const { return data_.size() / type_; }
+  BinTypeSize GetBinTypeSize() const { return type_; }
+  /*! \brief whether entries are local to their feature */
+  bool IsDense() const { return !offsets_.empty(); }
+  /*! \brief number of entries per row, 0 unless IsDense() */
+  size_t NumFeatures() const { return offsets_.size(); }
+  /*! \brief first global bin of each feature, nullptr unless IsDense() */
+  const uint32_t* Offsets() const { return offsets_.empty() ? nullptr : offsets_.data(); }
+  /*! \brief stored values, T must match GetBinTypeSize() */
+  template <typename T>
+  const T* Data() const {
+    CHECK_EQ(sizeof(T), static_cast<size_t>(type_));
+    return reinterpret_cast<const T*>(data_.data());
+  }
+  /*! \brief global bin id of entry i */
+  uint32_t operator[](size_t i) const {
+    uint32_t bin;
+    switch (type_) {
+      case kUint8BinsTypeSize:
+        bin = data_[i];
+        break;
+      case kUint16BinsTypeSize:
+        bin = reinterpret_cast<const uint16_t*>(data_.data())[i];
+        break;
+      default:
+        bin = reinterpret_cast<const uint32_t*>(data_.data())[i];
+    }
+    return offsets_.empty() ? bin : bin + offsets_[i % offsets_.size()];
+  }
+  /*! \brief store global bin id `bin` as entry i */
+  void Set(size_t i, uint32_t bin) {
+    if (!offsets_.empty()) {
+      bin -= offsets_[i % offsets_.size()];
+    }
+    switch (type_) {
+      case kUint8BinsTypeSize:
+        data_[i] = static_cast<uint8_t>(bin);
+        break;
+      case kUint16BinsTypeSize:
+        reinterpret_cast<uint16_t*>(data_.data())[i] = static_cast<uint16_t>(bin);
+        break;
+      default:
+        reinterpret_cast<uint32_t*>(data_.data())[i] = bin;
+    }
+  }
+  /*!
+   * \brief store global bin ids of the given width from now on, keeping the
+   *  first n entries and the size.
+   */
+  void ToGlobal(BinTypeSize type, size_t n) {
+    BinIndex global;
+    global.Init(type, {});
+    global.Resize(Size());
+    for (size_t i = 0; i < n; ++i) {
+      global.Set(i, (*this)[i]);
+    }
+    *this = std::move(global);
+  }
+  /*! \brief bytes used by the stored values */
+  size_t MemCostBytes() const { return data_.size(); }
+
+ private:
+  std::vector<uint8_t> data_;
+  std::vector<uint32_t> offsets_;
+  BinTypeSize type_{kUint32BinsTypeSize};
+};
 
 /*!
  * \brief preprocessed global index matrix, in CSR format
@@ -136,19 +236,13 @@ struct GHistIndexMatrix {
   /*! \brief row pointer to rows by element position */
   std::vector<size_t> row_ptr;
   /*! \brief The index data */
-  std::vector<uint32_t> index;
+  BinIndex index;
   /*! \brief hit count of each index */
   std::vector<size_t> hit_count;
   /*! \brief The corresponding cuts */
   HistCutMatrix cut;
   // Create a global histogram matrix, given cut
   void Init(DMatrix* p_fmat, int max_num_bins);
-  // get i-th row
-  inline GHistIndexRow operator[](size_t i) const {
-    return {&index[0] + row_ptr[i],
-            static_cast<GHistIndexRow::index_type>(
-                row_ptr[i + 1] - row_ptr[i])};
-  }
   inline void GetFeatureCounts(size_t* counts) const {
     auto nfeature = cut.row_ptr.size() - 1;
     for (unsigned fid = 0; fid < nfeature; ++fid) {
@@ -201,66 +295,131 @@ class GHistIndexBlockMatrix {
   std::vector<Block> blocks_;
 };
 
+/*!
+ * \brief gradient statistics of a histogram bin, summed in GradientSumT.
+ *  With float, bins take half the memory and allreduce traffic of double;
+ *  node totals are still kept in tree::GradStats.
+ */
+template <typename GradientSumT>
+struct GHistEntry {
+  /*! \brief sum gradient statistics */
+  GradientSumT sum_grad;
+  /*! \brief sum hessian statistics */
+  GradientSumT sum_hess;
+
+  GHistEntry() : sum_grad{0}, sum_hess{0} {}
+
+  double GetGrad() const { return sum_grad; }
+  double GetHess() const { return sum_hess; }
+
+  inline void Add(GradientPair p) {
+    sum_grad += p.GetGrad();
+    sum_hess += p.GetHess();
+  }
+  /*! \brief set current value to a - b */
+  inline void SetSubstract(const GHistEntry& a, const GHistEntry& b) {
+    sum_grad = a.sum_grad - b.sum_grad;
+    sum_hess = a.sum_hess - b.sum_hess;
+  }
+  /*! \brief used in All Reduce */
+  inline static void Reduce(GHistEntry& a, const GHistEntry& b) { // NOLINT(*)
+    a.sum_grad += b.sum_grad;
+    a.sum_hess += b.sum_hess;
+  }
+};
+
 /*!
  * \brief histogram of graident statistics for a single node.
- *  Consists of multiple GradStats, each entry showing total graident statistics
+ *  Consists of multiple GHistEntry, each entry showing total graident statistics
  *     for that particular bin
  *  Uses global bin id so as to represent all features simultaneously
  */
-using GHistRow = Span<tree::GradStats>;
+template <typename GradientSumT>
+using GHistRow = Span<GHistEntry<GradientSumT>>;
 
 /*!
- * \brief histogram of gradient statistics for multiple nodes
+ * \brief histogram of gradient statistics for multiple nodes.
+ *  Each histogram lives in its own slot, so adding one never moves the others,
+ *  and the slot of a released histogram is reused by the next one added.
  */
+template <typename GradientSumT>
 class HistCollection {
  public:
   // access histogram for i-th node
-  GHistRow operator[](bst_uint nid) const {
+  GHistRow<GradientSumT> operator[](bst_uint nid) const {
     constexpr uint32_t kMax = std::numeric_limits<uint32_t>::max();
-    CHECK_NE(row_ptr_[nid], kMax);
-    tree::GradStats* ptr =
-        const_cast<tree::GradStats*>(dmlc::BeginPtr(data_) + row_ptr_[nid]);
+    CHECK_NE(slot_of_node_[nid], kMax);
+    GHistEntry<GradientSumT>* ptr = const_cast<GHistEntry<GradientSumT>*>(
+        dmlc::BeginPtr(slots_[slot_of_node_[nid]]));
     return {ptr, nbins_};
   }
 
   // have we computed a histogram for i-th node?
   bool RowExists(bst_uint nid) const {
     const uint32_t k_max = std::numeric_limits<uint32_t>::max();
-    return (nid < row_ptr_.size() && row_ptr_[nid] != k_max);
+    return (nid < slot_of_node_.size() && slot_of_node_[nid] != k_max);
   }
 
   // initialize histogram collection
   void Init(uint32_t nbins) {
+    if (nbins != nbins_) {
+      slots_.clear();
+    }
     nbins_ = nbins;
-    row_ptr_.clear();
-    data_.clear();
+    slot_of_node_.clear();
+    free_slots_.resize(slots_.size());
+    std::iota(free_slots_.rbegin(), free_slots_.rend(), 0);
   }
 
   // create an empty histogram for i-th node
   void AddHistRow(bst_uint nid) {
     constexpr uint32_t kMax = std::numeric_limits<uint32_t>::max();
-    if (nid >= row_ptr_.size()) {
-      row_ptr_.resize(nid + 1, kMax);
+    if (nid >= slot_of_node_.size()) {
+      slot_of_node_.resize(nid + 1, kMax);
+    }
+    CHECK_EQ(slot_of_node_[nid], kMax);
+
+    if (free_slots_.empty()) {
+      slot_of_node_[nid] = static_cast<uint32_t>(slots_.size());
+      slots_.emplace_back(nbins_);
+    } else {
+      slot_of_node_[nid] = free_slots_.back();
+      free_slots_.pop_back();
+      std::vector<GHistEntry<GradientSumT>>& slot = slots_[slot_of_node_[nid]];
+      std::fill(slot.begin(), slot.end(), GHistEntry<GradientSumT>());
     }
-    CHECK_EQ(row_ptr_[nid], kMax);
+  }
 
-    row_ptr_[nid] = data_.size();
-    data_.resize(data_.size() + nbins_);
+  // release the histogram of i-th node, its slot is reused by the next AddHistRow
+  void ReleaseHistRow(bst_uint nid) {
+    constexpr uint32_t kMax = std::numeric_limits<uint32_t>::max();
+    CHECK(RowExists(nid));
+    free_slots_.push_back(slot_of_node_[nid]);
+    slot_of_node_[nid] = kMax;
   }
 
+  // number of histograms held
+  size_t NumRows() const { return slots_.size() - free_slots_.size(); }
+
+  // bytes taken by a single histogram
+  size_t RowBytes() const { return nbins_ * sizeof(GHistEntry<GradientSumT>); }
+
  private:
   /*! \brief number of all bins over all features */
-  uint32_t nbins_;
+  uint32_t nbins_{0};
 
-  std::vector<tree::GradStats> data_;
+  std::vector<std::vector<GHistEntry<GradientSumT>>> slots_;
+  /*! \brief slots not holding a histogram */
+  std::vector<uint32_t> free_slots_;
 
-  /*! \brief row_ptr_[nid] locates bin for historgram of node nid */
-  std::vector<size_t> row_ptr_;
+  /*! \brief slot_of_node_[nid] locates the historgram of node nid in slots_ */
+  std::vector<uint32_t> slot_of_node_;
 };
 
 /*!
  * \brief builder for histograms of gradient statistics
  */
+template <typename GradientSumT>
 class GHistBuilder {
  public:
   // initialize builder
@@ -274,14 +433,22 @@ class GHistBuilder {
   void BuildHist(const std::vector<GradientPair>& gpair,
                  const RowSetCollection::Elem row_indices,
                  const GHistIndexMatrix& gmat,
-                 GHistRow hist);
-  // same, with feature grouping
+                 GHistRow<GradientSumT> hist);
+  // construct the histograms of several nodes in a single pass, hists[i] from the
+  // rows row_indices[i]
+  void BuildHists(const std::vector<GradientPair>& gpair,
+                  const std::vector<RowSetCollection::Elem>& row_indices,
+                  const GHistIndexMatrix& gmat,
+                  const std::vector<GHistRow<GradientSumT>>& hists);
+  // same as BuildHist, with feature grouping
   void BuildBlockHist(const std::vector<GradientPair>& gpair,
                       const RowSetCollection::Elem row_indices,
                       const GHistIndexBlockMatrix& gmatb,
-                      GHistRow hist);
+                      GHistRow<GradientSumT> hist);
   // construct a histogram via subtraction trick
-  void SubtractionTrick(GHistRow self, GHistRow sibling, GHistRow parent);
+  void SubtractionTrick(GHistRow<GradientSumT> self,
+                        GHistRow<GradientSumT> sibling,
+                        GHistRow<GradientSumT> parent);
 
   uint32_t GetNumBins() {
       return nbins_;
@@ -293,7 +460,7 @@ class GHistBuilder {
   /*! \brief number of all bins over all features */
   uint32_t nbins_;
   std::vector<size_t> thread_init_;
-  std::vector<tree::GradStats> data_;
+  std::vector<GHistEntry<GradientSumT>> data_;
 };
 
 
@@ -10,8 +10,20 @@
 
 #include <dmlc/io.h>
 #include <rabit/rabit.h>
-#include <string>
+#include <xgboost/logging.h>
+
+#include <cstdint>
 #include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif  // defined(__unix__) || defined(__APPLE__)
 
 namespace xgboost {
 namespace common {
@@ -70,6 +82,80 @@ class PeekableInStream : public dmlc::Stream {
   /*! \brief internal buffer */
   std::string buffer_;
 };
+
+/*! \brief alignment of the sections of an image used in place from memory */
+constexpr size_t kImageAlignment = 64;
+
+/*! \brief pad an image with zeros so the next section is aligned */
+inline void AlignImage(std::string* image) {
+  image->resize((image->size() + kImageAlignment - 1) / kImageAlignment *
+                kImageAlignment, '\0');
+}
+
+/*!
+ * \brief Read-only view of a whole file.
+ *
+ *  The file is mapped into memory where mmap is available, so the pages are
+ *  loaded on demand and shared with every other process mapping the same
+ *  file.  Elsewhere the file is read into an aligned private buffer.
+ */
+class MappedFile {
+ public:
+  explicit MappedFile(const std::string& fname) {
+#if defined(__unix__) || defined(__APPLE__)
+    int fd = open(fname.c_str(), O_RDONLY);
+    CHECK_GE(fd, 0) << "Failed to open " << fname;
+    // the mapping outlives the descriptor, which is closed before any check
+    struct stat st;
+    const int stat_ret = fstat(fd, &st);
+    void* ptr = MAP_FAILED;
+    if (stat_ret == 0 && st.st_size != 0) {
+      ptr = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    CHECK_EQ(stat_ret, 0) << "Failed to stat " << fname;
+    size_ = static_cast<size_t>(st.st_size);
+    if (size_ != 0) {
+      CHECK(ptr != MAP_FAILED) << "Failed to map " << fname;
+      data_ = static_cast<const char*>(ptr);
+    }
+#else
+    std::unique_ptr<dmlc::Stream> fi(dmlc::Stream::Create(fname.c_str(), "r"));
+    std::string buffer;
+    char chunk[1 << 16];
+    size_t nread;
+    while ((nread = fi->Read(chunk, sizeof(chunk))) != 0) {
+      buffer.append(chunk, nread);
+    }
+    size_ = buffer.size();
+    buffer_.resize(size_ + kImageAlignment);
+    const auto addr = reinterpret_cast<uintptr_t>(buffer_.data());
+    char* aligned = buffer_.data() + (kImageAlignment - addr % kImageAlignment) % kImageAlignment;
+    std::memcpy(aligned, buffer.data(), size_);
+    data_ = aligned;
+#endif  // defined(__unix__) || defined(__APPLE__)
+  }
+  ~MappedFile() {
+#if defined(__unix__) || defined(__APPLE__)
+    if (data_ != nullptr) {
+      munmap(const_cast<char*>(data_), size_);
+    }
+#endif  // defined(__unix__) || defined(__APPLE__)
+  }
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  /*! \brief first byte of the file, aligned to at least kImageAlignment */
+  const char* Data() const { return data_; }
+  /*! \brief size of the file in bytes */
+  size_t Size() const { return size_; }
+
+ private:
+  const char* data_{nullptr};
+  size_t size_{0};
+  // storage of the file where it can't be mapped
+  std::vector<char> buffer_;
+};
 }  // namespace common
 }  // namespace xgboost
 #endif  // XGBOOST_COMMON_IO_H_
@@ -174,6 +174,7 @@ class GBLinear : public GradientBooster {
      std::fill(contribs.begin(), contribs.end(), 0);
   }
 
+  using GradientBooster::DumpModel;
   std::vector<std::string> DumpModel(const FeatureMap& fmap,
                                      bool with_stats,
                                      std::string format) const override {
@@ -18,13 +18,19 @@
 #include <string>
 #include <limits>
 #include <algorithm>
+#include <cstring>
+#include <unordered_map>
 
 #include "../common/common.h"
 #include "../common/host_device_vector.h"
+#include "../common/io.h"
 #include "../common/random.h"
 #include "gbtree.h"
 #include "gbtree_model.h"
 #include "../common/timer.h"
+#include "../predictor/binned_forest.h"
+#include "../predictor/compiled_forest.h"
+#include "../predictor/compressed_forest.h"
 
 
 namespace xgboost {
@@ -43,6 +49,7 @@ void GBTree::Configure(const std::vector<std::pair<std::string, std::string> >&
 
   // for the 'update' process_type, move trees into trees_to_update
   if (tparam_.process_type == TreeProcessType::kUpdate) {
+    this->CheckNotMapped("Updating trees");
     model_.InitTreesToUpdate();
   }
 
@@ -141,6 +148,7 @@ void GBTree::ConfigureUpdaters(const std::map<std::string, std::string>& cfg) {
 void GBTree::DoBoost(DMatrix* p_fmat,
                      HostDeviceVector<GradientPair>* in_gpair,
                      ObjFunction* obj) {
+  this->CheckNotMapped("Training");
   std::string updater_seq = tparam_.updater_seq;
   this->PerformTreeMethodHeuristic(p_fmat, {this->cfg_.begin(), this->cfg_.end()});
   this->ConfigureUpdaters({this->cfg_.begin(), this->cfg_.end()});
@@ -233,12 +241,83 @@ void GBTree::CommitModel(std::vector<std::vector<std::unique_ptr<RegTree>>>&& ne
   predictor_->UpdatePredictionCache(model_, &updaters_, num_new_trees);
 }
 
+void GBTree::SaveImage(std::string* image) const {
+  CHECK_EQ(image->size() % common::kImageAlignment, 0);
+  GBTreeModelParam param = model_.param;
+  param.num_trees = static_cast<int>(model_.NumTrees());
+  image->append(reinterpret_cast<const char*>(&param), sizeof(param));
+  image->append(reinterpret_cast<const char*>(model_.tree_info.data()),
+                model_.tree_info.size() * sizeof(int));
+  common::AlignImage(image);
+  if (model_.mapped_forest != nullptr) {
+    model_.mapped_forest->SaveImage(image);
+  } else {
+    // images are written for serving, lay the hot paths out contiguously
+    predictor::CompiledForest forest;
+    forest.Init(model_, predictor::NodeLayout::kHotPath);
+    forest.SaveImage(image);
+  }
+}
+
+void GBTree::SaveBinnedForest(DMatrix* dmat, int max_bin, dmlc::Stream* fo) const {
+  this->CheckNotMapped("Binning the model");
+  // the cuts tree_method=hist builds from the same matrix
+  common::HistCutMatrix cut;
+  cut.Init(dmat, static_cast<uint32_t>(max_bin));
+  predictor::BinnedForest forest;
+  forest.Init(model_, cut);
+  forest.Save(fo);
+}
+
+void GBTree::SaveCompressedForest(int leaf_format, bst_float max_leaf_error,
+                                  DMatrix* dvalid, dmlc::Stream* fo,
+                                  predictor::CompressionReport* out_report) const {
+  this->CheckNotMapped("Compressing the model");
+  CHECK(leaf_format >= static_cast<int>(predictor::LeafFormat::kUInt8) &&
+        leaf_format <= static_cast<int>(predictor::LeafFormat::kFloat32))
+      << "Unknown leaf format " << leaf_format;
+  predictor::CompressedForest forest;
+  forest.Init(model_, static_cast<predictor::LeafFormat>(leaf_format), max_leaf_error);
+  *out_report = forest.Report(model_, dvalid);
+  forest.Save(fo);
+}
+
+void GBTree::LoadImage(const char* data, size_t size) {
+  GBTreeModelParam param;
+  CHECK_GE(size, sizeof(param)) << "GBTree: invalid model image";
+  std::memcpy(&param, data, sizeof(param));
+  CHECK_GE(param.num_trees, 0) << "GBTree: invalid model image";
+  size_t offset = sizeof(param);
+  const size_t info_bytes = static_cast<size_t>(param.num_trees) * sizeof(int);
+  CHECK_LE(offset + info_bytes, size) << "GBTree: invalid model image";
+  std::vector<int> tree_info(param.num_trees);
+  std::memcpy(tree_info.data(), data + offset, info_bytes);
+  offset = (offset + info_bytes + common::kImageAlignment - 1) /
+           common::kImageAlignment * common::kImageAlignment;
+  CHECK_LE(offset, size) << "GBTree: invalid model image";
+  auto forest = std::make_shared<predictor::CompiledForest>();
+  forest->InitFromImage(data + offset, size - offset);
+  CHECK_EQ(forest->NumTrees(), tree_info.size()) << "GBTree: invalid model image";
+  CHECK_EQ(forest->NumGroups(), param.num_output_group) << "GBTree: invalid model image";
+  model_.SetMappedForest(param, std::move(tree_info), std::move(forest));
+
+  this->cfg_.clear();
+  this->cfg_.emplace_back(std::string("num_feature"),
+                          common::ToString(model_.param.num_feature));
+}
+
 
 // dart
 class Dart : public GBTree {
  public:
   explicit Dart(bst_float base_margin) : GBTree(base_margin) {}
 
+  void InitDartCache(const std::vector<std::shared_ptr<DMatrix> > &cache) {
+    for (const auto& d : cache) {
+      dart_cache_[d.get()].data = d;
+    }
+  }
+
   void Configure(const std::vector<std::pair<std::string, std::string> >& cfg) override {
     GBTree::Configure(cfg);
     if (model_.trees.size() == 0) {
@@ -266,6 +345,11 @@ class Dart : public GBTree {
                     HostDeviceVector<bst_float>* out_preds,
                     unsigned ntree_limit) override {
     DropTrees(ntree_limit);
+    auto it = dart_cache_.find(p_fmat);
+    if (ntree_limit == 0 && it != dart_cache_.end()) {
+      PredictFromCache(p_fmat, &it->second, &out_preds->HostVector());
+      return;
+    }
     PredLoopInternal<Dart>(p_fmat, &out_preds->HostVector(), 0, ntree_limit, true);
   }
 
@@ -295,6 +379,64 @@ class Dart : public GBTree {
     return false;
   }
 
+  void SaveImage(std::string* image) const override {
+    LOG(FATAL) << "Saving a model image is not supported by dart booster.";
+  }
+
+  void LoadImage(const char* data, size_t size) override {
+    LOG(FATAL) << "Loading a model image is not supported by dart booster.";
+  }
+
+  std::string GenerateSource(unsigned ntree_limit) const override {
+    LOG(FATAL) << "Source generation is not supported by dart booster.";
+    return "";
+  }
+
+  void SaveBinnedForest(DMatrix* dmat, int max_bin, dmlc::Stream* fo) const override {
+    LOG(FATAL) << "Binned forests are not supported by dart booster.";
+  }
+
+  void SaveCompressedForest(int leaf_format, bst_float max_leaf_error,
+                            DMatrix* dvalid, dmlc::Stream* fo,
+                            predictor::CompressionReport* out_report) const override {
+    LOG(FATAL) << "Compressed forests are not supported by dart booster.";
+  }
+
+  void PredictCombined(DMatrix* p_fmat, CombinedPrediction* out,
+                       unsigned ntree_limit) override {
+    LOG(FATAL) << "Combined prediction is not supported by dart booster.";
+  }
+
+  unsigned PredictStaged(DMatrix* p_fmat,
+                         HostDeviceVector<bst_float>* out_preds,
+                         unsigned ntree_limit) override {
+    LOG(FATAL) << "Staged prediction is not supported by dart booster.";
+    return 0;
+  }
+
+  void PredictCascade(DMatrix* p_fmat, bst_float margin_threshold,
+                      HostDeviceVector<bst_float>* out_preds,
+                      std::vector<unsigned>* out_ntrees,
+                      unsigned ntree_limit) override {
+    LOG(FATAL) << "Cascaded prediction is not supported by dart booster.";
+  }
+
+  void PredictContributionSparse(DMatrix* p_fmat,
+                                 std::vector<size_t>* out_indptr,
+                                 std::vector<unsigned>* out_index,
+                                 std::vector<bst_float>* out_values,
+                                 std::vector<bst_float>* out_bias,
+                                 unsigned ntree_limit, bool approximate) override {
+    LOG(FATAL) << "Sparse contributions are not supported by dart booster.";
+  }
+
+  void PredictInteractionTopK(DMatrix* p_fmat, unsigned top_k,
+                              std::vector<bst_float>* out_values,
+                              std::vector<unsigned>* out_index,
+                              unsigned ntree_limit, bool approximate) override {
+    LOG(FATAL) << "Top-k interactions are not supported by dart booster.";
+  }
+
  protected:
   friend class GBTree;
   // internal prediction loop
@@ -390,6 +532,90 @@ class Dart : public GBTree {
     }
   }
 
+  /*!
+   * \brief margin of a cached matrix with every tree at the weight it had when
+   *  last added, so a prediction only evaluates the trees dropped or re-weighted
+   *  since instead of the whole ensemble.
+   */
+  struct CacheEntry {
+    std::shared_ptr<DMatrix> data;
+    // prefix revision of the model the margin was built for
+    uint64_t revision{0};
+    // weight of each tree included in the margin
+    std::vector<bst_float> weights;
+    std::vector<bst_float> margin;
+  };
+
+  // predict all trees but the dropped ones from the cached margin of the matrix
+  void PredictFromCache(DMatrix* p_fmat, CacheEntry* entry,
+                        std::vector<bst_float>* out_preds) {
+    const size_t n = model_.param.num_output_group * p_fmat->Info().num_row_;
+    if (entry->revision != model_.PrefixRevision() || entry->margin.size() != n) {
+      entry->revision = model_.PrefixRevision();
+      PredLoopInternal<Dart>(p_fmat, &entry->margin, 0, 0, true);
+      // the loop skips dropped trees, add them back
+      entry->weights = weight_drop_;
+      AddTrees(p_fmat, idx_drop_, false, &entry->margin);
+    } else {
+      // bring the margin up to date with the trees re-weighted by the last
+      // commits and the trees committed since
+      std::vector<size_t> changed;
+      std::vector<bst_float> delta;
+      for (size_t i = 0; i < weight_drop_.size(); ++i) {
+        const bst_float weight = i < entry->weights.size() ? entry->weights[i] : 0.0f;
+        if (weight != weight_drop_[i]) {
+          changed.push_back(i);
+          delta.push_back(weight_drop_[i] - weight);
+        }
+      }
+      entry->weights = weight_drop_;
+      AddTrees(p_fmat, changed, delta, &entry->margin);
+    }
+    *out_preds = entry->margin;
+    AddTrees(p_fmat, idx_drop_, true, out_preds);
+  }
+
+  // add (or subtract) the weighted predictions of the given trees
+  void AddTrees(DMatrix* p_fmat, const std::vector<size_t>& trees, bool subtract,
+                std::vector<bst_float>* out_preds) {
+    std::vector<bst_float> delta(trees.size());
+    for (size_t k = 0; k < trees.size(); ++k) {
+      delta[k] = subtract ? -weight_drop_[trees[k]] : weight_drop_[trees[k]];
+    }
+    AddTrees(p_fmat, trees, delta, out_preds);
+  }
+
+  // add delta[k] times the prediction of tree trees[k] to out_preds
+  void AddTrees(DMatrix* p_fmat, const std::vector<size_t>& trees,
+                const std::vector<bst_float>& delta,
+                std::vector<bst_float>* out_preds) {
+    if (trees.empty()) {
+      return;
+    }
+    const MetaInfo& info = p_fmat->Info();
+    const int num_group = model_.param.num_output_group;
+    InitThreadTemp(omp_get_max_threads());
+    std::vector<bst_float>& preds = *out_preds;
+    for (const auto &batch : p_fmat->GetRowBatches()) {
+      const auto nsize = static_cast<bst_omp_uint>(batch.Size());
+      #pragma omp parallel for schedule(static)
+      for (bst_omp_uint i = 0; i < nsize; ++i) {
+        RegTree::FVec& feats = thread_temp_[omp_get_thread_num()];
+        const auto ridx = static_cast<size_t>(batch.base_rowid + i);
+        const unsigned root_index = info.GetRoot(ridx);
+        const SparsePage::Inst inst = batch[i];
+        feats.Fill(inst);
+        for (size_t k = 0; k < trees.size(); ++k) {
+          const RegTree& tree = *model_.trees[trees[k]];
+          const int tid = tree.GetLeafIndex(feats, root_index);
+          preds[ridx * num_group + model_.tree_info[trees[k]]] +=
+              delta[k] * tree[tid].LeafValue();
+        }
+        feats.Drop(inst);
+      }
+    }
+  }
+
   // commit new trees all at once
   void
   CommitModel(std::vector<std::vector<std::unique_ptr<RegTree>>>&& new_trees) override {
@@ -525,6 +751,8 @@ class Dart : public GBTree {
   std::vector<size_t> idx_drop_;
   // temporal storage for per thread
   std::vector<RegTree::FVec> thread_temp_;
+  // margins of the cached matrices
+  std::unordered_map<DMatrix*, CacheEntry> dart_cache_;
 };
 
 // register the objective functions
@@ -542,7 +770,8 @@ XGBOOST_REGISTER_GBM(GBTree, "gbtree")
 XGBOOST_REGISTER_GBM(Dart, "dart")
 .describe("Tree booster, dart.")
 .set_body([](const std::vector<std::shared_ptr<DMatrix> >& cached_mats, bst_float base_margin) {
-    GBTree* p = new Dart(base_margin);
+    auto* p = new Dart(base_margin);
+    p->InitDartCache(cached_mats);
     return p;
   });
 }  // namespace gbm
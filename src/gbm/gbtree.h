@@ -186,9 +186,14 @@ class GBTree : public GradientBooster {
   }
 
   void Save(dmlc::Stream* fo) const override {
+    this->CheckNotMapped("Saving the model in binary format");
     model_.Save(fo);
   }
 
+  void SaveImage(std::string* image) const override;
+
+  void LoadImage(const char* data, size_t size) override;
+
   bool AllowLazyCheckPoint() const override {
     return model_.param.num_output_group == 1 ||
         tparam_.updater_seq.find("distcol") != std::string::npos;
@@ -197,6 +202,7 @@ class GBTree : public GradientBooster {
   void PredictBatch(DMatrix* p_fmat,
                HostDeviceVector<bst_float>* out_preds,
                unsigned ntree_limit) override {
+    this->CheckMappedPredictor();
     predictor_->PredictBatch(p_fmat, out_preds, model_, 0, ntree_limit);
   }
 
@@ -204,6 +210,7 @@ class GBTree : public GradientBooster {
                std::vector<bst_float>* out_preds,
                unsigned ntree_limit,
                unsigned root_index) override {
+    this->CheckMappedPredictor();
     predictor_->PredictInstance(inst, out_preds, model_,
                                ntree_limit, root_index);
   }
@@ -211,30 +218,106 @@ class GBTree : public GradientBooster {
   void PredictLeaf(DMatrix* p_fmat,
                    std::vector<bst_float>* out_preds,
                    unsigned ntree_limit) override {
+    this->CheckMappedPredictor();
     predictor_->PredictLeaf(p_fmat, out_preds, model_, ntree_limit);
   }
 
+  void PredictCombined(DMatrix* p_fmat, CombinedPrediction* out,
+                       unsigned ntree_limit) override {
+    this->CheckNotMapped("Combined prediction");
+    predictor_->PredictCombined(p_fmat, out, model_, ntree_limit);
+  }
+
+  unsigned PredictStaged(DMatrix* p_fmat,
+                         HostDeviceVector<bst_float>* out_preds,
+                         unsigned ntree_limit) override {
+    this->CheckNotMapped("Staged prediction");
+    return predictor_->PredictStaged(p_fmat, out_preds, model_, ntree_limit);
+  }
+
+  void PredictCascade(DMatrix* p_fmat, bst_float margin_threshold,
+                      HostDeviceVector<bst_float>* out_preds,
+                      std::vector<unsigned>* out_ntrees,
+                      unsigned ntree_limit) override {
+    this->CheckNotMapped("Cascaded prediction");
+    predictor_->PredictCascade(p_fmat, margin_threshold, out_preds, out_ntrees,
+                               model_, ntree_limit);
+  }
+
   void PredictContribution(DMatrix* p_fmat,
                            std::vector<bst_float>* out_contribs,
                            unsigned ntree_limit, bool approximate, int condition,
                            unsigned condition_feature) override {
+    this->CheckNotMapped("Feature contribution");
     predictor_->PredictContribution(p_fmat, out_contribs, model_, ntree_limit, approximate);
   }
 
+  void PredictContributionSparse(DMatrix* p_fmat,
+                                 std::vector<size_t>* out_indptr,
+                                 std::vector<unsigned>* out_index,
+                                 std::vector<bst_float>* out_values,
+                                 std::vector<bst_float>* out_bias,
+                                 unsigned ntree_limit, bool approximate) override {
+    this->CheckNotMapped("Feature contribution");
+    predictor_->PredictContributionSparse(p_fmat, out_indptr, out_index, out_values,
+                                          out_bias, model_, ntree_limit, approximate);
+  }
+
   void PredictInteractionContributions(DMatrix* p_fmat,
                                        std::vector<bst_float>* out_contribs,
                                        unsigned ntree_limit, bool approximate) override {
+    this->CheckNotMapped("Feature interaction");
     predictor_->PredictInteractionContributions(p_fmat, out_contribs, model_,
                                                ntree_limit, approximate);
   }
 
+  void PredictInteractionTopK(DMatrix* p_fmat, unsigned top_k,
+                              std::vector<bst_float>* out_values,
+                              std::vector<unsigned>* out_index,
+                              unsigned ntree_limit, bool approximate) override {
+    this->CheckNotMapped("Feature interaction");
+    predictor_->PredictInteractionTopK(p_fmat, top_k, out_values, out_index,
+                                       model_, ntree_limit, approximate);
+  }
+
   std::vector<std::string> DumpModel(const FeatureMap& fmap,
                                      bool with_stats,
                                      std::string format) const override {
+    this->CheckNotMapped("Dumping the model");
     return model_.DumpModel(fmap, with_stats, format);
   }
 
+  void DumpModel(const FeatureMap& fmap,
+                 bool with_stats,
+                 std::string format,
+                 const std::function<void(size_t, const std::string&)>& fn) const override {
+    this->CheckNotMapped("Dumping the model");
+    model_.DumpModel(fmap, with_stats, format, fn);
+  }
+
+  std::string GenerateSource(unsigned ntree_limit) const override {
+    this->CheckNotMapped("Source generation");
+    return model_.GenerateSource(ntree_limit);
+  }
+
+  void SaveBinnedForest(DMatrix* dmat, int max_bin, dmlc::Stream* fo) const override;
+
+  void SaveCompressedForest(int leaf_format, bst_float max_leaf_error,
+                            DMatrix* dvalid, dmlc::Stream* fo,
+                            predictor::CompressionReport* out_report) const override;
+
  protected:
+  // A model loaded from an image has no RegTree, only the compiled forest the
+  // CPU predictor traverses.
+  void CheckNotMapped(const char* what) const {
+    CHECK(model_.mapped_forest == nullptr)
+        << what << " is not supported by a model loaded from an image.";
+  }
+  void CheckMappedPredictor() const {
+    CHECK(model_.mapped_forest == nullptr || tparam_.predictor == "cpu_predictor")
+        << "A model loaded from an image only predicts with cpu_predictor.";
+  }
+
   // initialize updater before using them
   void InitUpdater();
 
@@ -0,0 +1,155 @@
+/*!
+ * Copyright 2019 by Contributors
+ * \file gbtree_model.cc
+ * \brief Dump and generation of C source from a tree ensemble.
+ */
+#include <dmlc/omp.h>
+#include <xgboost/logging.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "gbtree_model.h"
+
+namespace xgboost {
+namespace gbm {
+
+namespace {
+// exact C literal of a float
+std::string FloatLiteral(bst_float value) {
+  if (std::isnan(value)) {
+    return "NAN";
+  }
+  if (std::isinf(value)) {
+    return value > 0 ? "HUGE_VALF" : "(-HUGE_VALF)";
+  }
+  char buf[64];
+  std::snprintf(buf, sizeof(buf), "%af", static_cast<double>(value));
+  return buf;
+}
+
+void GenerateNode(const RegTree& tree, int nid, int depth,
+                  std::ostringstream* os) {
+  const std::string indent(2 * (depth + 1), ' ');
+  const RegTree::Node& node = tree[nid];
+  if (node.IsLeaf()) {
+    *os << indent << "return " << FloatLiteral(node.LeafValue()) << ";\n";
+    return;
+  }
+  // a missing value is NaN, which fails every comparison and so takes the
+  // default direction
+  const std::string fvalue = "row[" + std::to_string(node.SplitIndex()) + "]";
+  const std::string cond = FloatLiteral(node.SplitCond());
+  // the child covering more training instances comes first and is marked
+  // likely, so the hot path falls through
+  const bst_float left_cover = tree.Stat(node.LeftChild()).sum_hess;
+  const bst_float right_cover = tree.Stat(node.RightChild()).sum_hess;
+  const bool right_first = right_cover > left_cover;
+  std::string test;
+  if (right_first) {
+    test = node.DefaultLeft() ? fvalue + " >= " + cond
+                              : "!(" + fvalue + " < " + cond + ")";
+  } else {
+    test = node.DefaultLeft() ? "!(" + fvalue + " >= " + cond + ")"
+                              : fvalue + " < " + cond;
+  }
+  if (left_cover != right_cover) {
+    test = "XGBOOST_AOT_LIKELY(" + test + ")";
+  }
+  *os << indent << "if (" << test << ") {\n";
+  GenerateNode(tree, right_first ? node.RightChild() : node.LeftChild(), depth + 1, os);
+  *os << indent << "} else {\n";
+  GenerateNode(tree, right_first ? node.LeftChild() : node.RightChild(), depth + 1, os);
+  *os << indent << "}\n";
+}
+}  // anonymous namespace
+
+void GBTreeModel::DumpModel(
+    const FeatureMap& fmap, bool with_stats, const std::string& format,
+    const std::function<void(size_t, const std::string&)>& fn) const {
+  // dump a block of trees in parallel, then hand it out in order
+  const size_t block_size = static_cast<size_t>(std::max(omp_get_max_threads(), 1)) * 8;
+  std::vector<std::string> block(std::min(block_size, trees.size()));
+  for (size_t begin = 0; begin < trees.size(); begin += block_size) {
+    const auto nsize = static_cast<bst_omp_uint>(std::min(block_size, trees.size() - begin));
+#pragma omp parallel for schedule(dynamic)
+    for (bst_omp_uint i = 0; i < nsize; ++i) {
+      block[i].clear();
+      trees[begin + i]->DumpModel(fmap, with_stats, format, &block[i]);
+    }
+    for (bst_omp_uint i = 0; i < nsize; ++i) {
+      fn(begin + i, block[i]);
+    }
+  }
+}
+
+std::string GBTreeModel::GenerateSource(unsigned ntree_limit) const {
+  CHECK_EQ(param.size_leaf_vector, 0)
+      << "size_leaf_vector is enforced to 0 so far";
+  const int num_group = param.num_output_group;
+  ntree_limit *= num_group;
+  if (ntree_limit == 0 || ntree_limit > trees.size()) {
+    ntree_limit = static_cast<unsigned>(trees.size());
+  }
+  std::ostringstream os;
+  os << "/*\n"
+     << " * Generated by XGBoost from a model of " << ntree_limit << " trees.\n"
+     << " *\n"
+     << " * predict(row, out) writes the margin of each of the "
+     << num_group << " output groups\n"
+     << " * of a dense row of " << param.num_feature
+     << " features to out, missing features are NaN.\n"
+     << " * Compile without -ffast-math to keep results identical to XGBoost.\n"
+     << " */\n"
+     << "#include <math.h>\n\n"
+     << "#if defined(_WIN32)\n"
+     << "#define XGBOOST_AOT_EXPORT __declspec(dllexport)\n"
+     << "#else\n"
+     << "#define XGBOOST_AOT_EXPORT __attribute__((visibility(\"default\")))\n"
+     << "#endif\n\n"
+     << "#if defined(__GNUC__)\n"
+     << "#define XGBOOST_AOT_LIKELY(x) __builtin_expect(!!(x), 1)\n"
+     << "#else\n"
+     << "#define XGBOOST_AOT_LIKELY(x) (x)\n"
+     << "#endif\n\n"
+     << "#ifdef __cplusplus\n"
+     << "extern \"C\" {\n"
+     << "#endif\n\n";
+  for (unsigned i = 0; i < ntree_limit; ++i) {
+    const RegTree& tree = *trees[i];
+    CHECK_EQ(tree.param.num_roots, 1)
+        << "Source generation doesn't support multiple roots.";
+    os << "static float tree_" << i << "(const float* row) {\n";
+    GenerateNode(tree, 0, 0, &os);
+    os << "}\n\n";
+  }
+  os << "XGBOOST_AOT_EXPORT int get_num_feature(void) { return "
+     << param.num_feature << "; }\n\n"
+     << "XGBOOST_AOT_EXPORT int get_num_output_group(void) { return "
+     << num_group << "; }\n\n"
+     << "XGBOOST_AOT_EXPORT void predict(const float* row, float* out) {\n"
+     << "  float psum;\n";
+  // same summation order as the CPU predictor
+  for (int gid = 0; gid < num_group; ++gid) {
+    os << "  psum = 0.0f;\n";
+    for (unsigned i = 0; i < ntree_limit; ++i) {
+      if (tree_info[i] == gid) {
+        os << "  psum += tree_" << i << "(row);\n";
+      }
+    }
+    os << "  out[" << gid << "] = " << FloatLiteral(base_margin)
+       << " + psum;\n";
+  }
+  os << "}\n\n"
+     << "#ifdef __cplusplus\n"
+     << "}  /* extern \"C\" */\n"
+     << "#endif\n";
+  return os.str();
+}
+
+}  // namespace gbm
+}  // namespace xgboost
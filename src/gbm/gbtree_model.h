@@ -6,12 +6,17 @@
 #include <dmlc/io.h>
 #include <xgboost/tree_model.h>
 
+#include <atomic>
+#include <functional>
 #include <memory>
 #include <utility>
 #include <string>
 #include <vector>
 
 namespace xgboost {
+namespace predictor {
+class CompiledForest;
+}  // namespace predictor
 namespace gbm {
 /*! \brief model parameters */
 struct GBTreeModelParam : public dmlc::Parameter<GBTreeModelParam> {
@@ -62,10 +67,12 @@ struct GBTreeModelParam : public dmlc::Parameter<GBTreeModelParam> {
 };
 
 struct GBTreeModel {
-  explicit GBTreeModel(bst_float base_margin) : base_margin(base_margin) {}
+  explicit GBTreeModel(bst_float base_margin)
+      : base_margin(base_margin), revision_(NewRevision()),
+        prefix_revision_(revision_) {}
   void Configure(const std::vector<std::pair<std::string, std::string> >& cfg) {
     // initialize model parameters if not yet been initialized.
-    if (trees.size() == 0) {
+    if (NumTrees() == 0) {
       param.InitAllowUnknown(cfg);
     }
   }
@@ -78,6 +85,8 @@ struct GBTreeModel {
       trees.clear();
       param.num_trees = 0;
       tree_info.clear();
+      revision_ = NewRevision();
+      prefix_revision_ = revision_;
     }
   }
 
@@ -86,6 +95,7 @@ struct GBTreeModel {
         << "GBTree: invalid model file";
     trees.clear();
     trees_to_update.clear();
+    mapped_forest.reset();
     for (int i = 0; i < param.num_trees; ++i) {
       std::unique_ptr<RegTree> ptr(new RegTree());
       ptr->Load(fi);
@@ -97,6 +107,8 @@ struct GBTreeModel {
           fi->Read(dmlc::BeginPtr(tree_info), sizeof(int) * param.num_trees),
           sizeof(int) * param.num_trees);
     }
+    revision_ = NewRevision();
+    prefix_revision_ = revision_;
   }
 
   void Save(dmlc::Stream* fo) const {
@@ -112,19 +124,64 @@ struct GBTreeModel {
 
   std::vector<std::string> DumpModel(const FeatureMap& fmap, bool with_stats,
                                      std::string format) const {
-    std::vector<std::string> dump;
-    for (const auto & tree : trees) {
-      dump.push_back(tree->DumpModel(fmap, with_stats, format));
-    }
+    std::vector<std::string> dump(trees.size());
+    this->DumpModel(fmap, with_stats, format,
+                    [&dump](size_t i, const std::string& str) { dump[i] = str; });
     return dump;
   }
+  /*!
+   * \brief dump the trees in parallel, handing each dump in tree order to `fn`.
+   *  Only a block of a few trees per thread is held in memory at a time.
+   */
+  void DumpModel(const FeatureMap& fmap, bool with_stats, const std::string& format,
+                 const std::function<void(size_t, const std::string&)>& fn) const;
+  /*!
+   * \brief generate C source of a function predicting one row with the model.
+   * \param ntree_limit limit number of trees used, 0 for all.
+   * \return source of a translation unit exporting `predict`.
+   */
+  std::string GenerateSource(unsigned ntree_limit) const;
   void CommitModel(std::vector<std::unique_ptr<RegTree> >&& new_trees,
                    int bst_group) {
     for (auto & new_tree : new_trees) {
+      // the tree may have been updated in place since its mean values were filled
+      new_tree->ClearNodeMeanValues();
       trees.push_back(std::move(new_tree));
       tree_info.push_back(bst_group);
     }
     param.num_trees += static_cast<int>(new_trees.size());
+    revision_ = NewRevision();
+  }
+  /*!
+   * \brief identifier of the current set of trees, unique within the process.
+   *  It changes whenever trees are loaded, committed or moved out for update,
+   *  so structures derived from the trees can detect that they are stale.
+   */
+  uint64_t Revision() const { return revision_; }
+  /*!
+   * \brief identifier of the trees already in the model.  Unlike Revision it
+   *  is kept when new trees are committed, so results computed from the first
+   *  k trees stay valid as long as it doesn't change.
+   */
+  uint64_t PrefixRevision() const { return prefix_revision_; }
+  /*!
+   * \brief replace the trees by a compiled forest used in place from a read-only
+   *  image, only prediction through the forest is possible afterwards.
+   */
+  void SetMappedForest(const GBTreeModelParam& mapped_param,
+                       std::vector<int> mapped_tree_info,
+                       std::shared_ptr<const predictor::CompiledForest> forest) {
+    param = mapped_param;
+    trees.clear();
+    trees_to_update.clear();
+    tree_info = std::move(mapped_tree_info);
+    mapped_forest = std::move(forest);
+    revision_ = NewRevision();
+    prefix_revision_ = revision_;
+  }
+  /*! \brief number of trees, including those only held by a mapped forest */
+  size_t NumTrees() const {
+    return mapped_forest == nullptr ? trees.size() : tree_info.size();
   }
 
   // base margin
@@ -137,6 +194,16 @@ struct GBTreeModel {
   std::vector<std::unique_ptr<RegTree> > trees_to_update;
   /*! \brief some information indicator of the tree, reserved */
   std::vector<int> tree_info;
+  /*! \brief trees of a model mapped from an image, in place of `trees` */
+  std::shared_ptr<const predictor::CompiledForest> mapped_forest;
+
+ private:
+  static uint64_t NewRevision() {
+    static std::atomic<uint64_t> counter{0};
+    return ++counter;
+  }
+  uint64_t revision_;
+  uint64_t prefix_revision_;
 };
 }  // namespace gbm
 }  // namespace xgboost
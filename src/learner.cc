@@ -9,10 +9,13 @@
 #include <xgboost/feature_map.h>
 #include <xgboost/learner.h>
 #include <xgboost/logging.h>
+#include <xgboost/predictor.h>
 #include <xgboost/generic_parameters.h>
 #include <algorithm>
+#include <cstring>
 #include <iomanip>
 #include <limits>
+#include <memory>
 #include <sstream>
 #include <string>
 #include <ios>
@@ -28,6 +31,27 @@ namespace {
 
 const char* kMaxDeltaStepDefaultValue = "0.7";
 
+// mapped model files start with kMmapMagic
+const char kMmapMagic[8] = {'x', 'g', 'b', 'm', 'm', 'a', 'p', '\0'};
+const uint32_t kMmapVersion = 1;
+// written in native order, a reader with another byte order sees it reversed
+const uint32_t kMmapByteOrder = 0x01020304;
+
+/*!
+ * \brief header of a mapped model file.  The learner section is the usual
+ *  binary model without the booster, the booster section is an image the
+ *  booster uses in place.  Sections are aligned to common::kImageAlignment.
+ */
+struct MmapModelHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint64_t learner_offset;
+  uint64_t learner_size;
+  uint64_t gbm_offset;
+  uint64_t gbm_size;
+};
+
 inline bool IsFloat(const std::string& str) {
   std::stringstream ss(str);
   float f;
@@ -62,6 +86,102 @@ std::vector<std::string> Learner::DumpModel(const FeatureMap& fmap,
   return gbm_->DumpModel(fmap, with_stats, format);
 }
 
+void Learner::DumpModel(const FeatureMap& fmap,
+                        bool with_stats,
+                        std::string format,
+                        const std::function<void(size_t, const std::string&)>& fn) const {
+  gbm_->DumpModel(fmap, with_stats, format, fn);
+}
+
+void Learner::DumpModel(const FeatureMap& fmap,
+                        bool with_stats,
+                        std::string format,
+                        dmlc::Stream* fo) const {
+  const bool json = format == "json";
+  std::string head;
+  if (json) {
+    fo->Write("[\n", 2);
+  }
+  gbm_->DumpModel(fmap, with_stats, format,
+                  [&](size_t i, const std::string& dump) {
+                    if (json) {
+                      if (i != 0) fo->Write(",\n", 2);
+                    } else {
+                      head = "booster[" + std::to_string(i) + "]:\n";
+                      fo->Write(head.data(), head.length());
+                    }
+                    fo->Write(dump.data(), dump.length());
+                  });
+  if (json) {
+    fo->Write("\n]\n", 3);
+  }
+}
+
+std::string Learner::GenerateSource(unsigned ntree_limit) const {
+  return gbm_->GenerateSource(ntree_limit);
+}
+
+void Learner::SaveBinnedForest(DMatrix* dmat, int max_bin, dmlc::Stream* fo) const {
+  gbm_->SaveBinnedForest(dmat, max_bin, fo);
+}
+
+void Learner::SaveCompressedForest(int leaf_format, bst_float max_leaf_error,
+                                   DMatrix* dvalid, dmlc::Stream* fo,
+                                   predictor::CompressionReport* out_report) const {
+  gbm_->SaveCompressedForest(leaf_format, max_leaf_error, dvalid, fo, out_report);
+}
+
+void Learner::PredictCombined(DMatrix* data, bool output_margin,
+                              CombinedPrediction* out, unsigned ntree_limit) const {
+  CHECK(gbm_ != nullptr) << "Predict must happen after Load or InitModel";
+  gbm_->PredictCombined(data, out, ntree_limit);
+  if (!output_margin && out->margin != nullptr) {
+    obj_->PredTransform(out->margin);
+  }
+}
+
+unsigned Learner::PredictStaged(DMatrix* data, bool output_margin,
+                                HostDeviceVector<bst_float>* out_preds,
+                                unsigned ntree_limit) const {
+  CHECK(gbm_ != nullptr) << "Predict must happen after Load or InitModel";
+  const unsigned nstage = gbm_->PredictStaged(data, out_preds, ntree_limit);
+  if (!output_margin) {
+    obj_->PredTransform(out_preds);
+  }
+  return nstage;
+}
+
+void Learner::PredictCascade(DMatrix* data, bst_float margin_threshold,
+                             HostDeviceVector<bst_float>* out_preds,
+                             std::vector<unsigned>* out_ntrees,
+                             unsigned ntree_limit) const {
+  CHECK(gbm_ != nullptr) << "Predict must happen after Load or InitModel";
+  gbm_->PredictCascade(data, margin_threshold, out_preds, out_ntrees,
+                       ntree_limit);
+}
+
+void Learner::PredictContributionSparse(DMatrix* data,
+                                        std::vector<size_t>* out_indptr,
+                                        std::vector<unsigned>* out_index,
+                                        std::vector<bst_float>* out_values,
+                                        std::vector<bst_float>* out_bias,
+                                        unsigned ntree_limit,
+                                        bool approximate) const {
+  CHECK(gbm_ != nullptr) << "Predict must happen after Load or InitModel";
+  gbm_->PredictContributionSparse(data, out_indptr, out_index, out_values,
+                                  out_bias, ntree_limit, approximate);
+}
+
+void Learner::PredictInteractionTopK(DMatrix* data, unsigned top_k,
+                                     std::vector<bst_float>* out_values,
+                                     std::vector<unsigned>* out_index,
+                                     unsigned ntree_limit,
+                                     bool approximate) const {
+  CHECK(gbm_ != nullptr) << "Predict must happen after Load or InitModel";
+  gbm_->PredictInteractionTopK(data, top_k, out_values, out_index, ntree_limit,
+                               approximate);
+}
+
 /*! \brief training parameter for regression */
 struct LearnerModelParam : public dmlc::Parameter<LearnerModelParam> {
   /* \brief global bias */
@@ -213,6 +333,35 @@ class LearnerImpl : public Learner {
   }
 
   void Load(dmlc::Stream* fi) override {
+    this->LoadLearner(fi, true);
+    mapped_file_.reset();
+  }
+
+  void LoadMmap(const std::string& fname) override {
+    auto file = std::make_shared<common::MappedFile>(fname);
+    MmapModelHeader header;
+    CHECK_GE(file->Size(), sizeof(header)) << "Invalid mapped model file " << fname;
+    std::memcpy(&header, file->Data(), sizeof(header));
+    CHECK_EQ(std::string(header.magic, sizeof(header.magic)),
+             std::string(kMmapMagic, sizeof(header.magic)))
+        << fname << " is not a mapped model file";
+    CHECK_EQ(header.byte_order, kMmapByteOrder)
+        << "Mapped model file was written on a machine with a different byte order";
+    CHECK_EQ(header.version, kMmapVersion)
+        << "Unsupported mapped model file version " << header.version;
+    CHECK(header.learner_offset + header.learner_size <= file->Size() &&
+          header.gbm_offset + header.gbm_size <= file->Size())
+        << "Truncated mapped model file " << fname;
+    common::MemoryFixSizeBuffer fs(const_cast<char*>(file->Data()) + header.learner_offset,
+                                   header.learner_size);
+    this->LoadLearner(&fs, false);
+    gbm_->LoadImage(file->Data() + header.gbm_offset, header.gbm_size);
+    // the previous mapping is released only after the booster using it
+    mapped_file_ = file;
+  }
+
+  // load the learner, and its booster too if `with_gbm`
+  void LoadLearner(dmlc::Stream* fi, bool with_gbm) {
     tparam_ = LearnerTrainParam();
     tparam_.Init(std::vector<std::pair<std::string, std::string>>{});
     // TODO(tqchen) mark deprecation of old format.
@@ -254,7 +403,9 @@ class LearnerImpl : public Learner {
     obj_.reset(ObjFunction::Create(name_obj_, &tparam_));
     gbm_.reset(GradientBooster::Create(name_gbm_, &tparam_,
                                        cache_, mparam_.base_score));
-    gbm_->Load(fi);
+    if (with_gbm) {
+      gbm_->Load(fi);
+    }
     if (mparam_.contain_extra_attrs != 0) {
       std::vector<std::pair<std::string, std::string> > attr;
       fi->Read(&attr);
@@ -321,6 +472,34 @@ class LearnerImpl : public Learner {
 
   // rabit save model to rabit checkpoint
   void Save(dmlc::Stream* fo) const override {
+    this->SaveLearner(fo, true);
+  }
+
+  void SaveMmap(dmlc::Stream* fo) const override {
+    MmapModelHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, kMmapMagic, sizeof(header.magic));
+    header.version = kMmapVersion;
+    header.byte_order = kMmapByteOrder;
+    std::string image(sizeof(header), '\0');
+    common::AlignImage(&image);
+    header.learner_offset = image.size();
+    {
+      common::MemoryBufferStream fs(&image);
+      fs.Seek(image.size());
+      this->SaveLearner(&fs, false);
+    }
+    header.learner_size = image.size() - header.learner_offset;
+    common::AlignImage(&image);
+    header.gbm_offset = image.size();
+    gbm_->SaveImage(&image);
+    header.gbm_size = image.size() - header.gbm_offset;
+    std::memcpy(&image[0], &header, sizeof(header));
+    fo->Write(image.data(), image.size());
+  }
+
+  // save the learner, and its booster too if `with_gbm`
+  void SaveLearner(dmlc::Stream* fo, bool with_gbm) const {
     LearnerModelParam mparam = mparam_;  // make a copy to potentially modify
     std::vector<std::pair<std::string, std::string> > extra_attr;
       // extra attributed to be added just before saving
@@ -347,7 +526,9 @@ class LearnerImpl : public Learner {
     fo->Write(&mparam, sizeof(LearnerModelParam));
     fo->Write(name_obj_);
     fo->Write(name_gbm_);
-    gbm_->Save(fo);
+    if (with_gbm) {
+      gbm_->Save(fo);
+    }
     if (mparam.contain_extra_attrs != 0) {
       std::map<std::string, std::string> attr(attributes_);
       for (const auto& kv : extra_attr) {
@@ -598,6 +779,8 @@ class LearnerImpl : public Learner {
   std::map<DMatrix*, HostDeviceVector<bst_float>> preds_;
   // gradient pairs
   HostDeviceVector<GradientPair> gpair_;
+  // file the booster was mapped from, if loaded by LoadMmap
+  std::shared_ptr<common::MappedFile> mapped_file_;
 
  private:
   /*! \brief random number transformation seed. */
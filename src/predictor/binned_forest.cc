@@ -0,0 +1,244 @@
+/*!
+ * Copyright 2019 by Contributors
+ * \file binned_forest.cc
+ * \brief Tree ensemble with split conditions remapped to quantile bins, used
+ *  to predict directly on histogram indices.
+ */
+#include <dmlc/omp.h>
+#include <xgboost/logging.h>
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "binned_forest.h"
+
+namespace xgboost {
+namespace predictor {
+
+constexpr BinnedForest::BinIdx BinnedForest::kMissing;
+
+namespace {
+// leading section of a saved binned forest
+struct BinnedForestHeader {
+  char magic[4];
+  int32_t num_feature;
+  int32_t num_group;
+  bst_float base_margin;
+  uint64_t num_trees;
+};
+const char kBinnedForestMagic[4] = {'b', 'i', 'n', 'f'};
+}  // anonymous namespace
+
+void BinnedForest::Init(const gbm::GBTreeModel& model,
+                        const common::HistCutMatrix& cut) {
+  forest_.Init(model);
+  num_feature_ = model.param.num_feature;
+  num_group_ = model.param.num_output_group;
+  num_trees_ = model.trees.size();
+  base_margin_ = model.base_margin;
+  cut_ptr_ = cut.row_ptr;
+  cut_values_ = cut.cut;
+  min_values_ = cut.min_val;
+  const size_t num_cut_feature = cut_ptr_.size() - 1;
+  bin_feature_.resize(cut.NumBins());
+  for (size_t fid = 0; fid < num_cut_feature; ++fid) {
+    CHECK_LT(cut_ptr_[fid + 1] - cut_ptr_[fid] + 1, kMissing)
+        << "Too many bins of feature " << fid << " for 16 bit bin ids.";
+    std::fill(bin_feature_.begin() + cut_ptr_[fid],
+              bin_feature_.begin() + cut_ptr_[fid + 1],
+              static_cast<uint32_t>(fid));
+  }
+
+  split_bin_.assign(forest_.NumNodes(), 0);
+  for (size_t k = 0; k < forest_.NumTrees(); ++k) {
+    const CompiledForest::Node* tree = forest_.Tree(k);
+    const size_t offset = forest_.TreeOffset(k);
+    const size_t nnode = (k + 1 < forest_.NumTrees()
+                          ? forest_.TreeOffset(k + 1) : forest_.NumNodes()) -
+                         offset;
+    for (size_t i = 0; i < nnode; ++i) {
+      if (tree[i].IsLeaf()) continue;
+      const unsigned fid = tree[i].SplitIndex();
+      const bst_float cond = tree[i].SplitCond();
+      CHECK_LT(fid, num_cut_feature)
+          << "Split on feature " << fid << " which has no cut points.";
+      auto cbegin = cut_values_.cbegin() + cut_ptr_[fid];
+      auto cend = cut_values_.cbegin() + cut_ptr_[fid + 1];
+      auto it = std::lower_bound(cbegin, cend, cond);
+      if (it != cend && *it == cond) {
+        split_bin_[offset + i] = static_cast<BinIdx>(it - cbegin + 1);
+      } else if (cond == min_values_[fid]) {
+        split_bin_[offset + i] = 0;
+      } else {
+        LOG(FATAL) << "Split condition " << cond << " of feature " << fid
+                   << " in tree " << forest_.TreeId(k)
+                   << " is not a cut point, the model can't be predicted on"
+                   << " these bins exactly.";
+      }
+    }
+  }
+}
+
+void BinnedForest::Save(dmlc::Stream* fo) const {
+  BinnedForestHeader header;
+  std::memcpy(header.magic, kBinnedForestMagic, sizeof(header.magic));
+  header.num_feature = num_feature_;
+  header.num_group = num_group_;
+  header.base_margin = base_margin_;
+  header.num_trees = num_trees_;
+  fo->Write(&header, sizeof(header));
+  fo->Write(cut_ptr_);
+  fo->Write(cut_values_);
+  fo->Write(min_values_);
+  fo->Write(bin_feature_);
+  fo->Write(split_bin_);
+  forest_.Save(fo);
+}
+
+void BinnedForest::Load(dmlc::Stream* fi) {
+  BinnedForestHeader header;
+  CHECK_EQ(fi->Read(&header, sizeof(header)), sizeof(header))
+      << "Invalid binned forest";
+  CHECK_EQ(std::memcmp(header.magic, kBinnedForestMagic, sizeof(header.magic)), 0)
+      << "Invalid binned forest";
+  num_feature_ = header.num_feature;
+  num_group_ = header.num_group;
+  base_margin_ = header.base_margin;
+  num_trees_ = header.num_trees;
+  CHECK(fi->Read(&cut_ptr_) && fi->Read(&cut_values_) && fi->Read(&min_values_) &&
+        fi->Read(&bin_feature_) && fi->Read(&split_bin_))
+      << "Invalid binned forest";
+  forest_.Load(fi);
+  CHECK(!cut_ptr_.empty() && cut_ptr_.back() == cut_values_.size() &&
+        min_values_.size() + 1 == cut_ptr_.size() &&
+        bin_feature_.size() == cut_values_.size() &&
+        split_bin_.size() == forest_.NumNodes() &&
+        forest_.NumTrees() == num_trees_ && forest_.NumGroups() == num_group_)
+      << "Invalid binned forest";
+}
+
+BinnedForest::BinIdx BinnedForest::BinOf(unsigned fid, bst_float fvalue) const {
+  if (fvalue < min_values_[fid]) {
+    return 0;
+  }
+  auto cbegin = cut_values_.cbegin() + cut_ptr_[fid];
+  auto cend = cut_values_.cbegin() + cut_ptr_[fid + 1];
+  return static_cast<BinIdx>(std::upper_bound(cbegin, cend, fvalue) - cbegin + 1);
+}
+
+std::vector<std::pair<size_t, size_t>>
+BinnedForest::Ranges(unsigned ntree_limit) const {
+  ntree_limit *= num_group_;
+  if (ntree_limit == 0 || ntree_limit > num_trees_) {
+    ntree_limit = static_cast<unsigned>(num_trees_);
+  }
+  std::vector<std::pair<size_t, size_t>> ranges(num_group_);
+  for (int gid = 0; gid < num_group_; ++gid) {
+    ranges[gid] = forest_.GroupRange(gid, 0, ntree_limit);
+  }
+  return ranges;
+}
+
+void BinnedForest::PredictRow(
+    const BinIdx* row, unsigned root_id,
+    const std::vector<std::pair<size_t, size_t>>& ranges,
+    bst_float* out) const {
+  for (int gid = 0; gid < num_group_; ++gid) {
+    bst_float psum = 0.0f;
+    for (size_t k = ranges[gid].first; k < ranges[gid].second; ++k) {
+      const CompiledForest::Node* tree = forest_.Tree(k);
+      const BinIdx* split_bin = split_bin_.data() + forest_.TreeOffset(k);
+      int nid = static_cast<int>(root_id);
+      while (!tree[nid].IsLeaf()) {
+        const BinIdx bin = row[tree[nid].SplitIndex()];
+        if (bin == kMissing) {
+          nid = tree[nid].DefaultChild();
+        } else {
+          nid = tree[nid].LeftChild() + !(bin <= split_bin[nid]);
+        }
+      }
+      psum += tree[nid].LeafValue();
+    }
+    out[gid] += psum;
+  }
+}
+
+void BinnedForest::PredictBatch(const common::GHistIndexMatrix& gmat,
+                                std::vector<bst_float>* out_preds,
+                                unsigned ntree_limit) const {
+  CHECK(gmat.cut.row_ptr == cut_ptr_ && gmat.cut.cut == cut_values_)
+      << "Histogram index was built with different cuts.";
+  const auto ranges = this->Ranges(ntree_limit);
+  const size_t nrow = gmat.row_ptr.size() - 1;
+  std::vector<bst_float>& preds = *out_preds;
+  preds.assign(nrow * num_group_, base_margin_);
+  const auto nsize = static_cast<bst_omp_uint>(nrow);
+#pragma omp parallel
+  {
+    std::vector<BinIdx> row(num_feature_, kMissing);
+#pragma omp for schedule(static)
+    for (bst_omp_uint i = 0; i < nsize; ++i) {
+      const size_t ibegin = gmat.row_ptr[i];
+      const size_t iend = gmat.row_ptr[i + 1];
+      for (size_t j = ibegin; j < iend; ++j) {
+        const uint32_t bin = gmat.index[j];
+        const uint32_t fid = bin_feature_[bin];
+        if (fid < row.size()) {
+          row[fid] = static_cast<BinIdx>(bin - cut_ptr_[fid] + 1);
+        }
+      }
+      this->PredictRow(row.data(), 0, ranges, &preds[i * num_group_]);
+      for (size_t j = ibegin; j < iend; ++j) {
+        const uint32_t bin = gmat.index[j];
+        const uint32_t fid = bin_feature_[bin];
+        if (fid < row.size()) {
+          row[fid] = kMissing;
+        }
+      }
+    }
+  }
+}
+
+void BinnedForest::PredictBatch(DMatrix* p_fmat,
+                                std::vector<bst_float>* out_preds,
+                                unsigned ntree_limit) const {
+  const MetaInfo& info = p_fmat->Info();
+  const auto ranges = this->Ranges(ntree_limit);
+  const size_t num_cut_feature = cut_ptr_.size() - 1;
+  std::vector<bst_float>& preds = *out_preds;
+  const auto& base_margin = info.base_margin_.HostVector();
+  if (base_margin.size() == info.num_row_ * num_group_) {
+    preds = base_margin;
+  } else {
+    preds.assign(info.num_row_ * num_group_, base_margin_);
+  }
+  for (const auto& batch : p_fmat->GetRowBatches()) {
+    const auto nsize = static_cast<bst_omp_uint>(batch.Size());
+#pragma omp parallel
+    {
+      std::vector<BinIdx> row(num_feature_, kMissing);
+#pragma omp for schedule(static)
+      for (bst_omp_uint i = 0; i < nsize; ++i) {
+        const size_t ridx = batch.base_rowid + i;
+        const SparsePage::Inst inst = batch[i];
+        for (const auto& e : inst) {
+          if (e.index < row.size() && e.index < num_cut_feature) {
+            row[e.index] = this->BinOf(e.index, e.fvalue);
+          }
+        }
+        this->PredictRow(row.data(), info.GetRoot(ridx), ranges,
+                         &preds[ridx * num_group_]);
+        for (const auto& e : inst) {
+          if (e.index < row.size()) {
+            row[e.index] = kMissing;
+          }
+        }
+      }
+    }
+  }
+}
+
+}  // namespace predictor
+}  // namespace xgboost
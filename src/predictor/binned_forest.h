@@ -0,0 +1,105 @@
+/*!
+ * Copyright 2019 by Contributors
+ * \file binned_forest.h
+ * \brief Tree ensemble with split conditions remapped to quantile bins, used
+ *  to predict directly on histogram indices.
+ */
+#ifndef XGBOOST_PREDICTOR_BINNED_FOREST_H_
+#define XGBOOST_PREDICTOR_BINNED_FOREST_H_
+
+#include <dmlc/io.h>
+#include <xgboost/base.h>
+#include <xgboost/data.h>
+
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "compiled_forest.h"
+#include "../common/hist_util.h"
+
+namespace xgboost {
+namespace predictor {
+
+/*!
+ * \brief A compiled forest whose split conditions are bin ids of a HistCutMatrix.
+ *
+ *  A value of feature f falls into local bin 0 when it is below min_val[f] and
+ *  into bin 1 + (number of cut points of f not greater than the value)
+ *  otherwise.  A split `value < cut[j]` then becomes `bin <= j + 1` and a
+ *  split at min_val[f] becomes `bin <= 0`, which is exact for any value.
+ *  Splits at other thresholds (models not trained on these cuts) can't be
+ *  represented and are rejected by `Init`.
+ *
+ *  Rows of a GHistIndexMatrix only know the clamped bin of a value, so
+ *  predicting on one equals predicting on the raw values whenever the values
+ *  lie in [min_val, last cut), which holds for the data the cuts were built
+ *  from.  Binning a DMatrix on the fly is exact for every value.
+ */
+class BinnedForest {
+ public:
+  /*! \brief storage type of a local bin id */
+  using BinIdx = uint16_t;
+  /*! \brief bin id marking a missing value */
+  static constexpr BinIdx kMissing = std::numeric_limits<BinIdx>::max();
+
+  /*!
+   * \brief compile the model and remap its splits to bins of `cut`.
+   * \param model the model, every threshold must be a cut point or min_val.
+   * \param cut quantile cuts the model was trained with.
+   */
+  void Init(const gbm::GBTreeModel& model, const common::HistCutMatrix& cut);
+
+  /*!
+   * \brief predict margins of rows stored as histogram indices.
+   * \param gmat rows binned with the cuts given to Init.
+   * \param out_preds output of size num_row * num_output_group.
+   * \param ntree_limit limit number of trees used, 0 for all.
+   */
+  void PredictBatch(const common::GHistIndexMatrix& gmat,
+                    std::vector<bst_float>* out_preds,
+                    unsigned ntree_limit = 0) const;
+
+  /*!
+   * \brief predict margins of a matrix, binning rows on the fly.
+   * \param p_fmat the input rows.
+   * \param out_preds output of size num_row * num_output_group.
+   * \param ntree_limit limit number of trees used, 0 for all.
+   */
+  void PredictBatch(DMatrix* p_fmat, std::vector<bst_float>* out_preds,
+                    unsigned ntree_limit = 0) const;
+
+  /*! \brief write the forest, its remapped splits and the cuts to a stream */
+  void Save(dmlc::Stream* fo) const;
+  /*! \brief read a forest written by Save, it predicts without the model */
+  void Load(dmlc::Stream* fi);
+
+ private:
+  // local bin of a value of feature fid
+  BinIdx BinOf(unsigned fid, bst_float fvalue) const;
+  // add leaf values of trees [0, tree_end) of each group to out
+  void PredictRow(const BinIdx* row, unsigned root_id,
+                  const std::vector<std::pair<size_t, size_t>>& ranges,
+                  bst_float* out) const;
+  // packed tree ranges of each group for a tree limit
+  std::vector<std::pair<size_t, size_t>> Ranges(unsigned ntree_limit) const;
+
+  CompiledForest forest_;
+  // split bin of each node in the packed layout
+  std::vector<BinIdx> split_bin_;
+  // cut points of each feature, as in HistCutMatrix
+  std::vector<uint32_t> cut_ptr_;
+  std::vector<bst_float> cut_values_;
+  std::vector<bst_float> min_values_;
+  // feature of each global bin
+  std::vector<uint32_t> bin_feature_;
+  int num_feature_{0};
+  int num_group_{0};
+  size_t num_trees_{0};
+  bst_float base_margin_{0.0f};
+};
+
+}  // namespace predictor
+}  // namespace xgboost
+#endif  // XGBOOST_PREDICTOR_BINNED_FOREST_H_
@@ -0,0 +1,257 @@
+/*!
+ * Copyright 2019 by Contributors
+ * \file compiled_forest.cc
+ * \brief Flattened, read-only layout of a tree ensemble used for CPU inference.
+ */
+#include <dmlc/omp.h>
+#include <xgboost/logging.h>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include "compiled_forest.h"
+#include "../common/io.h"
+
+namespace xgboost {
+namespace predictor {
+
+namespace {
+// node ids of a tree in breadth first order, roots first and siblings adjacent
+std::vector<int> BreadthFirstOrder(const RegTree& tree) {
+  std::vector<int> order(tree.param.num_roots);
+  std::iota(order.begin(), order.end(), 0);
+  for (size_t i = 0; i < order.size(); ++i) {
+    const RegTree::Node& node = tree[order[i]];
+    if (!node.IsLeaf()) {
+      order.push_back(node.LeftChild());
+      order.push_back(node.RightChild());
+    }
+  }
+  return order;
+}
+
+// node ids of a tree depth first with siblings adjacent, roots first.  The
+// children of a split are followed by the subtree of the child covering more
+// training instances, then by the subtree of the other one.
+std::vector<int> HotPathOrder(const RegTree& tree) {
+  std::vector<int> order(tree.param.num_roots);
+  std::iota(order.begin(), order.end(), 0);
+  std::vector<int> stack(order.rbegin(), order.rend());
+  while (!stack.empty()) {
+    const int nid = stack.back();
+    stack.pop_back();
+    const RegTree::Node& node = tree[nid];
+    if (node.IsLeaf()) {
+      continue;
+    }
+    const int left = node.LeftChild();
+    const int right = node.RightChild();
+    order.push_back(left);
+    order.push_back(right);
+    const bool right_hot = tree.Stat(right).sum_hess > tree.Stat(left).sum_hess;
+    // the hot child is popped first
+    stack.push_back(right_hot ? left : right);
+    stack.push_back(right_hot ? right : left);
+  }
+  return order;
+}
+
+/*! \brief leading section of a forest image */
+struct ImageHeader {
+  uint64_t num_trees;
+  uint64_t num_nodes;
+  int32_t num_group;
+  // size of size_t on the machine writing the image
+  int32_t word_size;
+};
+
+template <typename T>
+void AppendArray(const T* data, size_t size, std::string* image) {
+  common::AlignImage(image);
+  image->append(reinterpret_cast<const char*>(data), size * sizeof(T));
+}
+
+template <typename T>
+const T* ViewArray(const char* data, size_t size, size_t count, size_t* offset) {
+  *offset = (*offset + common::kImageAlignment - 1) / common::kImageAlignment *
+            common::kImageAlignment;
+  CHECK_LE(*offset + count * sizeof(T), size) << "Truncated forest image";
+  const T* ptr = reinterpret_cast<const T*>(data + *offset);
+  *offset += count * sizeof(T);
+  return ptr;
+}
+}  // anonymous namespace
+
+void CompiledForest::ViewStorage() {
+  nodes_ = View<Node>(storage_.nodes);
+  tree_ptr_ = View<size_t>(storage_.tree_ptr);
+  tree_id_ = View<unsigned>(storage_.tree_id);
+  packed_idx_ = View<size_t>(storage_.packed_idx);
+  group_ptr_ = View<size_t>(storage_.group_ptr);
+  leaf_bounds_ = View<std::pair<bst_float, bst_float>>(storage_.leaf_bounds);
+}
+
+void CompiledForest::SaveImage(std::string* image) const {
+  CHECK_EQ(image->size() % common::kImageAlignment, 0);
+  ImageHeader header;
+  header.num_trees = tree_id_.size();
+  header.num_nodes = nodes_.size();
+  header.num_group = num_group_;
+  header.word_size = static_cast<int32_t>(sizeof(size_t));
+  const size_t begin = image->size();
+  image->append(reinterpret_cast<const char*>(&header), sizeof(header));
+  // offsets inside the image are relative to its first byte
+  std::string body;
+  AppendArray(nodes_.data(), nodes_.size(), &body);
+  AppendArray(tree_ptr_.data(), tree_ptr_.size(), &body);
+  AppendArray(tree_id_.data(), tree_id_.size(), &body);
+  AppendArray(packed_idx_.data(), packed_idx_.size(), &body);
+  AppendArray(group_ptr_.data(), group_ptr_.size(), &body);
+  AppendArray(leaf_bounds_.data(), leaf_bounds_.size(), &body);
+  image->resize(begin + common::kImageAlignment, '\0');
+  image->append(body);
+}
+
+size_t CompiledForest::InitFromImage(const char* data, size_t size) {
+  CHECK_EQ(reinterpret_cast<uintptr_t>(data) % common::kImageAlignment, 0)
+      << "Forest image is not aligned";
+  CHECK_GE(size, common::kImageAlignment) << "Truncated forest image";
+  ImageHeader header;
+  std::memcpy(&header, data, sizeof(header));
+  CHECK_EQ(header.word_size, static_cast<int32_t>(sizeof(size_t)))
+      << "Forest image was written on a machine with a different word size";
+  CHECK_GE(header.num_group, 1) << "Invalid forest image";
+  storage_ = Storage();
+  const size_t ntree = header.num_trees;
+  num_group_ = header.num_group;
+  size_t offset = common::kImageAlignment;
+  const char* body = data + offset;
+  size -= offset;
+  offset = 0;
+  nodes_.ptr = ViewArray<Node>(body, size, header.num_nodes, &offset);
+  nodes_.len = header.num_nodes;
+  tree_ptr_.ptr = ViewArray<size_t>(body, size, ntree + 1, &offset);
+  tree_ptr_.len = ntree + 1;
+  tree_id_.ptr = ViewArray<unsigned>(body, size, ntree, &offset);
+  tree_id_.len = ntree;
+  packed_idx_.ptr = ViewArray<size_t>(body, size, ntree, &offset);
+  packed_idx_.len = ntree;
+  group_ptr_.ptr = ViewArray<size_t>(body, size, num_group_ + 1, &offset);
+  group_ptr_.len = num_group_ + 1;
+  leaf_bounds_.ptr =
+      ViewArray<std::pair<bst_float, bst_float>>(body, size, ntree, &offset);
+  leaf_bounds_.len = ntree;
+  CHECK_EQ(tree_ptr_[ntree], header.num_nodes) << "Invalid forest image";
+  CHECK_EQ(group_ptr_[num_group_], ntree) << "Invalid forest image";
+  revision_ = 0;
+  return common::kImageAlignment + offset;
+}
+
+void CompiledForest::Save(dmlc::Stream* fo) const {
+  std::string image;
+  this->SaveImage(&image);
+  fo->Write(image);
+}
+
+void CompiledForest::Load(dmlc::Stream* fi) {
+  std::string image;
+  CHECK(fi->Read(&image)) << "Invalid forest";
+  // view an aligned copy of the image, then take the arrays out of it
+  std::string buffer(image.size() + common::kImageAlignment, '\0');
+  const auto addr = reinterpret_cast<uintptr_t>(buffer.data());
+  char* aligned = &buffer[0] + (common::kImageAlignment - addr % common::kImageAlignment) %
+                                   common::kImageAlignment;
+  std::memcpy(aligned, image.data(), image.size());
+  this->InitFromImage(aligned, image.size());
+  storage_.nodes.assign(nodes_.ptr, nodes_.ptr + nodes_.len);
+  storage_.tree_ptr.assign(tree_ptr_.ptr, tree_ptr_.ptr + tree_ptr_.len);
+  storage_.tree_id.assign(tree_id_.ptr, tree_id_.ptr + tree_id_.len);
+  storage_.packed_idx.assign(packed_idx_.ptr, packed_idx_.ptr + packed_idx_.len);
+  storage_.group_ptr.assign(group_ptr_.ptr, group_ptr_.ptr + group_ptr_.len);
+  storage_.leaf_bounds.assign(leaf_bounds_.ptr, leaf_bounds_.ptr + leaf_bounds_.len);
+  this->ViewStorage();
+}
+
+void CompiledForest::Init(const gbm::GBTreeModel& model, NodeLayout layout) {
+  CHECK_EQ(model.param.size_leaf_vector, 0)
+      << "size_leaf_vector is enforced to 0 so far";
+  const size_t ntree = model.trees.size();
+  CHECK_EQ(model.tree_info.size(), ntree);
+  num_group_ = model.param.num_output_group;
+
+  std::vector<size_t>& group_ptr = storage_.group_ptr;
+  std::vector<unsigned>& tree_id = storage_.tree_id;
+  std::vector<size_t>& tree_ptr = storage_.tree_ptr;
+  // bucket trees by output group, keeping the model order inside each group
+  group_ptr.assign(num_group_ + 1, 0);
+  for (size_t i = 0; i < ntree; ++i) {
+    const int gid = model.tree_info[i];
+    CHECK(gid >= 0 && gid < num_group_) << "Invalid output group of tree " << i;
+    ++group_ptr[gid + 1];
+  }
+  std::partial_sum(group_ptr.begin(), group_ptr.end(), group_ptr.begin());
+  tree_id.resize(ntree);
+  storage_.packed_idx.resize(ntree);
+  std::vector<size_t> fill_pos(group_ptr.begin(), group_ptr.end() - 1);
+  for (size_t i = 0; i < ntree; ++i) {
+    const size_t k = fill_pos[model.tree_info[i]]++;
+    tree_id[k] = static_cast<unsigned>(i);
+    storage_.packed_idx[i] = k;
+  }
+
+  std::vector<std::vector<int>> orders(ntree);
+  const auto nsize = static_cast<bst_omp_uint>(ntree);
+#pragma omp parallel for schedule(dynamic)
+  for (bst_omp_uint k = 0; k < nsize; ++k) {
+    const RegTree& tree = *model.trees[tree_id[k]];
+    orders[k] = layout == NodeLayout::kHotPath ? HotPathOrder(tree)
+                                               : BreadthFirstOrder(tree);
+  }
+  tree_ptr.resize(ntree + 1);
+  tree_ptr[0] = 0;
+  for (size_t k = 0; k < ntree; ++k) {
+    tree_ptr[k + 1] = tree_ptr[k] + orders[k].size();
+  }
+
+  storage_.nodes.resize(tree_ptr.back());
+  storage_.leaf_bounds.resize(ntree);
+#pragma omp parallel for schedule(dynamic)
+  for (bst_omp_uint k = 0; k < nsize; ++k) {
+    const RegTree& tree = *model.trees[tree_id[k]];
+    const std::vector<int>& order = orders[k];
+    std::vector<int> position(tree.param.num_nodes, -1);
+    for (size_t i = 0; i < order.size(); ++i) {
+      position[order[i]] = static_cast<int>(i);
+    }
+    Node* out = storage_.nodes.data() + tree_ptr[k];
+    bst_float leaf_min = std::numeric_limits<bst_float>::max();
+    bst_float leaf_max = std::numeric_limits<bst_float>::lowest();
+    for (size_t i = 0; i < order.size(); ++i) {
+      const RegTree::Node& src = tree[order[i]];
+      Node& dst = out[i];
+      dst.nid_ = order[i];
+      if (src.IsLeaf()) {
+        dst.sindex_ = 0;
+        dst.cleft_ = -1;
+        dst.info_.leaf_value = src.LeafValue();
+        leaf_min = std::min(leaf_min, src.LeafValue());
+        leaf_max = std::max(leaf_max, src.LeafValue());
+      } else {
+        dst.sindex_ = src.SplitIndex() | (src.DefaultLeft() ? (1U << 31) : 0U);
+        dst.cleft_ = position[src.LeftChild()];
+        dst.info_.split_cond = src.SplitCond();
+      }
+    }
+    storage_.leaf_bounds[k] = {leaf_min, leaf_max};
+  }
+  this->ViewStorage();
+  revision_ = model.Revision();
+  layout_ = layout;
+}
+
+}  // namespace predictor
+}  // namespace xgboost
@@ -0,0 +1,232 @@
+/*!
+ * Copyright 2019 by Contributors
+ * \file compiled_forest.h
+ * \brief Flattened, read-only layout of a tree ensemble used for CPU inference.
+ */
+#ifndef XGBOOST_PREDICTOR_COMPILED_FOREST_H_
+#define XGBOOST_PREDICTOR_COMPILED_FOREST_H_
+
+#include <dmlc/io.h>
+#include <xgboost/base.h>
+#include <xgboost/tree_model.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../gbm/gbtree_model.h"
+
+namespace xgboost {
+namespace predictor {
+
+/*! \brief order of the nodes of a tree in a CompiledForest */
+enum class NodeLayout : int {
+  /*! \brief level by level, the top levels of a tree share few cache lines */
+  kBreadthFirst = 0,
+  /*!
+   * \brief depth first, descending into the child covering more training
+   *  instances (larger sum_hess) first.  The children of the hot child follow
+   *  right after it, so the likely path through a skewed tree is contiguous.
+   */
+  kHotPath = 1
+};
+
+/*!
+ * \brief All trees of a GBTreeModel packed into one contiguous node array.
+ *
+ *  Nodes of each tree are laid out in a NodeLayout with both children of a
+ *  split stored next to each other, deleted nodes and node statistics are
+ *  dropped.  Each node keeps its id in the source tree, so leaf indices are
+ *  reported the same whatever the layout.  Trees are bucketed by output
+ *  group, so trees contributing to the same group are also contiguous in
+ *  memory.  The layout is built once from a model and must be rebuilt when
+ *  `IsStale` reports the model has changed.  It can also be written to an
+ *  image and used in place from there, e.g. from a memory mapped model file.
+ */
+class CompiledForest {
+ public:
+  /*! \brief packed 16 byte representation of a tree node */
+  class Node {
+   public:
+    Node() = default;
+    /*! \brief index of left child inside the tree, right child follows it */
+    int LeftChild() const { return cleft_; }
+    /*! \brief index of right child inside the tree */
+    int RightChild() const { return cleft_ + 1; }
+    /*! \brief index of default child when feature is missing */
+    int DefaultChild() const { return cleft_ + (DefaultLeft() ? 0 : 1); }
+    /*! \brief feature index of split condition */
+    unsigned SplitIndex() const { return sindex_ & ((1U << 31) - 1U); }
+    /*! \brief when feature is unknown, whether goes to left child */
+    bool DefaultLeft() const { return (sindex_ >> 31) != 0; }
+    /*! \brief whether current node is leaf node */
+    bool IsLeaf() const { return cleft_ == -1; }
+    /*! \brief leaf value of leaf node */
+    bst_float LeafValue() const { return info_.leaf_value; }
+    /*! \brief split condition of the node */
+    bst_float SplitCond() const { return info_.split_cond; }
+    /*! \brief id of this node in the original RegTree */
+    int NodeId() const { return nid_; }
+
+   private:
+    friend class CompiledForest;
+    union Info {
+      bst_float leaf_value;
+      bst_float split_cond;
+    };
+    // split feature index, highest bit is the default direction
+    uint32_t sindex_{0};
+    // left child, -1 for leaf
+    int32_t cleft_{-1};
+    Info info_;
+    // node id in the source tree, used to report leaf indices
+    int32_t nid_{0};
+  };
+
+  CompiledForest() = default;
+  // the views may point into the forest's own storage
+  CompiledForest(const CompiledForest&) = delete;
+  CompiledForest& operator=(const CompiledForest&) = delete;
+
+  /*!
+   * \brief build the layout from trees of a model.
+   * \param model the model to compile.
+   * \param layout order of the nodes in each tree.
+   */
+  void Init(const gbm::GBTreeModel& model,
+            NodeLayout layout = NodeLayout::kBreadthFirst);
+  /*!
+   * \brief append the layout to an image that InitFromImage can use in place.
+   * \param image the image, its current end must be aligned to kImageAlignment.
+   */
+  void SaveImage(std::string* image) const;
+  /*!
+   * \brief use a layout written by SaveImage without copying it.
+   * \param data start of the layout, aligned to kImageAlignment, must outlive
+   *  the forest.
+   * \param size bytes available from data.
+   * \return bytes used by the layout.
+   */
+  size_t InitFromImage(const char* data, size_t size);
+  /*! \brief write the layout as an image to a stream */
+  void Save(dmlc::Stream* fo) const;
+  /*! \brief read a layout written by Save into the forest's own storage */
+  void Load(dmlc::Stream* fi);
+
+  /*! \brief whether the layout no longer matches the given model */
+  bool IsStale(const gbm::GBTreeModel& model,
+               NodeLayout layout = NodeLayout::kBreadthFirst) const {
+    return revision_ != model.Revision() || layout_ != layout ||
+           num_group_ != model.param.num_output_group ||
+           tree_id_.size() != model.trees.size();
+  }
+
+  /*! \brief number of output groups */
+  int NumGroups() const { return num_group_; }
+  /*! \brief number of compiled trees */
+  size_t NumTrees() const { return tree_id_.size(); }
+
+  /*!
+   * \brief packed positions of trees in group `gid` whose index in the model
+   *  falls inside [tree_begin, tree_end), in the original tree order.
+   */
+  std::pair<size_t, size_t> GroupRange(int gid, unsigned tree_begin,
+                                       unsigned tree_end) const {
+    auto begin = tree_id_.cbegin() + group_ptr_[gid];
+    auto end = tree_id_.cbegin() + group_ptr_[gid + 1];
+    auto first = std::lower_bound(begin, end, tree_begin);
+    auto last = std::lower_bound(first, end, tree_end);
+    return {static_cast<size_t>(first - tree_id_.cbegin()),
+            static_cast<size_t>(last - tree_id_.cbegin())};
+  }
+  /*! \brief packed position of the tree with index `tree_id` in the model */
+  size_t PackedIndex(unsigned tree_id) const { return packed_idx_[tree_id]; }
+  /*! \brief index in the model of the tree at packed position `k` */
+  unsigned TreeId(size_t k) const { return tree_id_[k]; }
+  /*! \brief memory used by nodes of the tree at packed position `k` */
+  size_t TreeBytes(size_t k) const {
+    return (tree_ptr_[k + 1] - tree_ptr_[k]) * sizeof(Node);
+  }
+  /*! \brief position of the first node of packed tree `k` among all nodes */
+  size_t TreeOffset(size_t k) const { return tree_ptr_[k]; }
+  /*! \brief number of nodes of all trees */
+  size_t NumNodes() const { return nodes_.size(); }
+  /*! \brief memory used by nodes of all trees */
+  size_t Bytes() const { return nodes_.size() * sizeof(Node); }
+  /*! \brief first node of the tree at packed position `k` */
+  const Node* Tree(size_t k) const { return nodes_.data() + tree_ptr_[k]; }
+  /*! \brief smallest and largest leaf value of the tree at packed position `k` */
+  std::pair<bst_float, bst_float> LeafBounds(size_t k) const {
+    return leaf_bounds_[k];
+  }
+
+  /*!
+   * \brief find the leaf reached by an instance.
+   * \param k packed position of the tree.
+   * \param feat dense feature vector of the instance.
+   * \param root_id starting root index of the instance.
+   */
+  const Node& GetLeaf(size_t k, const RegTree::FVec& feat,
+                      unsigned root_id) const {
+    const Node* tree = this->Tree(k);
+    const Node* node = tree + root_id;
+    while (!node->IsLeaf()) {
+      unsigned split_index = node->SplitIndex();
+      if (feat.IsMissing(split_index)) {
+        node = tree + node->DefaultChild();
+      } else {
+        node = tree + node->LeftChild() +
+               !(feat.Fvalue(split_index) < node->SplitCond());
+      }
+    }
+    return *node;
+  }
+
+ private:
+  /*! \brief arrays of a layout built by Init */
+  struct Storage {
+    std::vector<Node> nodes;
+    std::vector<size_t> tree_ptr;
+    std::vector<unsigned> tree_id;
+    std::vector<size_t> packed_idx;
+    std::vector<size_t> group_ptr;
+    std::vector<std::pair<bst_float, bst_float>> leaf_bounds;
+  };
+  /*! \brief unchecked read-only view of an array, traversal is hot */
+  template <typename T>
+  struct View {
+    const T* ptr{nullptr};
+    size_t len{0};
+    View() = default;
+    explicit View(const std::vector<T>& vec) : ptr(vec.data()), len(vec.size()) {}
+    const T& operator[](size_t i) const { return ptr[i]; }
+    const T* data() const { return ptr; }
+    const T* cbegin() const { return ptr; }
+    size_t size() const { return len; }
+  };
+  // point the views at storage_
+  void ViewStorage();
+
+  Storage storage_;
+  // all nodes, trees stored back to back
+  View<Node> nodes_;
+  // offset of each packed tree in nodes_, size NumTrees() + 1
+  View<size_t> tree_ptr_;
+  // model index of each packed tree
+  View<unsigned> tree_id_;
+  // packed position of each model tree
+  View<size_t> packed_idx_;
+  // packed trees of group g are [group_ptr_[g], group_ptr_[g + 1])
+  View<size_t> group_ptr_;
+  // minimum and maximum leaf value of each packed tree
+  View<std::pair<bst_float, bst_float>> leaf_bounds_;
+  int num_group_{0};
+  uint64_t revision_{0};
+  NodeLayout layout_{NodeLayout::kBreadthFirst};
+};
+
+}  // namespace predictor
+}  // namespace xgboost
+#endif  // XGBOOST_PREDICTOR_COMPILED_FOREST_H_
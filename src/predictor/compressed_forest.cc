@@ -0,0 +1,434 @@
+/*!
+ * Copyright 2019 by Contributors
+ * \file compressed_forest.cc
+ * \brief Inference only tree ensemble with shared threshold tables and
+ *  quantized leaf values.
+ */
+#include <dmlc/omp.h>
+#include <xgboost/logging.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include "compiled_forest.h"
+#include "compressed_forest.h"
+
+namespace xgboost {
+namespace predictor {
+
+namespace {
+// IEEE half precision bits of a float, rounding to nearest even
+uint16_t FloatToHalf(float value) {
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  const auto sign = static_cast<uint16_t>((bits >> 16) & 0x8000U);
+  const uint32_t magnitude = bits & 0x7fffffffU;
+  if (magnitude >= 0x7f800000U) {
+    // infinity or NaN
+    return sign | 0x7c00U | (magnitude > 0x7f800000U ? 0x200U : 0U);
+  }
+  if (magnitude < 0x38800000U) {
+    // below the smallest normal half, a multiple of 2^-24
+    float abs_value;
+    std::memcpy(&abs_value, &magnitude, sizeof(abs_value));
+    return sign | static_cast<uint16_t>(std::nearbyint(abs_value * 16777216.0f));
+  }
+  uint32_t half = (((magnitude >> 23) - 112U) << 10) | ((magnitude >> 13) & 0x3ffU);
+  const uint32_t rest = magnitude & 0x1fffU;
+  if (rest > 0x1000U || (rest == 0x1000U && (half & 1U))) {
+    // may carry into the exponent, up to infinity
+    ++half;
+  }
+  return sign | static_cast<uint16_t>(std::min(half, 0x7c00U));
+}
+
+float HalfToFloat(uint16_t half) {
+  const uint32_t sign = static_cast<uint32_t>(half & 0x8000U) << 16;
+  const uint32_t exponent = (half >> 10) & 0x1fU;
+  const uint32_t mantissa = half & 0x3ffU;
+  if (exponent == 0) {
+    const float value = std::ldexp(static_cast<float>(mantissa), -24);
+    return sign ? -value : value;
+  }
+  const uint32_t bits = exponent == 0x1fU
+      ? sign | 0x7f800000U | (mantissa << 13)
+      : sign | ((exponent + 112U) << 23) | (mantissa << 13);
+  float value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+// leading bytes of a saved compressed forest, followed by the format version
+const char kCompressedForestMagic[4] = {'c', 'm', 'p', 'f'};
+const uint32_t kCompressedForestVersion = 1;
+}  // anonymous namespace
+
+void CompressedForest::Init(const gbm::GBTreeModel& model, LeafFormat format,
+                            bst_float max_leaf_error) {
+  CHECK_GE(max_leaf_error, 0.0f);
+  CompiledForest forest;
+  forest.Init(model);
+  const size_t ntree = model.trees.size();
+  num_feature_ = model.param.num_feature;
+  num_group_ = model.param.num_output_group;
+  base_margin_ = model.base_margin;
+  max_leaf_error_ = 0;
+
+  // distinct thresholds of each feature
+  std::vector<std::vector<bst_float>> feature_thresholds(num_feature_);
+  for (size_t k = 0; k < ntree; ++k) {
+    const CompiledForest::Node* tree = forest.Tree(k);
+    const size_t nnode = forest.TreeBytes(k) / sizeof(CompiledForest::Node);
+    for (size_t i = 0; i < nnode; ++i) {
+      if (!tree[i].IsLeaf()) {
+        CHECK_LT(tree[i].SplitIndex(), static_cast<unsigned>(num_feature_))
+            << "Split on feature " << tree[i].SplitIndex() << " beyond num_feature.";
+        feature_thresholds[tree[i].SplitIndex()].push_back(tree[i].SplitCond());
+      }
+    }
+  }
+  threshold_ptr_.assign(1, 0);
+  thresholds_.clear();
+  for (int fid = 0; fid < num_feature_; ++fid) {
+    std::vector<bst_float>& values = feature_thresholds[fid];
+    std::sort(values.begin(), values.end());
+    values.erase(std::unique(values.begin(), values.end()), values.end());
+    CHECK_LE(values.size(), static_cast<size_t>(std::numeric_limits<uint16_t>::max()) + 1)
+        << "Too many distinct thresholds of feature " << fid << " for 16 bit indices.";
+    thresholds_.insert(thresholds_.end(), values.begin(), values.end());
+    threshold_ptr_.push_back(static_cast<uint32_t>(thresholds_.size()));
+  }
+
+  trees_.resize(ntree);
+  nodes_.clear();
+  leaf_u8_.clear();
+  leaf_f16_.clear();
+  leaf_f32_.clear();
+  std::vector<bst_float> leaves;
+  for (size_t t = 0; t < ntree; ++t) {
+    const size_t k = forest.PackedIndex(static_cast<unsigned>(t));
+    const CompiledForest::Node* tree = forest.Tree(k);
+    const size_t nnode = forest.TreeBytes(k) / sizeof(CompiledForest::Node);
+    CHECK_LE(nnode, static_cast<size_t>(std::numeric_limits<uint16_t>::max()))
+        << "Tree " << t << " has too many nodes for 16 bit child indices.";
+    Tree& out = trees_[t];
+    out.node_begin = nodes_.size();
+    out.group = model.tree_info[t];
+    leaves.clear();
+    for (size_t i = 0; i < nnode; ++i) {
+      Node node;
+      if (tree[i].IsLeaf()) {
+        node.sindex = 0;
+        node.cleft = 0;
+        node.index = static_cast<uint16_t>(leaves.size());
+        leaves.push_back(tree[i].LeafValue());
+      } else {
+        const unsigned fid = tree[i].SplitIndex();
+        auto begin = thresholds_.cbegin() + threshold_ptr_[fid];
+        auto end = thresholds_.cbegin() + threshold_ptr_[fid + 1];
+        node.sindex = fid | (tree[i].DefaultLeft() ? (1U << 31) : 0U);
+        node.cleft = static_cast<uint16_t>(tree[i].LeftChild());
+        node.index = static_cast<uint16_t>(
+            std::lower_bound(begin, end, tree[i].SplitCond()) - begin);
+      }
+      nodes_.push_back(node);
+    }
+
+    // narrowest format keeping every leaf within the bound
+    const auto minmax = std::minmax_element(leaves.cbegin(), leaves.cend());
+    const bst_float lo = *minmax.first;
+    const bst_float hi = *minmax.second;
+    std::vector<uint16_t> codes(leaves.size());
+    out.format = format;
+    while (out.format != LeafFormat::kFloat32) {
+      if (out.format == LeafFormat::kUInt8) {
+        out.bias = lo;
+        out.scale = (hi - lo) / 255.0f;
+      } else {
+        out.bias = 0.0f;
+        out.scale = std::max(std::abs(lo), std::abs(hi));
+      }
+      double error = 0;
+      for (size_t i = 0; i < leaves.size(); ++i) {
+        if (out.format == LeafFormat::kUInt8) {
+          codes[i] = out.scale == 0.0f ? 0 : static_cast<uint16_t>(
+              std::min(255.0f, std::round((leaves[i] - lo) / out.scale)));
+        } else {
+          codes[i] = out.scale == 0.0f ? 0 : FloatToHalf(leaves[i] / out.scale);
+        }
+        const bst_float decoded = out.format == LeafFormat::kUInt8
+            ? out.scale * codes[i] + out.bias
+            : out.scale * HalfToFloat(codes[i]);
+        error = std::max(error, std::abs(static_cast<double>(decoded) - leaves[i]));
+      }
+      if (error <= max_leaf_error) {
+        max_leaf_error_ = std::max(max_leaf_error_, error);
+        break;
+      }
+      out.format = static_cast<LeafFormat>(static_cast<int>(out.format) + 1);
+    }
+    switch (out.format) {
+      case LeafFormat::kUInt8:
+        out.leaf_begin = leaf_u8_.size();
+        leaf_u8_.insert(leaf_u8_.end(), codes.begin(), codes.end());
+        break;
+      case LeafFormat::kFloat16:
+        out.leaf_begin = leaf_f16_.size();
+        leaf_f16_.insert(leaf_f16_.end(), codes.begin(), codes.end());
+        break;
+      case LeafFormat::kFloat32:
+        out.scale = 1.0f;
+        out.bias = 0.0f;
+        out.leaf_begin = leaf_f32_.size();
+        leaf_f32_.insert(leaf_f32_.end(), leaves.begin(), leaves.end());
+        break;
+    }
+  }
+}
+
+bst_float CompressedForest::LeafValue(const Tree& tree, uint16_t leaf) const {
+  switch (tree.format) {
+    case LeafFormat::kUInt8:
+      return tree.scale * leaf_u8_[tree.leaf_begin + leaf] + tree.bias;
+    case LeafFormat::kFloat16:
+      return tree.scale * HalfToFloat(leaf_f16_[tree.leaf_begin + leaf]);
+    default:
+      return leaf_f32_[tree.leaf_begin + leaf];
+  }
+}
+
+bst_float CompressedForest::PredictTree(size_t t, const RegTree::FVec& feat,
+                                        unsigned root_id) const {
+  const Tree& tree = trees_[t];
+  const Node* nodes = nodes_.data() + tree.node_begin;
+  const Node* node = nodes + root_id;
+  while (node->cleft != 0) {
+    const unsigned fid = node->sindex & ((1U << 31) - 1U);
+    if (feat.IsMissing(fid)) {
+      node = nodes + node->cleft + ((node->sindex >> 31) != 0 ? 0 : 1);
+    } else {
+      node = nodes + node->cleft +
+             !(feat.Fvalue(fid) < thresholds_[threshold_ptr_[fid] + node->index]);
+    }
+  }
+  return this->LeafValue(tree, node->index);
+}
+
+void CompressedForest::InitMargins(const MetaInfo& info,
+                                   std::vector<bst_float>* out_preds) const {
+  const auto& base_margin = info.base_margin_.HostVector();
+  if (base_margin.size() == info.num_row_ * num_group_) {
+    *out_preds = base_margin;
+  } else {
+    out_preds->assign(info.num_row_ * num_group_, base_margin_);
+  }
+}
+
+size_t CompressedForest::NumTrees(unsigned ntree_limit) const {
+  const size_t limit = static_cast<size_t>(ntree_limit) * num_group_;
+  return limit == 0 || limit > trees_.size() ? trees_.size() : limit;
+}
+
+void CompressedForest::PredictBatch(DMatrix* p_fmat,
+                                    std::vector<bst_float>* out_preds,
+                                    unsigned ntree_limit) const {
+  const MetaInfo& info = p_fmat->Info();
+  const size_t ntree = this->NumTrees(ntree_limit);
+  std::vector<bst_float>& preds = *out_preds;
+  this->InitMargins(info, &preds);
+  for (const auto& batch : p_fmat->GetRowBatches()) {
+    const auto nsize = static_cast<bst_omp_uint>(batch.Size());
+#pragma omp parallel
+    {
+      RegTree::FVec feats;
+      feats.Init(num_feature_);
+      std::vector<bst_float> psum(num_group_);
+#pragma omp for schedule(static)
+      for (bst_omp_uint i = 0; i < nsize; ++i) {
+        const size_t ridx = batch.base_rowid + i;
+        const unsigned root_id = info.GetRoot(ridx);
+        feats.Fill(batch[i]);
+        std::fill(psum.begin(), psum.end(), 0.0f);
+        for (size_t t = 0; t < ntree; ++t) {
+          psum[trees_[t].group] += this->PredictTree(t, feats, root_id);
+        }
+        for (int gid = 0; gid < num_group_; ++gid) {
+          preds[ridx * num_group_ + gid] += psum[gid];
+        }
+        feats.Drop(batch[i]);
+      }
+    }
+  }
+}
+
+CompressionReport CompressedForest::Report(const gbm::GBTreeModel& model,
+                                           DMatrix* p_fmat) const {
+  CHECK_EQ(model.trees.size(), trees_.size())
+      << "Model is not the one the forest was compressed from.";
+  CompressionReport report;
+  report.bytes = this->Bytes();
+  for (const auto& tree : model.trees) {
+    report.original_bytes += static_cast<size_t>(tree->param.num_nodes) *
+                             (sizeof(RegTree::Node) + sizeof(RTreeNodeStat));
+  }
+  for (const Tree& tree : trees_) {
+    ++report.num_trees[static_cast<int>(tree.format)];
+  }
+  report.max_leaf_error = max_leaf_error_;
+
+  // margins of the source trees, summed in the same order
+  std::vector<bst_float> preds, exact;
+  this->PredictBatch(p_fmat, &preds);
+  this->InitMargins(p_fmat->Info(), &exact);
+  const MetaInfo& info = p_fmat->Info();
+  for (const auto& batch : p_fmat->GetRowBatches()) {
+    const auto nsize = static_cast<bst_omp_uint>(batch.Size());
+#pragma omp parallel
+    {
+      RegTree::FVec feats;
+      feats.Init(num_feature_);
+      std::vector<bst_float> psum(num_group_);
+#pragma omp for schedule(static)
+      for (bst_omp_uint i = 0; i < nsize; ++i) {
+        const size_t ridx = batch.base_rowid + i;
+        const unsigned root_id = info.GetRoot(ridx);
+        feats.Fill(batch[i]);
+        std::fill(psum.begin(), psum.end(), 0.0f);
+        for (size_t t = 0; t < model.trees.size(); ++t) {
+          const RegTree& tree = *model.trees[t];
+          psum[model.tree_info[t]] += tree[tree.GetLeafIndex(feats, root_id)].LeafValue();
+        }
+        for (int gid = 0; gid < num_group_; ++gid) {
+          exact[ridx * num_group_ + gid] += psum[gid];
+        }
+        feats.Drop(batch[i]);
+      }
+    }
+  }
+  double max_error = 0, sum_error = 0;
+  for (size_t i = 0; i < preds.size(); ++i) {
+    const double error = std::abs(static_cast<double>(preds[i]) - exact[i]);
+    max_error = std::max(max_error, error);
+    sum_error += error;
+  }
+  report.max_error = max_error;
+  report.mean_error = preds.empty() ? 0 : sum_error / preds.size();
+  return report;
+}
+
+void CompressedForest::Save(dmlc::Stream* fo) const {
+  static_assert(sizeof(Node) == 8, "Node must be saved without padding.");
+  fo->Write(kCompressedForestMagic, sizeof(kCompressedForestMagic));
+  fo->Write(kCompressedForestVersion);
+  fo->Write(static_cast<int32_t>(num_feature_));
+  fo->Write(static_cast<int32_t>(num_group_));
+  fo->Write(base_margin_);
+  fo->Write(max_leaf_error_);
+  fo->Write(threshold_ptr_);
+  fo->Write(thresholds_);
+  fo->Write(leaf_u8_);
+  fo->Write(leaf_f16_);
+  fo->Write(leaf_f32_);
+  fo->Write(nodes_);
+  // trees column by column in fixed width fields
+  std::vector<uint64_t> node_begin(trees_.size()), leaf_begin(trees_.size());
+  std::vector<bst_float> scale(trees_.size()), bias(trees_.size());
+  std::vector<int32_t> group(trees_.size());
+  std::vector<uint8_t> format(trees_.size());
+  for (size_t t = 0; t < trees_.size(); ++t) {
+    node_begin[t] = trees_[t].node_begin;
+    leaf_begin[t] = trees_[t].leaf_begin;
+    scale[t] = trees_[t].scale;
+    bias[t] = trees_[t].bias;
+    group[t] = trees_[t].group;
+    format[t] = static_cast<uint8_t>(trees_[t].format);
+  }
+  fo->Write(node_begin);
+  fo->Write(leaf_begin);
+  fo->Write(scale);
+  fo->Write(bias);
+  fo->Write(group);
+  fo->Write(format);
+}
+
+void CompressedForest::Load(dmlc::Stream* fi) {
+  char magic[sizeof(kCompressedForestMagic)];
+  CHECK_EQ(fi->Read(magic, sizeof(magic)), sizeof(magic)) << "Invalid compressed forest";
+  CHECK_EQ(std::memcmp(magic, kCompressedForestMagic, sizeof(magic)), 0)
+      << "Invalid compressed forest";
+  uint32_t version;
+  CHECK(fi->Read(&version)) << "Invalid compressed forest";
+  CHECK_EQ(version, kCompressedForestVersion)
+      << "Unsupported compressed forest version " << version;
+  int32_t num_feature, num_group;
+  std::vector<uint64_t> node_begin, leaf_begin;
+  std::vector<bst_float> scale, bias;
+  std::vector<int32_t> group;
+  std::vector<uint8_t> format;
+  CHECK(fi->Read(&num_feature) && fi->Read(&num_group) && fi->Read(&base_margin_) &&
+        fi->Read(&max_leaf_error_) && fi->Read(&threshold_ptr_) && fi->Read(&thresholds_) &&
+        fi->Read(&leaf_u8_) && fi->Read(&leaf_f16_) && fi->Read(&leaf_f32_) &&
+        fi->Read(&nodes_) && fi->Read(&node_begin) && fi->Read(&leaf_begin) &&
+        fi->Read(&scale) && fi->Read(&bias) && fi->Read(&group) && fi->Read(&format))
+      << "Invalid compressed forest";
+  num_feature_ = num_feature;
+  num_group_ = num_group;
+
+  // every index read during prediction must stay inside its array
+  CHECK(num_feature_ >= 0 && num_group_ >= 1 &&
+        threshold_ptr_.size() == static_cast<size_t>(num_feature_) + 1 &&
+        threshold_ptr_.front() == 0 && threshold_ptr_.back() == thresholds_.size() &&
+        std::is_sorted(threshold_ptr_.cbegin(), threshold_ptr_.cend()))
+      << "Invalid compressed forest: threshold table";
+  const size_t ntree = format.size();
+  CHECK(node_begin.size() == ntree && leaf_begin.size() == ntree && scale.size() == ntree &&
+        bias.size() == ntree && group.size() == ntree)
+      << "Invalid compressed forest: tree table";
+  trees_.resize(ntree);
+  for (size_t t = 0; t < ntree; ++t) {
+    Tree& tree = trees_[t];
+    const uint64_t node_end = t + 1 == ntree ? nodes_.size() : node_begin[t + 1];
+    CHECK(node_begin[t] < node_end && node_end <= nodes_.size())
+        << "Invalid compressed forest: nodes of tree " << t;
+    CHECK_LE(format[t], static_cast<uint8_t>(LeafFormat::kFloat32))
+        << "Invalid compressed forest: leaf format of tree " << t;
+    CHECK(group[t] >= 0 && group[t] < num_group_)
+        << "Invalid compressed forest: group of tree " << t;
+    tree.node_begin = node_begin[t];
+    tree.leaf_begin = leaf_begin[t];
+    tree.scale = scale[t];
+    tree.bias = bias[t];
+    tree.format = static_cast<LeafFormat>(format[t]);
+    tree.group = group[t];
+    const size_t num_leaf_values = tree.format == LeafFormat::kUInt8 ? leaf_u8_.size()
+        : tree.format == LeafFormat::kFloat16 ? leaf_f16_.size() : leaf_f32_.size();
+    const size_t nnode = node_end - node_begin[t];
+    for (size_t i = 0; i < nnode; ++i) {
+      const Node& node = nodes_[tree.node_begin + i];
+      if (node.cleft == 0) {
+        CHECK(leaf_begin[t] < num_leaf_values && node.index < num_leaf_values - leaf_begin[t])
+            << "Invalid compressed forest: leaf node " << i << " of tree " << t;
+      } else {
+        // children follow their parent, so traversal always ends at a leaf
+        const unsigned fid = node.sindex & ((1U << 31) - 1U);
+        CHECK(node.cleft > i && node.cleft + 1U < nnode && fid < threshold_ptr_.size() - 1 &&
+              threshold_ptr_[fid] + node.index < threshold_ptr_[fid + 1])
+            << "Invalid compressed forest: split node " << i << " of tree " << t;
+      }
+    }
+  }
+}
+
+size_t CompressedForest::Bytes() const {
+  return trees_.size() * sizeof(Tree) + nodes_.size() * sizeof(Node) +
+         threshold_ptr_.size() * sizeof(uint32_t) +
+         thresholds_.size() * sizeof(bst_float) +
+         leaf_u8_.size() * sizeof(uint8_t) + leaf_f16_.size() * sizeof(uint16_t) +
+         leaf_f32_.size() * sizeof(bst_float);
+}
+
+}  // namespace predictor
+}  // namespace xgboost
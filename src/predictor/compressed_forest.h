@@ -0,0 +1,151 @@
+/*!
+ * Copyright 2019 by Contributors
+ * \file compressed_forest.h
+ * \brief Inference only tree ensemble with shared threshold tables and
+ *  quantized leaf values.
+ */
+#ifndef XGBOOST_PREDICTOR_COMPRESSED_FOREST_H_
+#define XGBOOST_PREDICTOR_COMPRESSED_FOREST_H_
+
+#include <dmlc/io.h>
+#include <xgboost/base.h>
+#include <xgboost/data.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "../gbm/gbtree_model.h"
+
+namespace xgboost {
+namespace predictor {
+
+/*! \brief storage of the leaf values of a compressed tree, narrowest first */
+enum class LeafFormat : uint8_t {
+  /*! \brief 8 bit codes of an affine grid between the smallest and largest leaf */
+  kUInt8 = 0,
+  /*! \brief half precision floats scaled by the largest leaf magnitude */
+  kFloat16 = 1,
+  /*! \brief the exact values */
+  kFloat32 = 2
+};
+
+/*! \brief size and accuracy of a compressed forest */
+struct CompressionReport {
+  /*! \brief bytes used by the compressed forest */
+  size_t bytes{0};
+  /*! \brief bytes used by nodes and statistics of the source trees */
+  size_t original_bytes{0};
+  /*! \brief number of trees stored in each LeafFormat */
+  size_t num_trees[3]{0, 0, 0};
+  /*! \brief largest error of a single leaf value */
+  double max_leaf_error{0};
+  /*! \brief largest absolute error of a margin on the validation rows */
+  double max_error{0};
+  /*! \brief mean absolute error of the margins on the validation rows */
+  double mean_error{0};
+};
+
+/*!
+ * \brief A tree ensemble reduced to what prediction reads.
+ *
+ *  Node statistics are dropped.  A node takes 8 bytes: the split feature with
+ *  the default direction, the left child inside the tree (the right child
+ *  follows it), and a 16 bit index.  For a split the index selects the
+ *  threshold among the sorted distinct thresholds of the feature, shared by
+ *  all trees, so thresholds stay exact.  For a leaf it selects the value among
+ *  the leaves of the tree, which are stored per tree in the narrowest
+ *  LeafFormat whose error stays within a bound.  Trees are limited to 65535
+ *  nodes and features to 65536 distinct thresholds.
+ */
+class CompressedForest {
+ public:
+  /*! \brief packed 8 byte representation of a tree node */
+  struct Node {
+    // split feature index, highest bit is the default direction
+    uint32_t sindex;
+    // left child inside the tree, 0 for a leaf
+    uint16_t cleft;
+    // threshold index for a split, leaf index for a leaf
+    uint16_t index;
+  };
+
+  /*!
+   * \brief compress a model.
+   * \param model the model to compress.
+   * \param format the narrowest format tried for the leaves of each tree.
+   * \param max_leaf_error largest error allowed for a single leaf value, a tree
+   *  whose leaves don't fit `format` within it takes the next wider format.
+   */
+  void Init(const gbm::GBTreeModel& model, LeafFormat format,
+            bst_float max_leaf_error);
+
+  /*!
+   * \brief predict margins of a matrix.
+   * \param p_fmat the input rows.
+   * \param out_preds output of size num_row * num_output_group.
+   * \param ntree_limit limit number of trees used, 0 for all.
+   */
+  void PredictBatch(DMatrix* p_fmat, std::vector<bst_float>* out_preds,
+                    unsigned ntree_limit = 0) const;
+
+  /*!
+   * \brief measure the compression against the model it was built from.
+   * \param model the model given to Init.
+   * \param p_fmat validation rows the margins are compared on.
+   */
+  CompressionReport Report(const gbm::GBTreeModel& model, DMatrix* p_fmat) const;
+
+  /*! \brief bytes used by the compressed forest */
+  size_t Bytes() const;
+
+  /*!
+   * \brief write the compressed forest to a stream, behind a magic number and
+   *  a format version, in fixed width fields.
+   */
+  void Save(dmlc::Stream* fo) const;
+  /*!
+   * \brief read a forest written by Save, it predicts without the model.
+   *  Every index is checked, a corrupted forest is rejected.
+   */
+  void Load(dmlc::Stream* fi);
+
+ private:
+  /*! \brief layout of a tree */
+  struct Tree {
+    // first node in nodes_
+    size_t node_begin;
+    // first leaf value in the array of the format
+    size_t leaf_begin;
+    // leaf value is scale * code + bias
+    bst_float scale;
+    bst_float bias;
+    LeafFormat format;
+    int group;
+  };
+  // value of leaf `leaf` of tree `tree`
+  bst_float LeafValue(const Tree& tree, uint16_t leaf) const;
+  // leaf value reached by a row in tree `t`
+  bst_float PredictTree(size_t t, const RegTree::FVec& feat, unsigned root_id) const;
+  // number of trees used for a tree limit
+  size_t NumTrees(unsigned ntree_limit) const;
+  // base margins of the rows
+  void InitMargins(const MetaInfo& info, std::vector<bst_float>* out_preds) const;
+
+  std::vector<Tree> trees_;
+  std::vector<Node> nodes_;
+  // distinct split thresholds of feature f are [threshold_ptr_[f], threshold_ptr_[f + 1])
+  std::vector<uint32_t> threshold_ptr_;
+  std::vector<bst_float> thresholds_;
+  // leaf values of each format
+  std::vector<uint8_t> leaf_u8_;
+  std::vector<uint16_t> leaf_f16_;
+  std::vector<bst_float> leaf_f32_;
+  double max_leaf_error_{0};
+  int num_feature_{0};
+  int num_group_{0};
+  bst_float base_margin_{0.0f};
+};
+
+}  // namespace predictor
+}  // namespace xgboost
+#endif  // XGBOOST_PREDICTOR_COMPRESSED_FOREST_H_
@@ -1,67 +1,373 @@
 /*!
  * Copyright by Contributors 2017
  */
+#include <dmlc/parameter.h>
+#include <dmlc/thread_local.h>
 #include <xgboost/predictor.h>
 #include <xgboost/tree_model.h>
 #include <xgboost/tree_updater.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif  // defined(__unix__) || defined(__APPLE__)
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
 #include "dmlc/logging.h"
 #include "../common/host_device_vector.h"
+#include "compiled_forest.h"
+#include "shap_summary.h"
+#include "traversal_kernel.h"
 
 namespace xgboost {
 namespace predictor {
 
 DMLC_REGISTRY_FILE_TAG(cpu_predictor);
 
+/*! \brief parameters of the CPU predictor */
+struct CPUPredictionParam : public dmlc::Parameter<CPUPredictionParam> {
+  /*! \brief size in bytes of the per core cache used to block prediction */
+  int predictor_cache_size;
+  /*! \brief instruction set used to traverse trees in batch prediction */
+  int predictor_kernel;
+  /*! \brief batches with fewer rows are parallelised over trees */
+  int predictor_tree_parallel_rows;
+  /*! \brief number of tree prefix sums kept for each cached matrix */
+  int predictor_prefix_cache;
+  /*! \brief megabytes of TreeSHAP path summaries kept for a model */
+  int predictor_shap_cache;
+  /*! \brief order of the nodes in the flattened trees */
+  int predictor_node_layout;
+  // declare parameters
+  DMLC_DECLARE_PARAMETER(CPUPredictionParam) {
+    DMLC_DECLARE_FIELD(predictor_cache_size)
+        .set_default(0)
+        .set_lower_bound(0)
+        .describe("Size in bytes of the per core (L2) cache used to block "
+                  "rows and trees during batch prediction, 0 to detect it.");
+    DMLC_DECLARE_FIELD(predictor_kernel)
+        .set_default(kAutoKernel)
+        .add_enum("auto", kAutoKernel)
+        .add_enum("scalar", kScalarKernel)
+        .add_enum("avx2", kAVX2Kernel)
+        .add_enum("avx512", kAVX512Kernel)
+        .describe("Instruction set used to traverse trees in batch prediction, "
+                  "auto picks the widest one supported by the CPU.");
+    DMLC_DECLARE_FIELD(predictor_tree_parallel_rows)
+        .set_default(-1)
+        .set_lower_bound(-1)
+        .describe("Batches with fewer rows than this are predicted in parallel "
+                  "over trees instead of rows, -1 for the number of threads, "
+                  "0 to always parallelise over rows.");
+    DMLC_DECLARE_FIELD(predictor_prefix_cache)
+        .set_default(0)
+        .set_lower_bound(0)
+        .describe("Number of leaf sums over a prefix of the trees kept for "
+                  "each cached matrix, used to predict with ntree_limit "
+                  "incrementally. Each one holds a value per row and output "
+                  "group. 0 to disable.");
+    DMLC_DECLARE_FIELD(predictor_shap_cache)
+        .set_default(0)
+        .set_lower_bound(0)
+        .describe("Megabytes of precomputed path summaries used to speed up "
+                  "SHAP values, trees that don't fit the budget are explained "
+                  "with plain TreeSHAP. 0 to disable.");
+    DMLC_DECLARE_FIELD(predictor_node_layout)
+        .set_default(static_cast<int>(NodeLayout::kBreadthFirst))
+        .add_enum("breadth_first", static_cast<int>(NodeLayout::kBreadthFirst))
+        .add_enum("hot_path", static_cast<int>(NodeLayout::kHotPath))
+        .describe("Order of the nodes of each tree in memory. hot_path places "
+                  "the child with the larger cover right after its parent, "
+                  "covers can be recomputed on calibration data with the "
+                  "refresh updater and refresh_leaf=0.");
+  }
+};
+
+DMLC_REGISTER_PARAMETER(CPUPredictionParam);
+
+namespace {
+// size of the per core cache, falls back to a conservative guess
+size_t DetectCacheSize() {
+#if defined(_SC_LEVEL2_CACHE_SIZE)
+  const long size = sysconf(_SC_LEVEL2_CACHE_SIZE);  // NOLINT
+  if (size > 0) {
+    return static_cast<size_t>(size);
+  }
+#endif  // defined(_SC_LEVEL2_CACHE_SIZE)
+  return 256 * 1024;
+}
+
+/*! \brief scratch space owned by each thread calling into the predictor */
+struct PredictorThreadEntry {
+  RegTree::FVec feats;
+  // scratch of SHAP interaction values
+  std::vector<bst_float> shap;
+  // dense accumulator of sparse contributions, all zero between rows
+  std::vector<bst_float> contribs;
+};
+
+// Feature vector of the calling thread.  Keeping scratch per OS thread instead
+// of per predictor lets any number of application threads (and their OpenMP
+// teams) predict with one model concurrently, without locks or allocations
+// once the vector has been sized.
+RegTree::FVec& ThreadFVec(int num_feature) {
+  RegTree::FVec& feats =
+      dmlc::ThreadLocalStore<PredictorThreadEntry>::Get()->feats;
+  if (feats.Size() != static_cast<size_t>(num_feature)) {
+    feats.Init(num_feature);
+  }
+  return feats;
+}
+
+// Zeroed SHAP scratch of the calling thread holding at least size values.
+bst_float* ThreadShapScratch(size_t size) {
+  std::vector<bst_float>& shap =
+      dmlc::ThreadLocalStore<PredictorThreadEntry>::Get()->shap;
+  shap.resize(size);
+  std::fill(shap.begin(), shap.end(), 0);
+  return dmlc::BeginPtr(shap);
+}
+
+// Contribution accumulator of the calling thread, callers reset every value
+// they touch so only growing it needs to write zeros.
+bst_float* ThreadContribs(size_t size) {
+  std::vector<bst_float>& contribs =
+      dmlc::ThreadLocalStore<PredictorThreadEntry>::Get()->contribs;
+  if (contribs.size() < size) {
+    contribs.resize(size, 0);
+  }
+  return dmlc::BeginPtr(contribs);
+}
+}  // anonymous namespace
+
 class CPUPredictor : public Predictor {
  protected:
-  static bst_float PredValue(const  SparsePage::Inst& inst,
-                             const std::vector<std::unique_ptr<RegTree>>& trees,
-                             const std::vector<int>& tree_info, int bst_group,
-                             unsigned root_index, RegTree::FVec* p_feats,
-                             unsigned tree_begin, unsigned tree_end) {
+  // bounds of the number of rows traversed together
+  static constexpr size_t kMinBlockRows = 16;
+  static constexpr size_t kMaxBlockRows = 256;
+  /*! \brief rows and trees processed together by the block traversal */
+  struct TileShape {
+    // number of rows in a row block
+    size_t block_rows;
+    // tree blocks as [begin, end) packed tree positions
+    std::vector<std::pair<size_t, size_t>> tree_blocks;
+  };
+
+  // sum of leaf values over the packed trees [range.first, range.second)
+  static bst_float PredValue(const CompiledForest& forest,
+                             const RegTree::FVec& feats,
+                             std::pair<size_t, size_t> range,
+                             unsigned root_index) {
     bst_float psum = 0.0f;
-    p_feats->Fill(inst);
-    for (size_t i = tree_begin; i < tree_end; ++i) {
-      if (tree_info[i] == bst_group) {
-        int tid = trees[i]->GetLeafIndex(*p_feats, root_index);
-        psum += (*trees[i])[tid].LeafValue();
-      }
+    for (size_t k = range.first; k < range.second; ++k) {
+      psum += forest.GetLeaf(k, feats, root_index).LeafValue();
     }
-    p_feats->Drop(inst);
     return psum;
   }
 
-  // init thread buffers
-  inline void InitThreadTemp(int nthread, int num_feature) {
-    int prev_thread_temp_size = thread_temp.size();
-    if (prev_thread_temp_size < nthread) {
-      thread_temp.resize(nthread, RegTree::FVec());
-      for (int i = prev_thread_temp_size; i < nthread; ++i) {
-        thread_temp[i].Init(num_feature);
+  // Get the compiled layout of the model, rebuilding it if the model changed.
+  // Once built for a revision the forest is only read, so concurrent callers
+  // take the atomic check and never the lock.  A model mapped from an image
+  // brings its own forest.
+  const CompiledForest& GetForest(const gbm::GBTreeModel& model) {
+    if (model.mapped_forest != nullptr) {
+      return *model.mapped_forest;
+    }
+    if (forest_revision_.load(std::memory_order_acquire) != model.Revision()) {
+      std::lock_guard<std::mutex> guard(forest_mutex_);
+      const auto layout = static_cast<NodeLayout>(param_.predictor_node_layout);
+      if (forest_.IsStale(model, layout)) {
+        forest_.Init(model, layout);
+      }
+      forest_revision_.store(model.Revision(), std::memory_order_release);
+    }
+    return forest_;
+  }
+
+  // Split the forest into blocks of trees and the batch into blocks of rows
+  // such that one tree block and the feature vectors of one row block share
+  // the cache.  A forest fitting the cache as a whole is a single block.
+  TileShape ComputeTileShape(const CompiledForest& forest,
+                             int num_feature) const {
+    const size_t cache_size = param_.predictor_cache_size > 0
+        ? static_cast<size_t>(param_.predictor_cache_size)
+        : DetectCacheSize();
+    const size_t budget = cache_size / 2;
+    TileShape shape;
+    const size_t row_bytes =
+        std::max(static_cast<size_t>(num_feature), static_cast<size_t>(1)) *
+        sizeof(bst_float);
+    shape.block_rows = std::min(std::max(budget / row_bytes, kMinBlockRows),
+                                kMaxBlockRows);
+    size_t begin = 0, bytes = 0;
+    for (size_t k = 0; k < forest.NumTrees(); ++k) {
+      const size_t tree_bytes = forest.TreeBytes(k);
+      if (k != begin && bytes + tree_bytes > budget) {
+        shape.tree_blocks.emplace_back(begin, k);
+        begin = k;
+        bytes = 0;
+      }
+      bytes += tree_bytes;
+    }
+    shape.tree_blocks.emplace_back(begin, forest.NumTrees());
+    return shape;
+  }
+
+  // Block prediction of one row batch: every thread takes a block of rows
+  // and pushes it through one cache sized block of trees after another,
+  // keeping partial margins of the rows.  Each tree is applied to all rows of
+  // the block at once by the traversal kernel.  Trees of a group are still
+  // summed in model order, so the result matches the row by row loop exactly.
+  void PredBatchBlocked(const SparsePage& batch, const MetaInfo& info,
+                        const CompiledForest& forest, const TileShape& shape,
+                        TraversalKernel kernel,
+                        const std::vector<std::pair<size_t, size_t>>& ranges,
+                        int num_feature, std::vector<bst_float>* out_preds) {
+    const int num_group = static_cast<int>(ranges.size());
+    const size_t block_rows = shape.block_rows;
+    const size_t nsize = batch.Size();
+    const auto nblock =
+        static_cast<bst_omp_uint>((nsize + block_rows - 1) / block_rows);
+    std::vector<bst_float>& preds = *out_preds;
+#pragma omp parallel
+    {
+      FeatureBlock feats;
+      feats.Init(block_rows, num_feature);
+      std::vector<bst_float> psum(block_rows * num_group);
+      std::vector<unsigned> roots(block_rows);
+#pragma omp for schedule(static)
+      for (bst_omp_uint b = 0; b < nblock; ++b) {
+        const size_t row_begin = static_cast<size_t>(b) * block_rows;
+        const size_t nrows = std::min(block_rows, nsize - row_begin);
+        for (size_t r = 0; r < nrows; ++r) {
+          feats.Fill(r, batch[row_begin + r]);
+          roots[r] = info.GetRoot(batch.base_rowid + row_begin + r);
+        }
+        std::fill(psum.begin(), psum.end(), 0.0f);
+        for (const auto& tile : shape.tree_blocks) {
+          for (int gid = 0; gid < num_group; ++gid) {
+            const size_t first = std::max(tile.first, ranges[gid].first);
+            const size_t last = std::min(tile.second, ranges[gid].second);
+            for (size_t k = first; k < last; ++k) {
+              kernel(forest.Tree(k), feats, nrows, roots.data(),
+                     psum.data() + gid, num_group);
+            }
+          }
+        }
+        for (size_t r = 0; r < nrows; ++r) {
+          const size_t ridx = batch.base_rowid + row_begin + r;
+          for (int gid = 0; gid < num_group; ++gid) {
+            preds[ridx * num_group + gid] += psum[r * num_group + gid];
+          }
+          feats.Drop(r, batch[row_begin + r]);
+        }
+      }
+    }
+  }
+
+  // Prediction of a batch too small to keep every thread busy with rows: the
+  // rows are loaded once into a shared block and each thread traverses a
+  // contiguous slice of the trees in the group ranges, writing one leaf value
+  // per row and tree.  The leaf values are then summed per group in model
+  // order, so the result is identical to the row parallel loops.
+  void PredBatchTreeParallel(const SparsePage& batch, const MetaInfo& info,
+                             const CompiledForest& forest, TraversalKernel kernel,
+                             const std::vector<std::pair<size_t, size_t>>& ranges,
+                             int num_feature, std::vector<bst_float>* out_preds) {
+    const int num_group = static_cast<int>(ranges.size());
+    const size_t nrows = batch.Size();
+    // trees used, the ranges of the groups one after the other
+    std::vector<size_t> trees;
+    for (const auto& range : ranges) {
+      for (size_t k = range.first; k < range.second; ++k) {
+        trees.push_back(k);
+      }
+    }
+    const size_t ntree = trees.size();
+    std::vector<bst_float>& preds = *out_preds;
+    FeatureBlock feats;
+    feats.Init(nrows, num_feature);
+    std::vector<unsigned> roots(nrows);
+    for (size_t r = 0; r < nrows; ++r) {
+      feats.Fill(r, batch[r]);
+      roots[r] = info.GetRoot(batch.base_rowid + r);
+    }
+    std::vector<bst_float> leaf_values(nrows * ntree, 0.0f);
+    const auto nsize = static_cast<bst_omp_uint>(ntree);
+#pragma omp parallel for schedule(static)
+    for (bst_omp_uint j = 0; j < nsize; ++j) {
+      kernel(forest.Tree(trees[j]), feats, nrows, roots.data(), &leaf_values[j], ntree);
+    }
+    for (size_t r = 0; r < nrows; ++r) {
+      const size_t ridx = batch.base_rowid + r;
+      size_t j = r * ntree;
+      for (int gid = 0; gid < num_group; ++gid) {
+        bst_float psum = 0.0f;
+        for (size_t k = ranges[gid].first; k < ranges[gid].second; ++k, ++j) {
+          psum += leaf_values[j];
+        }
+        preds[ridx * num_group + gid] += psum;
       }
     }
   }
+
   inline void PredLoopSpecalize(DMatrix* p_fmat,
                                 std::vector<bst_float>* out_preds,
                                 const gbm::GBTreeModel& model, int num_group,
                                 unsigned tree_begin, unsigned tree_end) {
     const MetaInfo& info = p_fmat->Info();
-    const int nthread = omp_get_max_threads();
-    InitThreadTemp(nthread, model.param.num_feature);
     std::vector<bst_float>& preds = *out_preds;
     CHECK_EQ(model.param.size_leaf_vector, 0)
         << "size_leaf_vector is enforced to 0 so far";
     CHECK_EQ(preds.size(), p_fmat->Info().num_row_ * num_group);
+    const CompiledForest& forest = this->GetForest(model);
+    std::vector<std::pair<size_t, size_t>> ranges(num_group);
+    for (int gid = 0; gid < num_group; ++gid) {
+      ranges[gid] = forest.GroupRange(gid, tree_begin, tree_end);
+    }
+    const TileShape shape =
+        this->ComputeTileShape(forest, model.param.num_feature);
+    const TraversalKernel kernel = GetTraversalKernel(
+        static_cast<TraversalKernelType>(param_.predictor_kernel),
+        shape.block_rows * model.param.num_feature);
+    // block traversal pays off when the forest exceeds the cache or when
+    // rows can be moved through a tree in lock step by a SIMD kernel
+    const bool blocked = shape.tree_blocks.size() > 1 ||
+        kernel != GetTraversalKernel(kScalarKernel, 0);
+    const int nthread = omp_get_max_threads();
+    const size_t tree_parallel_rows = param_.predictor_tree_parallel_rows < 0
+        ? static_cast<size_t>(nthread)
+        : static_cast<size_t>(param_.predictor_tree_parallel_rows);
     // start collecting the prediction
     for (const auto &batch : p_fmat->GetRowBatches()) {
+      if (batch.Size() < tree_parallel_rows && forest.NumTrees() > 1) {
+        this->PredBatchTreeParallel(
+            batch, info, forest,
+            GetTraversalKernel(
+                static_cast<TraversalKernelType>(param_.predictor_kernel),
+                batch.Size() * model.param.num_feature),
+            ranges, model.param.num_feature, &preds);
+        continue;
+      }
+      if (blocked && batch.Size() >= kMinBlockRows) {
+        this->PredBatchBlocked(batch, info, forest, shape, kernel, ranges,
+                               model.param.num_feature, &preds);
+        continue;
+      }
       // parallel over local batch
       constexpr int kUnroll = 8;
       const auto nsize = static_cast<bst_omp_uint>(batch.Size());
       const bst_omp_uint rest = nsize % kUnroll;
 #pragma omp parallel for schedule(static)
       for (bst_omp_uint i = 0; i < nsize - rest; i += kUnroll) {
-        const int tid = omp_get_thread_num();
-        RegTree::FVec& feats = thread_temp[tid];
+        RegTree::FVec& feats = ThreadFVec(model.param.num_feature);
         int64_t ridx[kUnroll];
         SparsePage::Inst inst[kUnroll];
         for (int k = 0; k < kUnroll; ++k) {
@@ -71,24 +377,26 @@ class CPUPredictor : public Predictor {
           inst[k] = batch[i + k];
         }
         for (int k = 0; k < kUnroll; ++k) {
+          feats.Fill(inst[k]);
           for (int gid = 0; gid < num_group; ++gid) {
             const size_t offset = ridx[k] * num_group + gid;
-            preds[offset] += this->PredValue(
-                inst[k], model.trees, model.tree_info, gid,
-                info.GetRoot(ridx[k]), &feats, tree_begin, tree_end);
+            preds[offset] += PredValue(forest, feats, ranges[gid],
+                                       info.GetRoot(ridx[k]));
           }
+          feats.Drop(inst[k]);
         }
       }
       for (bst_omp_uint i = nsize - rest; i < nsize; ++i) {
-        RegTree::FVec& feats = thread_temp[0];
+        RegTree::FVec& feats = ThreadFVec(model.param.num_feature);
         const auto ridx = static_cast<int64_t>(batch.base_rowid + i);
         auto inst = batch[i];
+        feats.Fill(inst);
         for (int gid = 0; gid < num_group; ++gid) {
           const size_t offset = ridx * num_group + gid;
-          preds[offset] +=
-              this->PredValue(inst, model.trees, model.tree_info, gid,
-                              info.GetRoot(ridx), &feats, tree_begin, tree_end);
+          preds[offset] += PredValue(forest, feats, ranges[gid],
+                                     info.GetRoot(ridx));
         }
+        feats.Drop(inst);
       }
     }
   }
@@ -101,57 +409,103 @@ class CPUPredictor : public Predictor {
                       tree_begin, ntree_limit);
   }
 
-  bool PredictFromCache(DMatrix* dmat,
-                        HostDeviceVector<bst_float>* out_preds,
-                        const gbm::GBTreeModel& model,
-                        unsigned ntree_limit) {
-    if (ntree_limit == 0 ||
-        ntree_limit * model.param.num_output_group >= model.trees.size()) {
-      auto it = cache_.find(dmat);
-      if (it != cache_.end()) {
-        const HostDeviceVector<bst_float>& y = it->second.predictions;
-        if (y.Size() != 0) {
-          out_preds->Resize(y.Size());
-          std::copy(y.HostVector().begin(), y.HostVector().end(),
-                    out_preds->HostVector().begin());
-          return true;
+  // Add the leaf values of trees with model index in [tree_begin, tree_end)
+  // to per row and group sums, one tree after another in model order, so that
+  // continuing a sum over a tree prefix gives the sum computed from scratch.
+  void AccumulateLeafSums(DMatrix* dmat, const gbm::GBTreeModel& model,
+                          const CompiledForest& forest, unsigned tree_begin,
+                          unsigned tree_end, std::vector<bst_float>* sums) {
+    const MetaInfo& info = dmat->Info();
+    const int num_group = model.param.num_output_group;
+    std::vector<std::pair<size_t, size_t>> ranges(num_group);
+    for (int gid = 0; gid < num_group; ++gid) {
+      ranges[gid] = forest.GroupRange(gid, tree_begin, tree_end);
+    }
+    for (const auto &batch : dmat->GetRowBatches()) {
+      const auto nsize = static_cast<bst_omp_uint>(batch.Size());
+#pragma omp parallel for schedule(static)
+      for (bst_omp_uint i = 0; i < nsize; ++i) {
+        const auto ridx = static_cast<size_t>(batch.base_rowid + i);
+        const unsigned root_id = info.GetRoot(ridx);
+        RegTree::FVec& feats = ThreadFVec(model.param.num_feature);
+        feats.Fill(batch[i]);
+        for (int gid = 0; gid < num_group; ++gid) {
+          bst_float psum = (*sums)[ridx * num_group + gid];
+          for (size_t k = ranges[gid].first; k < ranges[gid].second; ++k) {
+            psum += forest.GetLeaf(k, feats, root_id).LeafValue();
+          }
+          (*sums)[ridx * num_group + gid] = psum;
         }
+        feats.Drop(batch[i]);
       }
     }
-    return false;
   }
 
-  void InitOutPredictions(const MetaInfo& info,
-                          HostDeviceVector<bst_float>* out_preds,
-                          const gbm::GBTreeModel& model) const {
-    size_t n = model.param.num_output_group * info.num_row_;
-    const auto& base_margin = info.base_margin_.HostVector();
-    out_preds->Resize(n);
-    std::vector<bst_float>& out_preds_h = out_preds->HostVector();
-    if (base_margin.size() == n) {
-      CHECK_EQ(out_preds->Size(), n);
-      std::copy(base_margin.begin(), base_margin.end(), out_preds_h.begin());
-    } else {
-      if (!base_margin.empty()) {
-        std::ostringstream oss;
-        oss << "Warning: Ignoring the base margin, since it has incorrect length. "
-            << "The base margin must be an array of length ";
-        if (model.param.num_output_group > 1) {
-          oss << "[num_class] * [number of data points], i.e. "
-              << model.param.num_output_group << " * " << info.num_row_
-              << " = " << n << ". ";
-        } else {
-          oss << "[number of data points], i.e. " << info.num_row_ << ". ";
+  // Predict a cached matrix with the first ntree_limit trees, starting from
+  // the longest stored tree prefix not exceeding the limit.  The leaf sums
+  // reached are stored for later requests, replacing the least recently used
+  // prefix.  out_preds must hold the base margins.
+  void PredictFromPrefix(DMatrix* dmat, HostDeviceVector<bst_float>* out_preds,
+                         const gbm::GBTreeModel& model, unsigned ntree_limit) {
+    std::vector<bst_float> sums;
+    unsigned tree_begin = 0;
+    {
+      std::lock_guard<std::mutex> guard(prefix_mutex_);
+      PrefixCache& cache = prefix_cache_[dmat];
+      if (cache.revision != model.PrefixRevision()) {
+        cache.entries.clear();
+        cache.revision = model.PrefixRevision();
+      }
+      PrefixEntry* best = nullptr;
+      for (auto& entry : cache.entries) {
+        if (entry.ntree <= ntree_limit &&
+            (best == nullptr || entry.ntree > best->ntree)) {
+          best = &entry;
         }
-        oss << "Instead, all data points will use "
-            << "base_score = " << model.base_margin;
-        LOG(INFO) << oss.str();
       }
-      std::fill(out_preds_h.begin(), out_preds_h.end(), model.base_margin);
+      if (best != nullptr) {
+        best->last_use = ++prefix_clock_;
+        tree_begin = best->ntree;
+        sums = best->sums;
+      }
+    }
+    if (sums.empty()) {
+      sums.assign(out_preds->Size(), 0.0f);
+    }
+    this->AccumulateLeafSums(dmat, model, this->GetForest(model), tree_begin,
+                             ntree_limit, &sums);
+    std::vector<bst_float>& preds = out_preds->HostVector();
+    for (size_t i = 0; i < preds.size(); ++i) {
+      preds[i] += sums[i];
+    }
+
+    std::lock_guard<std::mutex> guard(prefix_mutex_);
+    PrefixCache& cache = prefix_cache_[dmat];
+    if (cache.revision != model.PrefixRevision() ||
+        std::any_of(cache.entries.cbegin(), cache.entries.cend(),
+                    [&](const PrefixEntry& e) { return e.ntree == ntree_limit; })) {
+      return;
+    }
+    if (cache.entries.size() >= static_cast<size_t>(param_.predictor_prefix_cache)) {
+      auto lru = std::min_element(
+          cache.entries.begin(), cache.entries.end(),
+          [](const PrefixEntry& a, const PrefixEntry& b) {
+            return a.last_use < b.last_use;
+          });
+      cache.entries.erase(lru);
     }
+    cache.entries.push_back(PrefixEntry{ntree_limit, ++prefix_clock_, std::move(sums)});
   }
 
  public:
+  void Init(const std::vector<std::pair<std::string, std::string>>& cfg,
+            const std::vector<std::shared_ptr<DMatrix>>& cache) override {
+    Predictor::Init(cfg, cache);
+    param_.InitAllowUnknown(cfg);
+    // the node layout may have changed
+    forest_revision_.store(0, std::memory_order_release);
+  }
+
   void PredictBatch(DMatrix* dmat, HostDeviceVector<bst_float>* out_preds,
                     const gbm::GBTreeModel& model, int tree_begin,
                     unsigned ntree_limit = 0) override {
@@ -162,86 +516,292 @@ class CPUPredictor : public Predictor {
     this->InitOutPredictions(dmat->Info(), out_preds, model);
 
     ntree_limit *= model.param.num_output_group;
-    if (ntree_limit == 0 || ntree_limit > model.trees.size()) {
-      ntree_limit = static_cast<unsigned>(model.trees.size());
+    if (ntree_limit == 0 || ntree_limit > model.NumTrees()) {
+      ntree_limit = static_cast<unsigned>(model.NumTrees());
     }
 
+    if (tree_begin == 0 && ntree_limit < model.NumTrees() &&
+        param_.predictor_prefix_cache > 0 && cache_.find(dmat) != cache_.end()) {
+      this->PredictFromPrefix(dmat, out_preds, model, ntree_limit);
+      return;
+    }
     this->PredLoopInternal(dmat, &out_preds->HostVector(), model,
                            tree_begin, ntree_limit);
   }
 
+  unsigned PredictStaged(DMatrix* dmat, HostDeviceVector<bst_float>* out_preds,
+                         const gbm::GBTreeModel& model,
+                         unsigned ntree_limit) override {
+    const MetaInfo& info = dmat->Info();
+    const int num_group = model.param.num_output_group;
+    const auto ntree = static_cast<unsigned>(model.NumTrees());
+    unsigned nstage = (ntree + num_group - 1) / num_group;
+    if (ntree_limit != 0 && ntree_limit < nstage) {
+      nstage = ntree_limit;
+    }
+    HostDeviceVector<bst_float> base_margin;
+    this->InitOutPredictions(info, &base_margin, model);
+    const std::vector<bst_float>& base = base_margin.HostVector();
+    const size_t stage_size = info.num_row_ * num_group;
+    std::vector<bst_float>& preds = out_preds->HostVector();
+    preds.resize(stage_size * nstage);
+    const CompiledForest& forest = this->GetForest(model);
+    std::vector<std::pair<size_t, size_t>> ranges(num_group);
+    for (int gid = 0; gid < num_group; ++gid) {
+      ranges[gid] = forest.GroupRange(gid, 0, nstage * num_group);
+    }
+    for (const auto &batch : dmat->GetRowBatches()) {
+      const auto nsize = static_cast<bst_omp_uint>(batch.Size());
+#pragma omp parallel for schedule(static)
+      for (bst_omp_uint i = 0; i < nsize; ++i) {
+        const auto ridx = static_cast<size_t>(batch.base_rowid + i);
+        const unsigned root_id = info.GetRoot(ridx);
+        RegTree::FVec& feats = ThreadFVec(model.param.num_feature);
+        feats.Fill(batch[i]);
+        for (int gid = 0; gid < num_group; ++gid) {
+          const size_t offset = ridx * num_group + gid;
+          // one pass over the trees of the group, emitting the margin after
+          // each boosting round as PredictBatch would with that ntree_limit
+          bst_float psum = 0.0f;
+          size_t k = ranges[gid].first;
+          for (unsigned stage = 0; stage < nstage; ++stage) {
+            const unsigned tree_end = (stage + 1) * num_group;
+            for (; k < ranges[gid].second && forest.TreeId(k) < tree_end; ++k) {
+              psum += forest.GetLeaf(k, feats, root_id).LeafValue();
+            }
+            bst_float margin = base[offset];
+            margin += psum;
+            preds[stage * stage_size + offset] = margin;
+          }
+        }
+        feats.Drop(batch[i]);
+      }
+    }
+    return nstage;
+  }
+
   void UpdatePredictionCache(
       const gbm::GBTreeModel& model,
       std::vector<std::unique_ptr<TreeUpdater>>* updaters,
       int num_new_trees) override {
-    int old_ntree = model.trees.size() - num_new_trees;
-    // update cache entry
-    for (auto& kv : cache_) {
-      PredictionCacheEntry& e = kv.second;
-
-      if (e.predictions.Size() == 0) {
-        InitOutPredictions(e.data->Info(), &(e.predictions), model);
-        PredLoopInternal(e.data.get(), &(e.predictions.HostVector()), model, 0,
-                         model.trees.size());
-      } else if (model.param.num_output_group == 1 && updaters->size() > 0 &&
-                 num_new_trees == 1 &&
-                 updaters->back()->UpdatePredictionCache(e.data.get(),
-                                                         &(e.predictions))) {
-        {}  // do nothing
-      } else {
-        PredLoopInternal(e.data.get(), &(e.predictions.HostVector()), model, old_ntree,
-                         model.trees.size());
-      }
-    }
+    this->UpdateCachedPredictions(
+        model, updaters, num_new_trees,
+        [&](DMatrix* p_fmat, std::vector<bst_float>* out_preds,
+            unsigned tree_begin, unsigned tree_end) {
+          this->PredLoopInternal(p_fmat, out_preds, model, tree_begin, tree_end);
+        });
   }
 
   void PredictInstance(const SparsePage::Inst& inst,
                        std::vector<bst_float>* out_preds,
                        const gbm::GBTreeModel& model, unsigned ntree_limit,
                        unsigned root_index) override {
-    if (thread_temp.size() == 0) {
-      thread_temp.resize(1, RegTree::FVec());
-      thread_temp[0].Init(model.param.num_feature);
-    }
     ntree_limit *= model.param.num_output_group;
-    if (ntree_limit == 0 || ntree_limit > model.trees.size()) {
-      ntree_limit = static_cast<unsigned>(model.trees.size());
+    if (ntree_limit == 0 || ntree_limit > model.NumTrees()) {
+      ntree_limit = static_cast<unsigned>(model.NumTrees());
     }
     out_preds->resize(model.param.num_output_group *
                       (model.param.size_leaf_vector + 1));
+    const CompiledForest& forest = this->GetForest(model);
+    RegTree::FVec& feats = ThreadFVec(model.param.num_feature);
+    feats.Fill(inst);
     // loop over output groups
     for (int gid = 0; gid < model.param.num_output_group; ++gid) {
       (*out_preds)[gid] =
-          PredValue(inst, model.trees, model.tree_info, gid, root_index,
-                    &thread_temp[0], 0, ntree_limit) +
+          PredValue(forest, feats, forest.GroupRange(gid, 0, ntree_limit),
+                    root_index) +
           model.base_margin;
     }
+    feats.Drop(inst);
+  }
+  void PredictCascade(DMatrix* dmat, bst_float margin_threshold,
+                      HostDeviceVector<bst_float>* out_preds,
+                      std::vector<unsigned>* out_ntrees,
+                      const gbm::GBTreeModel& model,
+                      unsigned ntree_limit) override {
+    CHECK_EQ(model.param.num_output_group, 1)
+        << "Cascaded prediction needs a model with a single output group.";
+    const MetaInfo& info = dmat->Info();
+    this->InitOutPredictions(info, out_preds, model);
+    if (ntree_limit == 0 || ntree_limit > model.NumTrees()) {
+      ntree_limit = static_cast<unsigned>(model.NumTrees());
+    }
+    const CompiledForest& forest = this->GetForest(model);
+    const std::pair<size_t, size_t> range = forest.GroupRange(0, 0, ntree_limit);
+    const size_t ntree = range.second - range.first;
+    // smallest and largest sum of the trees left after evaluating i trees
+    std::vector<double> rest_min(ntree + 1, 0.0), rest_max(ntree + 1, 0.0);
+    double abs_sum = 0.0;
+    for (size_t i = ntree; i > 0; --i) {
+      const auto bounds = forest.LeafBounds(range.first + i - 1);
+      rest_min[i - 1] = rest_min[i] + bounds.first;
+      rest_max[i - 1] = rest_max[i] + bounds.second;
+      abs_sum += std::max(std::abs(bounds.first), std::abs(bounds.second));
+    }
+    // the margin is accumulated in single precision, stop only when the
+    // bound clears the threshold by more than the rounding error of the sum
+    const double rel_slack =
+        (ntree + 2) * static_cast<double>(std::numeric_limits<bst_float>::epsilon());
+    const double threshold = margin_threshold;
+
+    std::vector<bst_float>& preds = out_preds->HostVector();
+    std::vector<unsigned>& ntrees = *out_ntrees;
+    ntrees.resize(info.num_row_);
+    for (const auto &batch : dmat->GetRowBatches()) {
+      const auto nsize = static_cast<bst_omp_uint>(batch.Size());
+#pragma omp parallel for schedule(static)
+      for (bst_omp_uint i = 0; i < nsize; ++i) {
+        const auto ridx = static_cast<size_t>(batch.base_rowid + i);
+        const unsigned root_id = info.GetRoot(ridx);
+        RegTree::FVec& feats = ThreadFVec(model.param.num_feature);
+        feats.Fill(batch[i]);
+        const bst_float base = preds[ridx];
+        const double slack = rel_slack * (abs_sum + std::abs(base));
+        bst_float psum = 0.0f;
+        size_t used = 0;
+        while (used < ntree) {
+          const double margin = static_cast<double>(base) + psum;
+          if (margin + rest_min[used] - slack > threshold ||
+              margin + rest_max[used] + slack < threshold) {
+            break;
+          }
+          psum += forest.GetLeaf(range.first + used, feats, root_id).LeafValue();
+          ++used;
+        }
+        preds[ridx] += psum;
+        ntrees[ridx] = static_cast<unsigned>(used);
+        feats.Drop(batch[i]);
+      }
+    }
+  }
+
+  void PredictCombined(DMatrix* p_fmat, CombinedPrediction* out,
+                       const gbm::GBTreeModel& model, unsigned ntree_limit) override {
+    const MetaInfo& info = p_fmat->Info();
+    ntree_limit *= model.param.num_output_group;
+    if (ntree_limit == 0 || ntree_limit > model.NumTrees()) {
+      ntree_limit = static_cast<unsigned>(model.NumTrees());
+    }
+    const int ngroup = model.param.num_output_group;
+    const size_t ncolumns = model.param.num_feature + 1;
+    const size_t nleaf_out = info.num_row_ * ntree_limit;
+    if (out->margin != nullptr) {
+      this->InitOutPredictions(info, out->margin, model);
+    }
+    if (out->leaf_int32 != nullptr) {
+      out->leaf_int32->resize(nleaf_out);
+    }
+    if (out->leaf_uint16 != nullptr) {
+      for (unsigned j = 0; j < ntree_limit; ++j) {
+        CHECK_LE(model.trees[j]->param.num_nodes,
+                 std::numeric_limits<uint16_t>::max() + 1)
+            << "Tree " << j << " has too many nodes for 16 bit leaf indices.";
+      }
+      out->leaf_uint16->resize(nleaf_out);
+    }
+    // one-hot column of each leaf, numbered tree after tree
+    std::vector<std::vector<unsigned>> leaf_columns;
+    if (out->leaf_onehot != nullptr) {
+      leaf_columns.resize(ntree_limit);
+      unsigned ncolumn = 0;
+      for (unsigned j = 0; j < ntree_limit; ++j) {
+        const RegTree& tree = *model.trees[j];
+        leaf_columns[j].resize(tree.param.num_nodes);
+        for (int nid = 0; nid < tree.param.num_nodes; ++nid) {
+          if (tree[nid].IsLeaf() && !tree[nid].IsDeleted()) {
+            leaf_columns[j][nid] = ncolumn++;
+          }
+        }
+      }
+      out->num_leaf_columns = ncolumn;
+      out->leaf_onehot->resize(nleaf_out);
+    }
+    if (out->approx_contribs != nullptr) {
+      this->FillNodeMeanValues(model, ntree_limit);
+      out->approx_contribs->assign(info.num_row_ * ngroup * ncolumns, 0);
+    }
+    std::vector<bst_float>* margin =
+        out->margin == nullptr ? nullptr : &out->margin->HostVector();
+    const CompiledForest& forest = this->GetForest(model);
+    const std::vector<bst_float>& base_margin = info.base_margin_.HostVector();
+    for (const auto &batch : p_fmat->GetRowBatches()) {
+      const auto nsize = static_cast<bst_omp_uint>(batch.Size());
+#pragma omp parallel for schedule(static)
+      for (bst_omp_uint i = 0; i < nsize; ++i) {
+        auto ridx = static_cast<size_t>(batch.base_rowid + i);
+        unsigned root_id = info.GetRoot(ridx);
+        RegTree::FVec& feats = ThreadFVec(model.param.num_feature);
+        feats.Fill(batch[i]);
+        for (int gid = 0; gid < ngroup; ++gid) {
+          bst_float* contribs = out->approx_contribs == nullptr ? nullptr
+              : &(*out->approx_contribs)[(ridx * ngroup + gid) * ncolumns];
+          // summed in model order, as PredictBatch does
+          bst_float psum = 0.0f;
+          for (unsigned j = 0; j < ntree_limit; ++j) {
+            if (model.tree_info[j] != gid) {
+              continue;
+            }
+            int nid;
+            if (contribs != nullptr) {
+              // the contributions walk the path to the leaf anyway
+              const RegTree& tree = *model.trees[j];
+              nid = tree.CalculateContributionsApprox(feats, root_id, contribs);
+              psum += tree[nid].LeafValue();
+            } else {
+              const CompiledForest::Node& leaf =
+                  forest.GetLeaf(forest.PackedIndex(j), feats, root_id);
+              nid = leaf.NodeId();
+              psum += leaf.LeafValue();
+            }
+            const size_t offset = ridx * ntree_limit + j;
+            if (out->leaf_int32 != nullptr) {
+              (*out->leaf_int32)[offset] = nid;
+            }
+            if (out->leaf_uint16 != nullptr) {
+              (*out->leaf_uint16)[offset] = static_cast<uint16_t>(nid);
+            }
+            if (out->leaf_onehot != nullptr) {
+              (*out->leaf_onehot)[offset] = leaf_columns[j][nid];
+            }
+          }
+          if (margin != nullptr) {
+            (*margin)[ridx * ngroup + gid] += psum;
+          }
+          if (contribs != nullptr) {
+            contribs[ncolumns - 1] += base_margin.size() != 0
+                                          ? base_margin[ridx * ngroup + gid]
+                                          : model.base_margin;
+          }
+        }
+        feats.Drop(batch[i]);
+      }
+    }
   }
+
   void PredictLeaf(DMatrix* p_fmat, std::vector<bst_float>* out_preds,
                    const gbm::GBTreeModel& model, unsigned ntree_limit) override {
-    const int nthread = omp_get_max_threads();
-    InitThreadTemp(nthread, model.param.num_feature);
     const MetaInfo& info = p_fmat->Info();
     // number of valid trees
     ntree_limit *= model.param.num_output_group;
-    if (ntree_limit == 0 || ntree_limit > model.trees.size()) {
-      ntree_limit = static_cast<unsigned>(model.trees.size());
+    if (ntree_limit == 0 || ntree_limit > model.NumTrees()) {
+      ntree_limit = static_cast<unsigned>(model.NumTrees());
     }
     std::vector<bst_float>& preds = *out_preds;
     preds.resize(info.num_row_ * ntree_limit);
+    const CompiledForest& forest = this->GetForest(model);
     // start collecting the prediction
     for (const auto &batch : p_fmat->GetRowBatches()) {
       // parallel over local batch
       const auto nsize = static_cast<bst_omp_uint>(batch.Size());
 #pragma omp parallel for schedule(static)
       for (bst_omp_uint i = 0; i < nsize; ++i) {
-        const int tid = omp_get_thread_num();
         auto ridx = static_cast<size_t>(batch.base_rowid + i);
-        RegTree::FVec& feats = thread_temp[tid];
+        RegTree::FVec& feats = ThreadFVec(model.param.num_feature);
         feats.Fill(batch[i]);
         for (unsigned j = 0; j < ntree_limit; ++j) {
-          int tid = model.trees[j]->GetLeafIndex(feats, info.GetRoot(ridx));
-          preds[ridx * ntree_limit + j] = static_cast<bst_float>(tid);
+          int nid = forest.GetLeaf(forest.PackedIndex(j), feats,
+                                   info.GetRoot(ridx)).NodeId();
+          preds[ridx * ntree_limit + j] = static_cast<bst_float>(nid);
         }
         feats.Drop(batch[i]);
       }
@@ -253,13 +813,11 @@ class CPUPredictor : public Predictor {
                            bool approximate,
                            int condition,
                            unsigned condition_feature) override {
-    const int nthread = omp_get_max_threads();
-    InitThreadTemp(nthread,  model.param.num_feature);
     const MetaInfo& info = p_fmat->Info();
     // number of valid trees
     ntree_limit *= model.param.num_output_group;
-    if (ntree_limit == 0 || ntree_limit > model.trees.size()) {
-      ntree_limit = static_cast<unsigned>(model.trees.size());
+    if (ntree_limit == 0 || ntree_limit > model.NumTrees()) {
+      ntree_limit = static_cast<unsigned>(model.NumTrees());
     }
     const int ngroup = model.param.num_output_group;
     size_t ncolumns = model.param.num_feature + 1;
@@ -270,10 +828,11 @@ class CPUPredictor : public Predictor {
     // allocated one
     std::fill(contribs.begin(), contribs.end(), 0);
     // initialize tree node mean values
-    #pragma omp parallel for schedule(static)
-    for (bst_omp_uint i = 0; i < ntree_limit; ++i) {
-      model.trees[i]->FillNodeMeanValues();
-    }
+    this->FillNodeMeanValues(model, ntree_limit);
+    // summaries only answer unconditioned exact queries
+    const ShapSummaryList summaries = condition == 0 && !approximate
+                                          ? this->GetShapSummaries(model, ntree_limit)
+                                          : ShapSummaryList(ntree_limit);
     const std::vector<bst_float>& base_margin = info.base_margin_.HostVector();
     // start collecting the contributions
     for (const auto &batch : p_fmat->GetRowBatches()) {
@@ -283,7 +842,7 @@ class CPUPredictor : public Predictor {
       for (bst_omp_uint i = 0; i < nsize; ++i) {
         auto row_idx = static_cast<size_t>(batch.base_rowid + i);
         unsigned root_id = info.GetRoot(row_idx);
-        RegTree::FVec& feats = thread_temp[omp_get_thread_num()];
+        RegTree::FVec& feats = ThreadFVec(model.param.num_feature);
         // loop over all classes
         for (int gid = 0; gid < ngroup; ++gid) {
           bst_float* p_contribs =
@@ -294,7 +853,9 @@ class CPUPredictor : public Predictor {
             if (model.tree_info[j] != gid) {
               continue;
             }
-            if (!approximate) {
+            if (summaries[j] != nullptr && root_id == 0) {
+              summaries[j]->AddContributions(feats, p_contribs);
+            } else if (!approximate) {
               model.trees[j]->CalculateContributions(feats, root_id, p_contribs,
                                                      condition, condition_feature);
             } else {
@@ -313,52 +874,320 @@ class CPUPredictor : public Predictor {
     }
   }
 
+  void PredictContributionSparse(DMatrix* p_fmat, std::vector<size_t>* out_indptr,
+                                 std::vector<unsigned>* out_index,
+                                 std::vector<bst_float>* out_values,
+                                 std::vector<bst_float>* out_bias,
+                                 const gbm::GBTreeModel& model, unsigned ntree_limit,
+                                 bool approximate) override {
+    const MetaInfo& info = p_fmat->Info();
+    ntree_limit *= model.param.num_output_group;
+    if (ntree_limit == 0 || ntree_limit > model.NumTrees()) {
+      ntree_limit = static_cast<unsigned>(model.NumTrees());
+    }
+    const int ngroup = model.param.num_output_group;
+    const size_t ncolumns = model.param.num_feature + 1;
+    this->FillNodeMeanValues(model, ntree_limit);
+    const ShapSummaryList summaries = approximate ? ShapSummaryList(ntree_limit)
+                                                  : this->GetShapSummaries(model, ntree_limit);
+    // features the trees of a group can contribute to, in increasing order
+    std::vector<std::vector<unsigned>> group_features(ngroup);
+    const std::vector<std::vector<unsigned>> split_features =
+        SplitFeatures(model, ntree_limit);
+    for (unsigned j = 0; j < ntree_limit; ++j) {
+      std::vector<unsigned>& features = group_features[model.tree_info[j]];
+      features.insert(features.end(), split_features[j].begin(), split_features[j].end());
+    }
+    for (auto& features : group_features) {
+      std::sort(features.begin(), features.end());
+      features.erase(std::unique(features.begin(), features.end()), features.end());
+    }
+    std::vector<size_t>& indptr = *out_indptr;
+    indptr.assign(info.num_row_ * ngroup + 1, 0);
+    out_index->clear();
+    out_values->clear();
+    out_bias->resize(info.num_row_ * ngroup);
+    const std::vector<bst_float>& base_margin = info.base_margin_.HostVector();
+    const int nthread = omp_get_max_threads();
+    for (const auto &batch : p_fmat->GetRowBatches()) {
+      // each thread fills the entries of a contiguous chunk of rows, the chunks
+      // are then copied after each other
+      const size_t nsize = batch.Size();
+      const size_t chunk = (nsize + nthread - 1) / nthread;
+      std::vector<std::vector<unsigned>> chunk_index(nthread);
+      std::vector<std::vector<bst_float>> chunk_values(nthread);
+#pragma omp parallel for schedule(static, 1) num_threads(nthread)
+      for (int t = 0; t < nthread; ++t) {
+        const size_t end = std::min(nsize, (t + 1) * chunk);
+        for (size_t i = t * chunk; i < end; ++i) {
+          auto row_idx = static_cast<size_t>(batch.base_rowid + i);
+          unsigned root_id = info.GetRoot(row_idx);
+          RegTree::FVec& feats = ThreadFVec(model.param.num_feature);
+          bst_float* contribs = ThreadContribs(ncolumns);
+          feats.Fill(batch[i]);
+          for (int gid = 0; gid < ngroup; ++gid) {
+            for (unsigned j = 0; j < ntree_limit; ++j) {
+              if (model.tree_info[j] != gid) {
+                continue;
+              }
+              if (summaries[j] != nullptr && root_id == 0) {
+                summaries[j]->AddContributions(feats, contribs);
+              } else if (!approximate) {
+                model.trees[j]->CalculateContributions(feats, root_id, contribs);
+              } else {
+                model.trees[j]->CalculateContributionsApprox(feats, root_id, contribs);
+              }
+            }
+            (*out_bias)[row_idx * ngroup + gid] =
+                contribs[ncolumns - 1] + (base_margin.size() != 0
+                                              ? base_margin[row_idx * ngroup + gid]
+                                              : model.base_margin);
+            contribs[ncolumns - 1] = 0;
+            // trees only write to the features they split on
+            size_t nnz = 0;
+            for (unsigned fid : group_features[gid]) {
+              if (contribs[fid] != 0) {
+                chunk_index[t].push_back(fid);
+                chunk_values[t].push_back(contribs[fid]);
+                contribs[fid] = 0;
+                ++nnz;
+              }
+            }
+            indptr[row_idx * ngroup + gid + 1] = nnz;
+          }
+          feats.Drop(batch[i]);
+        }
+      }
+      const size_t row_begin = batch.base_rowid * ngroup;
+      const size_t row_end = row_begin + nsize * ngroup;
+      for (size_t r = row_begin; r < row_end; ++r) {
+        indptr[r + 1] += indptr[r];
+      }
+      out_index->resize(indptr[row_end]);
+      out_values->resize(indptr[row_end]);
+#pragma omp parallel for schedule(static, 1) num_threads(nthread)
+      for (int t = 0; t < nthread; ++t) {
+        if (t * chunk < nsize) {
+          const size_t offset = indptr[(batch.base_rowid + t * chunk) * ngroup];
+          std::copy(chunk_index[t].begin(), chunk_index[t].end(),
+                    out_index->begin() + offset);
+          std::copy(chunk_values[t].begin(), chunk_values[t].end(),
+                    out_values->begin() + offset);
+        }
+      }
+    }
+  }
+
   void PredictInteractionContributions(DMatrix* p_fmat, std::vector<bst_float>* out_contribs,
                                        const gbm::GBTreeModel& model, unsigned ntree_limit,
                                        bool approximate) override {
     const MetaInfo& info = p_fmat->Info();
     const int ngroup = model.param.num_output_group;
-    size_t ncolumns = model.param.num_feature;
-    const unsigned row_chunk = ngroup * (ncolumns + 1) * (ncolumns + 1);
-    const unsigned mrow_chunk = (ncolumns + 1) * (ncolumns + 1);
-    const unsigned crow_chunk = ngroup * (ncolumns + 1);
-
-    // allocate space for (number of features^2) times the number of rows and tmp off/on contribs
+    const size_t ncolumns = model.param.num_feature + 1;
+    const size_t row_chunk = ngroup * ncolumns * ncolumns;
     std::vector<bst_float>& contribs = *out_contribs;
-    contribs.resize(info.num_row_ * ngroup * (ncolumns + 1) * (ncolumns + 1));
-    std::vector<bst_float> contribs_off(info.num_row_ * ngroup * (ncolumns + 1));
-    std::vector<bst_float> contribs_on(info.num_row_ * ngroup * (ncolumns + 1));
-    std::vector<bst_float> contribs_diag(info.num_row_ * ngroup * (ncolumns + 1));
-
-    // Compute the difference in effects when conditioning on each of the features on and off
-    // see: Axiomatic characterizations of probabilistic and
-    //      cardinal-probabilistic interaction indices
-    PredictContribution(p_fmat, &contribs_diag, model, ntree_limit, approximate, 0, 0);
-    for (size_t i = 0; i < ncolumns + 1; ++i) {
-      PredictContribution(p_fmat, &contribs_off, model, ntree_limit, approximate, -1, i);
-      PredictContribution(p_fmat, &contribs_on, model, ntree_limit, approximate, 1, i);
-
-      for (size_t j = 0; j < info.num_row_; ++j) {
-        for (int l = 0; l < ngroup; ++l) {
-          const unsigned o_offset = j * row_chunk + l * mrow_chunk + i * (ncolumns + 1);
-          const unsigned c_offset = j * crow_chunk + l * (ncolumns + 1);
-          contribs[o_offset + i] = 0;
-          for (size_t k = 0; k < ncolumns + 1; ++k) {
-            // fill in the diagonal with additive effects, and off-diagonal with the interactions
-            if (k == i) {
-              contribs[o_offset + i] += contribs_diag[c_offset + k];
+    contribs.resize(info.num_row_ * row_chunk);
+    // matrices are written in place, the scratch of a thread is O(nfeats)
+    this->ForEachRowInteractions(
+        p_fmat, model, ntree_limit, approximate,
+        [&](size_t row_idx) { return &contribs[row_idx * row_chunk]; },
+        [](size_t row_idx, const bst_float* interactions) {});
+  }
+
+  void PredictInteractionTopK(DMatrix* p_fmat, unsigned top_k,
+                              std::vector<bst_float>* out_values,
+                              std::vector<unsigned>* out_index,
+                              const gbm::GBTreeModel& model, unsigned ntree_limit,
+                              bool approximate) override {
+    const MetaInfo& info = p_fmat->Info();
+    const int ngroup = model.param.num_output_group;
+    const size_t ncolumns = model.param.num_feature + 1;
+    const size_t mrow_chunk = ncolumns * ncolumns;
+    // pairs of distinct features, the bias takes part in no interaction
+    const size_t npairs = (ncolumns - 1) * (ncolumns - 2) / 2;
+    const size_t k = std::min(static_cast<size_t>(top_k), npairs);
+    out_values->resize(info.num_row_ * ngroup * k);
+    out_index->resize(info.num_row_ * ngroup * k);
+    if (k == 0) {
+      return;
+    }
+    this->ForEachRowInteractions(
+        p_fmat, model, ntree_limit, approximate,
+        [&](size_t row_idx) {
+          return &dmlc::ThreadLocalStore<InteractionThreadEntry>::Get()->Block(
+              ngroup * mrow_chunk)[0];
+        },
+        [&](size_t row_idx, const bst_float* interactions) {
+          std::vector<unsigned>& pairs =
+              dmlc::ThreadLocalStore<InteractionThreadEntry>::Get()->pairs;
+          for (int gid = 0; gid < ngroup; ++gid) {
+            const bst_float* matrix = interactions + gid * mrow_chunk;
+            // off diagonal entries of the upper triangle, as i * (nfeats + 1) + j
+            pairs.clear();
+            for (size_t i = 0; i + 1 < ncolumns; ++i) {
+              for (size_t j = i + 1; j + 1 < ncolumns; ++j) {
+                pairs.push_back(static_cast<unsigned>(i * ncolumns + j));
+              }
+            }
+            auto larger = [matrix](unsigned a, unsigned b) {
+              const bst_float va = std::abs(matrix[a]);
+              const bst_float vb = std::abs(matrix[b]);
+              return va > vb || (va == vb && a < b);
+            };
+            std::partial_sort(pairs.begin(), pairs.begin() + k, pairs.end(), larger);
+            const size_t offset = (row_idx * ngroup + gid) * k;
+            for (size_t r = 0; r < k; ++r) {
+              (*out_index)[offset + r] = pairs[r];
+              (*out_values)[offset + r] = matrix[pairs[r]];
+            }
+          }
+        });
+  }
+
+ protected:
+  /*! \brief per thread buffers of top-k interaction prediction */
+  struct InteractionThreadEntry {
+    std::vector<bst_float> block;
+    std::vector<unsigned> pairs;
+    std::vector<bst_float>& Block(size_t size) {
+      block.resize(size);
+      return block;
+    }
+  };
+
+  // path summaries of the first ntree_limit trees within predictor_shap_cache
+  ShapSummaryList GetShapSummaries(const gbm::GBTreeModel& model, unsigned ntree_limit) {
+    return shap_summaries_.Get(model, ntree_limit,
+                               static_cast<size_t>(param_.predictor_shap_cache) << 20);
+  }
+
+  // distinct features each of the first ntree_limit trees splits on
+  static std::vector<std::vector<unsigned>> SplitFeatures(const gbm::GBTreeModel& model,
+                                                          unsigned ntree_limit) {
+    std::vector<std::vector<unsigned>> split_features(ntree_limit);
+    #pragma omp parallel for schedule(dynamic)
+    for (bst_omp_uint j = 0; j < ntree_limit; ++j) {
+      const RegTree& tree = *model.trees[j];
+      std::vector<bool> used(model.param.num_feature, false);
+      for (int nid = 0; nid < tree.param.num_nodes; ++nid) {
+        const RegTree::Node& node = tree[nid];
+        if (!node.IsLeaf() && !node.IsDeleted() && !used[node.SplitIndex()]) {
+          used[node.SplitIndex()] = true;
+          split_features[j].push_back(node.SplitIndex());
+        }
+      }
+    }
+    return split_features;
+  }
+
+  // fill node mean values of the first ntree_limit trees
+  void FillNodeMeanValues(const gbm::GBTreeModel& model, unsigned ntree_limit) {
+    // filled once and only read afterwards
+    std::lock_guard<std::mutex> guard(node_mean_mutex_);
+    #pragma omp parallel for schedule(static)
+    for (bst_omp_uint i = 0; i < ntree_limit; ++i) {
+      model.trees[i]->FillNodeMeanValues();
+    }
+  }
+
+  /*!
+   * \brief compute the SHAP interaction matrices of every row in parallel.
+   *
+   * Rows are handled one at a time inside a single traversal of the data, so
+   * besides the matrices of a row only O(nfeats) scratch is used per thread.
+   * \param get_block returns where to write the ngroup matrices of a row
+   * \param consume called with the finished matrices of a row
+   */
+  template <typename GetBlock, typename Consume>
+  void ForEachRowInteractions(DMatrix* p_fmat, const gbm::GBTreeModel& model,
+                              unsigned ntree_limit, bool approximate,
+                              GetBlock get_block, Consume consume) {
+    const MetaInfo& info = p_fmat->Info();
+    ntree_limit *= model.param.num_output_group;
+    if (ntree_limit == 0 || ntree_limit > model.NumTrees()) {
+      ntree_limit = static_cast<unsigned>(model.NumTrees());
+    }
+    const int ngroup = model.param.num_output_group;
+    const size_t ncolumns = model.param.num_feature + 1;
+    const size_t mrow_chunk = ncolumns * ncolumns;
+    this->FillNodeMeanValues(model, ntree_limit);
+    const ShapSummaryList summaries = approximate ? ShapSummaryList(ntree_limit)
+                                                  : this->GetShapSummaries(model, ntree_limit);
+    const std::vector<bst_float>& base_margin = info.base_margin_.HostVector();
+    for (const auto &batch : p_fmat->GetRowBatches()) {
+      const auto nsize = static_cast<bst_omp_uint>(batch.Size());
+#pragma omp parallel for schedule(dynamic, 16)
+      for (bst_omp_uint i = 0; i < nsize; ++i) {
+        auto row_idx = static_cast<size_t>(batch.base_rowid + i);
+        unsigned root_id = info.GetRoot(row_idx);
+        RegTree::FVec& feats = ThreadFVec(model.param.num_feature);
+        // main effects of the row
+        bst_float* scratch = ThreadShapScratch(ncolumns);
+        bst_float* interactions = get_block(row_idx);
+        std::fill(interactions, interactions + ngroup * mrow_chunk, 0.0f);
+        feats.Fill(batch[i]);
+        for (int gid = 0; gid < ngroup; ++gid) {
+          bst_float* matrix = interactions + gid * mrow_chunk;
+          std::fill(scratch, scratch + ncolumns, 0.0f);
+          for (unsigned j = 0; j < ntree_limit; ++j) {
+            if (model.tree_info[j] != gid) {
+              continue;
+            }
+            if (!approximate) {
+              if (summaries[j] != nullptr && root_id == 0) {
+                summaries[j]->AddContributions(feats, scratch);
+              } else {
+                model.trees[j]->CalculateContributions(feats, root_id, scratch);
+              }
+              model.trees[j]->CalculateInteractionContributions(feats, root_id, matrix);
             } else {
-              contribs[o_offset + k] = (contribs_on[c_offset + k] - contribs_off[c_offset + k])/2.0;
-              contribs[o_offset + i] -= contribs[o_offset + k];
+              // the approximation has no interaction effects
+              model.trees[j]->CalculateContributionsApprox(feats, root_id, scratch);
             }
           }
+          scratch[ncolumns - 1] += base_margin.size() != 0
+                                       ? base_margin[row_idx * ngroup + gid]
+                                       : model.base_margin;
+          // the diagonal holds the main effects less the interactions
+          for (size_t c = 0; c < ncolumns; ++c) {
+            matrix[c * ncolumns + c] += scratch[c];
+          }
         }
+        feats.Drop(batch[i]);
+        consume(row_idx, interactions);
       }
     }
   }
-  std::vector<RegTree::FVec> thread_temp;
+
+  // flattened trees of the model last used for prediction
+  CompiledForest forest_;
+  // model revision forest_ was built for, 0 before the first build
+  std::atomic<uint64_t> forest_revision_{0};
+  std::mutex forest_mutex_;
+  // serializes lazy filling of node mean values used by contributions
+  std::mutex node_mean_mutex_;
+  /*! \brief TreeSHAP path summaries of the first trees of a model */
+  ShapSummaryCache shap_summaries_;
+  /*! \brief leaf sums of a cached matrix over the first ntree trees */
+  struct PrefixEntry {
+    unsigned ntree;
+    uint64_t last_use;
+    std::vector<bst_float> sums;
+  };
+  struct PrefixCache {
+    // prefix revision of the model the sums were computed with
+    uint64_t revision{0};
+    std::vector<PrefixEntry> entries;
+  };
+  std::unordered_map<DMatrix*, PrefixCache> prefix_cache_;
+  uint64_t prefix_clock_{0};
+  std::mutex prefix_mutex_;
+  CPUPredictionParam param_;
 };
 
+constexpr size_t CPUPredictor::kMinBlockRows;
+constexpr size_t CPUPredictor::kMaxBlockRows;
+
 XGBOOST_REGISTER_PREDICTOR(CPUPredictor, "cpu_predictor")
     .describe("Make predictions using CPU.")
     .set_body([]() { return new CPUPredictor(); });
@@ -482,6 +482,21 @@ class GPUPredictor : public xgboost::Predictor {
                                        condition_feature);
   }
 
+  void PredictCombined(DMatrix* p_fmat, CombinedPrediction* out,
+                       const gbm::GBTreeModel& model, unsigned ntree_limit) override {
+    cpu_predictor_->PredictCombined(p_fmat, out, model, ntree_limit);
+  }
+
+  void PredictContributionSparse(DMatrix* p_fmat, std::vector<size_t>* out_indptr,
+                                 std::vector<unsigned>* out_index,
+                                 std::vector<bst_float>* out_values,
+                                 std::vector<bst_float>* out_bias,
+                                 const gbm::GBTreeModel& model, unsigned ntree_limit,
+                                 bool approximate) override {
+    cpu_predictor_->PredictContributionSparse(p_fmat, out_indptr, out_index, out_values,
+                                              out_bias, model, ntree_limit, approximate);
+  }
+
   void PredictInteractionContributions(DMatrix* p_fmat,
                                        std::vector<bst_float>* out_contribs,
                                        const gbm::GBTreeModel& model,
@@ -491,6 +506,16 @@ class GPUPredictor : public xgboost::Predictor {
                                                    ntree_limit, approximate);
   }
 
+  void PredictInteractionTopK(DMatrix* p_fmat, unsigned top_k,
+                              std::vector<bst_float>* out_values,
+                              std::vector<unsigned>* out_index,
+                              const gbm::GBTreeModel& model,
+                              unsigned ntree_limit,
+                              bool approximate) override {
+    cpu_predictor_->PredictInteractionTopK(p_fmat, top_k, out_values, out_index,
+                                           model, ntree_limit, approximate);
+  }
+
   void Init(const std::vector<std::pair<std::string, std::string>>& cfg,
             const std::vector<std::shared_ptr<DMatrix>>& cache) override {
     Predictor::Init(cfg, cache);
@@ -3,6 +3,10 @@
  */
 #include <dmlc/registry.h>
 #include <xgboost/predictor.h>
+#include <xgboost/tree_updater.h>
+
+#include <algorithm>
+#include <sstream>
 
 namespace dmlc {
 DMLC_REGISTRY_ENABLE(::xgboost::PredictorReg);
@@ -15,6 +19,79 @@ void Predictor::Init(
     cache_[d.get()].data = d;
   }
 }
+bool Predictor::PredictFromCache(DMatrix* dmat,
+                                 HostDeviceVector<bst_float>* out_preds,
+                                 const gbm::GBTreeModel& model,
+                                 unsigned ntree_limit) const {
+  if (ntree_limit == 0 ||
+      ntree_limit * model.param.num_output_group >= model.NumTrees()) {
+    auto it = cache_.find(dmat);
+    if (it != cache_.end()) {
+      const HostDeviceVector<bst_float>& y = it->second.predictions;
+      if (y.Size() != 0) {
+        out_preds->Resize(y.Size());
+        std::copy(y.HostVector().begin(), y.HostVector().end(),
+                  out_preds->HostVector().begin());
+        return true;
+      }
+    }
+  }
+  return false;
+}
+void Predictor::InitOutPredictions(const MetaInfo& info,
+                                   HostDeviceVector<bst_float>* out_preds,
+                                   const gbm::GBTreeModel& model) const {
+  size_t n = model.param.num_output_group * info.num_row_;
+  const auto& base_margin = info.base_margin_.HostVector();
+  out_preds->Resize(n);
+  std::vector<bst_float>& out_preds_h = out_preds->HostVector();
+  if (base_margin.size() == n) {
+    CHECK_EQ(out_preds->Size(), n);
+    std::copy(base_margin.begin(), base_margin.end(), out_preds_h.begin());
+  } else {
+    if (!base_margin.empty()) {
+      std::ostringstream oss;
+      oss << "Warning: Ignoring the base margin, since it has incorrect length. "
+          << "The base margin must be an array of length ";
+      if (model.param.num_output_group > 1) {
+        oss << "[num_class] * [number of data points], i.e. "
+            << model.param.num_output_group << " * " << info.num_row_
+            << " = " << n << ". ";
+      } else {
+        oss << "[number of data points], i.e. " << info.num_row_ << ". ";
+      }
+      oss << "Instead, all data points will use "
+          << "base_score = " << model.base_margin;
+      LOG(INFO) << oss.str();
+    }
+    std::fill(out_preds_h.begin(), out_preds_h.end(), model.base_margin);
+  }
+}
+void Predictor::UpdateCachedPredictions(
+    const gbm::GBTreeModel& model,
+    std::vector<std::unique_ptr<TreeUpdater>>* updaters, int num_new_trees,
+    const std::function<void(DMatrix*, std::vector<bst_float>*, unsigned,
+                             unsigned)>& pred_loop) {
+  int old_ntree = model.NumTrees() - num_new_trees;
+  // update cache entry
+  for (auto& kv : cache_) {
+    PredictionCacheEntry& e = kv.second;
+
+    if (e.predictions.Size() == 0) {
+      InitOutPredictions(e.data->Info(), &(e.predictions), model);
+      pred_loop(e.data.get(), &(e.predictions.HostVector()), 0,
+                model.NumTrees());
+    } else if (model.param.num_output_group == 1 && updaters->size() > 0 &&
+               num_new_trees == 1 &&
+               updaters->back()->UpdatePredictionCache(e.data.get(),
+                                                       &(e.predictions))) {
+      {}  // do nothing
+    } else {
+      pred_loop(e.data.get(), &(e.predictions.HostVector()), old_ntree,
+                model.NumTrees());
+    }
+  }
+}
 Predictor* Predictor::Create(std::string const& name, LearnerTrainParam const* learner_param) {
   auto* e = ::dmlc::Registry<PredictorReg>::Get()->Find(name);
   if (e == nullptr) {
@@ -33,5 +110,6 @@ namespace predictor {
 DMLC_REGISTRY_LINK_TAG(gpu_predictor);
 #endif  // XGBOOST_USE_CUDA
 DMLC_REGISTRY_LINK_TAG(cpu_predictor);
+DMLC_REGISTRY_LINK_TAG(quickscorer_predictor);
 }  // namespace predictor
 }  // namespace xgboost
@@ -0,0 +1,447 @@
+/*!
+ * Copyright 2019 by Contributors
+ * \file quickscorer_predictor.cc
+ * \brief Bitvector based prediction for ensembles of shallow trees, following
+ *  the QuickScorer algorithm of Lucchese et al.
+ *
+ *  Leaves of every tree are numbered from left to right and a tree keeps a
+ *  64 bit vector of leaves that can still be reached by an instance.  All
+ *  split conditions on one feature are stored sorted by threshold, so the
+ *  splits an instance fails (goes right at) are found by scanning a short
+ *  prefix of the list; every failed split clears the leaves of its left
+ *  subtree.  The exit leaf of a tree is then the lowest bit still set.
+ */
+#include <dmlc/omp.h>
+#include <xgboost/predictor.h>
+#include <xgboost/tree_model.h>
+#include <xgboost/tree_updater.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "dmlc/logging.h"
+#include "../common/host_device_vector.h"
+#include "compiled_forest.h"
+
+namespace xgboost {
+namespace predictor {
+
+DMLC_REGISTRY_FILE_TAG(quickscorer_predictor);
+
+/*!
+ * \brief Threshold lists and leaf bitvectors of the trees of a model.
+ *
+ *  The index is built once per model revision and any range of trees can be
+ *  scored from it.  Only trees with a single root and at most kMaxLeaves
+ *  leaves can be indexed, the other trees are traversed node by node in a
+ *  CompiledForest of the same model.
+ */
+class QuickScorerIndex {
+ public:
+  /*! \brief width of the leaf bitvector */
+  static constexpr int kMaxLeaves = 64;
+
+  /*! \brief index the trees of the model */
+  void Init(const gbm::GBTreeModel& model) {
+    revision_ = model.Revision();
+    num_group_ = model.param.num_output_group;
+    const int num_feature = model.param.num_feature;
+
+    // false node entries per feature: (threshold, tree, mask)
+    std::vector<std::vector<std::tuple<bst_float, unsigned, uint64_t>>>
+        split_entries(num_feature);
+    std::vector<std::vector<std::pair<unsigned, uint64_t>>>
+        missing_entries(num_feature);
+    leaf_ptr_.assign(1, 0);
+    leaf_values_.clear();
+    tree_group_.clear();
+    indexed_.clear();
+    for (size_t t = 0; t < model.trees.size(); ++t) {
+      const RegTree& tree = *model.trees[t];
+      tree_group_.push_back(model.tree_info[t]);
+      indexed_.push_back(Indexable(tree));
+      if (!indexed_.back()) {
+        leaf_ptr_.push_back(leaf_values_.size());
+        continue;
+      }
+      // depth first from the left, leaves get increasing bit positions; the
+      // left subtree of a node covers leaves [first, mid)
+      std::vector<int> first_leaf(tree.param.num_nodes);
+      std::vector<std::pair<int, bool>> stack{{0, false}};
+      while (!stack.empty()) {
+        int nid = stack.back().first;
+        bool visited = stack.back().second;
+        stack.pop_back();
+        const RegTree::Node& node = tree[nid];
+        if (node.IsLeaf()) {
+          first_leaf[nid] = leaf_values_.size() - leaf_ptr_.back();
+          leaf_values_.push_back(node.LeafValue());
+        } else if (!visited) {
+          first_leaf[nid] = leaf_values_.size() - leaf_ptr_.back();
+          stack.emplace_back(nid, true);
+          stack.emplace_back(node.RightChild(), false);
+          stack.emplace_back(node.LeftChild(), false);
+        } else {
+          // both subtrees are numbered, the right one starts at mid
+          const int mid = first_leaf[node.RightChild()];
+          const int first = first_leaf[nid];
+          uint64_t mask = ~uint64_t(0);
+          for (int b = first; b < mid; ++b) {
+            mask &= ~(uint64_t(1) << b);
+          }
+          CHECK_LT(node.SplitIndex(), static_cast<unsigned>(num_feature));
+          split_entries[node.SplitIndex()].emplace_back(
+              node.SplitCond(), static_cast<unsigned>(t), mask);
+          if (!node.DefaultLeft()) {
+            missing_entries[node.SplitIndex()].emplace_back(t, mask);
+          }
+        }
+      }
+      leaf_ptr_.push_back(leaf_values_.size());
+    }
+
+    // flatten the per feature lists, sorted by threshold
+    feature_ptr_.assign(1, 0);
+    missing_ptr_.assign(1, 0);
+    thresholds_.clear();
+    split_tree_.clear();
+    split_mask_.clear();
+    missing_tree_.clear();
+    missing_mask_.clear();
+    used_features_.clear();
+    for (int fid = 0; fid < num_feature; ++fid) {
+      auto& entries = split_entries[fid];
+      std::stable_sort(entries.begin(), entries.end(),
+                       [](const std::tuple<bst_float, unsigned, uint64_t>& a,
+                          const std::tuple<bst_float, unsigned, uint64_t>& b) {
+                         return std::get<0>(a) < std::get<0>(b);
+                       });
+      for (const auto& e : entries) {
+        thresholds_.push_back(std::get<0>(e));
+        split_tree_.push_back(std::get<1>(e));
+        split_mask_.push_back(std::get<2>(e));
+      }
+      for (const auto& e : missing_entries[fid]) {
+        missing_tree_.push_back(e.first);
+        missing_mask_.push_back(e.second);
+      }
+      feature_ptr_.push_back(thresholds_.size());
+      missing_ptr_.push_back(missing_tree_.size());
+      if (!entries.empty()) {
+        used_features_.push_back(fid);
+      }
+    }
+  }
+
+  /*! \brief whether the index was built for this model */
+  bool IsStale(const gbm::GBTreeModel& model) const {
+    return revision_ != model.Revision();
+  }
+  /*! \brief number of trees of the model, indexed or not */
+  size_t NumTrees() const { return leaf_ptr_.size() - 1; }
+
+  /*!
+   * \brief score one instance with trees [tree_begin, tree_end), adding the
+   *  sum of each group to out[gid].
+   * \param feat dense feature vector of the instance.
+   * \param forest node layout of the model, traversed for trees not indexed.
+   * \param tree_begin first tree used.
+   * \param tree_end end of the trees used, at most NumTrees().
+   * \param leaves scratch space of NumTrees() bitvectors.
+   * \param psum scratch space of a value per output group.
+   * \param out output per group.
+   */
+  void Predict(const RegTree::FVec& feat, const CompiledForest& forest,
+               unsigned tree_begin, unsigned tree_end, uint64_t* leaves,
+               bst_float* psum, bst_float* out) const {
+    // splits of trees outside the range are skipped, the unsigned difference
+    // wraps for trees before tree_begin
+    const unsigned ntree = tree_end - tree_begin;
+    std::fill(leaves + tree_begin, leaves + tree_end, ~uint64_t(0));
+    for (unsigned fid : used_features_) {
+      if (feat.IsMissing(fid)) {
+        for (size_t i = missing_ptr_[fid]; i < missing_ptr_[fid + 1]; ++i) {
+          if (missing_tree_[i] - tree_begin < ntree) {
+            leaves[missing_tree_[i]] &= missing_mask_[i];
+          }
+        }
+        continue;
+      }
+      const bst_float fvalue = feat.Fvalue(fid);
+      size_t end = feature_ptr_[fid + 1];
+      if (!std::isnan(fvalue)) {
+        // splits with threshold <= fvalue send the instance right
+        end = std::upper_bound(thresholds_.begin() + feature_ptr_[fid],
+                               thresholds_.begin() + end, fvalue) -
+              thresholds_.begin();
+      }
+      for (size_t i = feature_ptr_[fid]; i < end; ++i) {
+        if (split_tree_[i] - tree_begin < ntree) {
+          leaves[split_tree_[i]] &= split_mask_[i];
+        }
+      }
+    }
+    // summed per group in model order, as the other predictors do
+    std::fill(psum, psum + num_group_, 0.0f);
+    for (unsigned t = tree_begin; t < tree_end; ++t) {
+      if (indexed_[t]) {
+        psum[tree_group_[t]] += leaf_values_[leaf_ptr_[t] + LowestBit(leaves[t])];
+      } else {
+        psum[tree_group_[t]] += forest.GetLeaf(forest.PackedIndex(t), feat, 0).LeafValue();
+      }
+    }
+    for (int gid = 0; gid < num_group_; ++gid) {
+      out[gid] += psum[gid];
+    }
+  }
+
+ private:
+  static bool Indexable(const RegTree& tree) {
+    if (tree.param.num_roots != 1) {
+      return false;
+    }
+    int n_leaves = 0;
+    for (int nid = 0; nid < tree.param.num_nodes; ++nid) {
+      n_leaves += !tree[nid].IsDeleted() && tree[nid].IsLeaf();
+    }
+    return n_leaves <= kMaxLeaves;
+  }
+
+  static int LowestBit(uint64_t v) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(v);
+#else
+    int n = 0;
+    while (!(v & 1)) {
+      v >>= 1;
+      ++n;
+    }
+    return n;
+#endif  // defined(__GNUC__)
+  }
+
+  // splits of feature f are [feature_ptr_[f], feature_ptr_[f + 1])
+  std::vector<size_t> feature_ptr_;
+  std::vector<bst_float> thresholds_;
+  std::vector<unsigned> split_tree_;
+  std::vector<uint64_t> split_mask_;
+  // splits of feature f defaulting right are [missing_ptr_[f], missing_ptr_[f + 1])
+  std::vector<size_t> missing_ptr_;
+  std::vector<unsigned> missing_tree_;
+  std::vector<uint64_t> missing_mask_;
+  // features used by at least one split
+  std::vector<unsigned> used_features_;
+  // leaves of tree t are [leaf_ptr_[t], leaf_ptr_[t + 1]), empty if not indexed
+  std::vector<size_t> leaf_ptr_;
+  // whether each tree is indexed
+  std::vector<bool> indexed_;
+  std::vector<bst_float> leaf_values_;
+  // output group of each tree
+  std::vector<int> tree_group_;
+  int num_group_{0};
+  uint64_t revision_{0};
+};
+
+constexpr int QuickScorerIndex::kMaxLeaves;
+
+class QuickScorerPredictor : public Predictor {
+ public:
+  QuickScorerPredictor()  // NOLINT
+      : cpu_predictor_(Predictor::Create("cpu_predictor", learner_param_)) {}
+
+  void Init(const std::vector<std::pair<std::string, std::string>>& cfg,
+            const std::vector<std::shared_ptr<DMatrix>>& cache) override {
+    Predictor::Init(cfg, cache);
+    cpu_predictor_->Init(cfg, cache);
+  }
+
+  void PredictBatch(DMatrix* dmat, HostDeviceVector<bst_float>* out_preds,
+                    const gbm::GBTreeModel& model, int tree_begin,
+                    unsigned ntree_limit = 0) override {
+    if (this->PredictFromCache(dmat, out_preds, model, ntree_limit)) {
+      return;
+    }
+    this->InitOutPredictions(dmat->Info(), out_preds, model);
+    ntree_limit *= model.param.num_output_group;
+    if (ntree_limit == 0 || ntree_limit > model.NumTrees()) {
+      ntree_limit = static_cast<unsigned>(model.NumTrees());
+    }
+    this->PredLoopInternal(dmat, &out_preds->HostVector(), model, tree_begin,
+                           ntree_limit);
+  }
+
+  void UpdatePredictionCache(
+      const gbm::GBTreeModel& model,
+      std::vector<std::unique_ptr<TreeUpdater>>* updaters,
+      int num_new_trees) override {
+    this->UpdateCachedPredictions(
+        model, updaters, num_new_trees,
+        [&](DMatrix* p_fmat, std::vector<bst_float>* out_preds,
+            unsigned tree_begin, unsigned tree_end) {
+          this->PredLoopInternal(p_fmat, out_preds, model, tree_begin, tree_end);
+        });
+  }
+
+  void PredictInstance(const SparsePage::Inst& inst,
+                       std::vector<bst_float>* out_preds,
+                       const gbm::GBTreeModel& model, unsigned ntree_limit,
+                       unsigned root_index) override {
+    cpu_predictor_->PredictInstance(inst, out_preds, model, ntree_limit,
+                                    root_index);
+  }
+
+  unsigned PredictStaged(DMatrix* dmat, HostDeviceVector<bst_float>* out_preds,
+                         const gbm::GBTreeModel& model,
+                         unsigned ntree_limit) override {
+    return cpu_predictor_->PredictStaged(dmat, out_preds, model, ntree_limit);
+  }
+
+  void PredictCascade(DMatrix* dmat, bst_float margin_threshold,
+                      HostDeviceVector<bst_float>* out_preds,
+                      std::vector<unsigned>* out_ntrees,
+                      const gbm::GBTreeModel& model,
+                      unsigned ntree_limit) override {
+    cpu_predictor_->PredictCascade(dmat, margin_threshold, out_preds, out_ntrees,
+                                   model, ntree_limit);
+  }
+
+  void PredictLeaf(DMatrix* p_fmat, std::vector<bst_float>* out_preds,
+                   const gbm::GBTreeModel& model,
+                   unsigned ntree_limit) override {
+    cpu_predictor_->PredictLeaf(p_fmat, out_preds, model, ntree_limit);
+  }
+
+  void PredictContribution(DMatrix* p_fmat,
+                           std::vector<bst_float>* out_contribs,
+                           const gbm::GBTreeModel& model, unsigned ntree_limit,
+                           bool approximate, int condition,
+                           unsigned condition_feature) override {
+    cpu_predictor_->PredictContribution(p_fmat, out_contribs, model, ntree_limit,
+                                        approximate, condition,
+                                        condition_feature);
+  }
+
+  void PredictCombined(DMatrix* p_fmat, CombinedPrediction* out,
+                       const gbm::GBTreeModel& model, unsigned ntree_limit) override {
+    cpu_predictor_->PredictCombined(p_fmat, out, model, ntree_limit);
+  }
+
+  void PredictContributionSparse(DMatrix* p_fmat, std::vector<size_t>* out_indptr,
+                                 std::vector<unsigned>* out_index,
+                                 std::vector<bst_float>* out_values,
+                                 std::vector<bst_float>* out_bias,
+                                 const gbm::GBTreeModel& model, unsigned ntree_limit,
+                                 bool approximate) override {
+    cpu_predictor_->PredictContributionSparse(p_fmat, out_indptr, out_index, out_values,
+                                              out_bias, model, ntree_limit, approximate);
+  }
+
+  void PredictInteractionContributions(DMatrix* p_fmat,
+                                       std::vector<bst_float>* out_contribs,
+                                       const gbm::GBTreeModel& model,
+                                       unsigned ntree_limit,
+                                       bool approximate) override {
+    cpu_predictor_->PredictInteractionContributions(p_fmat, out_contribs, model,
+                                                    ntree_limit, approximate);
+  }
+
+  void PredictInteractionTopK(DMatrix* p_fmat, unsigned top_k,
+                              std::vector<bst_float>* out_values,
+                              std::vector<unsigned>* out_index,
+                              const gbm::GBTreeModel& model,
+                              unsigned ntree_limit,
+                              bool approximate) override {
+    cpu_predictor_->PredictInteractionTopK(p_fmat, top_k, out_values, out_index,
+                                           model, ntree_limit, approximate);
+  }
+
+ protected:
+  void PredLoopInternal(DMatrix* p_fmat, std::vector<bst_float>* out_preds,
+                        const gbm::GBTreeModel& model, unsigned tree_begin,
+                        unsigned tree_end) {
+    CHECK_EQ(model.param.size_leaf_vector, 0)
+        << "size_leaf_vector is enforced to 0 so far";
+    const MetaInfo& info = p_fmat->Info();
+    const int num_group = model.param.num_output_group;
+    std::vector<bst_float>& preds = *out_preds;
+    CHECK_EQ(preds.size(), info.num_row_ * num_group);
+    this->InitIndex(model);
+    const CompiledForest& forest =
+        model.mapped_forest != nullptr ? *model.mapped_forest : forest_;
+    // models mapped from a file and multiple roots are traversed node by node
+    const bool use_index = index_.NumTrees() == model.NumTrees() && info.root_index_.empty();
+    std::vector<std::pair<size_t, size_t>> ranges;
+    if (!use_index) {
+      for (int gid = 0; gid < num_group; ++gid) {
+        ranges.push_back(forest.GroupRange(gid, tree_begin, tree_end));
+      }
+    }
+    for (const auto &batch : p_fmat->GetRowBatches()) {
+      const auto nsize = static_cast<bst_omp_uint>(batch.Size());
+#pragma omp parallel
+      {
+        RegTree::FVec feats;
+        feats.Init(model.param.num_feature);
+        std::vector<uint64_t> leaves(use_index ? index_.NumTrees() : 0);
+        std::vector<bst_float> psum(num_group);
+#pragma omp for schedule(static)
+        for (bst_omp_uint i = 0; i < nsize; ++i) {
+          const size_t ridx = batch.base_rowid + i;
+          bst_float* out = preds.data() + ridx * num_group;
+          feats.Fill(batch[i]);
+          if (use_index) {
+            index_.Predict(feats, forest, tree_begin, tree_end, leaves.data(),
+                           psum.data(), out);
+          } else {
+            const unsigned root_id = info.GetRoot(ridx);
+            for (int gid = 0; gid < num_group; ++gid) {
+              bst_float psum = 0.0f;
+              for (size_t k = ranges[gid].first; k < ranges[gid].second; ++k) {
+                psum += forest.GetLeaf(k, feats, root_id).LeafValue();
+              }
+              out[gid] += psum;
+            }
+          }
+          feats.Drop(batch[i]);
+        }
+      }
+    }
+  }
+
+ private:
+  // build the index and node layout of the model once per model revision,
+  // concurrent predictions wait for the build and then only read them
+  void InitIndex(const gbm::GBTreeModel& model) {
+    if (index_revision_.load(std::memory_order_acquire) != model.Revision()) {
+      std::lock_guard<std::mutex> guard(index_mutex_);
+      if (index_.IsStale(model)) {
+        index_.Init(model);
+      }
+      if (model.mapped_forest == nullptr && forest_.IsStale(model)) {
+        forest_.Init(model);
+      }
+      index_revision_.store(model.Revision(), std::memory_order_release);
+    }
+  }
+
+  std::unique_ptr<Predictor> cpu_predictor_;
+  // bitvector index of the model last predicted
+  QuickScorerIndex index_;
+  // node layout for trees the index can't hold
+  CompiledForest forest_;
+  // model revision index_ and forest_ were built for, 0 before the first build
+  std::atomic<uint64_t> index_revision_{0};
+  std::mutex index_mutex_;
+};
+
+XGBOOST_REGISTER_PREDICTOR(QuickScorerPredictor, "quickscorer_predictor")
+    .describe("Make predictions using the QuickScorer bitvector algorithm on CPU.")
+    .set_body([]() { return new QuickScorerPredictor(); });
+}  // namespace predictor
+}  // namespace xgboost
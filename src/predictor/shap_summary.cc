@@ -0,0 +1,237 @@
+/*!
+ * Copyright 2019 by Contributors
+ * \file shap_summary.cc
+ * \brief Precomputed per leaf path summaries answering TreeSHAP queries.
+ */
+#include <dmlc/omp.h>
+#include <xgboost/logging.h>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "shap_summary.h"
+
+namespace xgboost {
+namespace predictor {
+
+namespace {
+// calls visit(leaf, path) for every leaf, path holding the (parent, child)
+// node ids of the splits from the root down to the leaf
+template <typename Visit>
+void WalkPaths(const RegTree& tree, int nid,
+               std::vector<std::pair<int, int>>* path, Visit visit) {
+  const RegTree::Node& node = tree[nid];
+  if (node.IsLeaf()) {
+    visit(nid, *path);
+    return;
+  }
+  for (int child : {node.LeftChild(), node.RightChild()}) {
+    path->emplace_back(nid, child);
+    WalkPaths(tree, child, path, visit);
+    path->pop_back();
+  }
+}
+
+// position of each split of the path among its distinct features
+unsigned AssignSlots(const RegTree& tree, const std::vector<std::pair<int, int>>& path,
+                     std::vector<unsigned>* slots, std::vector<unsigned>* features) {
+  slots->clear();
+  features->clear();
+  for (const auto& step : path) {
+    const unsigned split_index = tree[step.first].SplitIndex();
+    auto it = std::find(features->begin(), features->end(), split_index);
+    slots->push_back(static_cast<unsigned>(it - features->begin()));
+    if (it == features->end()) {
+      features->push_back(split_index);
+    }
+  }
+  return static_cast<unsigned>(features->size());
+}
+
+/*!
+ * \brief contributions of a leaf to each distinct path feature for every pattern.
+ *
+ *  Feature i with zero fraction z_i and one fraction o_i in {0, 1} gets
+ *  (o_i - z_i) * v * sum_k w(k) e_k, where e_k are the coefficients of
+ *  prod_{j != i} (z_j + o_j t) and w(k) = k! (D - 1 - k)! / D! the Shapley
+ *  weights.  The product over all features is built once per pattern and
+ *  divided by the factor of i, as UnwoundPathSum does.
+ */
+void Tabulate(const std::vector<double>& zero_fractions, double leaf_value,
+              bst_float* out_values) {
+  const unsigned depth = static_cast<unsigned>(zero_fractions.size());
+  if (depth == 0) {
+    return;
+  }
+  std::vector<double> weights(depth);
+  weights[0] = 1.0 / depth;
+  for (unsigned k = 0; k + 1 < depth; ++k) {
+    weights[k + 1] = weights[k] * (k + 1) / (depth - 1 - k);
+  }
+  std::vector<double> poly(depth + 1);
+  std::vector<double> quotient(depth);
+  for (uint32_t pattern = 0; pattern < (1U << depth); ++pattern) {
+    std::fill(poly.begin(), poly.end(), 0.0);
+    poly[0] = 1.0;
+    for (unsigned j = 0; j < depth; ++j) {
+      const bool one = (pattern >> j) & 1U;
+      for (unsigned k = j + 1; k > 0; --k) {
+        poly[k] = poly[k] * zero_fractions[j] + (one ? poly[k - 1] : 0.0);
+      }
+      poly[0] *= zero_fractions[j];
+    }
+    bst_float* values = out_values + static_cast<size_t>(pattern) * depth;
+    for (unsigned i = 0; i < depth; ++i) {
+      const bool one = (pattern >> i) & 1U;
+      const double zero_fraction = zero_fractions[i];
+      if (one) {
+        quotient[depth - 1] = poly[depth];
+        for (unsigned k = depth - 1; k > 0; --k) {
+          quotient[k - 1] = poly[k] - zero_fraction * quotient[k];
+        }
+      } else if (zero_fraction != 0) {
+        for (unsigned k = 0; k < depth; ++k) {
+          quotient[k] = poly[k] / zero_fraction;
+        }
+      } else {
+        // (o_i - z_i) vanishes
+        values[i] = 0;
+        continue;
+      }
+      double total = 0;
+      for (unsigned k = 0; k < depth; ++k) {
+        total += quotient[k] * weights[k];
+      }
+      values[i] = static_cast<bst_float>(
+          ((one ? 1.0 : 0.0) - zero_fraction) * leaf_value * total);
+    }
+  }
+}
+}  // anonymous namespace
+
+size_t TreeShapSummary::EstimateBytes(const RegTree& tree) {
+  if (tree.param.num_roots != 1) {
+    return 0;
+  }
+  size_t bytes = 0;
+  bool fits = true;
+  std::vector<std::pair<int, int>> path;
+  std::vector<unsigned> slots, features;
+  WalkPaths(tree, 0, &path, [&](int nid, const std::vector<std::pair<int, int>>& path) {
+    const unsigned depth = AssignSlots(tree, path, &slots, &features);
+    if (depth > kMaxPathFeatures) {
+      fits = false;
+      return;
+    }
+    bytes += sizeof(Leaf) + path.size() * sizeof(Step) + depth * sizeof(unsigned) +
+             (static_cast<size_t>(1) << depth) * depth * sizeof(bst_float);
+  });
+  return fits ? bytes : 0;
+}
+
+void TreeShapSummary::Init(const RegTree& tree) {
+  CHECK_EQ(tree.param.num_roots, 1);
+  steps_.clear();
+  leaves_.clear();
+  features_.clear();
+  values_.clear();
+  double expected_value = 0;
+  std::vector<std::pair<int, int>> path;
+  std::vector<unsigned> slots, features;
+  std::vector<double> zero_fractions;
+  WalkPaths(tree, 0, &path, [&](int nid, const std::vector<std::pair<int, int>>& path) {
+    const unsigned depth = AssignSlots(tree, path, &slots, &features);
+    CHECK_LE(depth, kMaxPathFeatures);
+    Leaf leaf;
+    leaf.step_begin = steps_.size();
+    leaf.feature_begin = features_.size();
+    leaf.num_features = depth;
+    leaf.value_begin = values_.size();
+    // fractions of the training data flowing down the path, merged per feature
+    zero_fractions.assign(depth, 1.0);
+    double cover_fraction = 1.0;
+    for (size_t s = 0; s < path.size(); ++s) {
+      const RegTree::Node& node = tree[path[s].first];
+      const double ratio = static_cast<double>(tree.Stat(path[s].second).sum_hess) /
+                           tree.Stat(path[s].first).sum_hess;
+      zero_fractions[slots[s]] *= ratio;
+      cover_fraction *= ratio;
+      Step step;
+      step.split_index = node.SplitIndex();
+      step.split_cond = node.SplitCond();
+      step.default_left = node.DefaultLeft();
+      step.is_left = path[s].second == node.LeftChild();
+      step.slot = slots[s];
+      steps_.push_back(step);
+    }
+    leaf.step_end = steps_.size();
+    features_.insert(features_.end(), features.begin(), features.end());
+    values_.resize(values_.size() + (static_cast<size_t>(1) << depth) * depth);
+    const double leaf_value = tree[nid].LeafValue();
+    Tabulate(zero_fractions, leaf_value, values_.data() + leaf.value_begin);
+    expected_value += cover_fraction * leaf_value;
+    leaves_.push_back(leaf);
+  });
+  expected_value_ = static_cast<bst_float>(expected_value);
+}
+
+void TreeShapSummary::AddContributions(const RegTree::FVec& feat,
+                                       bst_float* out_contribs) const {
+  for (const Leaf& leaf : leaves_) {
+    // features whose splits the row follows all the way down to the leaf
+    uint32_t pattern = (1U << leaf.num_features) - 1U;
+    for (size_t s = leaf.step_begin; s < leaf.step_end; ++s) {
+      const Step& step = steps_[s];
+      const bool left = feat.IsMissing(step.split_index)
+                            ? step.default_left
+                            : feat.Fvalue(step.split_index) < step.split_cond;
+      if (left != step.is_left) {
+        pattern &= ~(1U << step.slot);
+      }
+    }
+    const bst_float* values = values_.data() + leaf.value_begin +
+                              static_cast<size_t>(pattern) * leaf.num_features;
+    const unsigned* features = features_.data() + leaf.feature_begin;
+    for (unsigned i = 0; i < leaf.num_features; ++i) {
+      out_contribs[features[i]] += values[i];
+    }
+  }
+  out_contribs[feat.Size()] += expected_value_;
+}
+
+ShapSummaryList ShapSummaryCache::Get(const gbm::GBTreeModel& model,
+                                      unsigned ntree_limit, size_t budget) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  if (revision_ != model.PrefixRevision() || budget_ != budget) {
+    revision_ = model.PrefixRevision();
+    budget_ = budget;
+    bytes_ = 0;
+    trees_.clear();
+  }
+  const size_t begin = trees_.size();
+  if (begin < ntree_limit) {
+    std::vector<bool> build(ntree_limit - begin, false);
+    for (size_t j = begin; j < ntree_limit; ++j) {
+      const size_t bytes = TreeShapSummary::EstimateBytes(*model.trees[j]);
+      if (bytes != 0 && bytes_ + bytes <= budget) {
+        bytes_ += bytes;
+        build[j - begin] = true;
+      }
+    }
+    trees_.resize(ntree_limit);
+    const auto nbuild = static_cast<bst_omp_uint>(build.size());
+    #pragma omp parallel for schedule(dynamic)
+    for (bst_omp_uint j = 0; j < nbuild; ++j) {
+      if (build[j]) {
+        std::shared_ptr<TreeShapSummary> summary(new TreeShapSummary());
+        summary->Init(*model.trees[begin + j]);
+        trees_[begin + j] = std::move(summary);
+      }
+    }
+  }
+  return ShapSummaryList(trees_.begin(), trees_.begin() + ntree_limit);
+}
+
+}  // namespace predictor
+}  // namespace xgboost
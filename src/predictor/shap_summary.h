@@ -0,0 +1,125 @@
+/*!
+ * Copyright 2019 by Contributors
+ * \file shap_summary.h
+ * \brief Precomputed per leaf path summaries answering TreeSHAP queries.
+ */
+#ifndef XGBOOST_PREDICTOR_SHAP_SUMMARY_H_
+#define XGBOOST_PREDICTOR_SHAP_SUMMARY_H_
+
+#include <xgboost/base.h>
+#include <xgboost/tree_model.h>
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "../gbm/gbtree_model.h"
+
+namespace xgboost {
+namespace predictor {
+
+/*!
+ * \brief SHAP values of every leaf of a tree, tabulated for each way a row can
+ *  agree with the leaf's path.
+ *
+ *  Along the path to a leaf a row either follows every split on a feature or
+ *  not, so the TreeSHAP contribution of the leaf only depends on which of the
+ *  D distinct path features the row agrees with.  The contributions are
+ *  computed once for all 2^D patterns, a query then only finds the pattern of
+ *  each leaf and adds D values, instead of the O(D^2) path arithmetic of
+ *  RegTree::TreeShap.  Memory grows as the number of leaves times 2^D * D, so
+ *  the summary must be rebuilt when the tree changes and is only worth it for
+ *  shallow trees.
+ */
+class TreeShapSummary {
+ public:
+  /*! \brief most distinct features on the path to a leaf of a summarized tree */
+  static constexpr unsigned kMaxPathFeatures = 16;
+  /*!
+   * \brief size in bytes of the summary of a tree.
+   * \return 0 if the tree can't be summarized, i.e. it has several roots or a
+   *  leaf with more than kMaxPathFeatures distinct features on its path.
+   */
+  static size_t EstimateBytes(const RegTree& tree);
+  /*! \brief tabulate the contributions of a tree accepted by EstimateBytes */
+  void Init(const RegTree& tree);
+  /*!
+   * \brief add the SHAP values of the tree for a row, same as
+   *  RegTree::CalculateContributions up to rounding.
+   * \param feat dense feature vector, if the feature is missing the field is set to NaN
+   * \param out_contribs contributions of each feature followed by the bias
+   */
+  void AddContributions(const RegTree::FVec& feat, bst_float* out_contribs) const;
+  /*! \brief size in bytes of the summary */
+  size_t Bytes() const {
+    return steps_.size() * sizeof(Step) + leaves_.size() * sizeof(Leaf) +
+           features_.size() * sizeof(unsigned) + values_.size() * sizeof(bst_float);
+  }
+
+ private:
+  /*! \brief a split on the path to a leaf */
+  struct Step {
+    unsigned split_index;
+    bst_float split_cond;
+    bool default_left;
+    // whether the path takes the left child
+    bool is_left;
+    // position of the split feature among the distinct features of the path
+    unsigned slot;
+  };
+  struct Leaf {
+    // [step_begin, step_end) in steps_
+    size_t step_begin;
+    size_t step_end;
+    // distinct features of the path start at feature_begin in features_
+    size_t feature_begin;
+    unsigned num_features;
+    // contributions for pattern p start at value_begin + p * num_features
+    size_t value_begin;
+  };
+  std::vector<Step> steps_;
+  std::vector<Leaf> leaves_;
+  std::vector<unsigned> features_;
+  std::vector<bst_float> values_;
+  // mean prediction of the tree, the contribution of the bias
+  bst_float expected_value_{0};
+};
+
+/*! \brief path summary of each tree, null for trees without one */
+using ShapSummaryList = std::vector<std::shared_ptr<const TreeShapSummary>>;
+
+/*!
+ * \brief Path summaries of the first trees of a model under a memory budget.
+ *
+ *  Summaries are built on first use, in model order, for every tree whose
+ *  estimated size fits what is left of the budget; a tree that doesn't fit
+ *  gets none, while later, smaller trees may still get one.  They are kept
+ *  while trees are committed to the model and dropped once other trees change
+ *  or the budget does.
+ */
+class ShapSummaryCache {
+ public:
+  /*!
+   * \brief summaries of the first ntree_limit trees, building the missing ones.
+   * \param budget memory budget in bytes.
+   */
+  ShapSummaryList Get(const gbm::GBTreeModel& model, unsigned ntree_limit, size_t budget);
+  /*! \brief size in bytes of the summaries held */
+  size_t Bytes() const {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return bytes_;
+  }
+
+ private:
+  // prefix revision of the model the summaries were built for
+  uint64_t revision_{0};
+  size_t budget_{0};
+  size_t bytes_{0};
+  ShapSummaryList trees_;
+  mutable std::mutex mutex_;
+};
+
+}  // namespace predictor
+}  // namespace xgboost
+#endif  // XGBOOST_PREDICTOR_SHAP_SUMMARY_H_
@@ -0,0 +1,209 @@
+/*!
+ * Copyright 2019 by Contributors
+ * \file traversal_kernel.cc
+ * \brief Kernels advancing a block of rows through one compiled tree.
+ *
+ *  The SIMD kernels move 8 (AVX2) or 16 (AVX-512) rows through a tree in lock
+ *  step: node fields and feature values are gathered, the split is evaluated
+ *  with a vector compare and the next node is chosen with a blend, so there is
+ *  no data dependent branch apart from the loop exit.  They are compiled with
+ *  function level target attributes and picked at runtime.
+ */
+#include <xgboost/logging.h>
+
+#include <algorithm>
+#include <limits>
+
+#include "traversal_kernel.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define XGBOOST_TRAVERSAL_SIMD 1
+#include <immintrin.h>
+#else
+#define XGBOOST_TRAVERSAL_SIMD 0
+#endif  // defined(__GNUC__) && defined(__x86_64__)
+
+namespace xgboost {
+namespace predictor {
+
+namespace {
+
+// The SIMD kernels read nodes as four 32 bit words:
+// split index with default direction, left child, split condition or leaf
+// value, original node id.
+constexpr int kSIndexWord = 0;
+constexpr int kCLeftWord = 1;
+constexpr int kInfoWord = 2;
+static_assert(sizeof(CompiledForest::Node) == 4 * sizeof(int32_t),
+              "Traversal kernels rely on the 16 byte node layout.");
+
+void TraverseScalar(const CompiledForest::Node* tree, const FeatureBlock& block,
+                    size_t nrow, const unsigned* roots, bst_float* out,
+                    size_t out_stride) {
+  for (size_t r = 0; r < nrow; ++r) {
+    const FeatureBlock::Entry* feat = block.Row(r);
+    const CompiledForest::Node* node = tree + roots[r];
+    while (!node->IsLeaf()) {
+      const FeatureBlock::Entry& e = feat[node->SplitIndex()];
+      if (e.flag == FeatureBlock::kMissing) {
+        node = tree + node->DefaultChild();
+      } else {
+        node = tree + node->LeftChild() + !(e.fvalue < node->SplitCond());
+      }
+    }
+    out[r * out_stride] += node->LeafValue();
+  }
+}
+
+#if XGBOOST_TRAVERSAL_SIMD
+
+__attribute__((target("avx2")))
+void TraverseAVX2(const CompiledForest::Node* tree, const FeatureBlock& block,
+                  size_t nrow, const unsigned* roots, bst_float* out,
+                  size_t out_stride) {
+  constexpr size_t kLanes = 8;
+  const auto* words = reinterpret_cast<const int*>(tree);
+  const auto* fwords = reinterpret_cast<const float*>(tree);
+  const auto* feats = reinterpret_cast<const int*>(block.Row(0));
+  const auto stride = static_cast<int>(block.Stride());
+  const __m256i all_ones = _mm256_set1_epi32(-1);
+  const __m256i index_mask = _mm256_set1_epi32(0x7fffffff);
+  alignas(32) int lane_buf[kLanes];
+  alignas(32) float leaf_buf[kLanes];
+  for (size_t base = 0; base < nrow; base += kLanes) {
+    const size_t n = std::min(kLanes, nrow - base);
+    // idle lanes in the last chunk repeat the first row of the chunk
+    for (size_t l = 0; l < kLanes; ++l) {
+      lane_buf[l] = static_cast<int>(roots[base + (l < n ? l : 0)]);
+    }
+    __m256i nid = _mm256_load_si256(reinterpret_cast<const __m256i*>(lane_buf));
+    for (size_t l = 0; l < kLanes; ++l) {
+      lane_buf[l] = static_cast<int>(base + (l < n ? l : 0)) * stride;
+    }
+    const __m256i row_offset =
+        _mm256_load_si256(reinterpret_cast<const __m256i*>(lane_buf));
+    while (true) {
+      const __m256i pos = _mm256_slli_epi32(nid, 2);
+      const __m256i cleft = _mm256_i32gather_epi32(words + kCLeftWord, pos, 4);
+      const __m256i is_leaf = _mm256_cmpeq_epi32(cleft, all_ones);
+      if (_mm256_movemask_epi8(is_leaf) == -1) break;
+      const __m256i sindex = _mm256_i32gather_epi32(words + kSIndexWord, pos, 4);
+      const __m256 cond = _mm256_i32gather_ps(fwords + kInfoWord, pos, 4);
+      const __m256i fidx =
+          _mm256_add_epi32(row_offset, _mm256_and_si256(sindex, index_mask));
+      const __m256i fbits = _mm256_i32gather_epi32(feats, fidx, 4);
+      const __m256i missing = _mm256_cmpeq_epi32(fbits, all_ones);
+      const __m256i less = _mm256_castps_si256(
+          _mm256_cmp_ps(_mm256_castsi256_ps(fbits), cond, _CMP_LT_OQ));
+      const __m256i default_left = _mm256_srai_epi32(sindex, 31);
+      // all ones when going left
+      const __m256i go_left = _mm256_blendv_epi8(less, default_left, missing);
+      // cleft + 1 for the right child, cleft for the left one
+      const __m256i next =
+          _mm256_add_epi32(_mm256_sub_epi32(cleft, all_ones), go_left);
+      nid = _mm256_blendv_epi8(next, nid, is_leaf);
+    }
+    const __m256 leaf = _mm256_i32gather_ps(fwords + kInfoWord,
+                                            _mm256_slli_epi32(nid, 2), 4);
+    _mm256_store_ps(leaf_buf, leaf);
+    for (size_t l = 0; l < n; ++l) {
+      out[(base + l) * out_stride] += leaf_buf[l];
+    }
+  }
+}
+
+__attribute__((target("avx512f")))
+void TraverseAVX512(const CompiledForest::Node* tree, const FeatureBlock& block,
+                    size_t nrow, const unsigned* roots, bst_float* out,
+                    size_t out_stride) {
+  constexpr size_t kLanes = 16;
+  const auto* words = reinterpret_cast<const int*>(tree);
+  const auto* fwords = reinterpret_cast<const float*>(tree);
+  const auto* feats = reinterpret_cast<const int*>(block.Row(0));
+  const auto stride = static_cast<int>(block.Stride());
+  const __m512i all_ones = _mm512_set1_epi32(-1);
+  const __m512i zero = _mm512_setzero_si512();
+  const __m512i index_mask = _mm512_set1_epi32(0x7fffffff);
+  alignas(64) int lane_buf[kLanes];
+  alignas(64) float leaf_buf[kLanes];
+  for (size_t base = 0; base < nrow; base += kLanes) {
+    const size_t n = std::min(kLanes, nrow - base);
+    for (size_t l = 0; l < kLanes; ++l) {
+      lane_buf[l] = static_cast<int>(roots[base + (l < n ? l : 0)]);
+    }
+    __m512i nid = _mm512_load_si512(lane_buf);
+    for (size_t l = 0; l < kLanes; ++l) {
+      lane_buf[l] = static_cast<int>(base + (l < n ? l : 0)) * stride;
+    }
+    const __m512i row_offset = _mm512_load_si512(lane_buf);
+    while (true) {
+      const __m512i pos = _mm512_slli_epi32(nid, 2);
+      const __m512i cleft = _mm512_i32gather_epi32(pos, words + kCLeftWord, 4);
+      const __mmask16 is_leaf = _mm512_cmpeq_epi32_mask(cleft, all_ones);
+      if (is_leaf == 0xFFFF) break;
+      const __m512i sindex = _mm512_i32gather_epi32(pos, words + kSIndexWord, 4);
+      const __m512 cond = _mm512_i32gather_ps(pos, fwords + kInfoWord, 4);
+      const __m512i fidx =
+          _mm512_add_epi32(row_offset, _mm512_and_si512(sindex, index_mask));
+      const __m512i fbits = _mm512_i32gather_epi32(fidx, feats, 4);
+      const __mmask16 missing = _mm512_cmpeq_epi32_mask(fbits, all_ones);
+      const __mmask16 less =
+          _mm512_cmp_ps_mask(_mm512_castsi512_ps(fbits), cond, _CMP_LT_OQ);
+      const __mmask16 default_left = _mm512_cmplt_epi32_mask(sindex, zero);
+      const __mmask16 go_left = static_cast<__mmask16>(
+          (missing & default_left) | (~missing & less));
+      const __m512i next = _mm512_mask_mov_epi32(
+          _mm512_sub_epi32(cleft, all_ones), go_left, cleft);
+      nid = _mm512_mask_mov_epi32(nid, static_cast<__mmask16>(~is_leaf), next);
+    }
+    const __m512 leaf = _mm512_i32gather_ps(_mm512_slli_epi32(nid, 2),
+                                            fwords + kInfoWord, 4);
+    _mm512_store_ps(leaf_buf, leaf);
+    for (size_t l = 0; l < n; ++l) {
+      out[(base + l) * out_stride] += leaf_buf[l];
+    }
+  }
+}
+
+#endif  // XGBOOST_TRAVERSAL_SIMD
+
+}  // anonymous namespace
+
+bool TraversalKernelSupported(TraversalKernelType type) {
+  switch (type) {
+    case kAutoKernel:
+    case kScalarKernel:
+      return true;
+#if XGBOOST_TRAVERSAL_SIMD
+    case kAVX2Kernel:
+      return __builtin_cpu_supports("avx2");
+    case kAVX512Kernel:
+      return __builtin_cpu_supports("avx512f");
+#endif  // XGBOOST_TRAVERSAL_SIMD
+    default:
+      return false;
+  }
+}
+
+TraversalKernel GetTraversalKernel(TraversalKernelType type, size_t max_index) {
+  CHECK(TraversalKernelSupported(type))
+      << "The requested traversal kernel is not supported by this CPU or build.";
+  if (type == kScalarKernel ||
+      max_index > static_cast<size_t>(std::numeric_limits<int32_t>::max())) {
+    return TraverseScalar;
+  }
+#if XGBOOST_TRAVERSAL_SIMD
+  if (type == kAVX512Kernel ||
+      (type == kAutoKernel && TraversalKernelSupported(kAVX512Kernel))) {
+    return TraverseAVX512;
+  }
+  if (type == kAVX2Kernel ||
+      (type == kAutoKernel && TraversalKernelSupported(kAVX2Kernel))) {
+    return TraverseAVX2;
+  }
+#endif  // XGBOOST_TRAVERSAL_SIMD
+  return TraverseScalar;
+}
+
+}  // namespace predictor
+}  // namespace xgboost
@@ -0,0 +1,106 @@
+/*!
+ * Copyright 2019 by Contributors
+ * \file traversal_kernel.h
+ * \brief Kernels advancing a block of rows through one compiled tree.
+ */
+#ifndef XGBOOST_PREDICTOR_TRAVERSAL_KERNEL_H_
+#define XGBOOST_PREDICTOR_TRAVERSAL_KERNEL_H_
+
+#include <xgboost/base.h>
+#include <xgboost/data.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "compiled_forest.h"
+
+namespace xgboost {
+namespace predictor {
+
+/*!
+ * \brief Dense row major block of feature vectors.
+ *
+ *  Same encoding as RegTree::FVec: a missing entry has all bits set, so a
+ *  feature value can be tested for missing with one integer comparison on any
+ *  number of lanes.
+ */
+class FeatureBlock {
+ public:
+  /*! \brief bit pattern of a missing entry */
+  static constexpr int32_t kMissing = -1;
+  /*! \brief a feature value or the missing flag */
+  union Entry {
+    bst_float fvalue;
+    int32_t flag;
+  };
+  /*!
+   * \brief allocate the block with all entries missing.
+   * \param nrow maximum number of rows held.
+   * \param nfeature number of features of a row.
+   */
+  void Init(size_t nrow, size_t nfeature) {
+    stride_ = nfeature;
+    Entry e;
+    e.flag = kMissing;
+    data_.assign(nrow * nfeature, e);
+  }
+  /*! \brief fill row `r` with an instance */
+  void Fill(size_t r, const SparsePage::Inst& inst) {
+    Entry* row = data_.data() + r * stride_;
+    for (const auto& entry : inst) {
+      if (entry.index >= stride_) continue;
+      row[entry.index].fvalue = entry.fvalue;
+    }
+  }
+  /*! \brief reset row `r` filled with `inst` back to missing */
+  void Drop(size_t r, const SparsePage::Inst& inst) {
+    Entry* row = data_.data() + r * stride_;
+    for (const auto& entry : inst) {
+      if (entry.index >= stride_) continue;
+      row[entry.index].flag = kMissing;
+    }
+  }
+  /*! \brief first entry of row `r` */
+  const Entry* Row(size_t r) const { return data_.data() + r * stride_; }
+  /*! \brief number of entries per row */
+  size_t Stride() const { return stride_; }
+
+ private:
+  std::vector<Entry> data_;
+  size_t stride_{0};
+};
+
+/*!
+ * \brief Send rows [0, nrow) of a feature block through one tree and
+ *  accumulate the reached leaf values, out[r * out_stride] += leaf(r).
+ * \param tree first node of a compiled tree.
+ * \param block feature vectors of the rows.
+ * \param nrow number of rows.
+ * \param roots starting root of each row.
+ * \param out first output value.
+ * \param out_stride distance between outputs of adjacent rows.
+ */
+using TraversalKernel = void (*)(const CompiledForest::Node* tree,
+                                 const FeatureBlock& block, size_t nrow,
+                                 const unsigned* roots, bst_float* out,
+                                 size_t out_stride);
+
+/*! \brief instruction set used to traverse trees */
+enum TraversalKernelType : int {
+  kAutoKernel = 0, kScalarKernel = 1, kAVX2Kernel = 2, kAVX512Kernel = 3
+};
+
+/*! \brief whether the kernel can run on this build and CPU */
+bool TraversalKernelSupported(TraversalKernelType type);
+
+/*!
+ * \brief get a traversal kernel.
+ * \param type requested kernel, kAutoKernel picks the widest supported one.
+ * \param max_index largest row * stride + feature offset the kernel reads,
+ *  SIMD kernels use 32 bit gather offsets and are skipped beyond that.
+ */
+TraversalKernel GetTraversalKernel(TraversalKernelType type, size_t max_index);
+
+}  // namespace predictor
+}  // namespace xgboost
+#endif  // XGBOOST_PREDICTOR_TRAVERSAL_KERNEL_H_
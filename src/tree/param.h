@@ -95,6 +95,10 @@ struct TrainParam : public dmlc::Parameter<TrainParam> {
   // for that feature; to save time, only up to (max_search_group) of existing groups
   // will be considered. If set to zero, ALL existing groups will be examined
   unsigned max_search_group;
+  // accumulate histogram bins in float instead of double
+  bool single_precision_histogram;
+  // memory cap of the cached histograms in lossguide growth, 0 for no cap
+  int max_hist_memory_mb;
 
   // declare the parameters
   DMLC_DECLARE_PARAMETER(TrainParam) {
@@ -219,6 +223,13 @@ struct TrainParam : public dmlc::Parameter<TrainParam> {
                   "groups before creating a new group for that feature; to save time, "
                   "only up to (max_search_group) of existing groups will be "
                   "considered. If set to zero, ALL existing groups will be examined.");
+    DMLC_DECLARE_FIELD(single_precision_histogram).set_default(false)
+        .describe("Accumulate histogram bins in single precision, halving histogram "
+                  "memory and allreduce traffic. Node totals stay in double.");
+    DMLC_DECLARE_FIELD(max_hist_memory_mb).set_lower_bound(0).set_default(0)
+        .describe("Memory cap in MB of the histograms cached for queued nodes in lossguide "
+                  "growth, 0 for no cap. Histograms of the least promising nodes are "
+                  "evicted and rebuilt when needed.");
 
     // add alias of parameters
     DMLC_DECLARE_ALIAS(reg_lambda, lambda);
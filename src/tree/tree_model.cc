@@ -4,10 +4,10 @@
  * \brief model structure for tree
  */
 #include <xgboost/tree_model.h>
-#include <sstream>
+#include <cstdio>
 #include <limits>
 #include <cmath>
-#include <iomanip>
+#include <string>
 #include "./param.h"
 
 namespace xgboost {
@@ -17,40 +17,85 @@ DMLC_REGISTER_PARAMETER(TreeParam);
 namespace tree {
 DMLC_REGISTER_PARAMETER(TrainParam);
 }
+// append only text buffer used by the dump, formats numbers without iostreams
+class DumpWriter {
+ public:
+  explicit DumpWriter(std::string* out) : out_(out) {}
+  DumpWriter& operator<<(const char* str) {
+    out_->append(str);
+    return *this;
+  }
+  DumpWriter& operator<<(const std::string& str) {
+    out_->append(str);
+    return *this;
+  }
+  DumpWriter& operator<<(char c) {
+    out_->push_back(c);
+    return *this;
+  }
+  DumpWriter& operator<<(int64_t value) {
+    char buf[24];
+    char* end = buf + sizeof(buf);
+    char* p = end;
+    uint64_t v = value < 0 ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+    do {
+      *--p = static_cast<char>('0' + v % 10);
+      v /= 10;
+    } while (v != 0);
+    if (value < 0) *--p = '-';
+    out_->append(p, end - p);
+    return *this;
+  }
+  DumpWriter& operator<<(int value) { return *this << static_cast<int64_t>(value); }
+  DumpWriter& operator<<(unsigned value) { return *this << static_cast<int64_t>(value); }
+  // same text as an ostream with precision max_digits10
+  DumpWriter& operator<<(bst_float value) {
+    char buf[32];
+    int len = snprintf(buf, sizeof(buf), "%.*g",
+                       std::numeric_limits<bst_float>::max_digits10,
+                       static_cast<double>(value));
+    out_->append(buf, len);
+    return *this;
+  }
+  void Indent(int n, const char* unit) {
+    for (int i = 0; i < n; ++i) {
+      out_->append(unit);
+    }
+  }
+
+ private:
+  std::string* out_;
+};
+
 // internal function to dump regression tree to text
-void DumpRegTree(std::stringstream& fo,  // NOLINT(*)
+void DumpRegTree(DumpWriter& fo,  // NOLINT(*)
                  const RegTree& tree,
                  const FeatureMap& fmap,
                  int nid, int depth, int add_comma,
-                 bool with_stats, std::string format) {
-  int float_max_precision = std::numeric_limits<bst_float>::max_digits10;
-  if (format == "json") {
+                 bool with_stats, bool json) {
+  if (json) {
     if (add_comma) {
-      fo << ",";
+      fo << ',';
     }
     if (depth != 0) {
-      fo << std::endl;
-    }
-    for (int i = 0; i < depth + 1; ++i) {
-      fo << "  ";
+      fo << '\n';
     }
+    fo.Indent(depth + 1, "  ");
   } else {
-    for (int i = 0; i < depth; ++i) {
-      fo << '\t';
-    }
+    fo.Indent(depth, "\t");
   }
   if (tree[nid].IsLeaf()) {
-    if (format == "json") {
+    if (json) {
       fo << "{ \"nodeid\": " << nid
-         << ", \"leaf\": " << std::setprecision(float_max_precision) << tree[nid].LeafValue();
+         << ", \"leaf\": " << tree[nid].LeafValue();
       if (with_stats) {
-        fo << ", \"cover\": " << std::setprecision(float_max_precision) << tree.Stat(nid).sum_hess;
+        fo << ", \"cover\": " << tree.Stat(nid).sum_hess;
       }
       fo << " }";
     } else {
-      fo << nid << ":leaf=" << std::setprecision(float_max_precision) << tree[nid].LeafValue();
+      fo << nid << ":leaf=" << tree[nid].LeafValue();
       if (with_stats) {
-        fo << ",cover=" << std::setprecision(float_max_precision) << tree.Stat(nid).sum_hess;
+        fo << ",cover=" << tree.Stat(nid).sum_hess;
       }
       fo << '\n';
     }
@@ -63,7 +108,7 @@ void DumpRegTree(std::stringstream& fo,  // NOLINT(*)
         case FeatureMap::kIndicator: {
           int nyes = tree[nid].DefaultLeft() ?
               tree[nid].RightChild() : tree[nid].LeftChild();
-          if (format == "json") {
+          if (json) {
             fo << "{ \"nodeid\": " << nid
                << ", \"depth\": " << depth
                << ", \"split\": \"" << fmap.Name(split_index) << "\""
@@ -80,7 +125,7 @@ void DumpRegTree(std::stringstream& fo,  // NOLINT(*)
           const int integer_threshold
             = (floored == cond) ? static_cast<int>(floored)
                                 : static_cast<int>(floored) + 1;
-          if (format == "json") {
+          if (json) {
             fo << "{ \"nodeid\": " << nid
                << ", \"depth\": " << depth
                << ", \"split\": \"" << fmap.Name(split_index) << "\""
@@ -99,17 +144,17 @@ void DumpRegTree(std::stringstream& fo,  // NOLINT(*)
         }
         case FeatureMap::kFloat:
         case FeatureMap::kQuantitive: {
-          if (format == "json") {
+          if (json) {
             fo << "{ \"nodeid\": " << nid
                << ", \"depth\": " << depth
                << ", \"split\": \"" << fmap.Name(split_index) << "\""
-               << ", \"split_condition\": " << std::setprecision(float_max_precision) << cond
+               << ", \"split_condition\": " << cond
                << ", \"yes\": " << tree[nid].LeftChild()
                << ", \"no\": " << tree[nid].RightChild()
                << ", \"missing\": " << tree[nid].DefaultChild();
           } else {
             fo << nid << ":[" << fmap.Name(split_index)
-               << "<" << std::setprecision(float_max_precision) << cond
+               << "<" << cond
                << "] yes=" << tree[nid].LeftChild()
                << ",no=" << tree[nid].RightChild()
                << ",missing=" << tree[nid].DefaultChild();
@@ -119,42 +164,40 @@ void DumpRegTree(std::stringstream& fo,  // NOLINT(*)
         default: LOG(FATAL) << "unknown fmap type";
         }
     } else {
-      if (format == "json") {
+      if (json) {
         fo << "{ \"nodeid\": " << nid
            << ", \"depth\": " << depth
            << ", \"split\": " << split_index
-           << ", \"split_condition\": " << std::setprecision(float_max_precision) << cond
+           << ", \"split_condition\": " << cond
            << ", \"yes\": " << tree[nid].LeftChild()
            << ", \"no\": " << tree[nid].RightChild()
            << ", \"missing\": " << tree[nid].DefaultChild();
       } else {
-        fo << nid << ":[f" << split_index << "<"<< std::setprecision(float_max_precision) << cond
+        fo << nid << ":[f" << split_index << "<" << cond
            << "] yes=" << tree[nid].LeftChild()
            << ",no=" << tree[nid].RightChild()
            << ",missing=" << tree[nid].DefaultChild();
       }
     }
     if (with_stats) {
-      if (format == "json") {
-        fo << ", \"gain\": " << std::setprecision(float_max_precision) << tree.Stat(nid).loss_chg
-           << ", \"cover\": " << std::setprecision(float_max_precision) << tree.Stat(nid).sum_hess;
+      if (json) {
+        fo << ", \"gain\": " << tree.Stat(nid).loss_chg
+           << ", \"cover\": " << tree.Stat(nid).sum_hess;
       } else {
-        fo << ",gain=" << std::setprecision(float_max_precision) << tree.Stat(nid).loss_chg
-           << ",cover=" << std::setprecision(float_max_precision) << tree.Stat(nid).sum_hess;
+        fo << ",gain=" << tree.Stat(nid).loss_chg
+           << ",cover=" << tree.Stat(nid).sum_hess;
       }
     }
-    if (format == "json") {
+    if (json) {
       fo << ", \"children\": [";
     } else {
       fo << '\n';
     }
-    DumpRegTree(fo, tree, fmap, tree[nid].LeftChild(), depth + 1, false, with_stats, format);
-    DumpRegTree(fo, tree, fmap, tree[nid].RightChild(), depth + 1, true, with_stats, format);
-    if (format == "json") {
-      fo << std::endl;
-      for (int i = 0; i < depth + 1; ++i) {
-        fo << "  ";
-      }
+    DumpRegTree(fo, tree, fmap, tree[nid].LeftChild(), depth + 1, false, with_stats, json);
+    DumpRegTree(fo, tree, fmap, tree[nid].RightChild(), depth + 1, true, with_stats, json);
+    if (json) {
+      fo << '\n';
+      fo.Indent(depth + 1, "  ");
       fo << "]}";
     }
   }
@@ -163,11 +206,20 @@ void DumpRegTree(std::stringstream& fo,  // NOLINT(*)
 std::string RegTree::DumpModel(const FeatureMap& fmap,
                                bool with_stats,
                                std::string format) const {
-  std::stringstream fo("");
+  std::string out;
+  this->DumpModel(fmap, with_stats, format, &out);
+  return out;
+}
+
+void RegTree::DumpModel(const FeatureMap& fmap,
+                        bool with_stats,
+                        const std::string& format,
+                        std::string* out) const {
+  DumpWriter fo(out);
+  const bool json = format == "json";
   for (int i = 0; i < param.num_roots; ++i) {
-    DumpRegTree(fo, *this, fmap, i, 0, false, with_stats, format);
+    DumpRegTree(fo, *this, fmap, i, 0, false, with_stats, json);
   }
-  return fo.str();
 }
 void RegTree::FillNodeMeanValues() {
   size_t num_nodes = this->param.num_nodes;
@@ -194,9 +246,9 @@ bst_float RegTree::FillNodeMeanValue(int nid) {
   return result;
 }
 
-void RegTree::CalculateContributionsApprox(const RegTree::FVec &feat,
-                                           unsigned root_id,
-                                           bst_float *out_contribs) const {
+int RegTree::CalculateContributionsApprox(const RegTree::FVec &feat,
+                                          unsigned root_id,
+                                          bst_float *out_contribs) const {
   CHECK_GT(this->node_mean_values_.size(), 0U);
   // this follows the idea of http://blog.datadive.net/interpreting-random-forests/
   unsigned split_index = 0;
@@ -206,7 +258,7 @@ void RegTree::CalculateContributionsApprox(const RegTree::FVec &feat,
   out_contribs[feat.Size()] += node_value;
   if ((*this)[pid].IsLeaf()) {
     // nothing to do anymore
-    return;
+    return pid;
   }
   while (!(*this)[pid].IsLeaf()) {
     split_index = (*this)[pid].SplitIndex();
@@ -219,6 +271,7 @@ void RegTree::CalculateContributionsApprox(const RegTree::FVec &feat,
   bst_float leaf_value = (*this)[pid].LeafValue();
   // update leaf feature weight
   out_contribs[split_index] += leaf_value - node_value;
+  return pid;
 }
 
 // Used by TreeShap
@@ -408,4 +461,146 @@ void RegTree::CalculateContributions(const RegTree::FVec &feat,
            1, 1, -1, condition, condition_feature, 1);
   delete[] unique_path_data;
 }
+
+// Used by TreeShapInteractions
+// a decision path conditioned on a feature, which is never extended into it;
+// the path is shared by the on and off conditions, only their weights differ
+struct ConditionedPath {
+  PathElement* unique_path;
+  unsigned unique_depth;
+  // the feature fixed, -1 for the unconditioned path
+  int condition_feature;
+  bst_float on_fraction;
+  bst_float off_fraction;
+  ConditionedPath() = default;
+  ConditionedPath(PathElement* p, unsigned d, int i) :
+    unique_path(p), unique_depth(d), condition_feature(i), on_fraction(1), off_fraction(1) {}
+};
+
+// recursive computation of SHAP interaction values for a decision tree
+void RegTree::TreeShapInteractions(const RegTree::FVec &feat, bst_float *out_interactions,
+                                   unsigned node_index, ConditionedPath *parent_paths,
+                                   unsigned num_paths, bst_float parent_zero_fraction,
+                                   bst_float parent_one_fraction, int parent_feature_index,
+                                   size_t path_stride) const {
+  const auto node = (*this)[node_index];
+
+  // extend the unique paths that still have weight coming down to us
+  ConditionedPath *paths = parent_paths + num_paths;
+  for (unsigned k = 0; k < num_paths; ++k) {
+    ConditionedPath &path = paths[k];
+    path = parent_paths[k];
+    if (path.on_fraction == 0 && path.off_fraction == 0) continue;
+    PathElement *unique_path = path.unique_path + path.unique_depth + 1;
+    std::copy(path.unique_path, path.unique_path + path.unique_depth + 1, unique_path);
+    path.unique_path = unique_path;
+    if (k == 0 || path.condition_feature != parent_feature_index) {
+      ExtendPath(unique_path, path.unique_depth, parent_zero_fraction,
+                 parent_one_fraction, parent_feature_index);
+    }
+  }
+
+  // leaf node, the unconditioned path weighs it the same whatever is fixed
+  if (node.IsLeaf()) {
+    const size_t ncolumns = feat.Size() + 1;
+    for (unsigned k = 1; k < num_paths; ++k) {
+      const ConditionedPath &path = paths[k];
+      const bst_float scale = (path.on_fraction - path.off_fraction) / 2 * node.LeafValue();
+      if (scale == 0) continue;
+      bst_float *row = out_interactions + path.condition_feature * ncolumns;
+      for (unsigned i = 1; i <= path.unique_depth; ++i) {
+        const bst_float w = UnwoundPathSum(path.unique_path, path.unique_depth, i);
+        const PathElement &el = path.unique_path[i];
+        const bst_float interaction = w * (el.one_fraction - el.zero_fraction) * scale;
+        row[el.feature_index] += interaction;
+        row[path.condition_feature] -= interaction;
+      }
+    }
+    return;
+  }
+
+  // internal node, find which branch is "hot" (meaning x would follow it)
+  const unsigned split_index = node.SplitIndex();
+  unsigned hot_index = 0;
+  if (feat.IsMissing(split_index)) {
+    hot_index = node.DefaultChild();
+  } else if (feat.Fvalue(split_index) < node.SplitCond()) {
+    hot_index = node.LeftChild();
+  } else {
+    hot_index = node.RightChild();
+  }
+  const unsigned cold_index = (static_cast<int>(hot_index) == node.LeftChild() ?
+                               node.RightChild() : node.LeftChild());
+  const bst_float w = this->Stat(node_index).sum_hess;
+  const bst_float hot_zero_fraction = this->Stat(hot_index).sum_hess / w;
+  const bst_float cold_zero_fraction = this->Stat(cold_index).sum_hess / w;
+  bst_float incoming_zero_fraction = 1;
+  bst_float incoming_one_fraction = 1;
+
+  // the first split on a feature starts the path conditioned on it, placed at the
+  // same offset in its own buffer as the unconditioned path it copies
+  unsigned condition = 1;
+  while (condition < num_paths &&
+         static_cast<unsigned>(paths[condition].condition_feature) != split_index) {
+    ++condition;
+  }
+  unsigned num_node_paths = num_paths;
+  if (condition == num_paths) {
+    ConditionedPath &path = paths[num_node_paths++];
+    path = ConditionedPath(paths[0].unique_path + condition * path_stride,
+                           paths[0].unique_depth, split_index);
+    std::copy(paths[0].unique_path, paths[0].unique_path + paths[0].unique_depth + 1,
+              path.unique_path);
+  }
+
+  // see if we have already split on this feature,
+  // if so we undo that split so we can redo it for this node
+  for (unsigned k = 0; k < num_node_paths; ++k) {
+    ConditionedPath &path = paths[k];
+    if (k == condition || (path.on_fraction == 0 && path.off_fraction == 0)) continue;
+    unsigned path_index = 0;
+    for (; path_index <= path.unique_depth; ++path_index) {
+      if (static_cast<unsigned>(path.unique_path[path_index].feature_index) == split_index) {
+        break;
+      }
+    }
+    if (path_index != path.unique_depth + 1) {
+      incoming_zero_fraction = path.unique_path[path_index].zero_fraction;
+      incoming_one_fraction = path.unique_path[path_index].one_fraction;
+      UnwindPath(path.unique_path, path.unique_depth, path_index);
+      path.unique_depth -= 1;
+    }
+    path.unique_depth += 1;
+  }
+
+  // divide up the weight of the conditioned feature among the recursive calls,
+  // fixed on only the hot branch is followed
+  ConditionedPath &conditioned = paths[condition];
+  const bst_float off_fraction = conditioned.off_fraction;
+  conditioned.off_fraction = off_fraction * hot_zero_fraction;
+  TreeShapInteractions(feat, out_interactions, hot_index, paths, num_node_paths,
+                       hot_zero_fraction * incoming_zero_fraction, incoming_one_fraction,
+                       split_index, path_stride);
+
+  conditioned.on_fraction = 0;
+  conditioned.off_fraction = off_fraction * cold_zero_fraction;
+  TreeShapInteractions(feat, out_interactions, cold_index, paths, num_node_paths,
+                       cold_zero_fraction * incoming_zero_fraction, 0,
+                       split_index, path_stride);
+}
+
+void RegTree::CalculateInteractionContributions(const RegTree::FVec &feat,
+                                                unsigned root_id,
+                                                bst_float *out_interactions) const {
+  // every path gets a buffer as large as TreeShap's, there is one path per
+  // split feature on the way down and the unconditioned one
+  const int maxd = this->MaxDepth(root_id) + 2;
+  const size_t path_stride = (maxd * (maxd + 1)) / 2;
+  std::vector<PathElement> unique_path_data(maxd * path_stride);
+  std::vector<ConditionedPath> paths(path_stride);
+  paths[0] = ConditionedPath(unique_path_data.data(), 0, -1);
+
+  TreeShapInteractions(feat, out_interactions, root_id, paths.data(), 1,
+                       1, 1, -1, path_stride);
+}
 }  // namespace xgboost
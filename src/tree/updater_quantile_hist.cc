@@ -66,34 +66,64 @@ void QuantileHistMaker::Update(HostDeviceVector<GradientPair> *gpair,
   float lr = param_.learning_rate;
   param_.learning_rate = lr / trees.size();
   // build tree
-  if (!builder_) {
-    builder_.reset(new Builder(
+  if (param_.single_precision_histogram) {
+    this->CallBuilderUpdate(&float_builder_, gpair, dmat, trees);
+  } else {
+    this->CallBuilderUpdate(&double_builder_, gpair, dmat, trees);
+  }
+  param_.learning_rate = lr;
+}
+
+template <typename GradientSumT>
+void QuantileHistMaker::CallBuilderUpdate(std::unique_ptr<Builder<GradientSumT>>* p_builder,
+                                          HostDeviceVector<GradientPair>* gpair,
+                                          DMatrix* dmat,
+                                          const std::vector<RegTree*>& trees) {
+  std::unique_ptr<Builder<GradientSumT>>& builder = *p_builder;
+  if (!builder) {
+    builder.reset(new Builder<GradientSumT>(
         param_,
         std::move(pruner_),
         std::unique_ptr<SplitEvaluator>(spliteval_->GetHostClone())));
   }
   for (auto tree : trees) {
-    builder_->Update(gmat_, gmatb_, column_matrix_, gpair, dmat, tree);
+    builder->Update(gmat_, gmatb_, column_matrix_, gpair, dmat, tree);
   }
-  param_.learning_rate = lr;
 }
 
 bool QuantileHistMaker::UpdatePredictionCache(
     const DMatrix* data,
     HostDeviceVector<bst_float>* out_preds) {
-  if (!builder_ || param_.subsample < 1.0f) {
+  if (param_.subsample < 1.0f) {
     return false;
-  } else {
-    return builder_->UpdatePredictionCache(data, out_preds);
+  } else if (param_.single_precision_histogram && float_builder_) {
+    return float_builder_->UpdatePredictionCache(data, out_preds);
+  } else if (!param_.single_precision_histogram && double_builder_) {
+    return double_builder_->UpdatePredictionCache(data, out_preds);
   }
+  return false;
 }
 
-void QuantileHistMaker::Builder::SyncHistograms(
-    int starting_index,
-    int sync_count,
+template <typename GradientSumT>
+void QuantileHistMaker::Builder<GradientSumT>::SyncHistograms(
+    const std::vector<int> &sync_nids,
     RegTree *p_tree) {
   builder_monitor_.Start("SyncHistograms");
-  this->histred_.Allreduce(hist_[starting_index].data(), hist_builder_.GetNumBins() * sync_count);
+  if (rabit::IsDistributed() && !sync_nids.empty()) {
+    // histograms don't share a buffer, reduce a contiguous copy in a single call
+    const size_t nbins = hist_builder_.GetNumBins();
+    hist_sync_buffer_.resize(nbins * sync_nids.size());
+    for (size_t i = 0; i < sync_nids.size(); ++i) {
+      GHistRowT hist = hist_[sync_nids[i]];
+      std::copy(hist.begin(), hist.end(), hist_sync_buffer_.begin() + i * nbins);
+    }
+    this->histred_.Allreduce(hist_sync_buffer_.data(), hist_sync_buffer_.size());
+    for (size_t i = 0; i < sync_nids.size(); ++i) {
+      GHistRowT hist = hist_[sync_nids[i]];
+      std::copy(hist_sync_buffer_.begin() + i * nbins,
+                hist_sync_buffer_.begin() + (i + 1) * nbins, hist.begin());
+    }
+  }
   // use Subtraction Trick
   for (auto const& node_pair : nodes_for_subtraction_trick_) {
     hist_.AddHistRow(node_pair.first);
@@ -103,57 +133,95 @@ void QuantileHistMaker::Builder::SyncHistograms(
   builder_monitor_.Stop("SyncHistograms");
 }
 
-void QuantileHistMaker::Builder::BuildLocalHistograms(
-    int *starting_index,
-    int *sync_count,
+template <typename GradientSumT>
+void QuantileHistMaker::Builder<GradientSumT>::BuildLocalHistograms(
+    std::vector<int> *sync_nids,
     const GHistIndexMatrix &gmat,
     const GHistIndexBlockMatrix &gmatb,
     RegTree *p_tree,
     const std::vector<GradientPair> &gpair_h) {
   builder_monitor_.Start("BuildLocalHistograms");
+  // histograms of the whole level are built together once all rows are added
+  std::vector<int>& nids = *sync_nids;
+  nids.clear();
   for (auto const& entry : qexpand_depth_wise_) {
     int nid = entry.nid;
     RegTree::Node &node = (*p_tree)[nid];
     if (rabit::IsDistributed()) {
       if (node.IsRoot() || node.IsLeftChild()) {
-        hist_.AddHistRow(nid);
         // in distributed setting, we always calculate from left child or root node
-        BuildHist(gpair_h, row_set_collection_[nid], gmat, gmatb, hist_[nid], false);
+        nids.push_back(nid);
         if (!node.IsRoot()) {
           nodes_for_subtraction_trick_[(*p_tree)[node.Parent()].RightChild()] = nid;
         }
-        (*sync_count)++;
-        (*starting_index) = std::min((*starting_index), nid);
       }
     } else {
       if (!node.IsRoot() && node.IsLeftChild() &&
           (row_set_collection_[nid].Size() <
            row_set_collection_[(*p_tree)[node.Parent()].RightChild()].Size())) {
-        hist_.AddHistRow(nid);
-        BuildHist(gpair_h, row_set_collection_[nid], gmat, gmatb, hist_[nid], false);
+        nids.push_back(nid);
         nodes_for_subtraction_trick_[(*p_tree)[node.Parent()].RightChild()] = nid;
-        (*sync_count)++;
-        (*starting_index) = std::min((*starting_index), nid);
       } else if (!node.IsRoot() && !node.IsLeftChild() &&
                  (row_set_collection_[nid].Size() <=
                   row_set_collection_[(*p_tree)[node.Parent()].LeftChild()].Size())) {
-        hist_.AddHistRow(nid);
-        BuildHist(gpair_h, row_set_collection_[nid], gmat, gmatb, hist_[nid], false);
+        nids.push_back(nid);
         nodes_for_subtraction_trick_[(*p_tree)[node.Parent()].LeftChild()] = nid;
-        (*sync_count)++;
-        (*starting_index) = std::min((*starting_index), nid);
       } else if (node.IsRoot()) {
-        hist_.AddHistRow(nid);
-        BuildHist(gpair_h, row_set_collection_[nid], gmat, gmatb, hist_[nid], false);
-        (*sync_count)++;
-        (*starting_index) = std::min((*starting_index), nid);
+        nids.push_back(nid);
       }
     }
   }
+  for (int nid : nids) {
+    hist_.AddHistRow(nid);
+  }
+  BuildHists(gpair_h, nids, gmat, gmatb);
   builder_monitor_.Stop("BuildLocalHistograms");
 }
 
-void QuantileHistMaker::Builder::BuildNodeStats(
+template <typename GradientSumT>
+void QuantileHistMaker::Builder<GradientSumT>::ReleaseParentHistograms(const RegTree &tree) {
+  for (auto const& entry : qexpand_depth_wise_) {
+    const RegTree::Node &node = tree[entry.nid];
+    if (!node.IsRoot() && hist_.RowExists(node.Parent())) {
+      hist_.ReleaseHistRow(node.Parent());
+    }
+  }
+}
+
+template <typename GradientSumT>
+size_t QuantileHistMaker::Builder<GradientSumT>::MaxHistRows() const {
+  // a split needs the parent and both children
+  return std::max(static_cast<size_t>(param_.max_hist_memory_mb) * (1 << 20)
+                  / hist_.RowBytes(), static_cast<size_t>(3));
+}
+
+template <typename GradientSumT>
+void QuantileHistMaker::Builder<GradientSumT>::EvictHistRows(size_t n_new,
+                                                             int nid_in_use,
+                                                             const RegTree &tree) {
+  if (param_.max_hist_memory_mb == 0) {
+    return;
+  }
+  const size_t max_rows = this->MaxHistRows();
+  while (hist_.NumRows() + n_new > max_rows) {
+    // nodes are numbered in the order they are queued, among equal loss_chg
+    // LossGuide expands the later ones last
+    int victim = -1;
+    for (int nid = 0; nid < tree.param.num_nodes; ++nid) {
+      if (nid != nid_in_use && hist_.RowExists(nid) &&
+          (victim == -1 || snode_[nid].best.loss_chg <= snode_[victim].best.loss_chg)) {
+        victim = nid;
+      }
+    }
+    if (victim == -1) {
+      break;
+    }
+    hist_.ReleaseHistRow(victim);
+  }
+}
+
+template <typename GradientSumT>
+void QuantileHistMaker::Builder<GradientSumT>::BuildNodeStats(
     const GHistIndexMatrix &gmat,
     DMatrix *p_fmat,
     RegTree *p_tree,
@@ -175,7 +243,8 @@ void QuantileHistMaker::Builder::BuildNodeStats(
   builder_monitor_.Stop("BuildNodeStats");
 }
 
-void QuantileHistMaker::Builder::EvaluateSplits(
+template <typename GradientSumT>
+void QuantileHistMaker::Builder<GradientSumT>::EvaluateSplits(
     const GHistIndexMatrix &gmat,
     const ColumnMatrix &column_matrix,
     DMatrix *p_fmat,
@@ -205,7 +274,8 @@ void QuantileHistMaker::Builder::EvaluateSplits(
   }
 }
 
-void QuantileHistMaker::Builder::ExpandWithDepthWidth(
+template <typename GradientSumT>
+void QuantileHistMaker::Builder<GradientSumT>::ExpandWithDepthWidth(
   const GHistIndexMatrix &gmat,
   const GHistIndexBlockMatrix &gmatb,
   const ColumnMatrix &column_matrix,
@@ -219,11 +289,12 @@ void QuantileHistMaker::Builder::ExpandWithDepthWidth(
   qexpand_depth_wise_.emplace_back(ExpandEntry(0, p_tree->GetDepth(0), 0.0, timestamp++));
   ++num_leaves;
   for (int depth = 0; depth < param_.max_depth + 1; depth++) {
-    int starting_index = std::numeric_limits<int>::max();
-    int sync_count = 0;
+    std::vector<int> sync_nids;
     std::vector<ExpandEntry> temp_qexpand_depth;
-    BuildLocalHistograms(&starting_index, &sync_count, gmat, gmatb, p_tree, gpair_h);
-    SyncHistograms(starting_index, sync_count, p_tree);
+    BuildLocalHistograms(&sync_nids, gmat, gmatb, p_tree, gpair_h);
+    SyncHistograms(sync_nids, p_tree);
+    // parents are no longer needed for the subtraction trick
+    ReleaseParentHistograms(*p_tree);
     BuildNodeStats(gmat, p_fmat, p_tree, gpair_h);
     EvaluateSplits(gmat, column_matrix, p_fmat, p_tree, &num_leaves, depth, &timestamp,
                    &temp_qexpand_depth);
@@ -239,7 +310,8 @@ void QuantileHistMaker::Builder::ExpandWithDepthWidth(
   }
 }
 
-void QuantileHistMaker::Builder::ExpandWithLossGuide(
+template <typename GradientSumT>
+void QuantileHistMaker::Builder<GradientSumT>::ExpandWithLossGuide(
     const GHistIndexMatrix& gmat,
     const GHistIndexBlockMatrix& gmatb,
     const ColumnMatrix& column_matrix,
@@ -251,6 +323,7 @@ void QuantileHistMaker::Builder::ExpandWithLossGuide(
   int num_leaves = 0;
 
   for (int nid = 0; nid < p_tree->param.num_roots; ++nid) {
+    this->EvictHistRows(1, -1, *p_tree);
     hist_.AddHistRow(nid);
     BuildHist(gpair_h, row_set_collection_[nid], gmat, gmatb, hist_[nid], true);
 
@@ -271,15 +344,24 @@ void QuantileHistMaker::Builder::ExpandWithLossGuide(
         || (param_.max_depth > 0 && candidate.depth == param_.max_depth)
         || (param_.max_leaves > 0 && num_leaves == param_.max_leaves) ) {
       (*p_tree)[nid].SetLeaf(snode_[nid].weight * param_.learning_rate);
+      if (hist_.RowExists(nid)) {
+        hist_.ReleaseHistRow(nid);
+      }
     } else {
       this->ApplySplit(nid, gmat, column_matrix, hist_, *p_fmat, p_tree);
 
       const int cleft = (*p_tree)[nid].LeftChild();
       const int cright = (*p_tree)[nid].RightChild();
+      this->EvictHistRows(2, nid, *p_tree);
       hist_.AddHistRow(cleft);
       hist_.AddHistRow(cright);
 
-      if (rabit::IsDistributed()) {
+      if (!hist_.RowExists(nid)) {
+        // the parent was evicted, building both children costs as much as
+        // rebuilding it
+        BuildHist(gpair_h, row_set_collection_[cleft], gmat, gmatb, hist_[cleft], true);
+        BuildHist(gpair_h, row_set_collection_[cright], gmat, gmatb, hist_[cright], true);
+      } else if (rabit::IsDistributed()) {
         // in distributed mode, we need to keep consistent across workers
         BuildHist(gpair_h, row_set_collection_[cleft], gmat, gmatb, hist_[cleft], true);
         SubtractionTrick(hist_[cright], hist_[cleft], hist_[nid]);
@@ -292,6 +374,10 @@ void QuantileHistMaker::Builder::ExpandWithLossGuide(
           SubtractionTrick(hist_[cleft], hist_[cright], hist_[nid]);
         }
       }
+      // the parent histogram is dead once both children are built
+      if (hist_.RowExists(nid)) {
+        hist_.ReleaseHistRow(nid);
+      }
 
       this->InitNewNode(cleft, gmat, gpair_h, *p_fmat, *p_tree);
       this->InitNewNode(cright, gmat, gpair_h, *p_fmat, *p_tree);
@@ -314,12 +400,13 @@ void QuantileHistMaker::Builder::ExpandWithLossGuide(
   }
 }
 
-void QuantileHistMaker::Builder::Update(const GHistIndexMatrix& gmat,
-                                        const GHistIndexBlockMatrix& gmatb,
-                                        const ColumnMatrix& column_matrix,
-                                        HostDeviceVector<GradientPair>* gpair,
-                                        DMatrix* p_fmat,
-                                        RegTree* p_tree) {
+template <typename GradientSumT>
+void QuantileHistMaker::Builder<GradientSumT>::Update(const GHistIndexMatrix& gmat,
+                                                      const GHistIndexBlockMatrix& gmatb,
+                                                      const ColumnMatrix& column_matrix,
+                                                      HostDeviceVector<GradientPair>* gpair,
+                                                      DMatrix* p_fmat,
+                                                      RegTree* p_tree) {
   builder_monitor_.Start("Update");
 
   const std::vector<GradientPair>& gpair_h = gpair->ConstHostVector();
@@ -345,7 +432,8 @@ void QuantileHistMaker::Builder::Update(const GHistIndexMatrix& gmat,
   builder_monitor_.Stop("Update");
 }
 
-bool QuantileHistMaker::Builder::UpdatePredictionCache(
+template <typename GradientSumT>
+bool QuantileHistMaker::Builder<GradientSumT>::UpdatePredictionCache(
     const DMatrix* data,
     HostDeviceVector<bst_float>* p_out_preds) {
   std::vector<bst_float>& out_preds = p_out_preds->HostVector();
@@ -386,10 +474,11 @@ bool QuantileHistMaker::Builder::UpdatePredictionCache(
   return true;
 }
 
-void QuantileHistMaker::Builder::InitData(const GHistIndexMatrix& gmat,
-                                          const std::vector<GradientPair>& gpair,
-                                          const DMatrix& fmat,
-                                          const RegTree& tree) {
+template <typename GradientSumT>
+void QuantileHistMaker::Builder<GradientSumT>::InitData(const GHistIndexMatrix& gmat,
+                                                        const std::vector<GradientPair>& gpair,
+                                                        const DMatrix& fmat,
+                                                        const RegTree& tree) {
   CHECK_EQ(tree.param.num_nodes, tree.param.num_roots)
       << "ColMakerHist: can only grow new tree";
   CHECK((param_.max_depth > 0 || param_.max_leaves > 0))
@@ -552,11 +641,13 @@ void QuantileHistMaker::Builder::InitData(const GHistIndexMatrix& gmat,
   builder_monitor_.Stop("InitData");
 }
 
-void QuantileHistMaker::Builder::EvaluateSplit(const int nid,
-                                               const GHistIndexMatrix& gmat,
-                                               const HistCollection& hist,
-                                               const DMatrix& fmat,
-                                               const RegTree& tree) {
+template <typename GradientSumT>
+void QuantileHistMaker::Builder<GradientSumT>::EvaluateSplit(
+    const int nid,
+    const GHistIndexMatrix& gmat,
+    const HistCollection<GradientSumT>& hist,
+    const DMatrix& fmat,
+    const RegTree& tree) {
   builder_monitor_.Start("EvaluateSplit");
   // start enumeration
   const MetaInfo& info = fmat.Info();
@@ -569,7 +660,7 @@ void QuantileHistMaker::Builder::EvaluateSplit(const int nid,
   for (bst_omp_uint tid = 0; tid < nthread; ++tid) {
     best_split_tloc_[tid] = snode_[nid].best;
   }
-  GHistRow node_hist = hist[nid];
+  GHistRowT node_hist = hist[nid];
 
 #pragma omp parallel for schedule(dynamic) num_threads(nthread)
   for (bst_omp_uint i = 0; i < nfeature; ++i) {  // NOLINT(*)
@@ -591,12 +682,13 @@ void QuantileHistMaker::Builder::EvaluateSplit(const int nid,
   builder_monitor_.Stop("EvaluateSplit");
 }
 
-void QuantileHistMaker::Builder::ApplySplit(int nid,
-                                            const GHistIndexMatrix& gmat,
-                                            const ColumnMatrix& column_matrix,
-                                            const HistCollection& hist,
-                                            const DMatrix& fmat,
-                                            RegTree* p_tree) {
+template <typename GradientSumT>
+void QuantileHistMaker::Builder<GradientSumT>::ApplySplit(int nid,
+                                                          const GHistIndexMatrix& gmat,
+                                                          const ColumnMatrix& column_matrix,
+                                                          const HistCollection<GradientSumT>& hist,
+                                                          const DMatrix& fmat,
+                                                          RegTree* p_tree) {
   builder_monitor_.Start("ApplySplit");
   // TODO(hcho3): support feature sampling by levels
 
@@ -635,13 +727,15 @@ void QuantileHistMaker::Builder::ApplySplit(int nid,
 
   const auto& rowset = row_set_collection_[nid];
 
-  Column column = column_matrix.GetColumn(fid);
-  if (column.GetType() == xgboost::common::kDenseColumn) {
-    ApplySplitDenseData(rowset, gmat, &row_split_tloc_, column, split_cond,
-                        default_left);
-  } else {
-    ApplySplitSparseData(rowset, gmat, &row_split_tloc_, column, lower_bound,
-                         upper_bound, split_cond, default_left);
+  switch (column_matrix.GetBinTypeSize()) {
+    case common::kUint8BinsTypeSize:
+      ApplySplitColumn<uint8_t>(rowset, gmat, column_matrix, fid, split_cond, default_left);
+      break;
+    case common::kUint16BinsTypeSize:
+      ApplySplitColumn<uint16_t>(rowset, gmat, column_matrix, fid, split_cond, default_left);
+      break;
+    default:
+      ApplySplitColumn<uint32_t>(rowset, gmat, column_matrix, fid, split_cond, default_left);
   }
 
   row_set_collection_.AddSplit(
@@ -649,11 +743,32 @@ void QuantileHistMaker::Builder::ApplySplit(int nid,
   builder_monitor_.Stop("ApplySplit");
 }
 
-void QuantileHistMaker::Builder::ApplySplitDenseData(
+template <typename GradientSumT>
+template <typename BinIdxType>
+void QuantileHistMaker::Builder<GradientSumT>::ApplySplitColumn(
+    const RowSetCollection::Elem rowset,
+    const GHistIndexMatrix& gmat,
+    const ColumnMatrix& column_matrix,
+    bst_uint fid,
+    bst_int split_cond,
+    bool default_left) {
+  const Column<BinIdxType> column = column_matrix.GetColumn<BinIdxType>(fid);
+  if (column.GetType() == xgboost::common::kDenseColumn) {
+    ApplySplitDenseData(rowset, gmat, &row_split_tloc_, column, split_cond,
+                        default_left);
+  } else {
+    ApplySplitSparseData(rowset, gmat, &row_split_tloc_, column, gmat.cut.row_ptr[fid],
+                         gmat.cut.row_ptr[fid + 1], split_cond, default_left);
+  }
+}
+
+template <typename GradientSumT>
+template <typename BinIdxType>
+void QuantileHistMaker::Builder<GradientSumT>::ApplySplitDenseData(
     const RowSetCollection::Elem rowset,
     const GHistIndexMatrix& gmat,
     std::vector<RowSetCollection::Split>* p_row_split_tloc,
-    const Column& column,
+    const Column<BinIdxType>& column,
     bst_int split_cond,
     bool default_left) {
   std::vector<RowSetCollection::Split>& row_split_tloc = *p_row_split_tloc;
@@ -667,7 +782,7 @@ void QuantileHistMaker::Builder::ApplySplitDenseData(
     auto& left = row_split_tloc[tid].left;
     auto& right = row_split_tloc[tid].right;
     size_t rid[kUnroll];
-    uint32_t rbin[kUnroll];
+    BinIdxType rbin[kUnroll];
     for (int k = 0; k < kUnroll; ++k) {
       rid[k] = rowset.begin[i + k];
     }
@@ -675,7 +790,7 @@ void QuantileHistMaker::Builder::ApplySplitDenseData(
       rbin[k] = column.GetFeatureBinIdx(rid[k]);
     }
     for (int k = 0; k < kUnroll; ++k) {                      // NOLINT
-      if (rbin[k] == std::numeric_limits<uint32_t>::max()) {  // missing value
+      if (rbin[k] == Column<BinIdxType>::kMissingBin) {  // missing value
         if (default_left) {
           left.push_back(rid[k]);
         } else {
@@ -694,8 +809,8 @@ void QuantileHistMaker::Builder::ApplySplitDenseData(
     auto& left = row_split_tloc[nthread_-1].left;
     auto& right = row_split_tloc[nthread_-1].right;
     const size_t rid = rowset.begin[i];
-    const uint32_t rbin = column.GetFeatureBinIdx(rid);
-    if (rbin == std::numeric_limits<uint32_t>::max()) {  // missing value
+    const BinIdxType rbin = column.GetFeatureBinIdx(rid);
+    if (rbin == Column<BinIdxType>::kMissingBin) {  // missing value
       if (default_left) {
         left.push_back(rid);
       } else {
@@ -711,11 +826,13 @@ void QuantileHistMaker::Builder::ApplySplitDenseData(
   }
 }
 
-void QuantileHistMaker::Builder::ApplySplitSparseData(
+template <typename GradientSumT>
+template <typename BinIdxType>
+void QuantileHistMaker::Builder<GradientSumT>::ApplySplitSparseData(
     const RowSetCollection::Elem rowset,
     const GHistIndexMatrix& gmat,
     std::vector<RowSetCollection::Split>* p_row_split_tloc,
-    const Column& column,
+    const Column<BinIdxType>& column,
     bst_uint lower_bound,
     bst_uint upper_bound,
     bst_int split_cond,
@@ -780,11 +897,12 @@ void QuantileHistMaker::Builder::ApplySplitSparseData(
   }
 }
 
-void QuantileHistMaker::Builder::InitNewNode(int nid,
-                                             const GHistIndexMatrix& gmat,
-                                             const std::vector<GradientPair>& gpair,
-                                             const DMatrix& fmat,
-                                             const RegTree& tree) {
+template <typename GradientSumT>
+void QuantileHistMaker::Builder<GradientSumT>::InitNewNode(int nid,
+                                                           const GHistIndexMatrix& gmat,
+                                                           const std::vector<GradientPair>& gpair,
+                                                           const DMatrix& fmat,
+                                                           const RegTree& tree) {
   builder_monitor_.Start("InitNewNode");
   {
     snode_.resize(tree.param.num_nodes, NodeEntry(param_));
@@ -792,7 +910,7 @@ void QuantileHistMaker::Builder::InitNewNode(int nid,
 
   {
     auto& stats = snode_[nid].stats;
-    GHistRow hist = hist_[nid];
+    GHistRowT hist = hist_[nid];
     if (tree[nid].IsRoot()) {
       if (data_layout_ == kDenseDataZeroBased || data_layout_ == kDenseDataOneBased) {
         const std::vector<uint32_t>& row_ptr = gmat.cut.row_ptr;
@@ -800,8 +918,7 @@ void QuantileHistMaker::Builder::InitNewNode(int nid,
         const uint32_t iend = row_ptr[fid_least_bins_ + 1];
         auto begin = hist.data();
         for (uint32_t i = ibegin; i < iend; ++i) {
-          const GradStats et = begin[i];
-          stats.Add(et.sum_grad, et.sum_hess);
+          stats.Add(begin[i].GetGrad(), begin[i].GetHess());
         }
       } else {
         const RowSetCollection::Elem e = row_set_collection_[nid];
@@ -809,7 +926,7 @@ void QuantileHistMaker::Builder::InitNewNode(int nid,
           stats.Add(gpair[*it]);
         }
       }
-      histred_.Allreduce(&snode_[nid].stats, 1);
+      stats_reducer_.Allreduce(&snode_[nid].stats, 1);
     } else {
       int parent_id = tree[nid].Parent();
       if (tree[nid].IsLeftChild()) {
@@ -832,14 +949,15 @@ void QuantileHistMaker::Builder::InitNewNode(int nid,
 }
 
 // enumerate the split values of specific feature
-void QuantileHistMaker::Builder::EnumerateSplit(int d_step,
-                                                const GHistIndexMatrix& gmat,
-                                                const GHistRow& hist,
-                                                const NodeEntry& snode,
-                                                const MetaInfo& info,
-                                                SplitEntry* p_best,
-                                                bst_uint fid,
-                                                bst_uint nodeID) {
+template <typename GradientSumT>
+void QuantileHistMaker::Builder<GradientSumT>::EnumerateSplit(int d_step,
+                                                              const GHistIndexMatrix& gmat,
+                                                              const GHistRowT& hist,
+                                                              const NodeEntry& snode,
+                                                              const MetaInfo& info,
+                                                              SplitEntry* p_best,
+                                                              bst_uint fid,
+                                                              bst_uint nodeID) {
   CHECK(d_step == +1 || d_step == -1);
 
   // aliases
@@ -906,6 +1024,9 @@ void QuantileHistMaker::Builder::EnumerateSplit(int d_step,
   p_best->Update(best);
 }
 
+template struct QuantileHistMaker::Builder<float>;
+template struct QuantileHistMaker::Builder<double>;
+
 XGBOOST_REGISTER_TREE_UPDATER(FastHistMaker, "grow_fast_histmaker")
 .describe("(Deprecated, use grow_quantile_histmaker instead.)"
           " Grow tree using quantized histogram.")
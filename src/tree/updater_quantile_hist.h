@@ -68,11 +68,11 @@ namespace tree {
 using xgboost::common::HistCutMatrix;
 using xgboost::common::GHistIndexMatrix;
 using xgboost::common::GHistIndexBlockMatrix;
-using xgboost::common::GHistIndexRow;
 using xgboost::common::HistCollection;
 using xgboost::common::RowSetCollection;
 using xgboost::common::GHistRow;
 using xgboost::common::GHistBuilder;
+using xgboost::common::GHistEntry;
 using xgboost::common::ColumnMatrix;
 using xgboost::common::Column;
 
@@ -113,10 +113,13 @@ class QuantileHistMaker: public TreeUpdater {
     explicit NodeEntry(const TrainParam& param)
         : root_gain(0.0f), weight(0.0f) {}
   };
-  // actual builder that runs the algorithm
-
+  // actual builder that runs the algorithm, summing histogram bins in GradientSumT
+  template <typename GradientSumT>
   struct Builder {
    public:
+    using GHistRowT = GHistRow<GradientSumT>;
+    using GHistEntryT = GHistEntry<GradientSumT>;
+
     // constructor
     explicit Builder(const TrainParam& param,
                      std::unique_ptr<TreeUpdater> pruner,
@@ -138,7 +141,7 @@ class QuantileHistMaker: public TreeUpdater {
                           const RowSetCollection::Elem row_indices,
                           const GHistIndexMatrix& gmat,
                           const GHistIndexBlockMatrix& gmatb,
-                          GHistRow hist,
+                          GHistRowT hist,
                           bool sync_hist) {
       builder_monitor_.Start("BuildHist");
       if (param_.enable_feature_grouping > 0) {
@@ -152,7 +155,29 @@ class QuantileHistMaker: public TreeUpdater {
       builder_monitor_.Stop("BuildHist");
     }
 
-    inline void SubtractionTrick(GHistRow self, GHistRow sibling, GHistRow parent) {
+    // build the histograms of several nodes, in one pass unless features are grouped
+    inline void BuildHists(const std::vector<GradientPair>& gpair,
+                           const std::vector<int>& nids,
+                           const GHistIndexMatrix& gmat,
+                           const GHistIndexBlockMatrix& gmatb) {
+      builder_monitor_.Start("BuildHist");
+      if (param_.enable_feature_grouping > 0) {
+        for (int nid : nids) {
+          hist_builder_.BuildBlockHist(gpair, row_set_collection_[nid], gmatb, hist_[nid]);
+        }
+      } else {
+        std::vector<RowSetCollection::Elem> row_indices;
+        std::vector<GHistRowT> hists;
+        for (int nid : nids) {
+          row_indices.push_back(row_set_collection_[nid]);
+          hists.push_back(hist_[nid]);
+        }
+        hist_builder_.BuildHists(gpair, row_indices, gmat, hists);
+      }
+      builder_monitor_.Stop("BuildHist");
+    }
+
+    inline void SubtractionTrick(GHistRowT self, GHistRowT sibling, GHistRowT parent) {
       builder_monitor_.Start("SubtractionTrick");
       hist_builder_.SubtractionTrick(self, sibling, parent);
       builder_monitor_.Stop("SubtractionTrick");
@@ -180,28 +205,38 @@ class QuantileHistMaker: public TreeUpdater {
 
     void EvaluateSplit(const int nid,
                        const GHistIndexMatrix& gmat,
-                       const HistCollection& hist,
+                       const HistCollection<GradientSumT>& hist,
                        const DMatrix& fmat,
                        const RegTree& tree);
 
     void ApplySplit(int nid,
                     const GHistIndexMatrix& gmat,
                     const ColumnMatrix& column_matrix,
-                    const HistCollection& hist,
+                    const HistCollection<GradientSumT>& hist,
                     const DMatrix& fmat,
                     RegTree* p_tree);
 
+    template <typename BinIdxType>
+    void ApplySplitColumn(const RowSetCollection::Elem rowset,
+                          const GHistIndexMatrix& gmat,
+                          const ColumnMatrix& column_matrix,
+                          bst_uint fid,
+                          bst_int split_cond,
+                          bool default_left);
+
+    template <typename BinIdxType>
     void ApplySplitDenseData(const RowSetCollection::Elem rowset,
                              const GHistIndexMatrix& gmat,
                              std::vector<RowSetCollection::Split>* p_row_split_tloc,
-                             const Column& column,
+                             const Column<BinIdxType>& column,
                              bst_int split_cond,
                              bool default_left);
 
+    template <typename BinIdxType>
     void ApplySplitSparseData(const RowSetCollection::Elem rowset,
                               const GHistIndexMatrix& gmat,
                               std::vector<RowSetCollection::Split>* p_row_split_tloc,
-                              const Column& column,
+                              const Column<BinIdxType>& column,
                               bst_uint lower_bound,
                               bst_uint upper_bound,
                               bst_int split_cond,
@@ -216,7 +251,7 @@ class QuantileHistMaker: public TreeUpdater {
     // enumerate the split values of specific feature
     void EnumerateSplit(int d_step,
                         const GHistIndexMatrix& gmat,
-                        const GHistRow& hist,
+                        const GHistRowT& hist,
                         const NodeEntry& snode,
                         const MetaInfo& info,
                         SplitEntry* p_best,
@@ -230,17 +265,25 @@ class QuantileHistMaker: public TreeUpdater {
                               RegTree *p_tree,
                               const std::vector<GradientPair> &gpair_h);
 
-    void BuildLocalHistograms(int *starting_index,
-                              int *sync_count,
+    void BuildLocalHistograms(std::vector<int> *sync_nids,
                               const GHistIndexMatrix &gmat,
                               const GHistIndexBlockMatrix &gmatb,
                               RegTree *p_tree,
                               const std::vector<GradientPair> &gpair_h);
 
-    void SyncHistograms(int starting_index,
-                        int sync_count,
+    void SyncHistograms(const std::vector<int> &sync_nids,
                         RegTree *p_tree);
 
+    // release the histograms of the parents of the nodes to expand
+    void ReleaseParentHistograms(const RegTree &tree);
+
+    // number of histograms fitting within max_hist_memory_mb
+    size_t MaxHistRows() const;
+
+    // evict cached histograms of queued nodes, the least promising first,
+    // until n_new more fit within max_hist_memory_mb
+    virtual void EvictHistRows(size_t n_new, int nid_in_use, const RegTree &tree);
+
     void BuildNodeStats(const GHistIndexMatrix &gmat,
                         DMatrix *p_fmat,
                         RegTree *p_tree,
@@ -283,14 +326,16 @@ class QuantileHistMaker: public TreeUpdater {
     /*! \brief TreeNode Data: statistics for each constructed node */
     std::vector<NodeEntry> snode_;
     /*! \brief culmulative histogram of gradients. */
-    HistCollection hist_;
+    HistCollection<GradientSumT> hist_;
+    /*! \brief contiguous copy of the histograms of a level for allreduce */
+    std::vector<GHistEntryT> hist_sync_buffer_;
     /*! \brief feature with least # of bins. to be used for dense specialization
                of InitNewNode() */
     uint32_t fid_least_bins_;
     /*! \brief local prediction cache; maps node id to leaf value */
     std::vector<float> leaf_value_cache_;
 
-    GHistBuilder hist_builder_;
+    GHistBuilder<GradientSumT> hist_builder_;
     std::unique_ptr<TreeUpdater> pruner_;
     std::unique_ptr<SplitEvaluator> spliteval_;
 
@@ -312,10 +357,18 @@ class QuantileHistMaker: public TreeUpdater {
     DataLayout data_layout_;
 
     common::Monitor builder_monitor_;
-    rabit::Reducer<GradStats, GradStats::Reduce> histred_;
+    rabit::Reducer<GHistEntryT, GHistEntryT::Reduce> histred_;
+    rabit::Reducer<GradStats, GradStats::Reduce> stats_reducer_;
   };
 
-  std::unique_ptr<Builder> builder_;
+  template <typename GradientSumT>
+  void CallBuilderUpdate(std::unique_ptr<Builder<GradientSumT>>* p_builder,
+                         HostDeviceVector<GradientPair>* gpair,
+                         DMatrix* dmat,
+                         const std::vector<RegTree*>& trees);
+
+  std::unique_ptr<Builder<float>> float_builder_;
+  std::unique_ptr<Builder<double>> double_builder_;
   std::unique_ptr<TreeUpdater> pruner_;
   std::unique_ptr<SplitEvaluator> spliteval_;
 };
@@ -1,8 +1,14 @@
 // Copyright by Contributors
+#include <dmlc/filesystem.h>
 #include <gtest/gtest.h>
 #include <xgboost/c_api.h>
 #include <xgboost/data.h>
 
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
 TEST(c_api, XGDMatrixCreateFromMatDT) {
   std::vector<int> col0 = {0, -1, 3};
   std::vector<float> col1 = {-4.0f, 2.0f, 0.0f};
@@ -63,3 +69,334 @@ TEST(c_api, XGDMatrixCreateFromMat_omp) {
     delete dmat;
   }
 }
+
+TEST(c_api, XGBoosterPredictRow) {
+  const int kRows = 64, kCols = 8;
+  const float kMissing = -1.0f;
+  std::vector<float> data(kRows * kCols);
+  std::vector<float> labels(kRows);
+  for (int i = 0; i < kRows; ++i) {
+    for (int j = 0; j < kCols; ++j) {
+      data[i * kCols + j] = (i * 7 + j * 3) % 5 == 0 ? kMissing
+                                                      : ((i * 13 + j * 5) % 17) / 17.0f;
+    }
+    labels[i] = static_cast<float>(i % 2);
+  }
+  DMatrixHandle dmat;
+  ASSERT_EQ(XGDMatrixCreateFromMat(data.data(), kRows, kCols, kMissing, &dmat), 0);
+  ASSERT_EQ(XGDMatrixSetFloatInfo(dmat, "label", labels.data(), kRows), 0);
+  BoosterHandle booster;
+  ASSERT_EQ(XGBoosterCreate(&dmat, 1, &booster), 0);
+  XGBoosterSetParam(booster, "objective", "binary:logistic");
+  XGBoosterSetParam(booster, "max_depth", "3");
+  XGBoosterSetParam(booster, "silent", "1");
+  for (int iter = 0; iter < 4; ++iter) {
+    ASSERT_EQ(XGBoosterUpdateOneIter(booster, iter, dmat), 0);
+  }
+
+  for (int option_mask : {0, 1}) {
+    bst_ulong len;
+    const float *batch_preds;
+    ASSERT_EQ(XGBoosterPredict(booster, dmat, option_mask, 0, &len, &batch_preds), 0);
+    std::vector<float> expected(batch_preds, batch_preds + len);
+    ASSERT_EQ(expected.size(), kRows);
+    for (int i = 0; i < kRows; ++i) {
+      const float *row = &data[i * kCols];
+      float out;
+      bst_ulong out_len;
+      // dense row
+      ASSERT_EQ(XGBoosterPredictRow(booster, row, nullptr, kCols, kMissing,
+                                    option_mask, 0, &out_len, &out), 0);
+      ASSERT_EQ(out_len, 1);
+      ASSERT_EQ(out, expected[i]);
+      // sparse row
+      std::vector<float> values;
+      std::vector<unsigned> indices;
+      for (int j = 0; j < kCols; ++j) {
+        if (row[j] != kMissing) {
+          values.push_back(row[j]);
+          indices.push_back(j);
+        }
+      }
+      ASSERT_EQ(XGBoosterPredictRow(booster, values.data(), indices.data(),
+                                    values.size(), kMissing, option_mask, 0,
+                                    &out_len, &out), 0);
+      ASSERT_EQ(out, expected[i]);
+    }
+  }
+  XGBoosterFree(booster);
+  XGDMatrixFree(dmat);
+}
+
+TEST(c_api, XGBoosterLoadModelMmap) {
+  const int kRows = 64, kCols = 8, kClasses = 3;
+  std::vector<float> data(kRows * kCols);
+  std::vector<float> labels(kRows);
+  for (int i = 0; i < kRows; ++i) {
+    for (int j = 0; j < kCols; ++j) {
+      data[i * kCols + j] = (i * 7 + j * 3) % 5 == 0 ? NAN
+                                                      : ((i * 13 + j * 5) % 17) / 17.0f;
+    }
+    labels[i] = static_cast<float>(i % kClasses);
+  }
+  DMatrixHandle dmat;
+  ASSERT_EQ(XGDMatrixCreateFromMat(data.data(), kRows, kCols, NAN, &dmat), 0);
+  ASSERT_EQ(XGDMatrixSetFloatInfo(dmat, "label", labels.data(), kRows), 0);
+  // not cached by the booster, so predictions of both traverse the trees
+  DMatrixHandle dtest;
+  ASSERT_EQ(XGDMatrixCreateFromMat(data.data(), kRows, kCols, NAN, &dtest), 0);
+  BoosterHandle booster;
+  ASSERT_EQ(XGBoosterCreate(&dmat, 1, &booster), 0);
+  XGBoosterSetParam(booster, "objective", "multi:softprob");
+  XGBoosterSetParam(booster, "num_class", "3");
+  XGBoosterSetParam(booster, "max_depth", "3");
+  XGBoosterSetParam(booster, "silent", "1");
+  for (int iter = 0; iter < 4; ++iter) {
+    ASSERT_EQ(XGBoosterUpdateOneIter(booster, iter, dmat), 0);
+  }
+
+  dmlc::TemporaryDirectory tempdir;
+  const std::string fname = tempdir.path + "/model.mmap";
+  ASSERT_EQ(XGBoosterSaveModelMmap(booster, fname.c_str()), 0);
+  BoosterHandle mapped;
+  ASSERT_EQ(XGBoosterCreate(nullptr, 0, &mapped), 0);
+  ASSERT_EQ(XGBoosterLoadModelMmap(mapped, fname.c_str()), 0);
+
+  // option 0: probabilities, 1: margin, 2: leaf index
+  for (int option_mask : {0, 1, 2}) {
+    bst_ulong len, mapped_len;
+    const float *preds, *mapped_preds;
+    ASSERT_EQ(XGBoosterPredict(booster, dtest, option_mask, 0, &len, &preds), 0);
+    std::vector<float> expected(preds, preds + len);
+    ASSERT_EQ(XGBoosterPredict(mapped, dtest, option_mask, 0,
+                               &mapped_len, &mapped_preds), 0);
+    ASSERT_EQ(mapped_len, len);
+    for (bst_ulong i = 0; i < len; ++i) {
+      ASSERT_EQ(mapped_preds[i], expected[i]);
+    }
+  }
+  // a mapped model holds no trees to train or dump
+  bst_ulong dump_len;
+  const char** dump;
+  ASSERT_NE(XGBoosterDumpModel(mapped, "", 0, &dump_len, &dump), 0);
+  ASSERT_NE(XGBoosterUpdateOneIter(mapped, 0, dmat), 0);
+  // the image of a mapped model can be written again
+  const std::string copy = tempdir.path + "/copy.mmap";
+  ASSERT_EQ(XGBoosterSaveModelMmap(mapped, copy.c_str()), 0);
+  BoosterHandle remapped;
+  ASSERT_EQ(XGBoosterCreate(nullptr, 0, &remapped), 0);
+  ASSERT_EQ(XGBoosterLoadModelMmap(remapped, copy.c_str()), 0);
+  {
+    bst_ulong len, remapped_len;
+    const float *preds, *remapped_preds;
+    ASSERT_EQ(XGBoosterPredict(booster, dtest, 1, 0, &len, &preds), 0);
+    std::vector<float> expected(preds, preds + len);
+    ASSERT_EQ(XGBoosterPredict(remapped, dtest, 1, 0, &remapped_len, &remapped_preds), 0);
+    ASSERT_EQ(remapped_len, len);
+    for (bst_ulong i = 0; i < len; ++i) {
+      ASSERT_EQ(remapped_preds[i], expected[i]);
+    }
+  }
+
+  XGBoosterFree(remapped);
+  XGBoosterFree(mapped);
+  XGBoosterFree(booster);
+  XGDMatrixFree(dtest);
+  XGDMatrixFree(dmat);
+}
+
+TEST(c_api, XGBinnedForest) {
+  const int kRows = 128, kCols = 6, kMaxBin = 16;
+  std::vector<float> data(kRows * kCols);
+  std::vector<float> labels(kRows);
+  for (int i = 0; i < kRows; ++i) {
+    for (int j = 0; j < kCols; ++j) {
+      data[i * kCols + j] = (i * 7 + j * 3) % 11 == 0 ? NAN
+                                                       : ((i * 13 + j * 5) % 37) / 37.0f;
+    }
+    labels[i] = data[i * kCols] > 0.5f ? 1.0f : 0.0f;
+  }
+  DMatrixHandle dmat;
+  ASSERT_EQ(XGDMatrixCreateFromMat(data.data(), kRows, kCols, NAN, &dmat), 0);
+  ASSERT_EQ(XGDMatrixSetFloatInfo(dmat, "label", labels.data(), kRows), 0);
+  DMatrixHandle dtest;
+  ASSERT_EQ(XGDMatrixCreateFromMat(data.data(), kRows, kCols, NAN, &dtest), 0);
+  BoosterHandle booster;
+  ASSERT_EQ(XGBoosterCreate(&dmat, 1, &booster), 0);
+  XGBoosterSetParam(booster, "objective", "binary:logistic");
+  XGBoosterSetParam(booster, "tree_method", "hist");
+  XGBoosterSetParam(booster, "max_bin", std::to_string(kMaxBin).c_str());
+  XGBoosterSetParam(booster, "max_depth", "4");
+  XGBoosterSetParam(booster, "silent", "1");
+  for (int iter = 0; iter < 4; ++iter) {
+    ASSERT_EQ(XGBoosterUpdateOneIter(booster, iter, dmat), 0);
+  }
+
+  dmlc::TemporaryDirectory tempdir;
+  const std::string fname = tempdir.path + "/model.binned";
+  ASSERT_EQ(XGBoosterSaveBinnedForest(booster, dmat, kMaxBin, fname.c_str()), 0);
+  BinnedForestHandle forest;
+  ASSERT_EQ(XGBinnedForestLoad(fname.c_str(), &forest), 0);
+  for (unsigned ntree_limit : {0U, 2U}) {
+    bst_ulong len, binned_len;
+    const float *preds, *binned_preds;
+    ASSERT_EQ(XGBoosterPredict(booster, dtest, 1, ntree_limit, &len, &preds), 0);
+    std::vector<float> expected(preds, preds + len);
+    ASSERT_EQ(XGBinnedForestPredict(forest, dtest, ntree_limit, &binned_len,
+                                    &binned_preds), 0);
+    ASSERT_EQ(binned_len, len);
+    for (bst_ulong i = 0; i < len; ++i) {
+      ASSERT_EQ(binned_preds[i], expected[i]);
+    }
+  }
+  // the splits of the model fall between the cuts of fewer bins
+  ASSERT_NE(XGBoosterSaveBinnedForest(booster, dmat, 4, fname.c_str()), 0);
+
+  XGBinnedForestFree(forest);
+  XGBoosterFree(booster);
+  XGDMatrixFree(dtest);
+  XGDMatrixFree(dmat);
+}
+
+TEST(c_api, XGCompressedForest) {
+  const int kRows = 96, kCols = 8, kIters = 6;
+  std::vector<float> data(kRows * kCols);
+  std::vector<float> labels(kRows);
+  for (int i = 0; i < kRows; ++i) {
+    for (int j = 0; j < kCols; ++j) {
+      data[i * kCols + j] = (i * 7 + j * 3) % 9 == 0 ? NAN
+                                                      : ((i * 13 + j * 5) % 23) / 23.0f;
+    }
+    labels[i] = data[i * kCols + 1] + data[i * kCols + 2];
+  }
+  DMatrixHandle dmat;
+  ASSERT_EQ(XGDMatrixCreateFromMat(data.data(), kRows, kCols, NAN, &dmat), 0);
+  ASSERT_EQ(XGDMatrixSetFloatInfo(dmat, "label", labels.data(), kRows), 0);
+  DMatrixHandle dtest;
+  ASSERT_EQ(XGDMatrixCreateFromMat(data.data(), kRows, kCols, NAN, &dtest), 0);
+  BoosterHandle booster;
+  ASSERT_EQ(XGBoosterCreate(&dmat, 1, &booster), 0);
+  XGBoosterSetParam(booster, "max_depth", "4");
+  XGBoosterSetParam(booster, "silent", "1");
+  for (int iter = 0; iter < kIters; ++iter) {
+    ASSERT_EQ(XGBoosterUpdateOneIter(booster, iter, dmat), 0);
+  }
+  bst_ulong len;
+  const float* preds;
+  ASSERT_EQ(XGBoosterPredict(booster, dtest, 1, 0, &len, &preds), 0);
+  const std::vector<float> expected(preds, preds + len);
+
+  dmlc::TemporaryDirectory tempdir;
+  const std::string fname = tempdir.path + "/model.compressed";
+  const float bound = 1e-3f;
+  // 0: 8 bit codes, 2: exact floats
+  for (int leaf_format : {0, 2}) {
+    bst_ulong bytes;
+    double max_error, mean_error;
+    ASSERT_EQ(XGBoosterSaveCompressedForest(booster, leaf_format, bound, dtest, fname.c_str(),
+                                            &bytes, &max_error, &mean_error), 0);
+    ASSERT_GT(bytes, 0U);
+    ASSERT_LE(max_error, kIters * bound + 1e-5);
+    ASSERT_LE(mean_error, max_error);
+    if (leaf_format == 2) {
+      ASSERT_EQ(max_error, 0.0);
+    }
+
+    CompressedForestHandle forest;
+    ASSERT_EQ(XGCompressedForestLoad(fname.c_str(), &forest), 0);
+    bst_ulong compressed_len;
+    const float* compressed_preds;
+    ASSERT_EQ(XGCompressedForestPredict(forest, dtest, 0, &compressed_len,
+                                        &compressed_preds), 0);
+    ASSERT_EQ(compressed_len, len);
+    for (bst_ulong i = 0; i < len; ++i) {
+      ASSERT_NEAR(compressed_preds[i], expected[i], max_error + 1e-6);
+    }
+    XGCompressedForestFree(forest);
+  }
+  // the error is reported on validation rows, which are required
+  bst_ulong bytes;
+  double max_error, mean_error;
+  ASSERT_NE(XGBoosterSaveCompressedForest(booster, 0, bound, nullptr, fname.c_str(),
+                                          &bytes, &max_error, &mean_error), 0);
+  ASSERT_NE(XGBoosterSaveCompressedForest(booster, 3, bound, dtest, fname.c_str(),
+                                          &bytes, &max_error, &mean_error), 0);
+
+  XGBoosterFree(booster);
+  XGDMatrixFree(dtest);
+  XGDMatrixFree(dmat);
+}
+
+namespace {
+int CollectDump(void* handle, bst_ulong index, const char* dump, bst_ulong len) {
+  auto* out = static_cast<std::vector<std::string>*>(handle);
+  EXPECT_EQ(index, out->size());
+  out->emplace_back(dump, len);
+  return 0;
+}
+int FailDump(void*, bst_ulong index, const char*, bst_ulong) {
+  return index == 2 ? -1 : 0;
+}
+}  // anonymous namespace
+
+TEST(c_api, XGBoosterDumpModelCallback) {
+  const int kRows = 64, kCols = 8;
+  std::vector<float> data(kRows * kCols);
+  std::vector<float> labels(kRows);
+  for (int i = 0; i < kRows; ++i) {
+    for (int j = 0; j < kCols; ++j) {
+      data[i * kCols + j] = ((i * 13 + j * 5) % 17) / 17.0f;
+    }
+    labels[i] = data[i * kCols] + data[i * kCols + 1];
+  }
+  DMatrixHandle dmat;
+  ASSERT_EQ(XGDMatrixCreateFromMat(data.data(), kRows, kCols, NAN, &dmat), 0);
+  ASSERT_EQ(XGDMatrixSetFloatInfo(dmat, "label", labels.data(), kRows), 0);
+  BoosterHandle booster;
+  ASSERT_EQ(XGBoosterCreate(&dmat, 1, &booster), 0);
+  XGBoosterSetParam(booster, "max_depth", "3");
+  XGBoosterSetParam(booster, "silent", "1");
+  const int kTrees = 40;
+  for (int iter = 0; iter < kTrees; ++iter) {
+    ASSERT_EQ(XGBoosterUpdateOneIter(booster, iter, dmat), 0);
+  }
+
+  dmlc::TemporaryDirectory tempdir;
+  for (const char* format : {"text", "json"}) {
+    bst_ulong len;
+    const char** dump;
+    ASSERT_EQ(XGBoosterDumpModelEx(booster, "", 1, format, &len, &dump), 0);
+    std::vector<std::string> expected(dump, dump + len);
+    ASSERT_EQ(expected.size(), kTrees);
+
+    // the callback sees every tree in order
+    std::vector<std::string> collected;
+    ASSERT_EQ(XGBoosterDumpModelCallback(booster, "", 1, format,
+                                         CollectDump, &collected), 0);
+    ASSERT_EQ(collected, expected);
+
+    // the file has the layout of the command line dump
+    std::string joined;
+    for (size_t i = 0; i < expected.size(); ++i) {
+      if (std::string(format) == "json") {
+        joined += (i == 0 ? "[\n" : ",\n") + expected[i];
+      } else {
+        joined += "booster[" + std::to_string(i) + "]:\n" + expected[i];
+      }
+    }
+    if (std::string(format) == "json") {
+      joined += "\n]\n";
+    }
+    const std::string fname = tempdir.path + "/dump." + format;
+    ASSERT_EQ(XGBoosterDumpModelToFile(booster, "", 1, format, fname.c_str()), 0);
+    std::ifstream fin(fname, std::ios::binary);
+    std::string written((std::istreambuf_iterator<char>(fin)),
+                        std::istreambuf_iterator<char>());
+    ASSERT_EQ(written, joined);
+  }
+  // a failing callback stops the dump
+  ASSERT_NE(XGBoosterDumpModelCallback(booster, "", 0, "text", FailDump, nullptr), 0);
+
+  XGBoosterFree(booster);
+  XGDMatrixFree(dmat);
+}
@@ -1,3 +1,4 @@
+#include <xgboost/c_api.h>
 #include "../../../src/common/column_matrix.h"
 #include "../helpers.h"
 #include "gtest/gtest.h"
@@ -10,10 +11,11 @@ TEST(DenseColumn, Test) {
   gmat.Init((*dmat).get(), 256);
   ColumnMatrix column_matrix;
   column_matrix.Init(gmat, 0.2);
+  ASSERT_EQ(column_matrix.GetBinTypeSize(), kUint8BinsTypeSize);
 
   for (auto i = 0ull; i < (*dmat)->Info().num_row_; i++) {
     for (auto j = 0ull; j < (*dmat)->Info().num_col_; j++) {
-        auto col = column_matrix.GetColumn(j);
+        auto col = column_matrix.GetColumn<uint8_t>(j);
         EXPECT_EQ(gmat.index[i * (*dmat)->Info().num_col_ + j],
                   col.GetGlobalBinIdx(i));
     }
@@ -27,8 +29,8 @@ TEST(SparseColumn, Test) {
   gmat.Init((*dmat).get(), 256);
   ColumnMatrix column_matrix;
   column_matrix.Init(gmat, 0.5);
-  auto col = column_matrix.GetColumn(0);
-  ASSERT_EQ(col.Size(), gmat.index.size());
+  auto col = column_matrix.GetColumn<uint8_t>(0);
+  ASSERT_EQ(col.Size(), gmat.index.Size());
   for (auto i = 0ull; i < col.Size(); i++) {
     EXPECT_EQ(gmat.index[gmat.row_ptr[col.GetRowIdx(i)]],
               col.GetGlobalBinIdx(i));
@@ -42,7 +44,7 @@ TEST(DenseColumnWithMissing, Test) {
   gmat.Init((*dmat).get(), 256);
   ColumnMatrix column_matrix;
   column_matrix.Init(gmat, 0.2);
-  auto col = column_matrix.GetColumn(0);
+  auto col = column_matrix.GetColumn<uint8_t>(0);
   for (auto i = 0ull; i < col.Size(); i++) {
     if (col.IsMissing(i)) continue;
     EXPECT_EQ(gmat.index[gmat.row_ptr[col.GetRowIdx(i)]],
@@ -51,6 +53,101 @@ TEST(DenseColumnWithMissing, Test) {
   delete dmat;
 }
 
+TEST(GHistIndexMatrix, BinTypeSize) {
+  const size_t kRows = 1000, kCols = 3;
+  const uint32_t kMultipliers[kCols] = {7, 11, 13};
+  std::vector<float> data(kRows * kCols);
+  for (size_t i = 0; i < kRows; ++i) {
+    for (size_t j = 0; j < kCols; ++j) {
+      data[i * kCols + j] = static_cast<float>(i * kMultipliers[j] % kRows);
+    }
+  }
+  DMatrixHandle handle;
+  ASSERT_EQ(XGDMatrixCreateFromMat(data.data(), kRows, kCols, NAN, &handle), 0);
+  auto dense = static_cast<std::shared_ptr<DMatrix>*>(handle);
+  GHistIndexMatrix gmat;
+  gmat.Init((*dense).get(), 200);
+  // more than 255 bins in total, less than 255 per feature
+  ASSERT_GT(gmat.cut.row_ptr.back(), 255);
+  for (size_t j = 0; j < kCols; ++j) {
+    ASSERT_LT(gmat.cut.row_ptr[j + 1] - gmat.cut.row_ptr[j], 255);
+  }
+
+  // dense rows store bins local to the feature in a byte
+  ASSERT_TRUE(gmat.index.IsDense());
+  ASSERT_EQ(gmat.index.GetBinTypeSize(), kUint8BinsTypeSize);
+  ASSERT_EQ(gmat.index.MemCostBytes(), kRows * kCols);
+  for (size_t i = 0; i < kRows * kCols; ++i) {
+    ASSERT_GE(gmat.index[i], gmat.cut.row_ptr[i % kCols]);
+    ASSERT_LT(gmat.index[i], gmat.cut.row_ptr[i % kCols + 1]);
+  }
+  ColumnMatrix column_matrix;
+  column_matrix.Init(gmat, 0.2);
+  ASSERT_EQ(column_matrix.GetBinTypeSize(), kUint8BinsTypeSize);
+  ASSERT_EQ(column_matrix.IndexBytes(), kRows * kCols);
+  for (size_t j = 0; j < kCols; ++j) {
+    auto col = column_matrix.GetColumn<uint8_t>(j);
+    for (size_t i = 0; i < kRows; ++i) {
+      ASSERT_EQ(col.GetGlobalBinIdx(i), gmat.index[i * kCols + j]);
+    }
+  }
+
+  // sparse rows store global bins, which need two bytes here
+  data[0] = NAN;
+  ASSERT_EQ(XGDMatrixCreateFromMat(data.data(), kRows, kCols, NAN, &handle), 0);
+  auto sparse = static_cast<std::shared_ptr<DMatrix>*>(handle);
+  GHistIndexMatrix sparse_gmat;
+  sparse_gmat.Init((*sparse).get(), 200);
+  ASSERT_FALSE(sparse_gmat.index.IsDense());
+  ASSERT_EQ(sparse_gmat.index.GetBinTypeSize(), kUint16BinsTypeSize);
+  ASSERT_EQ(sparse_gmat.index.Size(), kRows * kCols - 1);
+  ASSERT_EQ(sparse_gmat.index.MemCostBytes(), (kRows * kCols - 1) * sizeof(uint16_t));
+  for (size_t i = kCols - 1; i < sparse_gmat.index.Size(); ++i) {
+    const uint32_t fid = (i + 1) % kCols;
+    ASSERT_GE(sparse_gmat.index[i], sparse_gmat.cut.row_ptr[fid]);
+    ASSERT_LT(sparse_gmat.index[i], sparse_gmat.cut.row_ptr[fid + 1]);
+  }
+
+  delete dense;
+  delete sparse;
+}
+
+TEST(GHistIndexMatrix, RepeatedFeature) {
+  const size_t kRows = 1000, kCols = 3;
+  const uint32_t kMultipliers[kCols] = {7, 11, 13};
+  // as many entries as a dense matrix, but the first row holds feature 0
+  // twice and misses feature 1
+  std::vector<size_t> indptr(kRows + 1);
+  std::vector<unsigned> indices(kRows * kCols);
+  std::vector<float> data(kRows * kCols);
+  for (size_t i = 0; i < kRows; ++i) {
+    indptr[i + 1] = (i + 1) * kCols;
+    for (size_t j = 0; j < kCols; ++j) {
+      indices[i * kCols + j] = j;
+      data[i * kCols + j] = static_cast<float>(i * kMultipliers[j] % kRows);
+    }
+  }
+  indices[1] = 0;
+  DMatrixHandle handle;
+  ASSERT_EQ(XGDMatrixCreateFromCSREx(indptr.data(), indices.data(), data.data(),
+                                     indptr.size(), data.size(), kCols, &handle), 0);
+  auto dmat = static_cast<std::shared_ptr<DMatrix>*>(handle);
+  GHistIndexMatrix gmat;
+  gmat.Init((*dmat).get(), 200);
+
+  ASSERT_GT(gmat.cut.row_ptr.back(), 255);
+  ASSERT_FALSE(gmat.index.IsDense());
+  ASSERT_EQ(gmat.index.GetBinTypeSize(), kUint16BinsTypeSize);
+  ASSERT_EQ(gmat.index.Size(), kRows * kCols);
+  const uint32_t kFirstRow[kCols] = {0, 0, 2};
+  for (size_t i = 0; i < kRows * kCols; ++i) {
+    const uint32_t fid = i < kCols ? kFirstRow[i] : i % kCols;
+    ASSERT_GE(gmat.index[i], gmat.cut.row_ptr[fid]);
+    ASSERT_LT(gmat.index[i], gmat.cut.row_ptr[fid + 1]);
+  }
+  delete dmat;
+}
+
 void
 TestGHistIndexMatrixCreation(size_t nthreads) {
   /* This should create multiple sparse pages */
@@ -1,4 +1,6 @@
 #include <gtest/gtest.h>
+#include <cmath>
+#include <numeric>
 #include <vector>
 #include <string>
 #include <utility>
@@ -47,5 +49,133 @@ TEST(HistCutMatrix, SearchGroupInd) {
   delete pp_mat;
 }
 
+TEST(HistCollection, ReleaseHistRow) {
+  uint32_t constexpr kBins = 16;
+  HistCollection<double> hist;
+  hist.Init(kBins);
+  for (bst_uint nid = 0; nid < 3; ++nid) {
+    hist.AddHistRow(nid);
+    hist[nid][0].sum_grad = nid + 1;
+  }
+  GHistEntry<double>* second = hist[1].data();
+  ASSERT_EQ(hist.NumRows(), 3);
+  ASSERT_EQ(hist.RowBytes(), kBins * sizeof(GHistEntry<double>));
+
+  // the slot of a released histogram is reused and cleared
+  hist.ReleaseHistRow(0);
+  ASSERT_FALSE(hist.RowExists(0));
+  ASSERT_EQ(hist.NumRows(), 2);
+  hist.AddHistRow(7);
+  ASSERT_EQ(hist.NumRows(), 3);
+  ASSERT_EQ(hist[7][0].sum_grad, 0.0);
+
+  // adding histograms doesn't move the others
+  for (bst_uint nid = 8; nid < 64; ++nid) {
+    hist.AddHistRow(nid);
+  }
+  ASSERT_EQ(hist[1].data(), second);
+  ASSERT_EQ(hist[1][0].sum_grad, 2.0);
+  ASSERT_EQ(hist[2][0].sum_grad, 3.0);
+
+  // a new tree reuses all slots
+  hist.Init(kBins);
+  ASSERT_EQ(hist.NumRows(), 0);
+  ASSERT_FALSE(hist.RowExists(1));
+}
+
+template <typename GradientSumT>
+std::vector<GHistEntry<GradientSumT>> BuildHistOf(const GHistIndexMatrix& gmat,
+                                                  const std::vector<GradientPair>& gpair,
+                                                  const std::vector<size_t>& rows) {
+  const uint32_t nbins = gmat.cut.row_ptr.back();
+  GHistBuilder<GradientSumT> builder;
+  builder.Init(4, nbins);
+  HistCollection<GradientSumT> hist;
+  hist.Init(nbins);
+  hist.AddHistRow(0);
+  GHistRow<GradientSumT> row = hist[0];
+  builder.BuildHist(gpair, RowSetCollection::Elem(rows.data(), rows.data() + rows.size(), 0),
+                    gmat, row);
+  return std::vector<GHistEntry<GradientSumT>>(row.begin(), row.end());
+}
+
+TEST(GHistBuilder, SinglePrecision) {
+  size_t constexpr kRows = 2048, kCols = 8;
+  std::vector<GradientPair> gpair(kRows);
+  for (size_t i = 0; i < kRows; ++i) {
+    gpair[i] = GradientPair(std::sin(static_cast<float>(i)), 0.5f + (i % 13) / 13.0f);
+  }
+  std::vector<size_t> rows(kRows);
+  std::iota(rows.begin(), rows.end(), 0);
+
+  for (float sparsity : {0.0f, 0.3f}) {
+    auto pp_mat = CreateDMatrix(kRows, kCols, sparsity);
+    GHistIndexMatrix gmat;
+    gmat.Init((*pp_mat).get(), 64);
+    ASSERT_EQ(gmat.index.IsDense(), sparsity == 0.0f);
+
+    auto single = BuildHistOf<float>(gmat, gpair, rows);
+    auto precise = BuildHistOf<double>(gmat, gpair, rows);
+    ASSERT_EQ(single.size(), precise.size());
+    static_assert(sizeof(GHistEntry<float>) * 2 == sizeof(GHistEntry<double>),
+                  "float bins take half the memory");
+    for (size_t i = 0; i < precise.size(); ++i) {
+      // each bin sums at most kRows values of magnitude <= 1.5
+      ASSERT_NEAR(single[i].GetGrad(), precise[i].GetGrad(), 1e-6 * kRows);
+      ASSERT_NEAR(single[i].GetHess(), precise[i].GetHess(), 1e-6 * kRows);
+    }
+    delete pp_mat;
+  }
+}
+
+TEST(GHistBuilder, BuildHists) {
+  size_t constexpr kRows = 2048, kCols = 8;
+  std::vector<GradientPair> gpair(kRows);
+  for (size_t i = 0; i < kRows; ++i) {
+    gpair[i] = GradientPair(std::sin(static_cast<float>(i)), 0.5f + (i % 13) / 13.0f);
+  }
+  // rows of the nodes, including an empty one and nodes spanning several blocks
+  std::vector<size_t> rows(kRows);
+  std::iota(rows.begin(), rows.end(), 0);
+  std::vector<size_t> node_ptr {0, 0, 1, 700, 800, kRows};
+  const size_t n_nodes = node_ptr.size() - 1;
+
+  for (float sparsity : {0.0f, 0.3f}) {
+    auto pp_mat = CreateDMatrix(kRows, kCols, sparsity);
+    GHistIndexMatrix gmat;
+    gmat.Init((*pp_mat).get(), 64);
+    const uint32_t nbins = gmat.cut.row_ptr.back();
+
+    for (size_t nthread : {1, 3, 8}) {
+      GHistBuilder<double> builder;
+      builder.Init(nthread, nbins);
+      HistCollection<double> hist;
+      hist.Init(nbins);
+      for (size_t k = 0; k < 2 * n_nodes; ++k) {
+        hist.AddHistRow(k);
+      }
+      std::vector<RowSetCollection::Elem> row_indices;
+      std::vector<GHistRow<double>> hists;
+      for (size_t k = 0; k < n_nodes; ++k) {
+        row_indices.emplace_back(rows.data() + node_ptr[k], rows.data() + node_ptr[k + 1], k);
+        hists.push_back(hist[k]);
+        // leftovers must be overwritten
+        hist[k][0].sum_grad = 1.0;
+      }
+      builder.BuildHists(gpair, row_indices, gmat, hists);
+
+      for (size_t k = 0; k < n_nodes; ++k) {
+        GHistRow<double> expected = hist[n_nodes + k];
+        builder.BuildHist(gpair, row_indices[k], gmat, expected);
+        for (size_t i = 0; i < nbins; ++i) {
+          ASSERT_NEAR(hists[k][i].GetGrad(), expected[i].GetGrad(), 1e-9);
+          ASSERT_NEAR(hists[k][i].GetHess(), expected[i].GetHess(), 1e-9);
+        }
+      }
+    }
+    delete pp_mat;
+  }
+}
+
 }  // namespace common
 }  // namespace xgboost
@@ -1,6 +1,19 @@
+#include <dmlc/filesystem.h>
 #include <gtest/gtest.h>
 #include <xgboost/generic_parameters.h>
+#include <xgboost/predictor.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <dlfcn.h>
+#endif  // defined(__unix__) || defined(__APPLE__)
+
 #include "../helpers.h"
+#include "../../../src/common/random.h"
 #include "../../../src/gbm/gbtree.h"
 
 namespace xgboost {
@@ -46,4 +59,99 @@ TEST(GBTree, SelectTreeMethod) {
 
   delete mat_ptr;
 }
+
+TEST(Dart, PredictionCache) {
+  using Arg = std::pair<std::string, std::string>;
+  size_t constexpr kRows = 64;
+  size_t constexpr kCols = 8;
+  auto cached = CreateDMatrix(kRows, kCols, 0.2, 3);
+  auto uncached = CreateDMatrix(kRows, kCols, 0.2, 3);
+
+  LearnerTrainParam learner_param;
+  learner_param.InitAllowUnknown(std::vector<Arg>{Arg("n_gpus", "0")});
+  std::unique_ptr<GradientBooster> p_gbm{
+    GradientBooster::Create("dart", &learner_param, {*cached}, 0.5)};
+  p_gbm->Configure({Arg("rate_drop", "0.5"), Arg("max_depth", "3"),
+                    Arg("num_feature", std::to_string(kCols))});
+
+  HostDeviceVector<GradientPair> gpair(kRows);
+  HostDeviceVector<bst_float> expected, predt;
+  for (int iter = 0; iter < 8; ++iter) {
+    // both predictions drop the same trees
+    common::GlobalRandom().seed(iter);
+    p_gbm->PredictBatch((*cached).get(), &predt, 0);
+    common::GlobalRandom().seed(iter);
+    p_gbm->PredictBatch((*uncached).get(), &expected, 0);
+    ASSERT_EQ(predt.Size(), expected.Size());
+    for (size_t i = 0; i < expected.Size(); ++i) {
+      ASSERT_NEAR(predt.HostVector()[i], expected.HostVector()[i], 1e-5);
+    }
+    auto& h_gpair = gpair.HostVector();
+    for (size_t i = 0; i < kRows; ++i) {
+      h_gpair[i] = GradientPair(predt.HostVector()[i] - (i % 2), 1.0f);
+    }
+    p_gbm->DoBoost((*cached).get(), &gpair);
+  }
+
+  delete cached;
+  delete uncached;
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+TEST(GBTree, GenerateSource) {
+  if (std::system("cc --version > /dev/null 2>&1") != 0) {
+    LOG(WARNING) << "No C compiler found, skipping compiled model test.";
+    return;
+  }
+  int n_row = 57;
+  int n_col = 9;
+  int n_group = 2;
+  gbm::GBTreeModel model = CreateRandomTestModel(n_col, 16, 6, n_group);
+  model.base_margin = 0.3f;
+
+  dmlc::TemporaryDirectory tempdir;
+  const std::string source_path = tempdir.path + "/model.c";
+  const std::string lib_path = tempdir.path + "/model.so";
+  {
+    std::ofstream fo(source_path);
+    fo << model.GenerateSource(0);
+  }
+  const std::string cmd =
+      "cc -O2 -fPIC -shared -o " + lib_path + " " + source_path;
+  ASSERT_EQ(std::system(cmd.c_str()), 0);
+  void* lib = dlopen(lib_path.c_str(), RTLD_NOW | RTLD_LOCAL);
+  ASSERT_NE(lib, nullptr) << dlerror();
+  using PredictFn = void (*)(const float*, float*);
+  using CountFn = int (*)();
+  auto predict = reinterpret_cast<PredictFn>(dlsym(lib, "predict"));
+  auto num_feature = reinterpret_cast<CountFn>(dlsym(lib, "get_num_feature"));
+  auto num_group = reinterpret_cast<CountFn>(dlsym(lib, "get_num_output_group"));
+  ASSERT_NE(predict, nullptr);
+  ASSERT_EQ(num_feature(), n_col);
+  ASSERT_EQ(num_group(), n_group);
+
+  auto dmat = CreateDMatrix(n_row, n_col, 0.3);
+  auto lparam = CreateEmptyGenericParam(0, 0);
+  std::unique_ptr<Predictor> cpu_predictor =
+      std::unique_ptr<Predictor>(Predictor::Create("cpu_predictor", &lparam));
+  HostDeviceVector<float> expected;
+  cpu_predictor->PredictBatch((*dmat).get(), &expected, model, 0);
+
+  std::vector<float> row(n_col);
+  std::vector<float> out(n_group);
+  auto &batch = *(*dmat)->GetRowBatches().begin();
+  for (size_t i = 0; i < batch.Size(); ++i) {
+    std::fill(row.begin(), row.end(), std::numeric_limits<float>::quiet_NaN());
+    for (const auto& e : batch[i]) {
+      row[e.index] = e.fvalue;
+    }
+    predict(row.data(), out.data());
+    for (int gid = 0; gid < n_group; ++gid) {
+      ASSERT_EQ(out[gid], expected.HostVector()[i * n_group + gid]);
+    }
+  }
+  dlclose(lib);
+  delete dmat;
+}
+#endif  // defined(__unix__) || defined(__APPLE__)
 }  // namespace xgboost
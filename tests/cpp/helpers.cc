@@ -5,6 +5,7 @@
 #include "xgboost/c_api.h"
 #include <random>
 #include <cinttypes>
+#include <tuple>
 #include <dmlc/filesystem.h>
 #include "../../src/data/simple_csr_source.h"
 
@@ -243,4 +244,40 @@ gbm::GBTreeModel CreateTestModel() {
   return model;
 }
 
+gbm::GBTreeModel CreateRandomTestModel(int n_features, int n_trees, int max_depth,
+                                       int n_groups, int seed) {
+  SimpleLCG gen(seed);
+  SimpleRealUniformDistribution<float> dis(0.0f, 1.0f);
+  gbm::GBTreeModel model(0.5);
+  model.param.num_feature = n_features;
+  model.param.num_output_group = n_groups;
+  for (int i = 0; i < n_trees; ++i) {
+    std::unique_ptr<RegTree> tree(new RegTree);
+    tree->param.num_feature = n_features;
+    // (node id, depth, cover)
+    std::vector<std::tuple<int, int, float>> stack{std::make_tuple(0, 0, 100.0f)};
+    while (!stack.empty()) {
+      int nid, depth;
+      float cover;
+      std::tie(nid, depth, cover) = stack.back();
+      stack.pop_back();
+      tree->Stat(nid).sum_hess = cover;
+      if (depth >= max_depth || (depth > 0 && dis(&gen) < 0.2f)) {
+        continue;
+      }
+      auto fidx = static_cast<unsigned>(dis(&gen) * n_features) % n_features;
+      float left_ratio = 0.1f + 0.8f * dis(&gen);
+      tree->ExpandNode(nid, fidx, dis(&gen), dis(&gen) < 0.5f, 0.0f,
+                       dis(&gen) - 0.5f, dis(&gen) - 0.5f, 1.0f, cover);
+      stack.emplace_back((*tree)[nid].LeftChild(), depth + 1, cover * left_ratio);
+      stack.emplace_back((*tree)[nid].RightChild(), depth + 1,
+                         cover * (1.0f - left_ratio));
+    }
+    std::vector<std::unique_ptr<RegTree>> trees;
+    trees.push_back(std::move(tree));
+    model.CommitModel(std::move(trees), i % n_groups);
+  }
+  return model;
+}
+
 }  // namespace xgboost
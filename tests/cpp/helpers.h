@@ -188,6 +188,20 @@ std::unique_ptr<DMatrix> CreateSparsePageDMatrixWithRC(size_t n_rows, size_t n_c
 
 gbm::GBTreeModel CreateTestModel();
 
+/**
+ * \brief Creates a model of random trees, splitting on values in [0, 1).
+ *
+ * \param n_features  Number of features the trees split on.
+ * \param n_trees     Number of trees, assigned to output groups round robin.
+ * \param max_depth   Maximum depth of each tree.
+ * \param n_groups    Number of output groups.
+ * \param seed        The seed.
+ *
+ * \return The new model.
+ */
+gbm::GBTreeModel CreateRandomTestModel(int n_features, int n_trees, int max_depth,
+                                       int n_groups, int seed = 0);
+
 inline LearnerTrainParam CreateEmptyGenericParam(int gpu_id, int n_gpus) {
   xgboost::LearnerTrainParam tparam;
   std::vector<std::pair<std::string, std::string>> args {
@@ -0,0 +1,97 @@
+// Copyright by Contributors
+#include <gtest/gtest.h>
+#include <xgboost/predictor.h>
+#include "../helpers.h"
+#include "../../../src/common/io.h"
+#include "../../../src/predictor/binned_forest.h"
+
+namespace xgboost {
+namespace predictor {
+
+namespace {
+// move every split threshold of the model onto a cut point or min_val
+void SnapToCuts(const common::HistCutMatrix& cut, gbm::GBTreeModel* model) {
+  for (size_t t = 0; t < model->trees.size(); ++t) {
+    RegTree& tree = *model->trees[t];
+    for (int nid = 0; nid < tree.param.num_nodes; ++nid) {
+      RegTree::Node& node = tree[nid];
+      if (node.IsLeaf()) continue;
+      const unsigned fid = node.SplitIndex();
+      const uint32_t nbin = cut.row_ptr[fid + 1] - cut.row_ptr[fid];
+      const uint32_t j = (nid * 7 + t) % (nbin + 1);
+      const bst_float cond =
+          j == nbin ? cut.min_val[fid] : cut.cut[cut.row_ptr[fid] + j];
+      node.SetSplit(fid, cond, node.DefaultLeft());
+    }
+  }
+}
+}  // anonymous namespace
+
+TEST(BinnedForest, Predict) {
+  int n_row = 113;
+  int n_col = 10;
+  int n_group = 2;
+  auto dmat = CreateDMatrix(n_row, n_col, 0.2);
+  common::GHistIndexMatrix gmat;
+  gmat.Init((*dmat).get(), 16);
+  gbm::GBTreeModel model = CreateRandomTestModel(n_col, 20, 5, n_group);
+  SnapToCuts(gmat.cut, &model);
+
+  BinnedForest forest;
+  forest.Init(model, gmat.cut);
+
+  auto lparam = CreateEmptyGenericParam(0, 0);
+  std::unique_ptr<Predictor> cpu_predictor =
+      std::unique_ptr<Predictor>(Predictor::Create("cpu_predictor", &lparam));
+  // unseen rows may fall outside of the cut range
+  auto test_dmat = CreateDMatrix(n_row, n_col, 0.2, 5);
+  for (unsigned ntree_limit : {0U, 4U}) {
+    HostDeviceVector<float> expected;
+    cpu_predictor->PredictBatch((*dmat).get(), &expected, model, 0, ntree_limit);
+    std::vector<float> out_preds;
+    forest.PredictBatch(gmat, &out_preds, ntree_limit);
+    ASSERT_EQ(out_preds.size(), expected.Size());
+    for (size_t i = 0; i < out_preds.size(); ++i) {
+      ASSERT_EQ(out_preds[i], expected.HostVector()[i]);
+    }
+
+    cpu_predictor->PredictBatch((*test_dmat).get(), &expected, model, 0,
+                                ntree_limit);
+    forest.PredictBatch((*test_dmat).get(), &out_preds, ntree_limit);
+    ASSERT_EQ(out_preds.size(), expected.Size());
+    for (size_t i = 0; i < out_preds.size(); ++i) {
+      ASSERT_EQ(out_preds[i], expected.HostVector()[i]);
+    }
+  }
+
+  // a loaded forest predicts the same without the model
+  std::string buffer;
+  common::MemoryBufferStream fo(&buffer);
+  forest.Save(&fo);
+  BinnedForest loaded;
+  common::MemoryBufferStream fi(&buffer);
+  loaded.Load(&fi);
+  for (unsigned ntree_limit : {0U, 4U}) {
+    std::vector<float> expected, out_preds;
+    forest.PredictBatch(gmat, &expected, ntree_limit);
+    loaded.PredictBatch(gmat, &out_preds, ntree_limit);
+    ASSERT_EQ(out_preds, expected);
+    forest.PredictBatch((*test_dmat).get(), &expected, ntree_limit);
+    loaded.PredictBatch((*test_dmat).get(), &out_preds, ntree_limit);
+    ASSERT_EQ(out_preds, expected);
+  }
+  buffer.resize(buffer.size() / 2);
+  common::MemoryBufferStream truncated(&buffer);
+  EXPECT_ANY_THROW(loaded.Load(&truncated));
+
+  // a threshold between cut points can't be remapped
+  RegTree& tree = *model.trees[0];
+  tree[0].SetSplit(tree[0].SplitIndex(), 0.123456f, tree[0].DefaultLeft());
+  EXPECT_ANY_THROW(forest.Init(model, gmat.cut));
+
+  delete dmat;
+  delete test_dmat;
+}
+
+}  // namespace predictor
+}  // namespace xgboost
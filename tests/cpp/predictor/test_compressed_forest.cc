@@ -0,0 +1,114 @@
+// Copyright by Contributors
+#include <gtest/gtest.h>
+#include <xgboost/predictor.h>
+#include <cstring>
+#include "../helpers.h"
+#include "../../../src/common/io.h"
+#include "../../../src/predictor/compressed_forest.h"
+
+namespace xgboost {
+namespace predictor {
+
+TEST(CompressedForest, Predict) {
+  int n_row = 97;
+  int n_col = 10;
+  int n_group = 2;
+  int n_tree = 20;
+  auto dmat = CreateDMatrix(n_row, n_col, 0.2);
+  gbm::GBTreeModel model = CreateRandomTestModel(n_col, n_tree, 5, n_group);
+
+  auto lparam = CreateEmptyGenericParam(0, 0);
+  std::unique_ptr<Predictor> cpu_predictor =
+      std::unique_ptr<Predictor>(Predictor::Create("cpu_predictor", &lparam));
+
+  // without error only exactly representable leaves are compressed and
+  // predictions are identical
+  CompressedForest forest;
+  forest.Init(model, LeafFormat::kUInt8, 0.0f);
+  for (unsigned ntree_limit : {0U, 4U}) {
+    HostDeviceVector<float> expected;
+    cpu_predictor->PredictBatch((*dmat).get(), &expected, model, 0, ntree_limit);
+    std::vector<float> out_preds;
+    forest.PredictBatch((*dmat).get(), &out_preds, ntree_limit);
+    ASSERT_EQ(out_preds.size(), expected.Size());
+    for (size_t i = 0; i < out_preds.size(); ++i) {
+      ASSERT_EQ(out_preds[i], expected.HostVector()[i]);
+    }
+  }
+  CompressionReport report = forest.Report(model, (*dmat).get());
+  ASSERT_EQ(report.num_trees[0] + report.num_trees[1] + report.num_trees[2], n_tree);
+  ASSERT_EQ(report.max_leaf_error, 0.0);
+  ASSERT_EQ(report.max_error, 0.0);
+  ASSERT_LT(report.bytes, report.original_bytes);
+
+  const bst_float bound = 1e-2f;
+  for (LeafFormat format : {LeafFormat::kUInt8, LeafFormat::kFloat16}) {
+    forest.Init(model, format, bound);
+    report = forest.Report(model, (*dmat).get());
+    // leaves of the test model lie in [-0.5, 0.5], both grids are fine enough
+    ASSERT_EQ(report.num_trees[static_cast<int>(format)], n_tree);
+    ASSERT_LE(report.max_leaf_error, bound);
+    ASSERT_GT(report.max_error, 0.0);
+    ASSERT_LE(report.max_error, (n_tree / n_group) * bound + 1e-5);
+    ASSERT_LE(report.mean_error, report.max_error);
+  }
+
+  // a tighter bound than the 8 bit grid moves the trees to wider formats
+  forest.Init(model, LeafFormat::kUInt8, 1e-4f);
+  report = forest.Report(model, (*dmat).get());
+  ASSERT_LT(report.num_trees[static_cast<int>(LeafFormat::kUInt8)], n_tree / 2);
+  ASSERT_LE(report.max_leaf_error, 1e-4);
+
+  // a loaded forest predicts the same without the model
+  std::string buffer;
+  common::MemoryBufferStream fo(&buffer);
+  forest.Save(&fo);
+  CompressedForest loaded;
+  common::MemoryBufferStream fi(&buffer);
+  loaded.Load(&fi);
+  ASSERT_EQ(loaded.Bytes(), forest.Bytes());
+  for (unsigned ntree_limit : {0U, 4U}) {
+    std::vector<float> expected, out_preds;
+    forest.PredictBatch((*dmat).get(), &expected, ntree_limit);
+    loaded.PredictBatch((*dmat).get(), &out_preds, ntree_limit);
+    ASSERT_EQ(out_preds, expected);
+  }
+
+  // corrupted fields are rejected, the trees are saved last, one fixed width
+  // column after the other, each behind its 8 byte length
+  auto expect_invalid = [&](size_t offset, uint64_t value, size_t size) {
+    std::string corrupted = buffer;
+    std::memcpy(&corrupted[offset], &value, size);
+    common::MemoryBufferStream stream(&corrupted);
+    CompressedForest invalid;
+    EXPECT_ANY_THROW(invalid.Load(&stream));
+  };
+  const size_t format_column = 8 + n_tree;
+  const size_t float_column = 8 + 4 * n_tree;
+  const size_t size_column = 8 + 8 * n_tree;
+  const size_t last_group = buffer.size() - format_column - 4;
+  const size_t last_leaf_begin = buffer.size() - format_column - 3 * float_column - 8;
+  const size_t last_node_begin = last_leaf_begin - size_column;
+  // the last node is a leaf of the last tree: sindex, cleft, index
+  const size_t last_node = buffer.size() - format_column - 3 * float_column -
+                           2 * size_column - 8;
+  expect_invalid(4, 2, 4);                            // format version
+  expect_invalid(buffer.size() - 1, 3, 1);            // leaf format
+  expect_invalid(last_group, n_group, 4);             // output group
+  expect_invalid(last_leaf_begin, ~0ULL, 8);          // first leaf value
+  expect_invalid(last_node_begin, ~0ULL, 8);          // first node
+  expect_invalid(last_node + 4, 0xffff, 2);           // child beyond the tree
+  expect_invalid(last_node + 6, 0xffff, 2);           // leaf beyond the values
+  std::string intact = buffer;
+  common::MemoryBufferStream intact_stream(&intact);
+  loaded.Load(&intact_stream);
+
+  buffer.resize(buffer.size() / 2);
+  common::MemoryBufferStream truncated(&buffer);
+  EXPECT_ANY_THROW(loaded.Load(&truncated));
+
+  delete dmat;
+}
+
+}  // namespace predictor
+}  // namespace xgboost
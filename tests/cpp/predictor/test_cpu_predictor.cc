@@ -2,7 +2,15 @@
 #include <dmlc/filesystem.h>
 #include <gtest/gtest.h>
 #include <xgboost/predictor.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>
+
 #include "../helpers.h"
+#include "../../../src/predictor/compiled_forest.h"
+#include "../../../src/predictor/traversal_kernel.h"
 
 namespace xgboost {
 TEST(cpu_predictor, Test) {
@@ -55,6 +63,690 @@ TEST(cpu_predictor, Test) {
   delete dmat;
 }
 
+TEST(cpu_predictor, CompiledForest) {
+  auto lparam = CreateEmptyGenericParam(0, 0);
+  std::unique_ptr<Predictor> cpu_predictor =
+      std::unique_ptr<Predictor>(Predictor::Create("cpu_predictor", &lparam));
+
+  int n_row = 67;
+  int n_col = 16;
+  int n_group = 3;
+  gbm::GBTreeModel model = CreateRandomTestModel(n_col, 30, 6, n_group);
+  // leave deleted nodes behind in one of the trees
+  model.trees[4]->CollapseToLeaf((*model.trees[4])[0].LeftChild(), 0.25f);
+  ASSERT_GT(model.trees[4]->param.num_deleted, 0);
+
+  auto dmat = CreateDMatrix(n_row, n_col, 0.2);
+  auto check = [&]() {
+    const size_t n_trees = model.trees.size();
+    HostDeviceVector<float> out_predictions;
+    cpu_predictor->PredictBatch((*dmat).get(), &out_predictions, model, 0);
+    std::vector<float> leaf_out_predictions;
+    cpu_predictor->PredictLeaf((*dmat).get(), &leaf_out_predictions, model);
+    ASSERT_EQ(out_predictions.Size(), n_row * n_group);
+    ASSERT_EQ(leaf_out_predictions.size(), n_row * n_trees);
+
+    RegTree::FVec feats;
+    feats.Init(n_col);
+    auto &batch = *(*dmat)->GetRowBatches().begin();
+    for (size_t i = 0; i < batch.Size(); ++i) {
+      std::vector<float> psum(n_group, 0.0f);
+      feats.Fill(batch[i]);
+      for (size_t j = 0; j < n_trees; ++j) {
+        int nid = model.trees[j]->GetLeafIndex(feats);
+        ASSERT_EQ(leaf_out_predictions[i * n_trees + j], nid);
+        psum[model.tree_info[j]] += (*model.trees[j])[nid].LeafValue();
+      }
+      feats.Drop(batch[i]);
+      std::vector<float> instance_out_predictions;
+      cpu_predictor->PredictInstance(batch[i], &instance_out_predictions, model);
+      for (int gid = 0; gid < n_group; ++gid) {
+        ASSERT_FLOAT_EQ(out_predictions.HostVector()[i * n_group + gid],
+                        psum[gid] + model.base_margin);
+        ASSERT_FLOAT_EQ(instance_out_predictions[gid],
+                        psum[gid] + model.base_margin);
+      }
+    }
+  };
+  check();
+  // the compiled layout must follow newly committed trees
+  std::vector<std::unique_ptr<RegTree>> trees;
+  trees.push_back(std::move(CreateRandomTestModel(n_col, 1, 4, 1, 3).trees[0]));
+  model.CommitModel(std::move(trees), 1);
+  check();
+  // reordering nodes keeps predictions and leaf indices
+  cpu_predictor->Init({{"predictor_node_layout", "hot_path"}}, {});
+  check();
+
+  delete dmat;
+}
+
+TEST(cpu_predictor, HotPathLayout) {
+  gbm::GBTreeModel model = CreateRandomTestModel(8, 10, 8, 1);
+  predictor::CompiledForest forest;
+  forest.Init(model, predictor::NodeLayout::kHotPath);
+  ASSERT_FALSE(forest.IsStale(model, predictor::NodeLayout::kHotPath));
+  ASSERT_TRUE(forest.IsStale(model, predictor::NodeLayout::kBreadthFirst));
+  for (size_t k = 0; k < forest.NumTrees(); ++k) {
+    const RegTree& tree = *model.trees[forest.TreeId(k)];
+    const auto* nodes = forest.Tree(k);
+    const size_t nnode = forest.TreeBytes(k) / sizeof(predictor::CompiledForest::Node);
+    ASSERT_EQ(nnode, tree.GetNodes().size() - tree.param.num_deleted);
+    for (size_t i = 0; i < nnode; ++i) {
+      const auto& node = nodes[i];
+      if (node.IsLeaf()) continue;
+      const int nid = node.NodeId();
+      const int left = node.LeftChild();
+      const int right = node.RightChild();
+      ASSERT_EQ(nodes[left].NodeId(), tree[nid].LeftChild());
+      ASSERT_EQ(nodes[right].NodeId(), tree[nid].RightChild());
+      // the children of the hot child follow the pair of the parent's children
+      const int hot = tree.Stat(tree[nid].RightChild()).sum_hess >
+                      tree.Stat(tree[nid].LeftChild()).sum_hess ? right : left;
+      if (!nodes[hot].IsLeaf()) {
+        ASSERT_EQ(nodes[hot].LeftChild(), left + 2);
+      }
+    }
+  }
+}
+
+TEST(cpu_predictor, TiledPrediction) {
+  auto lparam = CreateEmptyGenericParam(0, 0);
+  std::unique_ptr<Predictor> cpu_predictor =
+      std::unique_ptr<Predictor>(Predictor::Create("cpu_predictor", &lparam));
+  cpu_predictor->Init({}, {});
+  // a tiny cache forces the forest to be split into many tree blocks
+  std::unique_ptr<Predictor> tiled_predictor =
+      std::unique_ptr<Predictor>(Predictor::Create("cpu_predictor", &lparam));
+  tiled_predictor->Init({{"predictor_cache_size", "2048"}}, {});
+
+  int n_row = 203;
+  int n_col = 16;
+  int n_group = 2;
+  gbm::GBTreeModel model = CreateRandomTestModel(n_col, 40, 5, n_group);
+  auto dmat = CreateDMatrix(n_row, n_col, 0.3);
+
+  for (unsigned ntree_limit : {0U, 7U}) {
+    HostDeviceVector<float> expected;
+    cpu_predictor->PredictBatch((*dmat).get(), &expected, model, 0, ntree_limit);
+    HostDeviceVector<float> tiled;
+    tiled_predictor->PredictBatch((*dmat).get(), &tiled, model, 0, ntree_limit);
+    ASSERT_EQ(tiled.Size(), n_row * n_group);
+    for (size_t i = 0; i < tiled.Size(); ++i) {
+      ASSERT_EQ(tiled.HostVector()[i], expected.HostVector()[i]);
+    }
+  }
+
+  delete dmat;
+}
+
+TEST(cpu_predictor, TraversalKernels) {
+  auto lparam = CreateEmptyGenericParam(0, 0);
+  std::unique_ptr<Predictor> scalar_predictor =
+      std::unique_ptr<Predictor>(Predictor::Create("cpu_predictor", &lparam));
+  scalar_predictor->Init({{"predictor_kernel", "scalar"}}, {});
+
+  int n_row = 141;
+  int n_col = 24;
+  int n_group = 3;
+  gbm::GBTreeModel model = CreateRandomTestModel(n_col, 30, 7, n_group, 1);
+  auto dmat = CreateDMatrix(n_row, n_col, 0.4);
+  HostDeviceVector<float> expected;
+  scalar_predictor->PredictBatch((*dmat).get(), &expected, model, 0);
+
+  for (std::string kernel : {"auto", "avx2", "avx512"}) {
+    if ((kernel == "avx2" &&
+         !predictor::TraversalKernelSupported(predictor::kAVX2Kernel)) ||
+        (kernel == "avx512" &&
+         !predictor::TraversalKernelSupported(predictor::kAVX512Kernel))) {
+      continue;
+    }
+    std::unique_ptr<Predictor> cpu_predictor =
+        std::unique_ptr<Predictor>(Predictor::Create("cpu_predictor", &lparam));
+    cpu_predictor->Init({{"predictor_kernel", kernel}}, {});
+    HostDeviceVector<float> out_predictions;
+    cpu_predictor->PredictBatch((*dmat).get(), &out_predictions, model, 0);
+    ASSERT_EQ(out_predictions.Size(), expected.Size());
+    for (size_t i = 0; i < expected.Size(); ++i) {
+      ASSERT_EQ(out_predictions.HostVector()[i], expected.HostVector()[i])
+          << "kernel: " << kernel;
+    }
+  }
+
+  delete dmat;
+}
+
+TEST(cpu_predictor, TreeParallelPrediction) {
+  auto lparam = CreateEmptyGenericParam(0, 0);
+  std::unique_ptr<Predictor> row_predictor =
+      std::unique_ptr<Predictor>(Predictor::Create("cpu_predictor", &lparam));
+  row_predictor->Init({{"predictor_tree_parallel_rows", "0"}}, {});
+
+  int n_col = 10;
+  int n_group = 3;
+  gbm::GBTreeModel model = CreateRandomTestModel(n_col, 45, 6, n_group, 2);
+  for (int n_row : {1, 5, 37}) {
+    auto dmat = CreateDMatrix(n_row, n_col, 0.2);
+    for (std::string kernel : {"scalar", "auto"}) {
+      std::unique_ptr<Predictor> tree_predictor =
+          std::unique_ptr<Predictor>(Predictor::Create("cpu_predictor", &lparam));
+      // every batch below 64 rows is split over trees
+      tree_predictor->Init({{"predictor_tree_parallel_rows", "64"},
+                            {"predictor_kernel", kernel}}, {});
+      for (unsigned ntree_limit : {0U, 4U}) {
+        HostDeviceVector<float> expected;
+        row_predictor->PredictBatch((*dmat).get(), &expected, model, 0,
+                                    ntree_limit);
+        HostDeviceVector<float> out_predictions;
+        tree_predictor->PredictBatch((*dmat).get(), &out_predictions, model, 0,
+                                     ntree_limit);
+        ASSERT_EQ(out_predictions.Size(), n_row * n_group);
+        for (size_t i = 0; i < expected.Size(); ++i) {
+          ASSERT_EQ(out_predictions.HostVector()[i], expected.HostVector()[i]);
+        }
+      }
+    }
+    delete dmat;
+  }
+}
+
+TEST(cpu_predictor, TreeParallelPredictionRange) {
+  auto lparam = CreateEmptyGenericParam(0, 0);
+  std::unique_ptr<Predictor> row_predictor =
+      std::unique_ptr<Predictor>(Predictor::Create("cpu_predictor", &lparam));
+  row_predictor->Init({{"predictor_tree_parallel_rows", "0"}}, {});
+  std::unique_ptr<Predictor> tree_predictor =
+      std::unique_ptr<Predictor>(Predictor::Create("cpu_predictor", &lparam));
+  tree_predictor->Init({{"predictor_tree_parallel_rows", "64"}}, {});
+
+  int n_row = 7;
+  int n_col = 10;
+  int n_group = 3;
+  gbm::GBTreeModel model = CreateRandomTestModel(n_col, 45, 6, n_group, 4);
+  auto dmat = CreateDMatrix(n_row, n_col, 0.2);
+  // only the trees in [tree_begin, ntree_limit * n_group) are traversed
+  std::vector<std::pair<int, unsigned>> limits{{0, 1}, {0, 4}, {3, 4}, {9, 0}};
+  for (const auto& limit : limits) {
+    HostDeviceVector<float> expected;
+    row_predictor->PredictBatch((*dmat).get(), &expected, model, limit.first,
+                                limit.second);
+    HostDeviceVector<float> out_predictions;
+    tree_predictor->PredictBatch((*dmat).get(), &out_predictions, model,
+                                 limit.first, limit.second);
+    ASSERT_EQ(out_predictions.Size(), expected.Size());
+    for (size_t i = 0; i < expected.Size(); ++i) {
+      ASSERT_EQ(out_predictions.HostVector()[i], expected.HostVector()[i])
+          << "tree_begin: " << limit.first << ", ntree_limit: " << limit.second;
+    }
+  }
+  delete dmat;
+}
+
+TEST(cpu_predictor, CascadePrediction) {
+  auto lparam = CreateEmptyGenericParam(0, 0);
+  std::unique_ptr<Predictor> cpu_predictor =
+      std::unique_ptr<Predictor>(Predictor::Create("cpu_predictor", &lparam));
+  cpu_predictor->Init({}, {});
+
+  int n_row = 150;
+  int n_col = 10;
+  unsigned n_tree = 100;
+  gbm::GBTreeModel model = CreateRandomTestModel(n_col, n_tree, 5, 1, 4);
+  auto dmat = CreateDMatrix(n_row, n_col, 0.2);
+  HostDeviceVector<float> expected;
+  cpu_predictor->PredictBatch((*dmat).get(), &expected, model, 0);
+
+  for (float threshold : {0.5f, 6.0f, -4.0f}) {
+    HostDeviceVector<float> out_predictions;
+    std::vector<unsigned> ntrees;
+    cpu_predictor->PredictCascade((*dmat).get(), threshold, &out_predictions,
+                                  &ntrees, model);
+    ASSERT_EQ(out_predictions.Size(), n_row);
+    ASSERT_EQ(ntrees.size(), n_row);
+    size_t total = 0;
+    for (int i = 0; i < n_row; ++i) {
+      float margin = out_predictions.HostVector()[i];
+      float exact = expected.HostVector()[i];
+      ASSERT_LE(ntrees[i], n_tree);
+      if (ntrees[i] == n_tree) {
+        ASSERT_EQ(margin, exact);
+      } else {
+        ASSERT_EQ(margin > threshold, exact > threshold);
+      }
+      total += ntrees[i];
+    }
+    if (threshold != 0.5f) {
+      // far from the base margin most rows are decided early
+      ASSERT_LT(total, n_row * n_tree);
+    }
+  }
+  // a limit on the number of trees stops at the limit
+  HostDeviceVector<float> out_predictions;
+  std::vector<unsigned> ntrees;
+  cpu_predictor->PredictCascade((*dmat).get(), 0.5f, &out_predictions, &ntrees,
+                                model, 10);
+  for (auto n : ntrees) {
+    ASSERT_LE(n, 10);
+  }
+
+  delete dmat;
+}
+
+TEST(cpu_predictor, PrefixCache) {
+  auto lparam = CreateEmptyGenericParam(0, 0);
+  int n_row = 83;
+  int n_col = 9;
+  int n_group = 2;
+  gbm::GBTreeModel model = CreateRandomTestModel(n_col, 30, 5, n_group, 5);
+  auto dmat = CreateDMatrix(n_row, n_col, 0.3);
+  std::unique_ptr<Predictor> uncached =
+      std::unique_ptr<Predictor>(Predictor::Create("cpu_predictor", &lparam));
+  uncached->Init({}, {});
+  std::unique_ptr<Predictor> cached =
+      std::unique_ptr<Predictor>(Predictor::Create("cpu_predictor", &lparam));
+  cached->Init({{"predictor_prefix_cache", "2"}}, {*dmat});
+
+  auto check = [&](unsigned ntree_limit) {
+    HostDeviceVector<float> expected;
+    uncached->PredictBatch((*dmat).get(), &expected, model, 0, ntree_limit);
+    HostDeviceVector<float> out_predictions;
+    cached->PredictBatch((*dmat).get(), &out_predictions, model, 0, ntree_limit);
+    ASSERT_EQ(out_predictions.Size(), expected.Size());
+    for (size_t i = 0; i < expected.Size(); ++i) {
+      ASSERT_EQ(out_predictions.HostVector()[i], expected.HostVector()[i])
+          << "ntree_limit: " << ntree_limit;
+    }
+  };
+  for (unsigned ntree_limit : {3U, 7U, 5U, 12U, 1U, 12U, 14U}) {
+    check(ntree_limit);
+  }
+  // prefixes stay valid when trees are appended
+  std::vector<std::unique_ptr<RegTree>> trees;
+  trees.push_back(std::move(CreateRandomTestModel(n_col, 1, 4, 1, 6).trees[0]));
+  model.CommitModel(std::move(trees), 0);
+  check(13);
+  // and are dropped when the existing trees are replaced
+  model.InitTreesToUpdate();
+  std::vector<std::unique_ptr<RegTree>> new_trees;
+  for (auto& tree : CreateRandomTestModel(n_col, 20, 5, 1, 7).trees) {
+    new_trees.push_back(std::move(tree));
+  }
+  model.CommitModel(std::move(new_trees), 0);
+  check(7);
+
+  delete dmat;
+}
+
+TEST(cpu_predictor, StagedPrediction) {
+  auto lparam = CreateEmptyGenericParam(0, 0);
+  std::unique_ptr<Predictor> cpu_predictor =
+      std::unique_ptr<Predictor>(Predictor::Create("cpu_predictor", &lparam));
+  cpu_predictor->Init({}, {});
+  int n_row = 61;
+  int n_col = 7;
+  int n_group = 3;
+  gbm::GBTreeModel model = CreateRandomTestModel(n_col, 25, 5, n_group, 8);
+  auto dmat = CreateDMatrix(n_row, n_col, 0.3);
+
+  HostDeviceVector<float> staged;
+  unsigned nstage = cpu_predictor->PredictStaged((*dmat).get(), &staged, model);
+  // the last round only holds one of the three groups
+  ASSERT_EQ(nstage, 9);
+  const size_t stage_size = n_row * n_group;
+  ASSERT_EQ(staged.Size(), nstage * stage_size);
+  for (unsigned stage = 0; stage < nstage; ++stage) {
+    HostDeviceVector<float> expected;
+    cpu_predictor->PredictBatch((*dmat).get(), &expected, model, 0, stage + 1);
+    for (size_t i = 0; i < stage_size; ++i) {
+      ASSERT_EQ(staged.HostVector()[stage * stage_size + i],
+                expected.HostVector()[i]);
+    }
+  }
+  ASSERT_EQ(cpu_predictor->PredictStaged((*dmat).get(), &staged, model, 4), 4);
+  ASSERT_EQ(staged.Size(), 4 * stage_size);
+
+  delete dmat;
+}
+
+TEST(cpu_predictor, InteractionContributions) {
+  auto lparam = CreateEmptyGenericParam(0, 0);
+  std::unique_ptr<Predictor> cpu_predictor =
+      std::unique_ptr<Predictor>(Predictor::Create("cpu_predictor", &lparam));
+  cpu_predictor->Init({}, {});
+  int n_row = 23;
+  int n_col = 6;
+  int n_group = 2;
+  gbm::GBTreeModel model = CreateRandomTestModel(n_col, 16, 4, n_group, 9);
+  auto dmat = CreateDMatrix(n_row, n_col, 0.3);
+  const size_t ncolumns = n_col + 1;
+
+  std::vector<float> interactions;
+  cpu_predictor->PredictInteractionContributions((*dmat).get(), &interactions, model);
+  ASSERT_EQ(interactions.size(), n_row * n_group * ncolumns * ncolumns);
+
+  // reference: differences of whole matrix contributions conditioned on each feature
+  std::vector<float> diag, on, off;
+  cpu_predictor->PredictContribution((*dmat).get(), &diag, model);
+  for (size_t i = 0; i < ncolumns; ++i) {
+    cpu_predictor->PredictContribution((*dmat).get(), &off, model, 0, false, -1, i);
+    cpu_predictor->PredictContribution((*dmat).get(), &on, model, 0, false, 1, i);
+    for (int r = 0; r < n_row * n_group; ++r) {
+      const float* matrix = &interactions[r * ncolumns * ncolumns];
+      float expected_diag = diag[r * ncolumns + i];
+      for (size_t j = 0; j < ncolumns; ++j) {
+        if (j == i) continue;
+        const float expected = (on[r * ncolumns + j] - off[r * ncolumns + j]) / 2;
+        ASSERT_NEAR(matrix[i * ncolumns + j], expected, 1e-5);
+        expected_diag -= expected;
+      }
+      ASSERT_NEAR(matrix[i * ncolumns + i], expected_diag, 1e-5);
+    }
+  }
+
+  // top-k agrees with the full matrices
+  const unsigned top_k = 4;
+  std::vector<float> values;
+  std::vector<unsigned> index;
+  cpu_predictor->PredictInteractionTopK((*dmat).get(), top_k, &values, &index, model);
+  ASSERT_EQ(values.size(), n_row * n_group * top_k);
+  ASSERT_EQ(index.size(), values.size());
+  for (int r = 0; r < n_row * n_group; ++r) {
+    const float* matrix = &interactions[r * ncolumns * ncolumns];
+    std::vector<float> magnitudes;
+    for (size_t i = 0; i < ncolumns - 1; ++i) {
+      for (size_t j = i + 1; j < ncolumns - 1; ++j) {
+        magnitudes.push_back(std::abs(matrix[i * ncolumns + j]));
+      }
+    }
+    std::sort(magnitudes.rbegin(), magnitudes.rend());
+    for (unsigned k = 0; k < top_k; ++k) {
+      const unsigned pos = index[r * top_k + k];
+      ASSERT_LT(pos / ncolumns, pos % ncolumns);
+      ASSERT_LT(pos % ncolumns, ncolumns - 1);
+      ASSERT_EQ(values[r * top_k + k], matrix[pos]);
+      ASSERT_EQ(std::abs(values[r * top_k + k]), magnitudes[k]);
+    }
+  }
+  // k is clamped to the number of feature pairs
+  cpu_predictor->PredictInteractionTopK((*dmat).get(), 100, &values, &index, model);
+  ASSERT_EQ(values.size(), n_row * n_group * n_col * (n_col - 1) / 2);
+
+  delete dmat;
+}
+
+TEST(cpu_predictor, InteractionContributionsRepeatedSplits) {
+  auto lparam = CreateEmptyGenericParam(0, 0);
+  std::unique_ptr<Predictor> cpu_predictor =
+      std::unique_ptr<Predictor>(Predictor::Create("cpu_predictor", &lparam));
+  cpu_predictor->Init({}, {});
+  // deep trees over few features split on each feature many times along a path
+  int n_row = 19;
+  int n_col = 3;
+  gbm::GBTreeModel model = CreateRandomTestModel(n_col, 6, 9, 1, 14);
+  auto dmat = CreateDMatrix(n_row, n_col, 0.2);
+  const size_t ncolumns = n_col + 1;
+
+  std::vector<float> interactions, on, off;
+  cpu_predictor->PredictInteractionContributions((*dmat).get(), &interactions, model);
+  for (size_t i = 0; i < ncolumns; ++i) {
+    cpu_predictor->PredictContribution((*dmat).get(), &off, model, 0, false, -1, i);
+    cpu_predictor->PredictContribution((*dmat).get(), &on, model, 0, false, 1, i);
+    for (int r = 0; r < n_row; ++r) {
+      const float* matrix = &interactions[r * ncolumns * ncolumns];
+      for (size_t j = 0; j < ncolumns; ++j) {
+        if (j == i) continue;
+        const float expected = (on[r * ncolumns + j] - off[r * ncolumns + j]) / 2;
+        ASSERT_NEAR(matrix[i * ncolumns + j], expected, 1e-5);
+      }
+    }
+  }
+
+  delete dmat;
+}
+
+TEST(cpu_predictor, ShapSummaries) {
+  auto lparam = CreateEmptyGenericParam(0, 0);
+  std::unique_ptr<Predictor> cpu_predictor =
+      std::unique_ptr<Predictor>(Predictor::Create("cpu_predictor", &lparam));
+  cpu_predictor->Init({{"predictor_shap_cache", "256"}}, {});
+  // plain TreeSHAP as reference
+  std::unique_ptr<Predictor> reference_predictor =
+      std::unique_ptr<Predictor>(Predictor::Create("cpu_predictor", &lparam));
+  reference_predictor->Init({{"predictor_shap_cache", "0"}}, {});
+  int n_row = 47;
+  int n_col = 9;
+  int n_group = 2;
+  gbm::GBTreeModel model = CreateRandomTestModel(n_col, 30, 6, n_group, 10);
+  auto dmat = CreateDMatrix(n_row, n_col, 0.3);
+
+  auto check = [&](unsigned ntree_limit) {
+    std::vector<float> contribs, expected;
+    cpu_predictor->PredictContribution((*dmat).get(), &contribs, model, ntree_limit);
+    reference_predictor->PredictContribution((*dmat).get(), &expected, model,
+                                             ntree_limit);
+    ASSERT_EQ(contribs.size(), expected.size());
+    for (size_t i = 0; i < contribs.size(); ++i) {
+      ASSERT_NEAR(contribs[i], expected[i], 1e-5);
+    }
+  };
+  check(5);
+  check(0);
+  // summaries of existing trees are kept when trees are committed
+  std::vector<std::unique_ptr<RegTree>> new_trees;
+  for (auto& tree : CreateRandomTestModel(n_col, 2, 6, 1, 11).trees) {
+    new_trees.push_back(std::move(tree));
+  }
+  model.CommitModel(std::move(new_trees), 1);
+  check(0);
+  // and rebuilt once the trees are replaced
+  model.InitTreesToUpdate();
+  new_trees.clear();
+  for (auto& tree : CreateRandomTestModel(n_col, 20, 4, 1, 12).trees) {
+    new_trees.push_back(std::move(tree));
+  }
+  model.CommitModel(std::move(new_trees), 0);
+  check(0);
+  // trees beyond a small budget fall back to TreeSHAP
+  cpu_predictor->Init({{"predictor_shap_cache", "1"}}, {});
+  gbm::GBTreeModel deep_model = CreateRandomTestModel(n_col, 30, 8, 1, 13);
+  std::vector<float> contribs, expected;
+  cpu_predictor->PredictContribution((*dmat).get(), &contribs, deep_model);
+  reference_predictor->PredictContribution((*dmat).get(), &expected, deep_model);
+  ASSERT_EQ(contribs.size(), expected.size());
+  for (size_t i = 0; i < contribs.size(); ++i) {
+    ASSERT_NEAR(contribs[i], expected[i], 1e-5);
+  }
+  // without a budget the summaries built so far are dropped and every tree
+  // is explained by TreeSHAP, giving exactly the reference values
+  cpu_predictor->Init({{"predictor_shap_cache", "0"}}, {});
+  cpu_predictor->PredictContribution((*dmat).get(), &contribs, model);
+  reference_predictor->PredictContribution((*dmat).get(), &expected, model);
+  ASSERT_EQ(contribs.size(), expected.size());
+  for (size_t i = 0; i < contribs.size(); ++i) {
+    ASSERT_EQ(contribs[i], expected[i]);
+  }
+
+  delete dmat;
+}
+
+TEST(cpu_predictor, SparseContributions) {
+  auto lparam = CreateEmptyGenericParam(0, 0);
+  std::unique_ptr<Predictor> cpu_predictor =
+      std::unique_ptr<Predictor>(Predictor::Create("cpu_predictor", &lparam));
+  cpu_predictor->Init({}, {});
+  int n_row = 53;
+  int n_col = 40;
+  int n_group = 2;
+  gbm::GBTreeModel model = CreateRandomTestModel(n_col, 8, 3, n_group, 14);
+  auto dmat = CreateDMatrix(n_row, n_col, 0.5);
+  const size_t ncolumns = n_col + 1;
+
+  for (bool approximate : {false, true}) {
+    std::vector<float> dense;
+    cpu_predictor->PredictContribution((*dmat).get(), &dense, model, 0, approximate);
+    std::vector<size_t> indptr;
+    std::vector<unsigned> index;
+    std::vector<float> values, bias;
+    cpu_predictor->PredictContributionSparse((*dmat).get(), &indptr, &index, &values,
+                                             &bias, model, 0, approximate);
+    ASSERT_EQ(indptr.size(), n_row * n_group + 1);
+    ASSERT_EQ(bias.size(), n_row * n_group);
+    ASSERT_EQ(indptr.back(), values.size());
+    ASSERT_EQ(index.size(), values.size());
+    // a few trees only split on a small part of the features
+    ASSERT_LT(values.size(), dense.size() / 2);
+    for (int r = 0; r < n_row * n_group; ++r) {
+      std::vector<float> row(ncolumns, 0.0f);
+      for (size_t k = indptr[r]; k < indptr[r + 1]; ++k) {
+        if (k > indptr[r]) {
+          ASSERT_LT(index[k - 1], index[k]);
+        }
+        ASSERT_NE(values[k], 0.0f);
+        row[index[k]] = values[k];
+      }
+      row[ncolumns - 1] = bias[r];
+      for (size_t c = 0; c < ncolumns; ++c) {
+        ASSERT_NEAR(row[c], dense[r * ncolumns + c], 1e-6);
+      }
+    }
+  }
+
+  delete dmat;
+}
+
+TEST(cpu_predictor, CombinedPrediction) {
+  auto lparam = CreateEmptyGenericParam(0, 0);
+  std::unique_ptr<Predictor> cpu_predictor =
+      std::unique_ptr<Predictor>(Predictor::Create("cpu_predictor", &lparam));
+  cpu_predictor->Init({}, {});
+  int n_row = 37;
+  int n_col = 8;
+  int n_group = 3;
+  int n_tree = 12;
+  gbm::GBTreeModel model = CreateRandomTestModel(n_col, n_tree, 4, n_group, 15);
+  auto dmat = CreateDMatrix(n_row, n_col, 0.4);
+
+  HostDeviceVector<float> expected_margin;
+  cpu_predictor->PredictBatch((*dmat).get(), &expected_margin, model, 0);
+  std::vector<float> expected_leaf;
+  cpu_predictor->PredictLeaf((*dmat).get(), &expected_leaf, model);
+  std::vector<float> expected_contribs;
+  cpu_predictor->PredictContribution((*dmat).get(), &expected_contribs, model, 0, true);
+
+  for (bool with_contribs : {false, true}) {
+    HostDeviceVector<float> margin;
+    std::vector<int32_t> leaf_int32;
+    std::vector<uint16_t> leaf_uint16;
+    std::vector<unsigned> leaf_onehot;
+    std::vector<float> contribs;
+    CombinedPrediction out;
+    out.margin = &margin;
+    out.leaf_int32 = &leaf_int32;
+    out.leaf_uint16 = &leaf_uint16;
+    out.leaf_onehot = &leaf_onehot;
+    out.approx_contribs = with_contribs ? &contribs : nullptr;
+    cpu_predictor->PredictCombined((*dmat).get(), &out, model);
+
+    ASSERT_EQ(margin.HostVector(), expected_margin.HostVector());
+    ASSERT_EQ(leaf_int32.size(), expected_leaf.size());
+    ASSERT_EQ(leaf_uint16.size(), expected_leaf.size());
+    ASSERT_EQ(leaf_onehot.size(), expected_leaf.size());
+    // one-hot columns number the leaves of the trees one after another
+    std::vector<unsigned> first_column(n_tree + 1, 0);
+    for (int j = 0; j < n_tree; ++j) {
+      unsigned n_leaves = 0;
+      for (int nid = 0; nid < model.trees[j]->param.num_nodes; ++nid) {
+        n_leaves += (*model.trees[j])[nid].IsLeaf();
+      }
+      first_column[j + 1] = first_column[j] + n_leaves;
+    }
+    ASSERT_EQ(out.num_leaf_columns, first_column[n_tree]);
+    for (size_t i = 0; i < expected_leaf.size(); ++i) {
+      const int j = i % n_tree;
+      ASSERT_EQ(leaf_int32[i], static_cast<int32_t>(expected_leaf[i]));
+      ASSERT_EQ(leaf_uint16[i], static_cast<uint16_t>(expected_leaf[i]));
+      ASSERT_GE(leaf_onehot[i], first_column[j]);
+      ASSERT_LT(leaf_onehot[i], first_column[j + 1]);
+      // distinct leaves of a tree get distinct columns
+      if (i >= static_cast<size_t>(n_tree)) {
+        ASSERT_EQ(leaf_onehot[i] == leaf_onehot[i - n_tree],
+                  leaf_int32[i] == leaf_int32[i - n_tree]);
+      }
+    }
+    if (with_contribs) {
+      ASSERT_EQ(contribs, expected_contribs);
+    }
+  }
+  // a subset of the outputs
+  HostDeviceVector<float> margin;
+  CombinedPrediction out;
+  out.margin = &margin;
+  cpu_predictor->PredictCombined((*dmat).get(), &out, model, 2);
+  HostDeviceVector<float> limited;
+  cpu_predictor->PredictBatch((*dmat).get(), &limited, model, 0, 2);
+  ASSERT_EQ(margin.HostVector(), limited.HostVector());
+
+  delete dmat;
+}
+
+TEST(cpu_predictor, ConcurrentPrediction) {
+  auto lparam = CreateEmptyGenericParam(0, 0);
+  int n_row = 97;
+  int n_col = 12;
+  int n_group = 2;
+  gbm::GBTreeModel model = CreateRandomTestModel(n_col, 24, 6, n_group);
+  auto dmat = CreateDMatrix(n_row, n_col, 0.3);
+
+  HostDeviceVector<float> expected_preds;
+  std::vector<float> expected_leaf;
+  {
+    std::unique_ptr<Predictor> reference =
+        std::unique_ptr<Predictor>(Predictor::Create("cpu_predictor", &lparam));
+    reference->Init({}, {});
+    reference->PredictBatch((*dmat).get(), &expected_preds, model, 0);
+    reference->PredictLeaf((*dmat).get(), &expected_leaf, model);
+  }
+  const auto& expected = expected_preds.HostVector();
+
+  // a fresh predictor, so that building the compiled forest races as well
+  std::unique_ptr<Predictor> cpu_predictor =
+      std::unique_ptr<Predictor>(Predictor::Create("cpu_predictor", &lparam));
+  cpu_predictor->Init({}, {});
+  const int kThreads = 8;
+  const int kIters = 16;
+  std::atomic<int> mismatches{0};
+  std::vector<std::thread> workers;
+  for (int t = 0; t < kThreads; ++t) {
+    workers.emplace_back([&, t]() {
+      for (int iter = 0; iter < kIters; ++iter) {
+        HostDeviceVector<float> preds;
+        cpu_predictor->PredictBatch((*dmat).get(), &preds, model, 0);
+        for (size_t i = 0; i < expected.size(); ++i) {
+          mismatches += preds.HostVector()[i] != expected[i];
+        }
+        std::vector<float> leaf;
+        cpu_predictor->PredictLeaf((*dmat).get(), &leaf, model);
+        mismatches += leaf != expected_leaf;
+        std::vector<float> instance;
+        for (const auto& batch : (*dmat)->GetRowBatches()) {
+          for (size_t i = t; i < batch.Size(); i += kThreads) {
+            cpu_predictor->PredictInstance(batch[i], &instance, model);
+            for (int gid = 0; gid < n_group; ++gid) {
+              mismatches += instance[gid] != expected[i * n_group + gid];
+            }
+          }
+        }
+      }
+    });
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  ASSERT_EQ(mismatches, 0);
+
+  delete dmat;
+}
+
 TEST(cpu_predictor, ExternalMemoryTest) {
   std::unique_ptr<DMatrix> dmat = CreateSparsePageDMatrix(12, 64);
   auto lparam = CreateEmptyGenericParam(0, 0);
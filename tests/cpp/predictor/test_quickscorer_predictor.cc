@@ -0,0 +1,118 @@
+// Copyright by Contributors
+#include <gtest/gtest.h>
+#include <xgboost/predictor.h>
+#include "../helpers.h"
+
+namespace xgboost {
+namespace {
+void CheckAgainstCPUPredictor(const gbm::GBTreeModel& model, DMatrix* dmat) {
+  auto lparam = CreateEmptyGenericParam(0, 0);
+  std::unique_ptr<Predictor> cpu_predictor =
+      std::unique_ptr<Predictor>(Predictor::Create("cpu_predictor", &lparam));
+  std::unique_ptr<Predictor> qs_predictor = std::unique_ptr<Predictor>(
+      Predictor::Create("quickscorer_predictor", &lparam));
+  // alternating limits are served by the same index
+  for (unsigned ntree_limit : {0U, 3U, 0U, 1U}) {
+    HostDeviceVector<float> expected;
+    cpu_predictor->PredictBatch(dmat, &expected, model, 0, ntree_limit);
+    HostDeviceVector<float> out_predictions;
+    qs_predictor->PredictBatch(dmat, &out_predictions, model, 0, ntree_limit);
+    ASSERT_EQ(out_predictions.Size(), expected.Size());
+    for (size_t i = 0; i < expected.Size(); ++i) {
+      ASSERT_EQ(out_predictions.HostVector()[i], expected.HostVector()[i]);
+    }
+  }
+}
+}  // anonymous namespace
+
+TEST(quickscorer_predictor, Test) {
+  auto lparam = CreateEmptyGenericParam(0, 0);
+  std::unique_ptr<Predictor> qs_predictor = std::unique_ptr<Predictor>(
+      Predictor::Create("quickscorer_predictor", &lparam));
+
+  gbm::GBTreeModel model = CreateTestModel();
+
+  int n_row = 5;
+  int n_col = 5;
+
+  auto dmat = CreateDMatrix(n_row, n_col, 0);
+
+  // Test predict batch
+  HostDeviceVector<float> out_predictions;
+  qs_predictor->PredictBatch((*dmat).get(), &out_predictions, model, 0);
+  std::vector<float>& out_predictions_h = out_predictions.HostVector();
+  for (size_t i = 0; i < out_predictions.Size(); i++) {
+    ASSERT_EQ(out_predictions_h[i], 1.5);
+  }
+
+  // Test predict leaf
+  std::vector<float> leaf_out_predictions;
+  qs_predictor->PredictLeaf((*dmat).get(), &leaf_out_predictions, model);
+  for (auto v : leaf_out_predictions) {
+    ASSERT_EQ(v, 0);
+  }
+
+  delete dmat;
+}
+
+TEST(quickscorer_predictor, ShallowTrees) {
+  int n_row = 97;
+  int n_col = 12;
+  gbm::GBTreeModel model = CreateRandomTestModel(n_col, 40, 6, 3);
+  auto dmat = CreateDMatrix(n_row, n_col, 0.3);
+  CheckAgainstCPUPredictor(model, (*dmat).get());
+  delete dmat;
+}
+
+TEST(quickscorer_predictor, DeepTreesFallback) {
+  int n_row = 97;
+  int n_col = 12;
+  // trees of depth 10 have more leaves than the bitvector holds
+  gbm::GBTreeModel model = CreateRandomTestModel(n_col, 6, 10, 1, 2);
+  int max_leaves = 0;
+  for (const auto& tree : model.trees) {
+    int n_leaves = 0;
+    for (int nid = 0; nid < tree->param.num_nodes; ++nid) {
+      n_leaves += !(*tree)[nid].IsDeleted() && (*tree)[nid].IsLeaf();
+    }
+    max_leaves = std::max(max_leaves, n_leaves);
+  }
+  ASSERT_GT(max_leaves, 64);
+  auto dmat = CreateDMatrix(n_row, n_col, 0.3);
+  CheckAgainstCPUPredictor(model, (*dmat).get());
+  delete dmat;
+}
+
+TEST(quickscorer_predictor, DeepTreeInTheMiddle) {
+  int n_row = 97;
+  int n_col = 12;
+  gbm::GBTreeModel shallow = CreateRandomTestModel(n_col, 8, 4, 2);
+  gbm::GBTreeModel deep = CreateRandomTestModel(n_col, 6, 10, 1, 2);
+  // only the deepest tree is traversed node by node, the others stay indexed
+  auto n_leaves = [](const RegTree& tree) {
+    int n = 0;
+    for (int nid = 0; nid < tree.param.num_nodes; ++nid) {
+      n += !tree[nid].IsDeleted() && tree[nid].IsLeaf();
+    }
+    return n;
+  };
+  auto deepest = std::max_element(
+      deep.trees.begin(), deep.trees.end(),
+      [&](const std::unique_ptr<RegTree>& a, const std::unique_ptr<RegTree>& b) {
+        return n_leaves(*a) < n_leaves(*b);
+      });
+  ASSERT_GT(n_leaves(**deepest), 64);
+
+  gbm::GBTreeModel model(0.5);
+  model.param.num_feature = n_col;
+  model.param.num_output_group = 2;
+  for (size_t i = 0; i < shallow.trees.size(); ++i) {
+    std::vector<std::unique_ptr<RegTree>> trees;
+    trees.push_back(std::move(i == 3 ? *deepest : shallow.trees[i]));
+    model.CommitModel(std::move(trees), shallow.tree_info[i]);
+  }
+  auto dmat = CreateDMatrix(n_row, n_col, 0.3);
+  CheckAgainstCPUPredictor(model, (*dmat).get());
+  delete dmat;
+}
+}  // namespace xgboost
@@ -0,0 +1,102 @@
+// Copyright by Contributors
+#include <gtest/gtest.h>
+#include "../helpers.h"
+#include "../../../src/predictor/shap_summary.h"
+
+namespace xgboost {
+namespace predictor {
+
+TEST(ShapSummaryCache, Budget) {
+  int n_col = 9;
+  unsigned n_tree = 12;
+  gbm::GBTreeModel model = CreateRandomTestModel(n_col, n_tree, 6, 1, 10);
+  size_t total_bytes = 0;
+  for (const auto& tree : model.trees) {
+    ASSERT_GT(TreeShapSummary::EstimateBytes(*tree), 0U);
+    total_bytes += TreeShapSummary::EstimateBytes(*tree);
+  }
+
+  ShapSummaryCache cache;
+  ShapSummaryList summaries = cache.Get(model, n_tree, total_bytes);
+  ASSERT_EQ(summaries.size(), n_tree);
+  for (const auto& summary : summaries) {
+    ASSERT_NE(summary, nullptr);
+  }
+  ASSERT_EQ(cache.Bytes(), total_bytes);
+
+  // a zero budget builds nothing, every tree falls back to TreeSHAP
+  summaries = cache.Get(model, n_tree, 0);
+  ASSERT_EQ(summaries.size(), n_tree);
+  for (const auto& summary : summaries) {
+    ASSERT_EQ(summary, nullptr);
+  }
+  ASSERT_EQ(cache.Bytes(), 0U);
+
+  // trees are summarized in model order while they fit the budget
+  const size_t budget = TreeShapSummary::EstimateBytes(*model.trees[0]) +
+                        TreeShapSummary::EstimateBytes(*model.trees[1]);
+  summaries = cache.Get(model, n_tree, budget);
+  ASSERT_NE(summaries[0], nullptr);
+  ASSERT_NE(summaries[1], nullptr);
+  for (size_t j = 2; j < summaries.size(); ++j) {
+    ASSERT_EQ(summaries[j], nullptr);
+  }
+  ASSERT_EQ(cache.Bytes(), budget);
+
+  // a tree larger than what is left gets none, later trees that fit are
+  // still summarized
+  size_t smallest = 0;
+  for (size_t j = 1; j < n_tree; ++j) {
+    if (TreeShapSummary::EstimateBytes(*model.trees[j]) <
+        TreeShapSummary::EstimateBytes(*model.trees[smallest])) {
+      smallest = j;
+    }
+  }
+  ASSERT_GT(smallest, 0U);
+  const size_t small_budget = TreeShapSummary::EstimateBytes(*model.trees[smallest]);
+  summaries = cache.Get(model, n_tree, small_budget);
+  for (size_t j = 0; j < smallest; ++j) {
+    ASSERT_EQ(summaries[j], nullptr);
+  }
+  ASSERT_NE(summaries[smallest], nullptr);
+  ASSERT_EQ(cache.Bytes(), small_budget);
+}
+
+TEST(ShapSummaryCache, Revision) {
+  int n_col = 9;
+  gbm::GBTreeModel model = CreateRandomTestModel(n_col, 10, 5, 2, 11);
+  const size_t budget = size_t(256) << 20;
+  ShapSummaryCache cache;
+  ShapSummaryList before = cache.Get(model, 10, budget);
+
+  // committed trees are summarized, those of the existing trees are kept
+  std::vector<std::unique_ptr<RegTree>> new_trees;
+  for (auto& tree : CreateRandomTestModel(n_col, 2, 5, 1, 12).trees) {
+    new_trees.push_back(std::move(tree));
+  }
+  model.CommitModel(std::move(new_trees), 1);
+  ShapSummaryList after = cache.Get(model, 12, budget);
+  ASSERT_EQ(after.size(), 12U);
+  for (size_t j = 0; j < before.size(); ++j) {
+    ASSERT_EQ(after[j], before[j]);
+  }
+  ASSERT_NE(after[10], nullptr);
+  ASSERT_NE(after[11], nullptr);
+
+  // replaced trees are summarized again
+  model.InitTreesToUpdate();
+  new_trees.clear();
+  for (auto& tree : CreateRandomTestModel(n_col, 10, 5, 1, 13).trees) {
+    new_trees.push_back(std::move(tree));
+  }
+  model.CommitModel(std::move(new_trees), 0);
+  ShapSummaryList rebuilt = cache.Get(model, 10, budget);
+  ASSERT_EQ(rebuilt.size(), 10U);
+  for (size_t j = 0; j < rebuilt.size(); ++j) {
+    ASSERT_NE(rebuilt[j], nullptr);
+    ASSERT_NE(rebuilt[j], before[j]);
+  }
+}
+
+}  // namespace predictor
+}  // namespace xgboost
@@ -20,8 +20,8 @@ namespace tree {
 class QuantileHistMock : public QuantileHistMaker {
   static double constexpr kEps = 1e-6;
 
-  struct BuilderMock : public QuantileHistMaker::Builder {
-    using RealImpl = QuantileHistMaker::Builder;
+  struct BuilderMock : public QuantileHistMaker::Builder<double> {
+    using RealImpl = QuantileHistMaker::Builder<double>;
 
     BuilderMock(const TrainParam& param,
                 std::unique_ptr<TreeUpdater> pruner,
@@ -61,14 +61,15 @@ class QuantileHistMock : public QuantileHistMaker {
 
       /* Validate GHistIndexMatrix */
       ASSERT_EQ(gmat.row_ptr.size(), num_row + 1);
-      ASSERT_LT(*std::max_element(gmat.index.begin(), gmat.index.end()),
-                gmat.cut.row_ptr.back());
+      for (size_t i = 0; i < gmat.index.Size(); ++i) {
+        ASSERT_LT(gmat.index[i], gmat.cut.row_ptr.back());
+      }
       for (const auto& batch : p_fmat->GetRowBatches()) {
         for (size_t i = 0; i < batch.Size(); ++i) {
           const size_t rid = batch.base_rowid + i;
           ASSERT_LT(rid, num_row);
           const size_t gmat_row_offset = gmat.row_ptr[rid];
-          ASSERT_LT(gmat_row_offset, gmat.index.size());
+          ASSERT_LT(gmat_row_offset, gmat.index.Size());
           SparsePage::Inst inst = batch[i];
           ASSERT_EQ(gmat.row_ptr[rid] + inst.size(), gmat.row_ptr[rid + 1]);
           for (size_t j = 0; j < inst.size(); ++j) {
@@ -212,6 +213,22 @@ class QuantileHistMock : public QuantileHistMaker {
 
       delete dmat;
     }
+
+    void EvictHistRows(size_t n_new, int nid_in_use, const RegTree& tree) override {
+      RealImpl::EvictHistRows(n_new, nid_in_use, tree);
+      // the histograms about to be added must fit within the cap
+      max_hist_rows_ = MaxHistRows();
+      ASSERT_LE(hist_.NumRows() + n_new, max_hist_rows_);
+      max_hist_rows_used_ = std::max(max_hist_rows_used_, hist_.NumRows() + n_new);
+      if (nid_in_use >= 0 && !hist_.RowExists(nid_in_use)) {
+        // the split node was evicted earlier, its children are built directly
+        ++num_evicted_parents_;
+      }
+    }
+
+    size_t max_hist_rows_{0};
+    size_t max_hist_rows_used_{0};
+    size_t num_evicted_parents_{0};
   };
 
   int static constexpr kNRows = 8, kNCols = 16;
@@ -261,12 +278,40 @@ class QuantileHistMock : public QuantileHistMaker {
     builder_->TestBuildHist(0, gmat, *(*dmat_).get(), tree);
   }
 
+  void TestBuildHistDense() {
+    RegTree tree = RegTree();
+    tree.param.InitAllowUnknown(cfg_);
+
+    auto dmat = CreateDMatrix(kNRows, kNCols, 0, 3);
+    size_t constexpr kMaxBins = 4;
+    common::GHistIndexMatrix gmat;
+    gmat.Init((*dmat).get(), kMaxBins);
+    ASSERT_TRUE(gmat.index.IsDense());
+
+    builder_->TestBuildHist(0, gmat, *(*dmat).get(), tree);
+    delete dmat;
+  }
+
   void TestEvaluateSplit() {
     RegTree tree = RegTree();
     tree.param.InitAllowUnknown(cfg_);
 
     builder_->TestEvaluateSplit(gmatb_, tree);
   }
+
+  void TestHistMemoryCap(DMatrix* dmat, HostDeviceVector<GradientPair>* gpair,
+                         RegTree* tree) {
+    common::GHistIndexMatrix gmat;
+    gmat.Init(dmat, static_cast<uint32_t>(param_.max_bin));
+    common::ColumnMatrix column_matrix;
+    column_matrix.Init(gmat, param_.sparse_threshold);
+    common::GHistIndexBlockMatrix gmatb;
+    builder_->Update(gmat, gmatb, column_matrix, gpair, dmat, tree);
+
+    // the cap was reached and some split nodes lost their histograms
+    ASSERT_EQ(builder_->max_hist_rows_used_, builder_->max_hist_rows_);
+    ASSERT_GT(builder_->num_evicted_parents_, 0);
+  }
 };
 
 TEST(Updater, QuantileHist_InitData) {
@@ -283,6 +328,7 @@ TEST(Updater, QuantileHist_BuildHist) {
        {"enable_feature_grouping", std::to_string(0)}};
   QuantileHistMock maker(cfg);
   maker.TestBuildHist();
+  maker.TestBuildHistDense();
 }
 
 TEST(Updater, QuantileHist_EvalSplits) {
@@ -295,5 +341,97 @@ TEST(Updater, QuantileHist_EvalSplits) {
   maker.TestEvaluateSplit();
 }
 
+TEST(Updater, QuantileHist_SinglePrecision) {
+  int constexpr kNRows = 512, kNCols = 8;
+  auto dmat = CreateDMatrix(kNRows, kNCols, 0.2, 3);
+  HostDeviceVector<GradientPair> gpair(kNRows);
+  auto& h_gpair = gpair.HostVector();
+  for (int i = 0; i < kNRows; ++i) {
+    h_gpair[i] = GradientPair(std::sin(static_cast<float>(i)), 1.0f);
+  }
+  auto lparam = CreateEmptyGenericParam(0, 0);
+
+  std::vector<RegTree> trees(2);
+  for (int single = 0; single < 2; ++single) {
+    std::vector<std::pair<std::string, std::string>> cfg
+        {{"num_feature", std::to_string(kNCols)},
+         {"max_depth", "4"},
+         {"single_precision_histogram", std::to_string(single)}};
+    std::unique_ptr<TreeUpdater> updater(
+        TreeUpdater::Create("grow_quantile_histmaker", &lparam));
+    updater->Init(cfg);
+    trees[single].param.InitAllowUnknown(cfg);
+    updater->Update(&gpair, dmat->get(), {&trees[single]});
+  }
+
+  // float bins find the same splits and nearly the same leaves
+  const RegTree& precise = trees[0];
+  const RegTree& single = trees[1];
+  ASSERT_GT(precise.param.num_nodes, 1);
+  ASSERT_EQ(single.param.num_nodes, precise.param.num_nodes);
+  for (int nid = 0; nid < precise.param.num_nodes; ++nid) {
+    ASSERT_EQ(single[nid].IsLeaf(), precise[nid].IsLeaf());
+    if (precise[nid].IsLeaf()) {
+      ASSERT_NEAR(single[nid].LeafValue(), precise[nid].LeafValue(), 1e-5);
+    } else {
+      ASSERT_EQ(single[nid].SplitIndex(), precise[nid].SplitIndex());
+      ASSERT_EQ(single[nid].SplitCond(), precise[nid].SplitCond());
+    }
+  }
+
+  delete dmat;
+}
+
+TEST(Updater, QuantileHist_LossguideMemoryCap) {
+  // a histogram of 50 features and 256 bins takes about 200KB, so 1MB holds
+  // far fewer than the queued nodes
+  int constexpr kNRows = 2000, kNCols = 50;
+  auto dmat = CreateDMatrix(kNRows, kNCols, 0, 3);
+  HostDeviceVector<GradientPair> gpair(kNRows);
+  auto& h_gpair = gpair.HostVector();
+  for (int i = 0; i < kNRows; ++i) {
+    h_gpair[i] = GradientPair(std::sin(static_cast<float>(i)), 1.0f);
+  }
+  auto lparam = CreateEmptyGenericParam(0, 0);
+
+  std::vector<RegTree> trees(2);
+  for (int capped = 0; capped < 2; ++capped) {
+    std::vector<std::pair<std::string, std::string>> cfg
+        {{"num_feature", std::to_string(kNCols)},
+         {"grow_policy", "lossguide"},
+         {"max_depth", "0"},
+         {"max_leaves", "64"},
+         {"max_bin", "256"},
+         {"max_hist_memory_mb", capped ? "1" : "0"}};
+    trees[capped].param.InitAllowUnknown(cfg);
+    if (capped) {
+      QuantileHistMock maker(cfg);
+      maker.TestHistMemoryCap(dmat->get(), &gpair, &trees[capped]);
+    } else {
+      std::unique_ptr<TreeUpdater> updater(
+          TreeUpdater::Create("grow_quantile_histmaker", &lparam));
+      updater->Init(cfg);
+      updater->Update(&gpair, dmat->get(), {&trees[capped]});
+    }
+  }
+
+  // evicted histograms are rebuilt, the tree is the same
+  const RegTree& uncapped = trees[0];
+  const RegTree& capped = trees[1];
+  ASSERT_GT(uncapped.param.num_nodes, 64);
+  ASSERT_EQ(capped.param.num_nodes, uncapped.param.num_nodes);
+  for (int nid = 0; nid < uncapped.param.num_nodes; ++nid) {
+    ASSERT_EQ(capped[nid].IsLeaf(), uncapped[nid].IsLeaf());
+    if (uncapped[nid].IsLeaf()) {
+      ASSERT_NEAR(capped[nid].LeafValue(), uncapped[nid].LeafValue(), 1e-6);
+    } else {
+      ASSERT_EQ(capped[nid].SplitIndex(), uncapped[nid].SplitIndex());
+      ASSERT_EQ(capped[nid].SplitCond(), uncapped[nid].SplitCond());
+    }
+  }
+
+  delete dmat;
+}
+
 }  // namespace tree
 }  // namespace xgboost
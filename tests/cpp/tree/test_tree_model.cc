@@ -101,4 +101,38 @@ TEST(Tree, AllocateNode) {
   ASSERT_TRUE(nodes.at(1).IsLeaf());
   ASSERT_TRUE(nodes.at(2).IsLeaf());
 }
+
+TEST(Tree, DumpModel) {
+  RegTree tree;
+  tree.ExpandNode(0, 3, 0.1f, true, 0.0f, -0.25f, 0.0f, 1.5f, 10.0f);
+  tree.ExpandNode(2, 1, 2.5f, false, 0.0f, 1e-8f, 123456.789f, 0.5f, 6.0f);
+  tree.Stat(1).sum_hess = 4.0f;
+  tree.Stat(3).sum_hess = 2.0f;
+  tree.Stat(4).sum_hess = 4.0f;
+  FeatureMap fmap;
+  fmap.PushBack(0, "f0", "q");
+  fmap.PushBack(1, "age", "int");
+
+  // floats are written with max_digits10 significant digits
+  ASSERT_EQ(tree.DumpModel(fmap, true, "text"),
+            "0:[f3<0.100000001] yes=1,no=2,missing=1,gain=1.5,cover=10\n"
+            "\t1:leaf=-0.25,cover=4\n"
+            "\t2:[age<3] yes=3,no=4,missing=4,gain=0.5,cover=6\n"
+            "\t\t3:leaf=9.99999994e-09,cover=2\n"
+            "\t\t4:leaf=123456.789,cover=4\n");
+  ASSERT_EQ(tree.DumpModel(fmap, false, "json"),
+            "  { \"nodeid\": 0, \"depth\": 0, \"split\": 3, \"split_condition\": 0.100000001,"
+            " \"yes\": 1, \"no\": 2, \"missing\": 1, \"children\": [\n"
+            "    { \"nodeid\": 1, \"leaf\": -0.25 },\n"
+            "    { \"nodeid\": 2, \"depth\": 1, \"split\": \"age\", \"split_condition\": 3,"
+            " \"yes\": 3, \"no\": 4, \"missing\": 4, \"children\": [\n"
+            "      { \"nodeid\": 3, \"leaf\": 9.99999994e-09 },\n"
+            "      { \"nodeid\": 4, \"leaf\": 123456.789 }\n"
+            "    ]}\n"
+            "  ]}");
+  // appending keeps what the string held
+  std::string out = "booster[0]:\n";
+  tree.DumpModel(fmap, true, "text", &out);
+  ASSERT_EQ(out, "booster[0]:\n" + tree.DumpModel(fmap, true, "text"));
+}
 }  // namespace xgboost
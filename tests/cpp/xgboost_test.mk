@@ -10,6 +10,9 @@ GTEST_INC=$(GTEST_PATH)/include/
 
 UNITTEST_CFLAGS=$(CFLAGS)
 UNITTEST_LDFLAGS=$(LDFLAGS) -L$(GTEST_LIB) -lgtest
+ifneq ($(UNAME), Windows)
+	UNITTEST_LDFLAGS += -ldl
+endif
 UNITTEST_DEPS=lib/libxgboost.a $(DMLC_CORE)/libdmlc.a $(RABIT)/lib/$(LIB_RABIT)
 
 COVER_OBJ=$(patsubst %.o, %.gcda, $(ALL_OBJ)) $(patsubst %.o, %.gcda, $(UNITTEST_OBJ))